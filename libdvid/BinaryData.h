@@ -10,6 +10,8 @@
 #ifndef BINARYDATA
 #define BINARYDATA
 
+#include "Globals.h"
+
 #include <boost/shared_ptr.hpp>
 #include <fstream>
 #include <string>
@@ -18,13 +20,24 @@ namespace libdvid {
 
 typedef unsigned char byte;
 
+//! Image formats recognized from their magic bytes
+enum ImageFormat { UNKNOWN_IMAGE, JPEG_IMAGE, PNG_IMAGE };
+
 //! Declares smart pointer type to access binary data
 class BinaryData;
 typedef boost::shared_ptr<BinaryData> BinaryDataPtr;
 
 /*!
  * Wraps a string object in an object that can only be allocated
- * on the heap.
+ * on the heap.  Binary data can also be a view of a range of
+ * another binary data object.  A view shares ownership of the
+ * other object instead of copying the range, so splitting a large
+ * response (e.g., into blocks) does not copy it.  The viewed data
+ * must not be modified while views of it exist.  Calling get_data
+ * on a view copies the range into the view (which then no longer
+ * references the other object).  A view can also reference a
+ * memory-mapped file, so large local files can be posted or wrapped
+ * (e.g., by DVIDVoxels) without being read into memory.
 */
 class BinaryData {
   public:
@@ -34,7 +47,7 @@ class BinaryData {
      * \param length Number of bytes in data_
      * \return smart pointer to new binary data
     */
-    static BinaryDataPtr create_binary_data(const char* data_, unsigned int length)
+    static BinaryDataPtr create_binary_data(const char* data_, uint64 length)
     {
         return BinaryDataPtr(new BinaryData(data_, length));
     }
@@ -49,7 +62,20 @@ class BinaryData {
     }
     
     /*!
-     * Read a file and load the data into binary format.
+     * Create a view of a range of existing binary data without copying.
+     * A view of a view references the original data.
+     * \param source binary data that holds the range
+     * \param offset start of the range in bytes
+     * \param length number of bytes in the range
+     * \return smart pointer to new binary data (view)
+    */
+    static BinaryDataPtr create_binary_data_view(BinaryDataPtr source,
+            uint64 offset, uint64 length);
+
+    /*!
+     * Read a file and load the data into binary format.  The rest of
+     * the file (from the current position) is read in one call when
+     * its size is known.
      * \param fin input file
      * \return smart pointer to new binary data
     */
@@ -58,6 +84,28 @@ class BinaryData {
         return BinaryDataPtr(new BinaryData(fin));
     }
 
+    /*!
+     * Ways to memory-map a file (see create_binary_data_mapped).
+     * A read-only mapping shares the page cache; get_data copies the
+     * file into memory before it can be modified.  A copy-on-write
+     * mapping can be modified in place through get_writable_raw; only
+     * the pages that are written are copied and the file is never
+     * changed.
+    */
+    enum MapMode { MAP_READ_ONLY, MAP_COPY_ON_WRITE };
+
+    /*!
+     * Create binary data backed by a memory-mapped file.  The file is
+     * read on demand from the page cache and is unmapped once the
+     * last reference (including views) is released.  The file should
+     * not be modified while it is mapped.
+     * \param filename path of the file
+     * \param mode read-only or copy-on-write mapping
+     * \return smart pointer to new binary data (view of the mapping)
+    */
+    static BinaryDataPtr create_binary_data_mapped(
+            const std::string& filename, MapMode mode = MAP_READ_ONLY);
+
     /*!
      * Decompress and load from lz4 format.
      * TODO: decompress from lz4 streaming interface
@@ -69,11 +117,50 @@ class BinaryData {
             int uncompressed_size);
 
     /*!
-     * Load data and compress to lz4 format.
+     * Decompress lz4 data into caller-owned memory.  Throws if the
+     * data is corrupt or does not decompress to exactly
+     * uncompressed_size bytes.
+     * \param lz4binary binary that contains lz4 data
+     * \param uncompressed_size the size of the uncompressed data
+     * \param uncompressed_data destination (at least uncompressed_size bytes)
+    */
+    static void decompress_lz4(const BinaryDataPtr lz4binary,
+            int uncompressed_size, char* uncompressed_data);
+
+    /*!
+     * Load data and compress to lz4 format.  The level trades CPU
+     * time for compression ratio: 0 is the default fast mode, a
+     * negative level -N uses the fast mode with acceleration N (faster,
+     * larger output), and a positive level uses LZ4HC at that level
+     * (slower, smaller output; capped at the highest LZ4HC level).
+     * All levels produce the same format and decompress at the same
+     * speed.
      * \param binary data to compress
+     * \param level compression level
      * \return smart pointer to new binary data (compressed)
     */
-    static BinaryDataPtr compress_lz4(const BinaryDataPtr lz4binary);
+    static BinaryDataPtr compress_lz4(const BinaryDataPtr lz4binary,
+            int level = 0);
+
+    /*!
+     * Encode data with a codec from the CodecRegistry.
+     * \param binary data to encode
+     * \param codec_name name of the codec (e.g., "lz4" or "gzip")
+     * \param level codec-specific level (0 for the default)
+     * \return smart pointer to new binary data (encoded)
+    */
+    static BinaryDataPtr encode(const BinaryDataPtr binary,
+            const std::string& codec_name, int level = 0);
+
+    /*!
+     * Decode data with a codec from the CodecRegistry.
+     * \param binary encoded data
+     * \param codec_name name of the codec
+     * \param decoded_size size of the decoded data (0 if unknown)
+     * \return smart pointer to new binary data (decoded)
+    */
+    static BinaryDataPtr decode(const BinaryDataPtr binary,
+            const std::string& codec_name, uint64 decoded_size = 0);
 
     /*!
      * Decompress and load from jpeg format.
@@ -86,8 +173,9 @@ class BinaryData {
             unsigned int& width, unsigned int& height);
 
     /*!
-     * Decompress and load from png format (must be 8-bit!).
-     * TODO: allow loading of non-8bt images
+     * Decompress and load from png format as 8-bit grayscale.
+     * 8 and 16-bit gray, palette, and RGB(A) images are supported
+     * (color is converted to gray and alpha is ignored).
      * \param pngbinary binary that contains png data
      * \param width returns width of decompressed image
      * \param height returns height of decompressed image
@@ -97,11 +185,61 @@ class BinaryData {
         unsigned int& width, unsigned int& height);
 
     /*!
-     * Allows modification of underlying buffer data.
+     * Decompress jpeg data as 8-bit grayscale into caller-owned
+     * memory.  Each thread reuses one libjpeg decompressor.
+     * \param jpegbinary binary that contains jpeg data
+     * \param output destination (row-major, width*height bytes)
+     * \param capacity size of output in bytes (throws if too small)
+     * \param width returns width of decompressed image
+     * \param height returns height of decompressed image
+    */
+    static void decompress_jpeg(const BinaryDataPtr jpegbinary,
+            byte* output, unsigned int capacity,
+            unsigned int& width, unsigned int& height);
+
+    /*!
+     * Decompress 8-bit png data into caller-owned memory.
+     * \param pngbinary binary that contains png data
+     * \param output destination (row-major, width*height bytes)
+     * \param capacity size of output in bytes (throws if too small)
+     * \param width returns width of decompressed image
+     * \param height returns height of decompressed image
+    */
+    static void decompress_png8(const BinaryDataPtr pngbinary,
+            byte* output, unsigned int capacity,
+            unsigned int& width, unsigned int& height);
+
+    /*!
+     * Determine the format of an image from its magic bytes.
+     * \param binary encoded image
+     * \return format (UNKNOWN_IMAGE if not jpeg or png)
+    */
+    static ImageFormat get_image_format(const BinaryDataPtr binary);
+
+    /*!
+     * Decompress a jpeg or png image (determined from its magic
+     * bytes) into caller-owned memory.  Throws if the format is
+     * not recognized.
+     * \param binary encoded image
+     * \param output destination (row-major, width*height bytes)
+     * \param capacity size of output in bytes (throws if too small)
+     * \param width returns width of decompressed image
+     * \param height returns height of decompressed image
+    */
+    static void decompress_image(const BinaryDataPtr binary,
+            byte* output, unsigned int capacity,
+            unsigned int& width, unsigned int& height);
+
+    /*!
+     * Allows modification of underlying buffer data.  A view is
+     * first copied into its own buffer.
      * \return string reference
     */
     std::string& get_data()
     {
+        if (view_owner) {
+            detach_view();
+        }
         return data;
     }
 
@@ -109,9 +247,9 @@ class BinaryData {
      * Returns the length of the array.
      * \return length of array
     */
-    int length() const
+    uint64 length() const
     {
-        return data.length();
+        return view_owner ? view_length : uint64(data.length());
     }
 
     /*!
@@ -120,7 +258,24 @@ class BinaryData {
     */ 
     const byte * get_raw() const
     {
-        return (const byte *)(data.c_str());
+        return view_owner ? view_data : (const byte *)(data.c_str());
+    }
+
+    /*!
+     * Retrieves a pointer for modifying the buffer in place without
+     * changing its length.  A copy-on-write mapping is modified
+     * directly; other views are first copied into their own buffer.
+     * \return byte array (null if empty)
+    */
+    byte * get_writable_raw();
+
+    /*!
+     * True if this object references a range of other binary data
+     * or of a mapped file.
+    */
+    bool is_view() const
+    {
+        return view_owner.get() != 0;
     }
    
     
@@ -130,32 +285,55 @@ class BinaryData {
      ~BinaryData() {}
 
   private:
+    //! the buffer pool constructs and recycles binary data
+    friend class BlockBufferPool;
+
     /*!
      * Private constructor to prevent stack allocation of binary data.
      * This creates a string with the data in the buffer.
      * \param data_ Constant source data
      * \param length Number of bytes in data_
     */
-    BinaryData(const char* data_, unsigned int length) : data(data_, length) {}
+    BinaryData(const char* data_, uint64 length) : data(data_, length),
+        view_data(0), view_length(0), view_writable(false) {}
    
     /*!
      * Private empty constructor.
     */
-    BinaryData() {}
+    BinaryData() : view_data(0), view_length(0), view_writable(false) {}
+
+    /*!
+     * Private constructor for a view of memory kept alive by owner.
+    */
+    BinaryData(boost::shared_ptr<const void> owner, const byte* view_data_,
+            uint64 view_length_, bool view_writable_) :
+        view_owner(owner), view_data(view_data_), view_length(view_length_),
+        view_writable(view_writable_) {}
+
+    //! copies the viewed range into data and drops the owner
+    void detach_view();
 
     /*!
      * Private constructor to prevent stack allocation of binary data.
      * Read a file and load the data into binary format.
      * \param fin input file
     */
-    explicit BinaryData(std::ifstream& fin)
-    {
-        data.assign( (std::istreambuf_iterator<char>(fin) ),
-                (std::istreambuf_iterator<char>()    ) ); 
-    }
+    explicit BinaryData(std::ifstream& fin);
     
     //! store binary array
     std::string data;
+
+    //! keeps the viewed memory alive (null if not a view)
+    boost::shared_ptr<const void> view_owner;
+
+    //! start of the viewed range
+    const byte* view_data;
+
+    //! number of bytes in the viewed range
+    uint64 view_length;
+
+    //! true if the viewed range may be modified (copy-on-write mapping)
+    bool view_writable;
 };
 
 }
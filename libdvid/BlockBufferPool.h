@@ -0,0 +1,163 @@
+/*!
+ * This file defines a process-wide pool of reusable buffers for
+ * block-sized binary data (e.g., 32x32x32 grayscale or label blocks).
+ * Fetching or writing a large body allocates and frees thousands of
+ * identical buffers; recycling them avoids the allocator and page
+ * fault cost of every new buffer.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef BLOCKBUFFERPOOL_H
+#define BLOCKBUFFERPOOL_H
+
+#include "BinaryData.h"
+#include "Globals.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/atomic.hpp>
+#include <map>
+#include <vector>
+
+namespace libdvid {
+
+/*!
+ * Hands out binary data whose buffer returns to the pool when the
+ * last BinaryDataPtr to it is dropped.  Buffers are cached by size,
+ * first in a small cache for the thread that drops them (no locking)
+ * and then in a cache shared by all threads.  The total size of the
+ * cached buffers is capped; buffers beyond the cap are freed.
+ * All functions are thread-safe.
+ *
+ * The pool counts how many buffers were requested, how many were
+ * served from a cache (hits), and the largest number of bytes handed
+ * out at once.
+*/
+class BlockBufferPool {
+  public:
+    /*!
+     * Retrieve the pool for this process (never destroyed so buffers
+     * can be recycled until the program exits).
+    */
+    static BlockBufferPool& get_pool();
+
+    /*!
+     * Create binary data of the given size.  The contents are not
+     * initialized when a buffer is reused.
+     * \param size number of bytes
+     * \return smart pointer to binary data (recycled when released)
+    */
+    BinaryDataPtr create_binary_data(unsigned int size);
+
+    /*!
+     * Cap the total size of the cached buffers.
+     * \param max_bytes cap in bytes (0 disables caching)
+    */
+    void set_max_cached_bytes(uint64 max_bytes);
+
+    /*!
+     * Set the number of buffers of each size cached per thread.
+    */
+    void set_thread_cache_size(int num_buffers);
+
+    /*!
+     * Free the buffers in the shared cache (buffers in the caches of
+     * other threads are kept).
+    */
+    void clear();
+
+    /*!
+     * Number of buffers requested.
+    */
+    uint64 get_num_requests() const
+    {
+        return num_requests.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Number of requests served with a cached buffer.
+    */
+    uint64 get_num_hits() const
+    {
+        return num_hits.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Fraction of requests served with a cached buffer (0 if none).
+    */
+    double get_hit_rate() const;
+
+    /*!
+     * Bytes handed out and not yet released.
+    */
+    uint64 get_bytes_in_use() const
+    {
+        return bytes_in_use.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Largest number of bytes handed out at one time.
+    */
+    uint64 get_peak_bytes_in_use() const
+    {
+        return peak_bytes_in_use.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Bytes held in the caches.
+    */
+    uint64 get_cached_bytes() const
+    {
+        return cached_bytes.load(boost::memory_order_relaxed);
+    }
+
+  private:
+    //! cached buffers keyed by size
+    typedef std::map<unsigned int, std::vector<BinaryData*> > BufferCache;
+
+    //! buffers cached by one thread
+    struct ThreadCache;
+
+    //! returns a buffer to the pool when its last reference is dropped
+    struct RecycleBuffer;
+
+    BlockBufferPool();
+    BlockBufferPool(const BlockBufferPool&);
+    BlockBufferPool& operator=(const BlockBufferPool&);
+
+    //! takes a cached buffer of the size (null if none)
+    BinaryData* take(unsigned int size);
+
+    //! caches or frees a released buffer
+    void recycle(BinaryData* binary, unsigned int size);
+
+    //! moves the buffers of an exiting thread to the shared cache
+    void absorb(BufferCache& cache);
+
+    //! cache for the calling thread
+    boost::thread_specific_ptr<ThreadCache> thread_cache;
+
+    //! cache shared by all threads
+    BufferCache shared_cache;
+
+    //! protects shared_cache
+    boost::mutex mutex;
+
+    //! cap on cached bytes
+    boost::atomic<uint64> max_cached_bytes;
+
+    //! buffers of each size cached per thread
+    boost::atomic<int> thread_cache_size;
+
+    //! counters
+    boost::atomic<uint64> num_requests;
+    boost::atomic<uint64> num_hits;
+    boost::atomic<uint64> bytes_in_use;
+    boost::atomic<uint64> peak_bytes_in_use;
+    boost::atomic<uint64> cached_bytes;
+};
+
+}
+
+#endif
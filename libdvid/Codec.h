@@ -0,0 +1,147 @@
+/*!
+ * This file defines the codecs used to encode binary data for
+ * transfer to and from DVID and the registry that looks them up by
+ * name.  The registry is populated with lz4 and gzip (and zstd or
+ * snappy when libdvid is built with them), DVID's compressed label
+ * block format ("blocks"), and decode-only codecs for the jpeg and
+ * png tiles served by DVID.  Applications can register their own
+ * codecs.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "BinaryData.h"
+#include "Globals.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace libdvid {
+
+/*!
+ * Capability flags of a codec.
+*/
+enum CodecCapability {
+    CODEC_ENCODE = 1,       //!< encode is supported
+    CODEC_DECODE = 2,       //!< decode is supported
+    CODEC_LOSSLESS = 4,     //!< decoding returns the encoded data exactly
+    CODEC_IMAGE = 8,        //!< decodes 2D images to 8-bit grayscale
+    CODEC_DVID_VOLUME = 16, //!< DVID accepts it for raw volumes
+                            //!< (?compression=<name>)
+    CODEC_LABEL_BLOCKS = 32 //!< DVID accepts it for labelarray and
+                            //!< labelmap blocks (?compression=<name>)
+};
+
+/*!
+ * Common interface for encoding and decoding binary data.  Codecs
+ * are stateless and shared by all threads.
+*/
+class Codec {
+  public:
+    virtual ~Codec() {}
+
+    /*!
+     * Name used in the registry (and in DVID compression queries).
+    */
+    virtual std::string get_name() const = 0;
+
+    /*!
+     * Bitwise or of CodecCapability flags.
+    */
+    virtual unsigned int get_capabilities() const = 0;
+
+    /*!
+     * True if the codec has all of the given capabilities.
+    */
+    bool has_capabilities(unsigned int capabilities) const
+    {
+        return (get_capabilities() & capabilities) == capabilities;
+    }
+
+    /*!
+     * Encode data.  Throws if the codec cannot encode.
+     * \param binary data to encode
+     * \param level codec-specific level (0 for the default)
+     * \return smart pointer to new binary data (encoded)
+    */
+    virtual BinaryDataPtr encode(const BinaryDataPtr binary,
+            int level = 0) const;
+
+    /*!
+     * Decode data.  Codecs whose format does not record the size
+     * (e.g., lz4) throw if decoded_size is 0.
+     * \param binary encoded data
+     * \param decoded_size size of the decoded data (0 if unknown)
+     * \return smart pointer to new binary data (decoded)
+    */
+    virtual BinaryDataPtr decode(const BinaryDataPtr binary,
+            uint64 decoded_size = 0) const = 0;
+
+    /*!
+     * Decode data of a known size into caller-owned memory.  Throws
+     * if the data does not decode to exactly decoded_size bytes.
+     * \param binary encoded data
+     * \param output destination (at least decoded_size bytes)
+     * \param decoded_size size of the decoded data
+    */
+    virtual void decode(const BinaryDataPtr binary, byte* output,
+            uint64 decoded_size) const;
+};
+
+//! Declares smart pointer type for a codec
+typedef boost::shared_ptr<Codec> CodecPtr;
+
+/*!
+ * Process-wide registry of codecs keyed by name.  All functions are
+ * thread-safe.
+*/
+class CodecRegistry {
+  public:
+    /*!
+     * Retrieve the registry for this process.
+    */
+    static CodecRegistry& get_registry();
+
+    /*!
+     * Add a codec (replaces a codec with the same name).
+    */
+    void register_codec(CodecPtr codec);
+
+    /*!
+     * True if a codec with the name is registered.
+    */
+    bool has_codec(const std::string& name);
+
+    /*!
+     * Retrieve a codec by name.  Throws if it is not registered.
+    */
+    CodecPtr get_codec(const std::string& name);
+
+    /*!
+     * Names of the registered codecs with all of the given
+     * capabilities (sorted).
+     * \param capabilities bitwise or of CodecCapability flags
+    */
+    std::vector<std::string> get_codec_names(unsigned int capabilities = 0);
+
+  private:
+    CodecRegistry();
+    CodecRegistry(const CodecRegistry&);
+    CodecRegistry& operator=(const CodecRegistry&);
+
+    //! codecs keyed by name
+    std::map<std::string, CodecPtr> codecs;
+
+    //! protects codecs
+    boost::mutex mutex;
+};
+
+}
+
+#endif
@@ -36,9 +36,6 @@ class DVIDBlocks {
     {
         uint64 total_size = uint64(N)*uint64(N)*uint64(N)*
             uint64(sizeof(T))*uint64(num_blocks); 
-        if (total_size > INT_MAX) {
-            throw ErrMsg("Cannot allocate larger than INT_MAX");
-        }
         data = BinaryData::create_binary_data((const char*) array_, total_size);
     }
 
@@ -71,7 +68,8 @@ class DVIDBlocks {
     }
   
     /*!
-     * Grabs pointer for block in the array.
+     * Grabs pointer for block in the array.  The pointer is
+     * invalidated by push_back.
      * \return constant buffer
     */
     const T* operator[](const int index) const
@@ -79,22 +77,40 @@ class DVIDBlocks {
         if (index >= num_blocks) {
             throw ErrMsg("Block index out-of-bounds");
         }
-        return (const T*) &(data->get_raw()[N*N*N*sizeof(T)*index]);
+        return (const T*) &(data->get_raw()[uint64(N*N*N*sizeof(T))*index]);
+    }
+
+    /*!
+     * Retrieve one block as binary data that references this array
+     * (the block is not copied).  The view stays valid after
+     * push_back, which appends to a copy while views exist.
+     * \param index block index
+     * \return view of the block
+    */
+    BinaryDataPtr get_block(const int index) const
+    {
+        if ((index < 0) || (index >= num_blocks)) {
+            throw ErrMsg("Block index out-of-bounds");
+        }
+        const uint64 block_bytes = N*N*N*sizeof(T);
+        return BinaryData::create_binary_data_view(data,
+                block_bytes*index, block_bytes);
     }
 
     /*!
-     * Copies blocks to end of current array.
+     * Copies blocks to end of current array.  If the binary data is
+     * shared (block views, get_binary, or the constructor argument),
+     * the array is copied first so the other references still see
+     * the old blocks.
      * \param block constant buffer to be copied
     */
     void push_back(const T* block)
     {
-        uint64 total_size = uint64(num_blocks+1)*uint64(N)*uint64(N)*
-            uint64(N)*uint64(sizeof(T)); 
-
-        if (total_size > INT_MAX) {
-            throw ErrMsg("Cannot allocate larger than INT_MAX");
+        // appending may reallocate memory that views reference
+        if (!data.unique()) {
+            data = BinaryData::create_binary_data(
+                    (const char*) data->get_raw(), data->length());
         }
-
         std::string& dataint = data->get_data();
         dataint.append((char*) block, N*N*N*sizeof(T));
         ++num_blocks;
@@ -9,10 +9,16 @@
 #define DVIDCONNECTION_H
 
 #include "BinaryData.h"
+#include "DVIDConnectionPool.h"
+#include <boost/function.hpp>
+#include <boost/thread/future.hpp>
 #include <string>
 
 namespace libdvid {
 
+class ResponseSink;
+class UploadSource;
+
 //! Define connection methods
 enum ConnectionMethod { HEAD, GET, POST, PUT, DELETE};
 
@@ -20,35 +26,59 @@ enum ConnectionMethod { HEAD, GET, POST, PUT, DELETE};
 enum ConnectionType {DEFAULT, JSON, BINARY};
 
 /*!
- * Creates a libcurl connection and 
- * provides utilities for transfering data between this library
+ * Result of an asynchronous request.
+*/
+struct DVIDResponse {
+    DVIDResponse() : status(0), curl_code(0) {}
+
+    //! http status code (0 if no response was received)
+    int status;
+
+    //! curl result code (0 if the transfer completed)
+    int curl_code;
+
+    //! response body
+    BinaryDataPtr data;
+
+    //! error message reported by curl (empty if none)
+    std::string error_msg;
+};
+
+//! Function called with the response when an asynchronous request completes
+typedef boost::function<void (DVIDResponse&)> ResponseCallback;
+
+//! Future for the response of an asynchronous request
+typedef boost::shared_future<DVIDResponse> DVIDResponseFuture;
+
+//! Future for binary data produced by an asynchronous request
+typedef boost::shared_future<BinaryDataPtr> BinaryDataFuture;
+
+/*!
+ * Provides utilities for transfering data between this library
  * and DVID.  Each service will call DVIDConnection independently
  * and does not need to be accessed very often by the end-user.
- * This class uses a static variable to set the curl context
- * and also sets a curl connection.
- *
- * WARNING: It is currently not possible to use a single DVIDConnection
- * for multiple threads.  Users should instantiate multiple services
- * to access DVID rather than reusing the same one.  This problem will
- * be fixed when the curl connection is given thread-level scope as
- * available in C++11.
+ * Curl handles are checked out from the DVIDConnectionPool for the
+ * server address for the duration of each request, so connections
+ * and DNS lookups are reused across requests, threads, and copies.
+ * A single DVIDConnection can be used from multiple threads.
 */
 class DVIDConnection {
   public:
     /*!
-     * Starts curl connection.
+     * Attaches to the connection pool for the given address.  The
+     * address is either an http address (e.g., http://127.0.0.1:8000)
+     * or unix:///path/to/socket for a server on the same host.
     */
     explicit DVIDConnection(std::string addr_);
   
     /*!
-     * Copy constructor to ensure that creation of curl connection
-     * is created and detroyed propertly per instance -- this will
-     * ensure that each copy is can be run in thread-safe manner.
+     * Copies share the connection pool (and therefore the warm
+     * curl handles) of the original connection.
     */ 
     DVIDConnection(const DVIDConnection& copy_connection);
 
     /*!
-     * Destroys curl connection.
+     * Curl handles are owned by the pool -- nothing to destroy.
     */
     ~DVIDConnection();
 
@@ -79,6 +109,124 @@ class DVIDConnection {
             BinaryDataPtr results, std::string& error_msg, ConnectionType type=DEFAULT,
             int timeout=DEFAULT_TIMEOUT);
 
+    /*!
+     * Performs a request and feeds the response body to the sink piece
+     * by piece as it is downloaded, so it can be processed before the
+     * transfer completes.  Only the body of a successful (2xx) response
+     * is given to the sink; other bodies are appended to error_msg.
+     * An exception is generated if curl cannot properly connect to
+     * the URL or if the sink throws.
+     *
+     * \param url endpoint where request is performed
+     * \param method http verb (HEAD, GET, POST, PUT, DELETE)
+     * \param payload binary data containing data to be posted
+     * \param sink consumer of the response body
+     * \param error_msg error message if there is an error
+     * \param type connection type for request
+     * \param timeout timeout for the request
+     * \return html status code
+    */
+    int make_request(std::string endpoint, ConnectionMethod method,
+            BinaryDataPtr payload, ResponseSink& sink,
+            std::string& error_msg, ConnectionType type=DEFAULT,
+            int timeout=DEFAULT_TIMEOUT);
+
+    /*!
+     * Performs a request whose body is streamed from the source rather
+     * than held in memory.  The body is sent with chunked transfer
+     * encoding if the source does not know its size.  An exception is
+     * generated if curl cannot properly connect to the URL or if the
+     * source fails.
+     *
+     * \param url endpoint where request is performed
+     * \param method http verb (POST or PUT)
+     * \param source produces the request body
+     * \param results binary data containing the result
+     * \param error_msg error message if there is an error
+     * \param type connection type for request
+     * \param timeout timeout for the request
+     * \return html status code
+    */
+    int make_request(std::string endpoint, ConnectionMethod method,
+            UploadSource& source, BinaryDataPtr results,
+            std::string& error_msg, ConnectionType type=DEFAULT,
+            int timeout=DEFAULT_TIMEOUT);
+
+    /*!
+     * Performs a request and writes the response body directly into
+     * caller-owned memory without any intermediate buffer.  An
+     * exception is generated if curl cannot properly connect to the
+     * URL or if the body is larger than the capacity.  The body of a
+     * failed request (e.g., an error message) is also written to results.
+     *
+     * \param url endpoint where request is performed
+     * \param method http verb (HEAD, GET, POST, PUT, DELETE)
+     * \param payload binary data containing data to be posted
+     * \param results destination of the response body
+     * \param capacity number of bytes available in results
+     * \param length returns number of bytes written to results
+     * \param error_msg error message if there is an error
+     * \param type connection type for request
+     * \param timeout timeout for the request
+     * \return html status code
+    */
+    int make_request(std::string endpoint, ConnectionMethod method,
+            BinaryDataPtr payload, char* results, size_t capacity,
+            size_t& length, std::string& error_msg,
+            ConnectionType type=DEFAULT, int timeout=DEFAULT_TIMEOUT);
+
+    /*!
+     * Issue a request on the shared asynchronous request engine
+     * (see DVIDRequestEngine) and return immediately.  Many requests
+     * can be in flight at once without dedicating a thread to each.
+     * The future holds a DVIDException if curl cannot properly connect
+     * to the URL.  Non-200 status codes are not treated as errors.
+     *
+     * \param endpoint endpoint where request is performed
+     * \param method http verb (HEAD, GET, POST, PUT, DELETE)
+     * \param payload binary data containing data to be posted
+     * \param type connection type for request
+     * \param timeout timeout for the request
+     * \return future for the response
+    */
+    DVIDResponseFuture make_request_async(std::string endpoint,
+            ConnectionMethod method, BinaryDataPtr payload,
+            ConnectionType type=DEFAULT, int timeout=DEFAULT_TIMEOUT);
+
+    /*!
+     * Issue a request on the shared asynchronous request engine and
+     * call the callback with the response when it completes.  The
+     * callback is invoked on the engine I/O thread, so it should not
+     * block.  Transfer failures are reported through curl_code.
+     *
+     * \param endpoint endpoint where request is performed
+     * \param method http verb (HEAD, GET, POST, PUT, DELETE)
+     * \param payload binary data containing data to be posted
+     * \param callback function called with the response
+     * \param type connection type for request
+     * \param timeout timeout for the request
+     * \param delay seconds to wait before the request is started
+    */
+    void make_request_async(std::string endpoint, ConnectionMethod method,
+            BinaryDataPtr payload, ResponseCallback callback,
+            ConnectionType type=DEFAULT, int timeout=DEFAULT_TIMEOUT,
+            double delay=0);
+
+    /*!
+     * Determine whether a curl error is likely temporary (e.g., the
+     * connection was refused, reset, or timed out) so that retrying
+     * the request could succeed.
+     * \param curl_code curl error code
+     * \return true if the error is transient
+    */
+    static bool is_transient_error(int curl_code);
+
+    /*!
+     * Name used for a request with the given method in traces
+     * (e.g., "HTTP GET").
+    */
+    static const char* get_trace_name(ConnectionMethod method);
+
     /*!
      * Get the address for the DVID connection.
     */
@@ -92,7 +240,59 @@ class DVIDConnection {
     */
     std::string get_uri_root() const
     {
-        return (addr + DVID_PREFIX);
+        return (url_root + DVID_PREFIX);
+    }
+
+    /*!
+     * Set the priority lane for requests made through this connection
+     * (see RequestScheduler).  Interactive requests are dispatched
+     * ahead of normal and bulk requests to the same server.
+     * \param priority_ lane for subsequent requests
+    */
+    void set_priority(RequestPriority priority_)
+    {
+        priority = priority_;
+    }
+
+    /*!
+     * Get the priority lane for requests made through this connection.
+    */
+    RequestPriority get_priority() const
+    {
+        return priority;
+    }
+
+    /*!
+     * Hedge GET requests (without a payload) made through this
+     * connection.  A request that has not completed after a percentile
+     * of the recent latency for its endpoint family is sent again and
+     * the first response is used (see RequestHedger).  Hedged requests
+     * run on the request engine and their body is passed to the sink
+     * once complete rather than as it arrives.  The losing request is
+     * cancelled.  Requests made from a callback on the request engine
+     * I/O thread are not hedged, since waiting there for the engine
+     * would deadlock.  Disabled by default.
+     * \param enable true to hedge reads
+    */
+    void set_hedging(bool enable)
+    {
+        hedging = enable;
+    }
+
+    /*!
+     * True if GET requests are hedged.
+    */
+    bool get_hedging() const
+    {
+        return hedging;
+    }
+
+    /*!
+     * Get the pool that supplies curl handles for this connection.
+    */
+    DVIDConnectionPoolPtr get_pool() const
+    {
+        return pool;
     }
 
     //! default timeout in seconds
@@ -104,13 +304,42 @@ class DVIDConnection {
     */
     DVIDConnection& operator=(const DVIDConnection& connection);
 
-    //! reuse curl connection -- eventually make this thread static and
-    //! initialize once (CURL typedef is actually a void*)
-    void* curl_connection;
+    /*!
+     * Configures a pooled curl handle, performs the request, and
+     * writes the body to the given sink.  If divert_errors is set,
+     * the body of a non-2xx response is appended to error_msg instead.
+     * \return html status code
+    */
+    int perform_request(std::string endpoint, ConnectionMethod method,
+            BinaryDataPtr payload, UploadSource* source,
+            ResponseSink& sink, bool divert_errors, std::string& error_msg,
+            ConnectionType type, int timeout);
+
+    /*!
+     * Performs a GET on the request engine, sends a hedge if it has
+     * not completed after the delay, writes the first response to the
+     * sink, and cancels the other attempt.
+     * \return html status code
+    */
+    int perform_hedged_request(std::string endpoint, ResponseSink& sink,
+            bool divert_errors, std::string& error_msg, ConnectionType type,
+            int timeout, double delay);
+
+    //! shared pool of curl handles for the server
+    DVIDConnectionPoolPtr pool;
 
     //! DVID address
     std::string addr;
 
+    //! start of request urls (the host is a placeholder for unix sockets)
+    std::string url_root;
+
+    //! priority lane for requests
+    RequestPriority priority;
+
+    //! true if reads are hedged
+    bool hedging;
+
     //! prefix for all DVID calls (versioning may be added here in the future) 
     static const char* DVID_PREFIX;
 };
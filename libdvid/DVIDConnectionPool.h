@@ -0,0 +1,265 @@
+/*!
+ * This file defines a process-wide pool of libcurl handles for
+ * each DVID server.  Handles are kept warm between requests so
+ * that TCP connections, keep-alive state, and DNS lookups can be
+ * reused across threads and across DVIDConnection instances.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDCONNECTIONPOOL_H
+#define DVIDCONNECTIONPOOL_H
+
+#include "RequestStats.h"
+#include "RequestCoalescer.h"
+#include "FlowControl.h"
+#include "RequestScheduler.h"
+#include "RequestHedger.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <string>
+#include <vector>
+
+namespace libdvid {
+
+class DVIDConnectionPool;
+
+//! Declares smart pointer type to access a connection pool
+typedef boost::shared_ptr<DVIDConnectionPool> DVIDConnectionPoolPtr;
+
+/*!
+ * Pool of curl handles keyed by server address.  There is exactly one
+ * pool per address in the process, which is retrieved with get_pool.
+ * All handles in a pool share a DNS and connection cache through
+ * a curl share object.  The number of handles that can be checked
+ * out at one time is capped; callers block until a handle is returned
+ * when the cap is reached.  All functions are thread-safe.
+ *
+ * Addresses of the form unix:///path/to/socket reach a server on
+ * the same host through a unix domain socket instead of TCP.
+*/
+class DVIDConnectionPool {
+  public:
+    /*!
+     * Retrieve the pool for the given server address, creating it
+     * if it does not exist yet.
+     * \param addr DVID server address
+     * \return shared pool for the address
+    */
+    static DVIDConnectionPoolPtr get_pool(std::string addr);
+
+    /*!
+     * Checks out a curl handle (CURL typedef is actually a void*).
+     * The call first waits for the scheduler to admit a request in
+     * the given lane.  An idle handle is then reused if available,
+     * otherwise a new one is created.
+     * \param priority lane of the request
+     * \return curl handle
+    */
+    void* acquire(RequestPriority priority = NORMAL_PRIORITY);
+
+    /*!
+     * Returns a handle to the pool.  The handle options are reset
+     * but its live connections and caches are kept.
+     * \param handle curl handle retrieved with acquire
+     * \param priority lane given to acquire
+    */
+    void release(void* handle, RequestPriority priority = NORMAL_PRIORITY);
+
+    /*!
+     * Set the maximum number of handles that can be checked out
+     * at the same time for this server.  This is also the number of
+     * requests (including asynchronous ones) the scheduler allows
+     * in flight.
+     * \param max_handles_ handle cap (must be positive)
+    */
+    void set_max_handles(int max_handles_);
+
+    /*!
+     * Get the maximum number of handles for this server.
+     * \return handle cap
+    */
+    int get_max_handles();
+
+    /*!
+     * Get the number of handles created and not destroyed.
+     * \return number of handles (idle and checked out)
+    */
+    int num_handles();
+
+    /*!
+     * Get the address of the server for this pool.
+    */
+    std::string get_addr() const
+    {
+        return addr;
+    }
+
+    /*!
+     * Get the unix domain socket used to reach the server (empty
+     * if the server is reached over TCP).
+    */
+    std::string get_unix_socket() const
+    {
+        return unix_socket;
+    }
+
+    /*!
+     * Extract the socket path from an address of the form
+     * unix:///path/to/socket.
+     * \param addr DVID server address
+     * \return socket path or an empty string for other addresses
+    */
+    static std::string parse_unix_socket(const std::string& addr);
+
+    /*!
+     * Get the timing statistics for requests made to this server.
+    */
+    RequestStatsPtr get_stats() const
+    {
+        return stats;
+    }
+
+    /*!
+     * Get the tracker used to merge identical concurrent requests
+     * to this server.
+    */
+    RequestCoalescerPtr get_coalescer() const
+    {
+        return coalescer;
+    }
+
+    /*!
+     * Get the rate and concurrency limits for requests to this server.
+    */
+    FlowControllerPtr get_flow_controller() const
+    {
+        return flow;
+    }
+
+    /*!
+     * Get the priority scheduler for requests to this server.
+    */
+    RequestSchedulerPtr get_scheduler() const
+    {
+        return scheduler;
+    }
+
+    /*!
+     * Get the policy and counters for hedged reads from this server.
+    */
+    RequestHedgerPtr get_hedger() const
+    {
+        return hedger;
+    }
+
+    /*!
+     * Destroys all idle handles and the shared curl cache.
+    */
+    ~DVIDConnectionPool();
+
+    //! default cap on handles per server
+    static const int DEFAULT_MAX_HANDLES = 64;
+
+    /*!
+     * Scoped helper that checks out a handle on construction
+     * and returns it on destruction (even if an exception is thrown).
+    */
+    class PooledHandle {
+      public:
+        explicit PooledHandle(DVIDConnectionPoolPtr pool_,
+                RequestPriority priority_ = NORMAL_PRIORITY) :
+            pool(pool_), priority(priority_)
+        {
+            handle = pool->acquire(priority);
+        }
+
+        ~PooledHandle()
+        {
+            pool->release(handle, priority);
+        }
+
+        //! curl handle for the lifetime of this object
+        void* get() const
+        {
+            return handle;
+        }
+
+      private:
+        PooledHandle(const PooledHandle&);
+        PooledHandle& operator=(const PooledHandle&);
+
+        DVIDConnectionPoolPtr pool;
+        RequestPriority priority;
+        void* handle;
+    };
+
+  private:
+    /*!
+     * Private constructor -- pools are only created through get_pool.
+     * \param addr_ DVID server address
+    */
+    explicit DVIDConnectionPool(std::string addr_);
+
+    DVIDConnectionPool(const DVIDConnectionPool&);
+    DVIDConnectionPool& operator=(const DVIDConnectionPool&);
+
+    /*!
+     * Takes an idle handle or creates one (waits if the cap on
+     * handles has been reached).
+    */
+    void* take_handle();
+
+    /*!
+     * Applies the options every pooled handle should have.
+    */
+    void init_handle(void* handle);
+
+    //! DVID address
+    std::string addr;
+
+    //! unix domain socket path (empty for TCP)
+    std::string unix_socket;
+
+    //! curl share object for DNS/connection caches (CURLSH is a void)
+    void* curl_share;
+
+    //! handles ready to be checked out
+    std::vector<void*> idle_handles;
+
+    //! number of handles created (idle and in use)
+    int total_handles;
+
+    //! cap on the number of handles
+    int max_handles;
+
+    //! protects the handle lists
+    boost::mutex mutex;
+
+    //! signals that a handle was returned
+    boost::condition_variable handle_available;
+
+    //! locks for the curl share object (one per type of shared data)
+    boost::mutex share_locks[8];
+
+    //! statistics for all requests to this server
+    RequestStatsPtr stats;
+
+    //! requests in flight that can be shared
+    RequestCoalescerPtr coalescer;
+
+    //! client-side rate and concurrency limits
+    FlowControllerPtr flow;
+
+    //! orders requests by priority lane
+    RequestSchedulerPtr scheduler;
+
+    //! decides when hedged reads are duplicated
+    RequestHedgerPtr hedger;
+};
+
+}
+
+#endif
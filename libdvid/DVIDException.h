@@ -66,6 +66,14 @@ class DVIDException : public ErrMsg {
         msg = sstr.str();
     }
 
+    /*!
+     * Get the http status code (0 if no response was received).
+    */
+    int get_status() const
+    {
+        return status;
+    }
+
     /*!
      * Empty destructor.
     */
@@ -76,6 +84,50 @@ class DVIDException : public ErrMsg {
     int status;
 };
 
+/*!
+ * Error raised when the request could not be completed at the
+ * transport level (e.g., connection refused or timed out).  It
+ * records the curl error code and whether the failure is transient,
+ * i.e., the same request may succeed if it is tried again.
+*/
+class DVIDConnectionException : public DVIDException {
+  public:
+    /*!
+     * \param msg_ error message
+     * \param status_ http status code (usually 0)
+     * \param curl_code_ curl error code
+     * \param transient_ true if retrying could succeed
+    */
+    DVIDConnectionException(std::string msg_, int status_, int curl_code_,
+            bool transient_) : DVIDException(msg_, status_),
+        curl_code(curl_code_), transient(transient_) {}
+
+    /*!
+     * Get the curl error code.
+    */
+    int get_curl_code() const
+    {
+        return curl_code;
+    }
+
+    /*!
+     * True if the error is likely temporary.
+    */
+    bool is_transient() const
+    {
+        return transient;
+    }
+
+    ~DVIDConnectionException() throw() {}
+
+  private:
+    //! curl error code
+    int curl_code;
+
+    //! true if the error is likely temporary
+    bool transient;
+};
+
 }
 
 #endif
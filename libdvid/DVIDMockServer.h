@@ -0,0 +1,226 @@
+/*!
+ * This file defines a small in-process HTTP server that imitates
+ * the subset of the DVID REST API used by DVIDNodeService and
+ * DVIDServerService.  It allows the tests and load tests to run on
+ * a machine without DVID and makes performance measurements
+ * repeatable by injecting a fixed latency, slow responses
+ * (stragglers), a bandwidth limit, and busy (503) responses.
+ *
+ * Supported datatypes and endpoints (relative to /api):
+ *  - /server/info, /repos, /repo/<uuid>/info, /repo/<uuid>/instance
+ *  - uint8blk and labelblk: info, raw (0_1_2 with lz4 compression and
+ *    roi masking), blocks
+ *  - labelarray and labelmap: info, raw, blocks (GET by size and offset
+ *    and POST, gzip compressed label blocks or uncompressed)
+ *  - labelvol (synced to a labelblk): sparsevol, sparsevol-coarse
+ *  - imagetile (synced to a uint8blk): tile (PNG)
+ *  - keyvalue: key, keys
+ *  - roi: roi, partition, ptquery
+ *  - labelgraph: weight, neighbors, subgraph, propertytransaction
+ *
+ * Data is kept in memory and there is no versioning.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDMOCKSERVER_H
+#define DVIDMOCKSERVER_H
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <string>
+#include <set>
+
+namespace libdvid {
+
+/*!
+ * Stand-in for a DVID server listening on the loopback interface
+ * or a unix domain socket.
+ * Each connection is served by its own thread and supports keep-alive.
+ * Configuration functions can be called while the server is running.
+*/
+class DVIDMockServer {
+  public:
+    /*!
+     * Create a server (it does not listen until start is called).
+     * \param port_ TCP port (0 picks a free port)
+    */
+    explicit DVIDMockServer(int port_ = 0);
+
+    /*!
+     * Create a server that listens on a unix domain socket.  An
+     * existing file at the path is replaced.
+     * \param unix_socket_ absolute path of the socket
+    */
+    explicit DVIDMockServer(const std::string& unix_socket_);
+
+    /*!
+     * Stops the server if it is running.
+    */
+    ~DVIDMockServer();
+
+    /*!
+     * Start listening and serving requests.  An exception is
+     * generated if the port cannot be bound.
+    */
+    void start();
+
+    /*!
+     * Stop serving and close all connections.
+    */
+    void stop();
+
+    /*!
+     * Port the server is listening on (valid after start).
+    */
+    int get_port() const
+    {
+        return port;
+    }
+
+    /*!
+     * Host and port the server is listening on (e.g., 127.0.0.1:8000)
+     * or the socket path for a unix socket server.
+    */
+    std::string get_addr() const;
+
+    /*!
+     * Address to give to DVIDNodeService (e.g., http://127.0.0.1:8000
+     * or unix:///tmp/dvid.sock).
+    */
+    std::string get_url() const;
+
+    /*!
+     * Delay every response by a fixed amount.
+     * \param seconds delay added before each response is sent
+    */
+    void set_latency(double seconds);
+
+    /*!
+     * Limit the rate that response bodies are sent on each connection.
+     * \param bytes_per_second rate limit (0 for no limit)
+    */
+    void set_bandwidth(double bytes_per_second);
+
+    /*!
+     * Respond to a fraction of requests with 503 (server busy).
+     * The choice is made by a seeded generator so the same sequence of
+     * requests sees the same busy responses.
+     * \param fraction probability between 0 and 1
+     * \param seed seed for the generator
+    */
+    void set_busy_rate(double fraction, unsigned int seed = 0);
+
+    /*!
+     * Delay a fraction of responses by an extra amount (in addition
+     * to the latency) to simulate stragglers.  The choice is made by a
+     * seeded generator.
+     * \param fraction probability between 0 and 1
+     * \param seconds extra delay of a straggler
+     * \param seed seed for the generator
+    */
+    void set_straggler_rate(double fraction, double seconds,
+            unsigned int seed = 0);
+
+    /*!
+     * Respond to the next requests with 503 (server busy).
+     * \param count number of requests that will be rejected
+    */
+    void inject_busy(int count);
+
+    /*!
+     * Number of requests received.
+    */
+    int get_num_requests();
+
+    /*!
+     * Number of requests answered with 503.
+    */
+    int get_num_busy();
+
+  private:
+    //! in-memory repositories and instances
+    struct Store;
+
+    DVIDMockServer(const DVIDMockServer&);
+    DVIDMockServer& operator=(const DVIDMockServer&);
+
+    //! starts listening on the unix domain socket
+    void start_unix();
+
+    //! accepts connections until stopped
+    void accept_loop();
+
+    //! serves requests on one connection
+    void serve_connection(int fd);
+
+    //! true if the request should be rejected as busy
+    bool should_reject();
+
+    //! sends a response (applying latency and bandwidth)
+    bool send_response(int fd, int status, const std::string& body,
+            bool head, const std::string& content_type);
+
+    //! TCP port
+    int port;
+
+    //! unix domain socket path (empty for TCP)
+    std::string unix_socket;
+
+    //! listening socket (-1 if not listening)
+    int listen_fd;
+
+    //! set when the server is stopping
+    bool stopping;
+
+    //! response delay in seconds
+    double latency;
+
+    //! response rate limit in bytes/second (0 for none)
+    double bandwidth;
+
+    //! fraction of requests answered with 503
+    double busy_rate;
+
+    //! fraction of responses that are delayed further
+    double straggler_rate;
+
+    //! extra delay of a straggler in seconds
+    double straggler_delay;
+
+    //! requests that will be answered with 503
+    int busy_pending;
+
+    //! number of requests received
+    int num_requests;
+
+    //! number of 503 responses
+    int num_busy;
+
+    //! chooses which requests are busy
+    boost::mt19937 busy_generator;
+
+    //! chooses which responses straggle
+    boost::mt19937 straggler_generator;
+
+    //! protects configuration, counters, and the connection list
+    boost::mutex mutex;
+
+    //! open client sockets (shut down on stop)
+    std::set<int> connections;
+
+    //! accept thread
+    boost::shared_ptr<boost::thread> accept_thread;
+
+    //! connection threads
+    boost::thread_group connection_threads;
+
+    //! data held by the server
+    boost::shared_ptr<Store> store;
+};
+
+}
+
+#endif
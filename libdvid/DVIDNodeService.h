@@ -2,8 +2,8 @@
  * This file defines an API for accessing the DVID version node REST
  * interface.  Only a subset of the REST interface is implemented.
  *
- * Note: to be thread safe instantiate a unique node service
- * object for each thread.
+ * Note: a node service can be shared by multiple threads.  Requests
+ * draw curl handles from the connection pool for the server.
  *
  * TODO: expand API and load node meta on initialization.
  *
@@ -19,10 +19,17 @@
 #include "DVIDConnection.h"
 #include "DVIDBlocks.h"
 #include "DVIDRoi.h"
+#include "UploadSource.h"
+#include "ResponseSink.h"
+#include "RetryPolicy.h"
+#include "Codec.h"
 
 #include <json/value.h>
+#include <boost/function.hpp>
+#include <algorithm>
 #include <vector>
 #include <fstream>
+#include <map>
 #include <string>
 
 namespace libdvid {
@@ -42,10 +49,249 @@ class DVIDNodeService {
     /*!
      * Constructor sets up a http connection and checks
      * whether a node of the given uuid and web server exists.
-     * \param web_addr_ address of DVID server
+     * \param web_addr_ address of DVID server (or unix:///path/to/socket
+     * for a server on the same host)
      * \param uuid_ uuid corresponding to a DVID node
+     * \param retry_policy_ how requests are retried (default: retry 503)
     */
-    DVIDNodeService(std::string web_addr_, UUID uuid_);
+    DVIDNodeService(std::string web_addr_, UUID uuid_,
+            RetryPolicy retry_policy_ = RetryPolicy());
+
+    /*!
+     * Change how requests are retried when the server is busy or the
+     * connection fails temporarily.  This should be called before
+     * the service is shared between threads.
+     * \param retry_policy_ policy for subsequent requests
+    */
+    void set_retry_policy(RetryPolicy retry_policy_)
+    {
+        retry_policy = retry_policy_;
+    }
+
+    /*!
+     * Retrieve the policy used to retry requests.
+    */
+    RetryPolicy get_retry_policy() const
+    {
+        return retry_policy;
+    }
+
+    /*!
+     * Merge identical concurrent GET requests (without a payload)
+     * made through this service.  While such a request is in flight,
+     * other threads making the same request (from any service with
+     * coalescing enabled on the same server) wait for it and receive
+     * the same BinaryDataPtr instead of issuing their own request.
+     * Shared results must not be modified.  Disabled by default.
+     * \param enable true to coalesce requests
+    */
+    void set_coalescing(bool enable)
+    {
+        coalesce_gets = enable;
+    }
+
+    /*!
+     * True if identical concurrent GET requests are merged.
+    */
+    bool get_coalescing() const
+    {
+        return coalesce_gets;
+    }
+
+    /*!
+     * Hedge the reads (tiles, blocks, volumes, key values) made
+     * through this service.  A read that is slower than a percentile
+     * of the recent reads of its kind is sent a second time and the
+     * first response is used, which trims the tail latency at the
+     * cost of a few duplicate requests.  The percentile and budget
+     * are set with get_request_hedger.  Disabled by default.
+     * \param enable true to hedge reads
+    */
+    void set_hedging(bool enable)
+    {
+        connection.set_hedging(enable);
+    }
+
+    /*!
+     * True if reads are hedged.
+    */
+    bool get_hedging() const
+    {
+        return connection.get_hedging();
+    }
+
+    /*!
+     * Set the number of threads that lz4 compress volumes for
+     * put_gray3D and put_labels3D.  With more than one thread, a
+     * large volume is posted as several block-aligned Z slabs: later
+     * slabs are compressed in parallel while earlier ones upload.
+     * (Each slab is a separate request, so a failed put may leave the
+     * first slabs written and DVID reports a mutation per slab.)
+     * Defaults to 1.
+     * \param num_threads compression threads (1 compresses the whole
+     * volume before posting it in one request)
+    */
+    void set_compression_threads(int num_threads)
+    {
+        compression_threads = (num_threads < 1) ? 1 : num_threads;
+    }
+
+    /*!
+     * Get the number of threads that lz4 compress volumes.
+    */
+    int get_compression_threads() const
+    {
+        return compression_threads;
+    }
+
+    /*!
+     * Set the largest volume (in uncompressed bytes) transferred in
+     * one request by get_gray3D, get_labels3D, put_gray3D, and
+     * put_labels3D.  Larger volumes are split into block-aligned
+     * sub-volumes (along Z first so they stay contiguous) that are
+     * transferred concurrently and assembled in place; each
+     * sub-volume is a separate request, so a failed put may leave
+     * part of the volume written.  Streamed volumes (UploadSource)
+     * and asynchronous requests are not split.  Defaults to 1 GB.
+     * \param max_bytes bytes per request (at most INT_MAX)
+    */
+    void set_max_request_bytes(uint64 max_bytes)
+    {
+        max_request_bytes = std::min(std::max(max_bytes, uint64(1)),
+                uint64(INT_MAX));
+    }
+
+    /*!
+     * Get the largest volume transferred in one request.
+    */
+    uint64 get_max_request_bytes() const
+    {
+        return max_request_bytes;
+    }
+
+    /*!
+     * Set the number of sub-requests of a split volume that run at
+     * once (default: 4).
+    */
+    void set_transfer_threads(int num_threads)
+    {
+        transfer_threads = (num_threads < 1) ? 1 : num_threads;
+    }
+
+    /*!
+     * Get the number of sub-requests of a split volume that run at once.
+    */
+    int get_transfer_threads() const
+    {
+        return transfer_threads;
+    }
+
+    /*!
+     * Select the codec (see CodecRegistry) for transfers of a data
+     * instance.  Compressed volume GETs and PUTs use it if DVID
+     * accepts it for volumes (CODEC_DVID_VOLUME) and fall back to
+     * lz4 otherwise.  Key values put to a keyvalue instance with a
+     * lossless codec are stored encoded with a small header naming
+     * the codec (a libdvid format that other DVID clients cannot
+     * read); get decodes such values only for instances with a
+     * lossless codec selected, and values without a valid header are
+     * returned as stored.  A label block codec (CODEC_LABEL_BLOCKS,
+     * e.g., "blocks") can only be selected for labelarray and
+     * labelmap instances (checked with a request to DVID); label
+     * block spans (get_labelblocks, put_labelblocks, get_blocks_async)
+     * then go through the blocks endpoints of those types with each
+     * block gzip compressed in the codec's format.  (Values streamed
+     * with an UploadSource or ResponseSink are not encoded or
+     * decoded.)  This should be called before the service is shared
+     * between threads.
+     * \param datatype_instance name of the instance
+     * \param codec_name registered codec (empty for the default)
+    */
+    void set_codec(std::string datatype_instance, std::string codec_name);
+
+    /*!
+     * Get the codec selected for an instance (empty for the default).
+    */
+    std::string get_codec(std::string datatype_instance) const;
+
+    /*!
+     * Retrieve the timing statistics for requests made to this
+     * DVID server (shared by all services using the same address).
+     * Histograms can be queried per endpoint family and phase.
+    */
+    RequestStatsPtr get_request_stats() const
+    {
+        return connection.get_pool()->get_stats();
+    }
+
+    /*!
+     * Dump the request statistics for this DVID server as JSON.
+     * \return formatted JSON keyed by endpoint family
+    */
+    std::string dump_request_stats() const
+    {
+        return get_request_stats()->dump_json();
+    }
+
+    /*!
+     * Retrieve the tracker for coalesced requests to this DVID server
+     * (shared by all services using the same address).
+    */
+    RequestCoalescerPtr get_request_coalescer() const
+    {
+        return connection.get_pool()->get_coalescer();
+    }
+
+    /*!
+     * Retrieve the client-side flow control for this DVID server
+     * (shared by all services using the same address).  It can cap
+     * the request rate and bandwidth and adapt the number of requests
+     * in flight to the server's responsiveness.
+    */
+    FlowControllerPtr get_flow_controller() const
+    {
+        return connection.get_pool()->get_flow_controller();
+    }
+
+    /*!
+     * Set the priority lane for the requests made by this service.
+     * Interactive requests (e.g., from a viewer) are dispatched ahead
+     * of normal and bulk requests to the same server, and bulk jobs
+     * can only occupy a bounded share of the connections.
+     * \param priority lane (NORMAL_PRIORITY by default)
+    */
+    void set_priority(RequestPriority priority)
+    {
+        connection.set_priority(priority);
+    }
+
+    /*!
+     * Get the priority lane for the requests made by this service.
+    */
+    RequestPriority get_priority() const
+    {
+        return connection.get_priority();
+    }
+
+    /*!
+     * Retrieve the scheduler that orders the requests to this DVID
+     * server by priority (shared by all services using the same
+     * address).  It can change the share of connections per lane.
+    */
+    RequestSchedulerPtr get_request_scheduler() const
+    {
+        return connection.get_pool()->get_scheduler();
+    }
+
+    /*!
+     * Retrieve the policy for hedged reads from this DVID server
+     * (shared by all services using the same address), including the
+     * number of hedges sent and won.
+    */
+    RequestHedgerPtr get_request_hedger() const
+    {
+        return connection.get_pool()->get_hedger();
+    }
 
     /*!
      * Allow client to specify a custom http request with an
@@ -60,6 +306,34 @@ class DVIDNodeService {
     BinaryDataPtr custom_request(std::string endpoint, BinaryDataPtr payload,
             ConnectionMethod method);
 
+    /*!
+     * Custom http request whose response is fed to the sink as it
+     * is downloaded rather than returned as one buffer.  This allows
+     * large responses to be decoded or written to disk with bounded
+     * memory.  A DVIDException is thrown (and the sink is not used)
+     * if the request does not succeed.  If coalescing is enabled,
+     * GET requests without a payload are downloaded in full (so they
+     * can be shared) and then written to the sink.
+     * \param endpoint REST endpoint given the node's uuid
+     * \param payload binary data to be sent in the request
+     * \param method http verb (GET, PUT, POST, DELETE)
+     * \param sink consumer of the response body
+    */
+    void custom_request(std::string endpoint, BinaryDataPtr payload,
+            ConnectionMethod method, ResponseSink& sink);
+
+    /*!
+     * Asynchronous version of custom_request.  The request is issued
+     * on the shared request engine and the call returns immediately.
+     * The future holds a DVIDException if the http status is not 200.
+     * \param endpoint REST endpoint given the node's uuid
+     * \param payload binary data to be sent in the request
+     * \param method http verb (GET, PUT, POST, DELETE)
+     * \return future for the http response as binary data
+    */
+    BinaryDataFuture custom_request_async(std::string endpoint,
+            BinaryDataPtr payload, ConnectionMethod method);
+
     /*!
      * Retrieves meta data for a given datatype instance
      * \param datatype_name name of datatype instance
@@ -90,6 +364,14 @@ class DVIDNodeService {
     */
     bool create_labelblk(std::string datatype_name,
             std::string labelvol_name = "");
+
+    /*!
+     * Create an instance of uint64 labelarray datatype (labels that
+     * can be transferred as compressed label blocks; see set_codec).
+     * \param datatype_name name of new datatype instance
+     * \return true if create, false if already exists
+    */
+    bool create_labelarray(std::string datatype_name);
     
     /*!
      * Create an instance of keyvalue datatype.
@@ -141,6 +423,18 @@ class DVIDNodeService {
     BinaryDataPtr get_tile_slice_binary(std::string datatype_instance, Slice2D slice,
             unsigned int scaling, std::vector<int> tile_loc);
 
+    /*!
+     * Asynchronous version of get_tile_slice_binary.  Many tiles can be
+     * requested at once without dedicating a thread to each.
+     * \param datatype_instance name of tile type instance
+     * \param slice specify XY, YZ, or XZ
+     * \param scaling specify zoom level (1=max res)
+     * \param tile_loc e.g., X,Y,Z location of tile (X and Y are in block coordinates
+     * \return future for the raw compressed tile (e.g, JPEG or PNG) 
+    */ 
+    BinaryDataFuture get_tile_slice_binary_async(std::string datatype_instance,
+            Slice2D slice, unsigned int scaling, std::vector<int> tile_loc);
+
     /*!
      * Retrive a 3D 1-byte grayscale volume with the specified
      * dimension size and spatial offset.  The dimension
@@ -150,13 +444,13 @@ class DVIDNodeService {
      * server implementation of DVID with hundreds of volume requests,
      * we support a throttle command that prevents multiple volume
      * GETs/PUTs from executing at the same time.
-     * A 2D slice should be requested as X x Y x 1.  The requested
-     * number of voxels cannot be larger than INT_MAX/8.
+     * A 2D slice should be requested as X x Y x 1.  Requests larger
+     * than get_max_request_bytes() are split (see set_max_request_bytes).
      * \param datatype_instance name of grayscale type instance
      * \param dims size of X, Y, Z dimensions in voxel coordinates
      * \param offset X, Y, Z offset in voxel coordinates
      * \param throttle allow only one request at time (default: true)
-     * \param compress enable lz4 compression
+     * \param compress enable compression (lz4 unless set with set_codec)
      * \param roi specify DVID roi to mask GET operation (return 0s outside ROI)
      * \return 3D grayscale object that wraps a byte buffer
     */
@@ -174,14 +468,14 @@ class DVIDNodeService {
      * overload a single server implementation of DVID with hundreds
      * of volume requests, we support a throttle command that prevents
      * multiple volume GETs/PUTs from executing at the same time.
-     * A 2D slice should be requested as ch1 size x ch2 size x 1.  The requested
-     * number of voxels cannot be larger than INT_MAX/8.
+     * A 2D slice should be requested as ch1 size x ch2 size x 1.  Requests
+     * larger than get_max_request_bytes() are split (see set_max_request_bytes).
      * \param datatype_instance name of grayscale type instance
      * \param dims size of dimensions (order given by channels)
      * \param offset offset in voxel coordinates (order given by channels)
      * \param channels channel order (default: 0,1,2)
      * \param throttle allow only one request at time (default: true)
-     * \param compress enable lz4 compression
+     * \param compress enable compression (lz4 unless set with set_codec)
      * \param roi specify DVID roi to mask GET operation (return 0s outside ROI)
      * \return 3D grayscale object that wraps a byte buffer
     */
@@ -199,13 +493,13 @@ class DVIDNodeService {
      * server implementation of DVID with hundreds of volume requests,
      * we support a throttle command that prevents multiple volume
      * GETs/PUTs from executing at the same time.
-     * A 2D slice should be requested as X x Y x 1.  The requested
-     * number of voxels cannot be larger than INT_MAX/8.
+     * A 2D slice should be requested as X x Y x 1.  Requests larger
+     * than get_max_request_bytes() are split (see set_max_request_bytes).
      * \param datatype_instance name of the labelblk type instance
      * \param dims size of X, Y, Z dimensions in voxel coordinates
      * \param offset X, Y, Z offset in voxel coordinates
      * \param throttle allow only one request at time (default: true)
-     * \param compress enable lz4 compression
+     * \param compress enable compression (lz4 unless set with set_codec)
      * \param roi specify DVID roi to mask GET operation (return 0s outside ROI)
      * \return 3D label object that wraps a byte buffer
     */
@@ -223,14 +517,14 @@ class DVIDNodeService {
      * overload a single server implementation of DVID with hundreds
      * of volume requests, we support a throttle command that prevents
      * multiple volume GETs/PUTs from executing at the same time.
-     * A 2D slice should be requested as ch1 size x ch2 size x 1.  The requested
-     * number of voxels cannot be larger than INT_MAX/8.
+     * A 2D slice should be requested as ch1 size x ch2 size x 1.  Requests
+     * larger than get_max_request_bytes() are split (see set_max_request_bytes).
      * \param datatype_instance name of the labelblk type instance
      * \param dims size of dimensions (order given by channels)
      * \param offset offset in voxel coordinates (order given by channels)
      * \param channels channel order (default: 0,1,2)
      * \param throttle allow only one request at time (default: true)
-     * \param compress enable lz4 compression
+     * \param compress enable compression (lz4 unless set with set_codec)
      * \param roi specify DVID roi to mask GET operation (return 0s outside ROI)
      * \return 3D label object that wraps a byte buffer
     */
@@ -239,6 +533,67 @@ class DVIDNodeService {
             std::vector<unsigned int> channels, bool throttle=true,
             bool compress=true, std::string roi="");
 
+    /*!
+     * Retrieve a 3D 1-byte grayscale volume directly into caller-owned
+     * memory (e.g., a numpy array).  The response is written into
+     * buffer as it arrives (or lz4 decompressed into it when compress
+     * is enabled) so no intermediate copy of the volume is made.
+     * See get_gray3D above for the meaning of the other parameters.
+     * \param datatype_instance name of grayscale type instance
+     * \param dims size of dimensions (order given by channels)
+     * \param offset offset in voxel coordinates (order given by channels)
+     * \param channels channel order (e.g., 0,1,2)
+     * \param buffer destination for the volume
+     * \param capacity number of bytes available in buffer
+     * \param throttle allow only one request at time (default: true)
+     * \param compress enable compression (lz4 unless set with set_codec)
+     * \param roi specify DVID roi to mask GET operation (return 0s outside ROI)
+    */
+    void get_gray3D(std::string datatype_instance, Dims_t dims,
+            std::vector<int> offset, std::vector<unsigned int> channels,
+            uint8* buffer, size_t capacity, bool throttle=true,
+            bool compress=false, std::string roi="");
+
+    /*!
+     * Retrieve a 3D 8-byte label volume directly into caller-owned
+     * memory.  See the grayscale version above.
+     * \param datatype_instance name of the labelblk type instance
+     * \param dims size of dimensions (order given by channels)
+     * \param offset offset in voxel coordinates (order given by channels)
+     * \param channels channel order (e.g., 0,1,2)
+     * \param buffer destination for the volume
+     * \param capacity number of bytes available in buffer
+     * \param throttle allow only one request at time (default: true)
+     * \param compress enable compression (lz4 unless set with set_codec)
+     * \param roi specify DVID roi to mask GET operation (return 0s outside ROI)
+    */
+    void get_labels3D(std::string datatype_instance, Dims_t dims,
+            std::vector<int> offset, std::vector<unsigned int> channels,
+            uint64* buffer, size_t capacity, bool throttle=true,
+            bool compress=true, std::string roi="");
+
+    /*!
+     * Asynchronously retrieve a 3D volume with the specified dimension
+     * size, spatial offset, and channel order.  If the server is busy
+     * (status 503), the request is reissued after a delay.  If compression
+     * is enabled, the lz4 response is decompressed when it arrives,
+     * so the future always holds the uncompressed volume.  The caller
+     * wraps the buffer in a Grayscale3D or Labels3D as appropriate.
+     * \param datatype_instance name of grayscale or labelblk type instance
+     * \param sizes size of dimensions (order given by channels)
+     * \param offset offset in voxel coordinates (order given by channels)
+     * \param channels channel order (e.g., 0,1,2)
+     * \param voxel_size number of bytes per voxel (1 or 8)
+     * \param throttle allow only one request at time
+     * \param compress enable compression (lz4 unless set with set_codec)
+     * \param roi specify DVID roi to mask GET operation (return 0s outside ROI)
+     * \return future for the uncompressed byte buffer of the volume
+    */
+    BinaryDataFuture get_volume3D_async(std::string datatype_instance,
+            Dims_t sizes, std::vector<int> offset,
+            std::vector<unsigned int> channels, unsigned int voxel_size,
+            bool throttle=false, bool compress=false, std::string roi="");
+
     /*
      * Retrieve label id at the specified point.  If no ID is found, return 0.
      * \param datatype_instance name of the labelblk type instance
@@ -260,17 +615,20 @@ class DVIDNodeService {
      * implementation of DVID with hundreds
      * of volume PUTs, we support a throttle command that prevents
      * multiple volume GETs/PUTs from executing at the same time.
-     * The number of voxels put cannot be larger than INT_MAX/8.
+     * Volumes larger than get_max_request_bytes() are split (see
+     * set_max_request_bytes).
      * TODO: expose block size parameter through interface.
      * \param datatype_instance name of the grayscale type instance
      * \param volume grayscale 3D volume encodes dimension sizes and binary buffer 
      * \param offset offset in voxel coordinates (order given by channels)
      * \param throttle allow only one request at time (default: true)
-     * \param compress enable lz4 compression
+     * \param compress enable compression (lz4 unless set with set_codec)
+     * \param level level of the compression codec (0 for its default;
+     * lz4 levels are as in BinaryData::compress_lz4, gzip levels 1-9)
     */
     void put_gray3D(std::string datatype_instance, Grayscale3D const & volume,
             std::vector<int> offset, bool throttle=true,
-            bool compress=false);
+            bool compress=false, int level=0);
 
     /*!
      * Put a 3D 8-byte label volume to DVID with the specified
@@ -282,18 +640,51 @@ class DVIDNodeService {
      * implementation of DVID with hundreds
      * of volume PUTs, we support a throttle command that prevents
      * multiple volume GETs/PUTs from executing at the same time.
-     * The number of voxels put cannot be larger than INT_MAX/8.
+     * Volumes larger than get_max_request_bytes() are split (see
+     * set_max_request_bytes).
      * TODO: expose block size parameter through interface.
      * \param datatype_instance name of the grayscale type instance
      * \param volume label 3D volume encodes dimension sizes and binary buffer 
      * \param offset offset in voxel coordinates (order given by channels)
      * \param throttle allow only one request at time (default: true)
      * \param roi specify DVID roi to mask PUT operation (default: empty)
-     * \param compress enable lz4 compression
+     * \param compress enable compression (lz4 unless set with set_codec)
+     * \param level level of the compression codec (0 for its default;
+     * lz4 levels are as in BinaryData::compress_lz4, gzip levels 1-9)
     */
     void put_labels3D(std::string datatype_instance, Labels3D const & volume,
             std::vector<int> offset, bool throttle=true,
-            bool compress=true, std::string roi="");
+            bool compress=true, std::string roi="", int level=0);
+
+    /*!
+     * Stream a 3D 1-byte grayscale volume to DVID.  The uncompressed
+     * voxels (X, Y, Z order) are pulled from the source as they are
+     * sent, so the volume never needs to be held in memory.  The same
+     * alignment requirements as put_gray3D apply.  If the server is
+     * busy, the source must support rewind to be resent.
+     * \param datatype_instance name of the grayscale type instance
+     * \param sizes X, Y, Z size of the volume
+     * \param offset offset in voxel coordinates
+     * \param source produces sizes[0]*sizes[1]*sizes[2] bytes
+     * \param throttle allow only one request at time (default: true)
+    */
+    void put_gray3D(std::string datatype_instance, Dims_t sizes,
+            std::vector<int> offset, UploadSource& source,
+            bool throttle=true);
+
+    /*!
+     * Stream a 3D 8-byte label volume to DVID.  See the grayscale
+     * version above.
+     * \param datatype_instance name of the labelblk type instance
+     * \param sizes X, Y, Z size of the volume
+     * \param offset offset in voxel coordinates
+     * \param source produces sizes[0]*sizes[1]*sizes[2]*8 bytes
+     * \param throttle allow only one request at time (default: true)
+     * \param roi specify DVID roi to mask PUT operation (default: empty)
+    */
+    void put_labels3D(std::string datatype_instance, Dims_t sizes,
+            std::vector<int> offset, UploadSource& source,
+            bool throttle=true, std::string roi="");
 
     /************** API to access DVID blocks directly **************/
     // This API is probably most relevant for bulk transfers to and
@@ -313,12 +704,28 @@ class DVIDNodeService {
     GrayscaleBlocks get_grayblocks(std::string datatype_instance,
            std::vector<int> block_coords, unsigned int span); 
 
+    /*!
+     * Fetch grayscale blocks from DVID directly into caller-owned memory.
+     * The blocks are written one after the other (each block is X,Y,Z
+     * ordered) in the same layout as GrayscaleBlocks.
+     * \param datatype instance name of grayscale type instance
+     * \param block_coords location of first block in span (block coordinates) (X,Y,Z)
+     * \param span number of blocks to read
+     * \param buffer destination for the blocks
+     * \param capacity number of bytes available in buffer
+    */
+    void get_grayblocks(std::string datatype_instance,
+           std::vector<int> block_coords, unsigned int span,
+           uint8* buffer, size_t capacity);
+
     /*!
      * Fetch label blocks from DVID.  The call will fetch
      * a series of contiguous blocks along the first dimension (X).
      * The number of blocks fetched is encoded in the LabelBlocks
-     * returned structure.
-     * TODO: support compression and throttling.
+     * returned structure.  The blocks are transferred compressed if
+     * a label block codec is set for the (labelarray or labelmap)
+     * instance (see set_codec).
+     * TODO: support throttling.
      * \param datatype instance name of labelblk type instance
      * \param block_coords location of first block in span (block coordinates) (X,Y,Z)
      * \param span number of blocks to attemp to read
@@ -327,6 +734,20 @@ class DVIDNodeService {
     LabelBlocks get_labelblocks(std::string datatype_instance,
            std::vector<int> block_coords, unsigned int span);
 
+    /*!
+     * Asynchronously fetch a span of blocks (grayscale or labels) from
+     * DVID.  The future holds the blocks laid out one after the other
+     * and can be wrapped in GrayscaleBlocks or LabelBlocks.  Label
+     * blocks are transferred compressed if a label block codec is set
+     * for the instance (see set_codec).
+     * \param datatype_instance name of grayscale or labelblk type instance
+     * \param block_coords location of first block in span (block coordinates) (X,Y,Z)
+     * \param span number of blocks to attempt to read
+     * \return future for the array of blocks
+    */
+    BinaryDataFuture get_blocks_async(std::string datatype_instance,
+            std::vector<int> block_coords, int span);
+
     /*!
      * Put grayscale blocks to DVID.   The call will put
      * a series of contiguous blocks along the first spatial dimension (X).
@@ -343,7 +764,9 @@ class DVIDNodeService {
      * Put label blocks to DVID.   The call will put
      * a series of contiguous blocks along the first spatial dimension (X).
      * The number of blocks posted is encoded in LabelBlocks.
-     * TODO: support compression and throttling.
+     * The blocks are transferred compressed if a label block codec
+     * is set for the (labelarray or labelmap) instance (see set_codec).
+     * TODO: support throttling.
      * NOTE: UNTESTED (DVID DOES NOT YET SUPPORT)
      * \param datatype instance name of labelblk type instance
      * \param blocks stores buffer for array of blocks
@@ -365,13 +788,25 @@ class DVIDNodeService {
     
     /*!
      * Put data in a file at a given key location.  It will overwrite
-     * data that exists at the key for the given node version.
+     * data that exists at the key for the given node version.  The
+     * file is streamed from its current position so it is never
+     * loaded into memory.
      * \param keyvalue name of keyvalue instance
      * \param key name of key to the keyvalue instance
      * \param fin file stream that contains binary to store
     */
     void put(std::string keyvalue, std::string key, std::ifstream& fin);
 
+    /*!
+     * Put data produced by an upload source (stream, file descriptor,
+     * or callback) at a given key location.  The data is streamed so
+     * memory use does not depend on the size of the value.
+     * \param keyvalue name of keyvalue instance
+     * \param key name of key to the keyvalue instance
+     * \param source produces the binary to store
+    */
+    void put(std::string keyvalue, std::string key, UploadSource& source);
+
     /*!
      * Put JSON data at a given key location.  It will overwrite data
      * that exists at the key for the given node version.
@@ -388,6 +823,15 @@ class DVIDNodeService {
      * \return binary data stored at key
     */
     BinaryDataPtr get(std::string keyvalue, std::string key);
+
+    /*!
+     * Stream binary data at a given key location to a sink
+     * (e.g., an OStreamSink to write a large value to disk).
+     * \param keyvalue name of keyvalue instance
+     * \param key name of key to the keyvalue instance
+     * \param sink consumer of the value
+    */
+    void get(std::string keyvalue, std::string key, ResponseSink& sink);
     // could return a reference but assuming that this is used for short messages
     
     /*!
@@ -615,6 +1059,74 @@ class DVIDNodeService {
     //! uuid for instance
     const UUID uuid;
 
+    //! determines when failed requests are retried
+    RetryPolicy retry_policy;
+
+    //! merge identical concurrent GET requests
+    bool coalesce_gets;
+
+    //! threads that compress volume slabs
+    int compression_threads;
+
+    //! largest volume transferred in one request
+    uint64 max_request_bytes;
+
+    //! sub-requests of a split volume that run at once
+    int transfer_threads;
+
+    //! codecs selected per instance
+    std::map<std::string, std::string> instance_codecs;
+
+    /*!
+     * Choose the codec for an instance: the selected codec if it has
+     * the capabilities, otherwise the fallback.
+     * \param datatype_instance name of the instance
+     * \param capabilities bitwise or of required CodecCapability flags
+     * \param fallback codec name used otherwise (empty for none)
+     * \return codec (null if none)
+    */
+    CodecPtr negotiate_codec(std::string datatype_instance,
+            unsigned int capabilities, std::string fallback) const;
+
+    /*!
+     * Codec for compressed volume transfers of an instance.
+    */
+    CodecPtr get_volume_codec(std::string datatype_instance) const;
+
+    /*!
+     * Codec for key values of an instance (null if they are stored
+     * as given).
+    */
+    CodecPtr get_key_codec(std::string datatype_instance) const;
+
+    /*!
+     * Codec for label block transfers of an instance (null if the
+     * blocks are sent raw).
+    */
+    CodecPtr get_block_codec(std::string datatype_instance) const;
+
+    /*!
+     * Perform a request for a node endpoint (with retries) and return
+     * the response body.
+     * \param node_endpoint endpoint starting with /node/<uuid>
+     * \param payload binary data to be sent in the request
+     * \param method http verb
+     * \return http response as binary data
+    */
+    BinaryDataPtr fetch_binary(std::string node_endpoint,
+            BinaryDataPtr payload, ConnectionMethod method);
+
+    /*!
+     * Runs a request until it succeeds or the retry policy gives up.
+     * Responses with a retryable status are retried.  Transient
+     * connection errors are retried only if the request is idempotent;
+     * otherwise the DVIDConnectionException is rethrown.
+     * \param attempt performs one attempt and returns the http status
+     * \param idempotent true if repeating the request is safe
+     * \return http status of the last attempt
+    */
+    int perform_with_retry(boost::function<int ()> attempt, bool idempotent);
+
     /*!
      * Helper function to put a 3D volume to DVID with the specified
      * dimension and spatial offset.  THE DIMENSION AND OFFSET ARE
@@ -623,12 +1135,66 @@ class DVIDNodeService {
      * \param volume binary buffer encodes volume 
      * \param offset offset in voxel coordinates (order given by channels)
      * \param throttle allow only one request at time
-     * \param compress enable lz4 compression
+     * \param compress enable compression (lz4 unless set with set_codec)
      * \param roi specify DVID roi to mask PUT operation (default: empty)
+     * \param level level of the compression codec if compress is set
     */
     void put_volume(std::string datatype_instance, BinaryDataPtr volume,
             std::vector<unsigned int> sizes, std::vector<int> offset,
-            bool throttle, bool compress, std::string roi);
+            bool throttle, bool compress, std::string roi, int level);
+
+    /*!
+     * Helper function to post a volume (compressed in the calling
+     * thread if compress is set) in one request.  Arguments are as in
+     * put_volume.
+    */
+    void post_volume(std::string datatype_instance, BinaryDataPtr volume,
+            std::vector<unsigned int> sizes, std::vector<int> offset,
+            bool throttle, bool compress, std::string roi, int level);
+
+    //! a volume split into sub-requests (defined in the source)
+    struct VolumeTransfer;
+
+    /*!
+     * Helper function to transfer a volume larger than
+     * max_request_bytes as block-aligned sub-volumes.  Returns false
+     * (and transfers nothing) if the volume cannot be split.
+     * \param transfer volume, destination or source, and parameters
+    */
+    bool transfer_split_volume(VolumeTransfer& transfer);
+
+    /*!
+     * Worker that transfers the sub-volumes of a split volume until
+     * none are left (the first error is recorded in transfer).  Each
+     * sub-volume is one request compressed in the worker thread.
+    */
+    void transfer_volume_parts(VolumeTransfer* transfer);
+
+    /*!
+     * Helper function to post a volume as lz4 compressed Z slabs
+     * that are compressed on compression_threads threads while
+     * earlier slabs are uploaded.  Arguments are as in put_volume.
+     * \param slab_depth depth of each slab (block aligned)
+    */
+    void put_volume_slabs(std::string datatype_instance,
+            BinaryDataPtr volume, std::vector<unsigned int> sizes,
+            std::vector<int> offset, bool throttle, std::string roi,
+            int level, unsigned int slab_depth);
+
+    /*!
+     * Helper function to stream an uncompressed 3D volume to DVID.
+     * THE DIMENSION AND OFFSET ARE IN VOXEL COORDINATS BUT MUST
+     * BE BLOCK ALIGNED.
+     * \param datatype_instance name of tile type instance
+     * \param source produces the volume
+     * \param offset offset in voxel coordinates (order given by channels)
+     * \param throttle allow only one request at time
+     * \param roi specify DVID roi to mask PUT operation (default: empty)
+     * \param voxel_size number of bytes per voxel
+    */
+    void put_volume(std::string datatype_instance, UploadSource& source,
+            std::vector<unsigned int> sizes, std::vector<int> offset,
+            bool throttle, std::string roi, unsigned int voxel_size);
 
     /*!
      * Helper to retrieve blocks from DVID for labels and grayscale.
@@ -640,6 +1206,39 @@ class DVIDNodeService {
     BinaryDataPtr get_blocks(std::string datatype_instance,
         std::vector<int> block_coords, int span);
 
+    /*!
+     * Helper to construct the REST endpoint for a span of blocks.
+     * \param datatype_instance name of datatype instance
+     * \param block_coords starting block in DVID block coordinates
+     * \param span number of blocks in the span
+     * \return endpoint relative to the node
+    */
+    std::string construct_blocks_uri(std::string datatype_instance,
+        std::vector<int> block_coords, int span);
+
+    /*!
+     * Helper to construct the labelarray/labelmap REST endpoint that
+     * fetches a span of compressed label blocks.
+     * \param datatype_instance name of labelarray or labelmap instance
+     * \param block_coords starting block in DVID block coordinates
+     * \param span number of blocks in the span
+     * \param codec label block compression requested
+     * \return endpoint relative to the node
+    */
+    std::string construct_label_blocks_uri(std::string datatype_instance,
+        std::vector<int> block_coords, int span, CodecPtr codec);
+
+    /*!
+     * Helper to construct the REST endpoint for a tile.
+     * \param datatype_instance name of tile type instance
+     * \param slice specify XY, YZ, or XZ
+     * \param scaling specify zoom level (1=max res)
+     * \param tile_loc X,Y,Z location of tile
+     * \return endpoint relative to the node
+    */
+    std::string construct_tile_uri(std::string datatype_instance,
+            Slice2D slice, unsigned int scaling, std::vector<int> tile_loc);
+
     /*!
      * Helper to put blocks from DVID for labels and grayscale.
      * \param datatype_instance name of datatype instance
@@ -674,7 +1273,7 @@ class DVIDNodeService {
      * \param offset offset in voxel coordinates (order given by channels)
      * \param channels channel order (default: 0,1,2)
      * \param throttle allow only one request at time
-     * \param compress enable lz4 compression
+     * \param compress enable compression (lz4 unless set with set_codec)
      * \param roi specify DVID roi to mask GET operation (return 0s outside ROI)
      * \return byte buffer corresponding to volume
     */
@@ -682,6 +1281,24 @@ class DVIDNodeService {
         std::vector<int> offset, std::vector<unsigned int> channels,
         bool throttle, bool compress, std::string roi);
 
+    /*!
+     * Helper function to retrieve a 3D volume into caller-owned memory.
+     * \param datatype_instance name of tile type instance
+     * \param dims size of dimensions (order given by channels)
+     * \param offset offset in voxel coordinates (order given by channels)
+     * \param channels channel order (default: 0,1,2)
+     * \param throttle allow only one request at time
+     * \param compress enable compression (lz4 unless set with set_codec)
+     * \param roi specify DVID roi to mask GET operation (return 0s outside ROI)
+     * \param buffer destination for the uncompressed volume
+     * \param capacity number of bytes available in buffer
+     * \param voxel_size number of bytes per voxel
+    */
+    void get_volume3D(std::string datatype_inst, Dims_t sizes,
+        std::vector<int> offset, std::vector<unsigned int> channels,
+        bool throttle, bool compress, std::string roi, char* buffer,
+        size_t capacity, unsigned int voxel_size);
+
     /*!
      * Helper function to construct a REST endpoint strign for
      * volume GETs and PUTs given several parameters.
@@ -690,7 +1307,7 @@ class DVIDNodeService {
      * \param offset offset in voxel coordinates (order given by channels)
      * \param channels channel order (default: 0,1,2)
      * \param throttle allow only one request at time
-     * \param compress enable lz4 compression
+     * \param compress enable compression (lz4 unless set with set_codec)
      * \param roi specify DVID roi to mask operation (default: empty)
     */
     std::string construct_volume_uri(std::string datatype_inst, Dims_t sizes,
@@ -0,0 +1,193 @@
+/*!
+ * This file defines an event-driven engine that performs many
+ * http requests concurrently on a single I/O thread using the
+ * curl multi interface.  Users normally access it through
+ * DVIDConnection::make_request_async.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef DVIDREQUESTENGINE_H
+#define DVIDREQUESTENGINE_H
+
+#include "DVIDConnection.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+
+namespace libdvid {
+
+/*!
+ * Process-wide engine that multiplexes asynchronous requests over
+ * one curl multi handle.  The I/O thread is started on the first
+ * submission and stopped when the program exits.  Callbacks are
+ * invoked on the I/O thread.  Requests wait in the queue (without
+ * blocking the I/O thread) while the flow control or scheduler for
+ * their server does not allow them to start; higher priority requests
+ * are started first.  Requests waiting for a scheduler slot are
+ * retried when the scheduler reports a free slot rather than polled.
+ * Callbacks must not wait for other requests on the engine since the
+ * engine cannot make progress until they return.  All functions are
+ * thread-safe.
+*/
+class DVIDRequestEngine {
+  public:
+    /*!
+     * Retrieve the engine for this process.
+     * \return engine singleton
+    */
+    static DVIDRequestEngine& get_engine();
+
+    /*!
+     * Queue a request.  The request is started on the I/O thread
+     * once the delay has elapsed.
+     * \param url full url for the request
+     * \param method http verb (HEAD, GET, POST, PUT, DELETE)
+     * \param payload binary data containing data to be posted
+     * \param type connection type for request
+     * \param timeout timeout in seconds for the request (0 for infinite)
+     * \param callback function called with the response
+     * \param delay seconds to wait before the request is started
+     * \param pool pool for the server (optional), which supplies the
+     * statistics, unix socket, flow control, and scheduler for the request
+     * \param priority lane of the request in the scheduler of the pool
+     * \return id of the request (for cancel)
+    */
+    uint64 submit(std::string url, ConnectionMethod method,
+            BinaryDataPtr payload, ConnectionType type, int timeout,
+            ResponseCallback callback, double delay = 0,
+            DVIDConnectionPoolPtr pool = DVIDConnectionPoolPtr(),
+            RequestPriority priority = NORMAL_PRIORITY);
+
+    /*!
+     * Abandon a request that is queued or in flight.  Its callback is
+     * called on the I/O thread with CURLE_ABORTED_BY_CALLBACK as the
+     * curl code.  Nothing happens if the request already completed.
+     * \param id id returned by submit
+    */
+    void cancel(uint64 id);
+
+    /*!
+     * True if called on the I/O thread (i.e., from a callback).
+    */
+    bool in_io_thread();
+
+    /*!
+     * Limit the number of connections opened to a single host.
+     * Requests beyond the limit are queued by curl.
+     * \param max_connections connection cap (0 for no limit)
+    */
+    void set_max_host_connections(int max_connections);
+
+    /*!
+     * Number of requests queued or in flight.
+     * \return outstanding requests
+    */
+    int num_outstanding();
+
+    /*!
+     * Stops the I/O thread.  Outstanding requests are abandoned.
+    */
+    ~DVIDRequestEngine();
+
+    //! default cap on connections opened to each host
+    static const int DEFAULT_MAX_HOST_CONNECTIONS = 128;
+
+  private:
+    //! State for a single request
+    struct Request;
+    struct HigherPriority;
+
+    //! Requests waiting for a slot of one scheduler (FIFO by lane)
+    struct SlotQueue {
+        std::deque<Request*> lanes[NUM_PRIORITIES];
+    };
+
+    DVIDRequestEngine();
+    DVIDRequestEngine(const DVIDRequestEngine&);
+    DVIDRequestEngine& operator=(const DVIDRequestEngine&);
+
+    //! Main loop of the I/O thread
+    void run();
+
+    //! Add requests whose delay has expired to the multi handle
+    void start_ready_requests();
+
+    //! Apply flow control (requeues the request if it cannot start)
+    bool admit_request(Request* request);
+
+    //! Abandon the requests passed to cancel
+    void cancel_requests();
+
+    //! Start requests that were given a slot by a woken scheduler
+    void start_slot_waiters(RequestScheduler* scheduler,
+            std::vector<Request*>& started);
+
+    //! Add an admitted request to the multi handle
+    void start_request(Request* request);
+
+    //! Schedule a retry of the requests waiting for the scheduler
+    void wake_scheduler(RequestScheduler* scheduler);
+
+    //! Deliver responses for completed transfers
+    void finish_completed_requests();
+
+    //! Configure a curl handle for the request
+    void* prepare_handle(Request* request);
+
+    //! curl multi handle (CURLM is a void)
+    void* multi_handle;
+
+    //! recycled easy handles
+    std::vector<void*> idle_handles;
+
+    //! requests waiting to be started ordered by start time
+    std::multimap<double, Request*> pending;
+
+    //! requests added to the multi handle keyed by easy handle
+    std::map<void*, Request*> active;
+
+    //! requests waiting for a scheduler slot (used by the I/O thread)
+    std::map<RequestScheduler*, SlotQueue> slot_waiters;
+
+    //! number of requests in slot_waiters
+    int num_slot_waiters;
+
+    //! schedulers that reported a free slot since the last retry
+    std::set<RequestScheduler*> woken_schedulers;
+
+    //! last time every scheduler with waiters was retried
+    double last_slot_check;
+
+    //! id of the next request submitted
+    uint64 next_id;
+
+    //! ids of requests to cancel
+    std::vector<uint64> cancelled_ids;
+
+    //! cap on connections to a single host
+    int max_host_connections;
+
+    //! true if the cap needs to be pushed to the multi handle
+    bool max_host_connections_dirty;
+
+    //! set when the engine is destroyed
+    bool stopping;
+
+    //! protects pending, active, num_slot_waiters, woken_schedulers,
+    //! next_id, cancelled_ids, stopping, and configuration
+    boost::mutex mutex;
+
+    //! I/O thread (created on first submit)
+    boost::shared_ptr<boost::thread> io_thread;
+};
+
+}
+
+#endif
@@ -2,8 +2,7 @@
  * This file defines API for accessing the DVID server REST interface.
  * Only a subset of the REST interface is implemented.
  *
- * Note: to be thread safe intantiate a unique server service object
- * for each thread.
+ * Note: a server service can be shared by multiple threads.
  *
  * TODO: expand API (such as retrieving all repos on the server) and 
  * load server meta on initialization.
@@ -26,7 +25,7 @@ class DVIDServerService {
   public:
     /*!
      * Constructor takes http address of DVID server.
-     * \param addr_ DVID address
+     * \param addr_ DVID address (or unix:///path/to/socket)
     */
     explicit DVIDServerService(std::string addr_);
     
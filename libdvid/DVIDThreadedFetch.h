@@ -3,14 +3,13 @@
  * pieces of data from DVID in a more efficient way.  To this end,
  * it supports the ability to fetch data in parallel.  If threading
  * is enabled, the DVID backend should ideally be a distributed one.
+ * All threads share the provided node service (and its connection pool).
  *
  * \author Stephen Plaza (plazas@janelia.hhmi.org)
 */
 #ifndef THREADEDFETCH 
 #define THREADEDFETCH
 
-// TODO: implement a copy constructor for DVIDNodeService
-
 #include "DVIDNodeService.h"
 
 namespace libdvid {
@@ -68,13 +67,30 @@ void put_labelblocks(DVIDNodeService& service, std::string labelsname,
  * \param orientation specify XY, YZ, or XZ
  * \param scaling specify zoom level (1=max res)
  * \param tile_locs_array e.g., X,Y,Z location of tile (X and Y are in block coordinates)
- * \param num_threads num_threads to use (0 means use as many as tiles)
+ * \param num_threads num_threads to use (0 means issue all requests
+ * concurrently on the asynchronous request engine)
  * \return byte buffer array with order the same as tiles requested
 */
 std::vector<BinaryDataPtr> get_tile_array_binary(DVIDNodeService& service,
         std::string datatype_instance, Slice2D orientation, unsigned int scaling,
         const std::vector<std::vector<int> >& tile_locs_array, int num_threads=0);
 
+/*!
+ * Decodes JPEG or PNG tiles (e.g., from get_tile_array_binary) in
+ * parallel into one contiguous 8-bit buffer.  Tile i is written at
+ * output + i*tile_width*tile_height.  Each thread reuses its JPEG
+ * decompressor and the format of each tile is determined from its
+ * magic bytes.
+ * \param tiles encoded tiles (each must decode to tile_width x tile_height)
+ * \param tile_width width of every tile
+ * \param tile_height height of every tile
+ * \param output destination with room for all of the tiles
+ * \param num_threads number of threads (0 uses the number of cores)
+*/
+void decode_tile_array(const std::vector<BinaryDataPtr>& tiles,
+        unsigned int tile_width, unsigned int tile_height, byte* output,
+        int num_threads=0);
+
 }
 
 #endif
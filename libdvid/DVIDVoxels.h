@@ -42,17 +42,11 @@ class DVIDVoxels {
      * buffer of a certain length and associates it with
      * a volume of the provided dimensions.
      * \param array_ buffer to be copied
-     * \param length number of bytes in buffer
+     * \param length number of voxels in buffer
      * \param dims_ dimension sizes for the volume
     */ 
-    DVIDVoxels(const T* array_, unsigned int length, Dims_t& dims_)
+    DVIDVoxels(const T* array_, uint64 length, Dims_t& dims_)
                : dims(dims_) {
-        uint64 total_size = uint64(dims_[0])*uint64(dims_[1])*
-            uint64(dims_[2])*uint64(sizeof(T)); 
-        if (total_size > INT_MAX) {
-            throw ErrMsg("Cannot allocate larger than INT_MAX");
-        }
-
         data = BinaryData::create_binary_data((const char*) array_,
                                                 length*sizeof(T));
         if (dims.size() != N) {
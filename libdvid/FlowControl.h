@@ -0,0 +1,195 @@
+/*!
+ * This file defines client-side flow control for the requests made
+ * to a DVID server.  Token buckets cap the request rate and the
+ * bandwidth, and an AIMD (additive increase, multiplicative decrease)
+ * controller limits the number of requests in flight.  The controller
+ * grows the limit while the server responds quickly and shrinks it
+ * when the server reports that it is busy (503) or its latency rises,
+ * so large jobs can run as fast as the server allows without
+ * overloading it.
+ *
+ * Flow control is disabled by default.  It is shared by all
+ * connections to the same server (see DVIDConnectionPool).
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef FLOWCONTROL_H
+#define FLOWCONTROL_H
+
+#include "Globals.h"
+#include "RequestStats.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace libdvid {
+
+/*!
+ * Token bucket that refills at a fixed rate up to a burst size.
+ * Reservations may take more tokens than are available; the balance
+ * then becomes negative and later reservations wait until it is
+ * repaid.  Not thread-safe (FlowController serializes access).
+*/
+class TokenBucket {
+  public:
+    TokenBucket() : rate(0), burst(0), tokens(0), last_refill(0) {}
+
+    /*!
+     * Change the refill rate.
+     * \param rate_ tokens per second (0 for no limit)
+     * \param burst_ largest balance (0 for one second of tokens)
+    */
+    void set_rate(double rate_, double burst_);
+
+    /*!
+     * Get the refill rate (0 if there is no limit).
+    */
+    double get_rate() const
+    {
+        return rate;
+    }
+
+    /*!
+     * Take tokens from the bucket.
+     * \param amount number of tokens
+     * \param now current time in seconds
+     * \return seconds the caller should wait before proceeding
+    */
+    double reserve(double amount, double now);
+
+  private:
+    //! add the tokens accrued since the last refill
+    void refill(double now);
+
+    double rate;
+    double burst;
+    double tokens;
+    double last_refill;
+};
+
+/*!
+ * Flow control for one DVID server.  Callers reserve capacity before
+ * a request (reserve) and report the outcome afterwards (end).  The
+ * concurrency limit is enforced by the RequestScheduler for the
+ * server.  All functions are thread-safe.
+*/
+class FlowController {
+  public:
+    FlowController();
+
+    /*!
+     * Cap the number of requests started per second.
+     * \param requests_per_second rate (0 for no limit)
+     * \param burst requests that can be started at once (0 for one
+     * second of requests)
+    */
+    void set_request_rate(double requests_per_second, double burst = 0);
+
+    /*!
+     * Cap the bytes sent and received per second.  Uploads are charged
+     * before the request starts and downloads when it completes.
+     * \param bytes_per_second rate (0 for no limit)
+     * \param burst bytes that can be transferred at once (0 for one
+     * second of bytes)
+    */
+    void set_byte_rate(double bytes_per_second, double burst = 0);
+
+    /*!
+     * Enable the adaptive concurrency limit.  The limit starts at
+     * min_limit and doubles as requests complete (slow start) until
+     * the first sign of congestion; afterwards it grows by one for
+     * each limit's worth of completed requests.  It is halved (at
+     * most once per round trip) when the server responds with 503,
+     * a connection fails, or the smoothed time to first byte exceeds
+     * latency_tolerance times the lowest smoothed value seen.
+     * \param min_limit_ smallest limit (at least 1)
+     * \param max_limit_ largest limit
+     * \param latency_tolerance_ allowed latency growth (e.g., 2.0)
+    */
+    void enable_adaptive(int min_limit_ = 1, int max_limit_ = 64,
+            double latency_tolerance_ = 2.0);
+
+    /*!
+     * Disable the concurrency limit.
+    */
+    void disable_adaptive();
+
+    /*!
+     * True if any limit is enabled.
+    */
+    bool is_enabled();
+
+    /*!
+     * Reserve a request and the upload bandwidth.
+     * \param upload_bytes size of the request body
+     * \return seconds the caller should wait before starting
+    */
+    double reserve(uint64 upload_bytes);
+
+    /*!
+     * Update the concurrency limit and bandwidth with the outcome
+     * of a request.
+     * \param status http status (ignored if failed)
+     * \param failed true if the connection failed
+     * \param timing timing of the request
+    */
+    void end(int status, bool failed, const RequestTiming& timing);
+
+    /*!
+     * Current concurrency limit (0 if adaptive control is disabled).
+    */
+    int get_concurrency_limit();
+
+    /*!
+     * Number of times the concurrency limit was decreased.
+    */
+    uint64 get_num_decreases();
+
+  private:
+    FlowController(const FlowController&);
+    FlowController& operator=(const FlowController&);
+
+    //! bucket for request starts
+    TokenBucket request_bucket;
+
+    //! bucket for bytes
+    TokenBucket byte_bucket;
+
+    //! true if the concurrency limit is enforced
+    bool adaptive;
+
+    //! bounds on the limit
+    int min_limit, max_limit;
+
+    //! allowed growth of latency over the baseline
+    double latency_tolerance;
+
+    //! current concurrency limit
+    double limit;
+
+    //! true until the first decrease
+    bool slow_start;
+
+    //! smoothed time to first byte (seconds)
+    double smoothed_latency;
+
+    //! lowest smoothed time to first byte seen (seconds)
+    double baseline_latency;
+
+    //! time of the last decrease
+    double last_decrease;
+
+    //! number of decreases
+    uint64 num_decreases;
+
+    //! protects all state
+    boost::mutex mutex;
+};
+
+//! Declares smart pointer type for a flow controller
+typedef boost::shared_ptr<FlowController> FlowControllerPtr;
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*!
+ * This file defines a codec for DVID's compressed label block format.
+ * A block of 64-bit labels is stored as a table of the labels in the
+ * block followed, for each 8x8x8 sub-block, by a table of indices into
+ * the block table and the voxels packed as indices into the sub-block
+ * table (ceil(log2(n)) bits per voxel for n labels).  Blocks with a
+ * few dozen labels shrink 10-50x; solid blocks are stored as a single
+ * label.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef LABELBLOCKCODEC_H
+#define LABELBLOCKCODEC_H
+
+#include "Codec.h"
+#include "Globals.h"
+
+#include <string>
+
+namespace libdvid {
+
+/*!
+ * Encodes blocks of uint64 labels (each X,Y,Z ordered) as a sequence
+ * of DVID compressed label blocks.  The serialization of one block is
+ * (all values little-endian):
+ *
+ *  3 x uint32  number of sub-blocks in X, Y, and Z
+ *  uint32      number of labels in the block (N)
+ *  N x uint64  labels in the block
+ *
+ * and, unless N is 1 (a solid block):
+ *
+ *  Nsb x uint16    number of labels in each sub-block (Ns[i]), sub-blocks
+ *                  X,Y,Z ordered
+ *  sum(Ns) x uint32  indices into the block labels for each sub-block
+ *  packed bits     for each sub-block, the 512 X,Y,Z ordered voxels as
+ *                  ceil(log2(Ns[i])) bit indices into the sub-block
+ *                  labels, most significant bit first
+ *
+ * The encoded blocks are self-delimiting so a span of blocks is just
+ * their concatenation.  The codec is registered as "blocks", the
+ * compression DVID uses for label block transfers.
+ *
+ * With SSE2, 1, 2, 4, and 8 bit indices are packed and unpacked with
+ * vector shifts; other widths use a scalar bit accumulator.  Mapping
+ * the unpacked indices to labels stays scalar since it is a gather.
+*/
+class LabelBlockCodec : public Codec {
+  public:
+    /*!
+     * Codec for cubic blocks of the given size (a multiple of 8).
+    */
+    explicit LabelBlockCodec(unsigned int block_size_ = DEFBLOCKSIZE);
+
+    std::string get_name() const
+    {
+        return "blocks";
+    }
+
+    unsigned int get_capabilities() const
+    {
+        return CODEC_ENCODE | CODEC_DECODE | CODEC_LOSSLESS |
+            CODEC_LABEL_BLOCKS;
+    }
+
+    /*!
+     * Encode a span of label blocks.  Throws if the data is not a
+     * whole number of blocks.  The level is ignored.
+    */
+    BinaryDataPtr encode(const BinaryDataPtr binary, int level = 0) const;
+
+    /*!
+     * Decode a span of label blocks (decoded_size is optional).
+    */
+    BinaryDataPtr decode(const BinaryDataPtr binary,
+            uint64 decoded_size = 0) const;
+
+    /*!
+     * Decode a span of label blocks into caller-owned memory.
+    */
+    void decode(const BinaryDataPtr binary, byte* output,
+            uint64 decoded_size) const;
+
+    /*!
+     * Append the encoding of one block.
+     * \param labels block_size^3 labels (X,Y,Z ordered)
+     * \param output encoded block is appended here
+    */
+    void encode_block(const uint64* labels, std::string& output) const;
+
+    /*!
+     * Decode one block.  Throws if the data is malformed.
+     * \param data encoded data starting at a block
+     * \param length bytes available at data
+     * \param labels destination for block_size^3 labels
+     * \return number of bytes consumed
+    */
+    size_t decode_block(const byte* data, size_t length,
+            uint64* labels) const;
+
+    /*!
+     * Size of one decoded block in bytes.
+    */
+    size_t get_block_bytes() const
+    {
+        return size_t(block_size) * block_size * block_size *
+            sizeof(uint64);
+    }
+
+  private:
+    //! voxels along each dimension of a block
+    unsigned int block_size;
+};
+
+}
+
+#endif
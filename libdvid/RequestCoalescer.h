@@ -0,0 +1,86 @@
+/*!
+ * This file defines a helper that merges identical concurrent
+ * requests ("single flight").  When several threads request the
+ * same resource at the same time, only the first performs the
+ * request and the others wait for and share its result.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef REQUESTCOALESCER_H
+#define REQUESTCOALESCER_H
+
+#include "BinaryData.h"
+#include "Globals.h"
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/atomic.hpp>
+#include <map>
+#include <string>
+
+namespace libdvid {
+
+/*!
+ * Tracks requests in flight by key.  Results are only shared
+ * between calls that overlap in time; nothing is cached after
+ * a request completes.  All functions are thread-safe.
+*/
+class RequestCoalescer {
+  public:
+    RequestCoalescer() : num_fetches(0), num_shared(0) {}
+
+    /*!
+     * Run fetch unless a call with the same key is in flight, in
+     * which case wait for that call and return its result.  If the
+     * fetch throws, every waiter receives a copy of the exception (an
+     * ErrMsg for exceptions that are not std::exception, which the
+     * caller that ran the fetch receives unchanged).
+     * Note: all waiters receive the same BinaryDataPtr and should
+     * not modify it.
+     * \param key identifies the request (e.g., endpoint and query)
+     * \param fetch performs the request
+     * \return result of the request
+    */
+    BinaryDataPtr run(const std::string& key,
+            boost::function<BinaryDataPtr ()> fetch);
+
+    /*!
+     * Number of requests actually performed.
+    */
+    uint64 get_num_fetches() const
+    {
+        return num_fetches.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Number of calls that shared the result of another call.
+    */
+    uint64 get_num_shared() const
+    {
+        return num_shared.load(boost::memory_order_relaxed);
+    }
+
+  private:
+    RequestCoalescer(const RequestCoalescer&);
+    RequestCoalescer& operator=(const RequestCoalescer&);
+
+    //! results of the requests in flight
+    std::map<std::string, boost::shared_future<BinaryDataPtr> > in_flight;
+
+    //! protects in_flight
+    boost::mutex mutex;
+
+    //! counters
+    boost::atomic<uint64> num_fetches;
+    boost::atomic<uint64> num_shared;
+};
+
+//! Declares smart pointer type for a coalescer
+typedef boost::shared_ptr<RequestCoalescer> RequestCoalescerPtr;
+
+}
+
+#endif
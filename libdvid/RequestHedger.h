@@ -0,0 +1,163 @@
+/*!
+ * This file defines the policy for hedged reads.  A hedged GET that
+ * has not completed after a percentile of the recent latency for its
+ * endpoint family is sent a second time, and whichever response
+ * arrives first is used.  A few slow requests (e.g., a stalled
+ * connection or a busy server thread) then no longer dominate the
+ * tail latency of tile, block, and volume reads.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef REQUESTHEDGER_H
+#define REQUESTHEDGER_H
+
+#include "RequestStats.h"
+#include "Globals.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
+
+namespace libdvid {
+
+/*!
+ * Decides when hedged requests to one server are duplicated and
+ * counts how often the duplicate (the hedge) is sent and wins.  The
+ * delay before a hedge is the given percentile of the total request
+ * time recorded in the request statistics of the server (so it
+ * follows the latency since the statistics were last reset).  The
+ * histograms have power-of-two buckets so the delay is rounded up to
+ * the next power of two microseconds.  No hedge is sent until enough
+ * requests of a family have been recorded, and the number of hedges
+ * is capped at a fraction of the hedged requests so that hedging
+ * cannot double the load on a slow server.  The losing request is
+ * cancelled once the winner responds.  All functions are thread-safe.
+ *
+ * The defaults hedge after the 95th percentile with a budget of 10%
+ * of the requests once 20 requests of a family have completed.
+*/
+class RequestHedger {
+  public:
+    /*!
+     * \param stats_ statistics that supply the latency percentiles
+    */
+    explicit RequestHedger(RequestStatsPtr stats_);
+
+    /*!
+     * Set the latency percentile after which a hedge is sent.
+     * \param fraction percentile between 0 and 1 (e.g., 0.95)
+    */
+    void set_percentile(double fraction);
+
+    /*!
+     * Get the latency percentile after which a hedge is sent.
+    */
+    double get_percentile();
+
+    /*!
+     * Set the number of completed requests of a family needed before
+     * its requests are hedged.
+    */
+    void set_min_samples(uint64 min_samples_);
+
+    /*!
+     * Bound the delay before a hedge.
+     * \param min_delay_ shortest delay in seconds
+     * \param max_delay_ longest delay in seconds
+    */
+    void set_delay_bounds(double min_delay_, double max_delay_);
+
+    /*!
+     * Cap the hedges sent to a fraction of the hedged requests.
+     * \param fraction budget between 0 and 1
+    */
+    void set_budget(double fraction);
+
+    /*!
+     * Determine the delay before a request of the family is hedged
+     * and count the request if it will be hedged.
+     * \param family endpoint family of the request
+     * \return delay in seconds (negative if the request should
+     * not be hedged)
+    */
+    double begin_request(EndpointFamily family);
+
+    /*!
+     * Decide whether a hedge may be sent once the delay of a request
+     * expired, and count it if so.
+     * \return true if the budget allows a hedge
+    */
+    bool try_hedge();
+
+    /*!
+     * Count a hedge that responded before the original request.
+    */
+    void record_hedge_win()
+    {
+        ++num_hedge_wins;
+    }
+
+    /*!
+     * Number of requests that were eligible for a hedge.
+    */
+    uint64 get_num_requests() const
+    {
+        return num_requests.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Number of hedges sent.
+    */
+    uint64 get_num_hedges() const
+    {
+        return num_hedges.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Number of hedges that responded before the original request.
+    */
+    uint64 get_num_hedge_wins() const
+    {
+        return num_hedge_wins.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Clear the counters.
+    */
+    void reset();
+
+  private:
+    RequestHedger(const RequestHedger&);
+    RequestHedger& operator=(const RequestHedger&);
+
+    //! source of the latency histograms
+    RequestStatsPtr stats;
+
+    //! latency percentile that triggers a hedge
+    double percentile;
+
+    //! requests of a family needed before hedging
+    uint64 min_samples;
+
+    //! bounds on the delay (seconds)
+    double min_delay, max_delay;
+
+    //! largest fraction of requests that are hedged
+    double budget;
+
+    //! protects the settings
+    boost::mutex mutex;
+
+    //! counters
+    boost::atomic<uint64> num_requests;
+    boost::atomic<uint64> num_hedges;
+    boost::atomic<uint64> num_hedge_wins;
+};
+
+//! Declares smart pointer type for a hedging policy
+typedef boost::shared_ptr<RequestHedger> RequestHedgerPtr;
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+/*!
+ * This file defines the scheduler that decides which requests to a
+ * DVID server may start.  Requests are placed in one of three
+ * priority lanes.  When a connection becomes free, waiting requests
+ * in a higher lane are always dispatched before those in a lower
+ * lane, and each lane may only occupy a bounded share of the
+ * connections so that bulk jobs leave room for interactive requests.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef REQUESTSCHEDULER_H
+#define REQUESTSCHEDULER_H
+
+#include "FlowControl.h"
+#include "Globals.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace libdvid {
+
+//! Priority lanes (highest first)
+enum RequestPriority { INTERACTIVE_PRIORITY, NORMAL_PRIORITY, BULK_PRIORITY,
+    NUM_PRIORITIES };
+
+//! Called when a waiting request may be able to start
+typedef boost::function<void ()> SlotListener;
+
+/*!
+ * Counts the requests in flight to one server by lane.  A request in
+ * a lane may start if (1) fewer requests than the capacity are in
+ * flight, (2) the lane is below its share of the capacity, and
+ * (3) no request in a higher lane is waiting (new requests also queue
+ * behind requests waiting in their own lane).  The capacity is the
+ * smaller of the configured capacity and the concurrency limit of the
+ * flow controller (if enabled).  All functions are thread-safe.
+*/
+class RequestScheduler {
+  public:
+    /*!
+     * \param capacity_ requests that may be in flight at once
+     * \param flow_ flow control that may lower the capacity (optional)
+    */
+    RequestScheduler(int capacity_,
+            FlowControllerPtr flow_ = FlowControllerPtr());
+
+    /*!
+     * Change the number of requests that may be in flight at once.
+     * \param capacity_ capacity (must be positive)
+    */
+    void set_capacity(int capacity_);
+
+    /*!
+     * Get the configured capacity.
+    */
+    int get_capacity();
+
+    /*!
+     * Limit the fraction of the capacity that a lane may occupy.
+     * A lane always gets at least one request in flight.  By default
+     * interactive requests may use all connections, normal requests
+     * 90%, and bulk requests 50%.
+     * \param priority lane
+     * \param fraction share between 0 and 1
+    */
+    void set_lane_share(RequestPriority priority, double fraction);
+
+    /*!
+     * Get the fraction of the capacity that a lane may occupy.
+    */
+    double get_lane_share(RequestPriority priority);
+
+    /*!
+     * Wait until a request in the lane may start.
+     * \param priority lane
+    */
+    void acquire(RequestPriority priority);
+
+    /*!
+     * Start a request in the lane if allowed.  Callers that poll
+     * (rather than block) pass the same waiting flag on every attempt
+     * so that their request counts as waiting between attempts.
+     * \param priority lane
+     * \param waiting set while the caller is registered as waiting
+     * \return true if the request may start
+    */
+    bool try_acquire(RequestPriority priority, bool& waiting);
+
+    /*!
+     * Stop waiting without starting (for a caller of try_acquire that
+     * gives up).
+     * \param priority lane
+     * \param waiting flag passed to try_acquire
+    */
+    void abandon(RequestPriority priority, bool& waiting);
+
+    /*!
+     * Finish a request started in the lane.
+     * \param priority lane
+    */
+    void release(RequestPriority priority);
+
+    /*!
+     * Call a function whenever a waiting request may be able to start
+     * (a request finished, a waiter started or gave up, or the limits
+     * changed).  Callers of try_acquire use this instead of polling.
+     * The function is called without the scheduler locked and must not
+     * block.  Only one listener is kept.
+     * \param listener function to call (empty to remove the listener)
+    */
+    void set_slot_listener(SlotListener listener);
+
+    /*!
+     * Number of requests in flight in a lane.
+    */
+    int get_in_flight(RequestPriority priority);
+
+    /*!
+     * Number of requests waiting in a lane.
+    */
+    int get_waiting(RequestPriority priority);
+
+    /*!
+     * Number of requests started in a lane.
+    */
+    uint64 get_num_dispatched(RequestPriority priority);
+
+    /*!
+     * Name of a lane (e.g., "interactive").
+    */
+    static const char* get_priority_name(RequestPriority priority);
+
+  private:
+    RequestScheduler(const RequestScheduler&);
+    RequestScheduler& operator=(const RequestScheduler&);
+
+    /*!
+     * True if a request in the lane may start (mutex must be held).
+     * \param priority lane
+     * \param queued true if the request is counted as waiting
+    */
+    bool can_start(RequestPriority priority, bool queued);
+
+    /*!
+     * Wake blocked waiters (mutex must be held).
+     * \return listener to call once the mutex is released
+    */
+    SlotListener slot_freed();
+
+    //! configured capacity
+    int capacity;
+
+    //! share of the capacity for each lane
+    double shares[NUM_PRIORITIES];
+
+    //! requests in flight by lane
+    int in_flight[NUM_PRIORITIES];
+
+    //! total requests in flight
+    int total_in_flight;
+
+    //! waiting requests by lane
+    int waiting[NUM_PRIORITIES];
+
+    //! requests started by lane
+    uint64 dispatched[NUM_PRIORITIES];
+
+    //! flow control that may lower the capacity
+    FlowControllerPtr flow;
+
+    //! protects all state
+    boost::mutex mutex;
+
+    //! signals that a request finished
+    boost::condition_variable slot_available;
+
+    //! notified along with slot_available
+    SlotListener slot_listener;
+};
+
+//! Declares smart pointer type for a scheduler
+typedef boost::shared_ptr<RequestScheduler> RequestSchedulerPtr;
+
+}
+
+#endif
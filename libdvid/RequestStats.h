@@ -0,0 +1,257 @@
+/*!
+ * This file defines counters and latency histograms for the http
+ * requests made to a DVID server.  Timings are taken from libcurl
+ * for every request and aggregated by the kind of endpoint
+ * requested so that it is possible to see where time is spent
+ * (e.g., DNS, connecting, waiting for the server, transferring).
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef REQUESTSTATS_H
+#define REQUESTSTATS_H
+
+#include "Globals.h"
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <json/value.h>
+#include <string>
+
+namespace libdvid {
+
+//! Groups of DVID endpoints that are tracked separately
+enum EndpointFamily { BLOCKS_ENDPOINT, RAW_ENDPOINT, TILE_ENDPOINT,
+    SPARSEVOL_COARSE_ENDPOINT, GRAPH_ENDPOINT, KEYVALUE_ENDPOINT,
+    OTHER_ENDPOINT, NUM_ENDPOINT_FAMILIES };
+
+//! Phases of a request reported by libcurl (cumulative from the start)
+enum TimingPhase { NAMELOOKUP_TIME, CONNECT_TIME, PRETRANSFER_TIME,
+    STARTTRANSFER_TIME, TOTAL_TIME, NUM_TIMING_PHASES };
+
+/*!
+ * Timing of a single request.  Times are in seconds since the
+ * request started (the libcurl CURLINFO_*_TIME values).
+*/
+struct RequestTiming {
+    RequestTiming() : bytes_sent(0), bytes_received(0)
+    {
+        for (int i = 0; i < NUM_TIMING_PHASES; ++i) {
+            times[i] = 0;
+        }
+    }
+
+    //! seconds at the end of each phase
+    double times[NUM_TIMING_PHASES];
+
+    //! request body bytes uploaded
+    uint64 bytes_sent;
+
+    //! response body bytes downloaded
+    uint64 bytes_received;
+};
+
+/*!
+ * Read the timing of the last transfer made by a curl handle.
+ * \param curl_handle curl easy handle (CURL is a void)
+ * \return timing of the transfer
+*/
+RequestTiming get_request_timing(void* curl_handle);
+
+/*!
+ * Histogram of non-negative values with power-of-two buckets.
+ * Bucket 0 counts 0, bucket i counts [2^(i-1), 2^i).  Recording
+ * is lock-free so it can be shared by all threads.  Percentiles
+ * are approximate (the upper bound of the bucket is reported).
+*/
+class LogHistogram {
+  public:
+    LogHistogram();
+
+    /*!
+     * Add a value to the histogram.
+    */
+    void record(uint64 value);
+
+    /*!
+     * Number of values recorded.
+    */
+    uint64 get_count() const
+    {
+        return count.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Sum of all values recorded.
+    */
+    uint64 get_sum() const
+    {
+        return sum.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Largest value recorded.
+    */
+    uint64 get_max() const
+    {
+        return max_value.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Average of the values recorded (0 if none).
+    */
+    double get_mean() const;
+
+    /*!
+     * Estimate the value below which the given fraction of the
+     * recorded values fall.
+     * \param fraction between 0 and 1 (e.g., 0.99)
+     * \return upper bound of the bucket containing the percentile
+    */
+    uint64 get_percentile(double fraction) const;
+
+    /*!
+     * Number of values in a bucket.
+    */
+    uint64 get_bucket(int bucket) const
+    {
+        return buckets[bucket].load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Clear all values.
+    */
+    void reset();
+
+    /*!
+     * Summarize the histogram as count, mean, max, and percentiles.
+    */
+    Json::Value to_json() const;
+
+    //! number of buckets (covers all 64 bit values)
+    static const int NUM_BUCKETS = 65;
+
+  private:
+    LogHistogram(const LogHistogram&);
+    LogHistogram& operator=(const LogHistogram&);
+
+    boost::atomic<uint64> buckets[NUM_BUCKETS];
+    boost::atomic<uint64> count;
+    boost::atomic<uint64> sum;
+    boost::atomic<uint64> max_value;
+};
+
+/*!
+ * Request statistics for one DVID server.  Each endpoint family has
+ * a request and failure count, byte counts, and a histogram (in
+ * microseconds) for each timing phase.  Recording is lock-free.
+ * There is one instance per server address owned by the connection
+ * pool (see DVIDConnectionPool::get_stats).
+*/
+class RequestStats {
+  public:
+    RequestStats() {}
+
+    /*!
+     * Determine the family of a DVID endpoint from its action
+     * (e.g., /node/<uuid>/<instance>/blocks/... is BLOCKS_ENDPOINT).
+     * \param endpoint endpoint relative to the api root or a full url
+     * \return endpoint family
+    */
+    static EndpointFamily classify_endpoint(const std::string& endpoint);
+
+    /*!
+     * Name used for the family when dumped (e.g., "blocks").
+    */
+    static const char* get_family_name(EndpointFamily family);
+
+    /*!
+     * Name used for the phase when dumped (e.g., "connect").
+    */
+    static const char* get_phase_name(TimingPhase phase);
+
+    /*!
+     * Add a completed request.
+     * \param family endpoint family of the request
+     * \param timing timing reported by curl
+     * \param failed true if the transfer did not complete
+    */
+    void record(EndpointFamily family, const RequestTiming& timing,
+            bool failed);
+
+    /*!
+     * Latency histogram in microseconds for a family and phase.
+    */
+    const LogHistogram& get_histogram(EndpointFamily family,
+            TimingPhase phase) const
+    {
+        return families[family].phases[phase];
+    }
+
+    //! Number of requests made for a family
+    uint64 get_num_requests(EndpointFamily family) const
+    {
+        return families[family].requests.load(boost::memory_order_relaxed);
+    }
+
+    //! Number of requests whose transfer failed for a family
+    uint64 get_num_failures(EndpointFamily family) const
+    {
+        return families[family].failures.load(boost::memory_order_relaxed);
+    }
+
+    //! Request body bytes sent for a family
+    uint64 get_bytes_sent(EndpointFamily family) const
+    {
+        return families[family].bytes_sent.load(boost::memory_order_relaxed);
+    }
+
+    //! Response body bytes received for a family
+    uint64 get_bytes_received(EndpointFamily family) const
+    {
+        return families[family].bytes_received.load(
+                boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Clear all statistics.  Requests that complete during the
+     * reset may be partially counted.
+    */
+    void reset();
+
+    /*!
+     * Statistics for every family that has requests as a JSON object
+     * keyed by family name.  Times are in microseconds.
+    */
+    Json::Value to_json() const;
+
+    /*!
+     * Formatted JSON of to_json.
+    */
+    std::string dump_json() const;
+
+  private:
+    RequestStats(const RequestStats&);
+    RequestStats& operator=(const RequestStats&);
+
+    //! Statistics for one endpoint family
+    struct FamilyStats {
+        FamilyStats() : requests(0), failures(0), bytes_sent(0),
+            bytes_received(0) {}
+
+        boost::atomic<uint64> requests;
+        boost::atomic<uint64> failures;
+        boost::atomic<uint64> bytes_sent;
+        boost::atomic<uint64> bytes_received;
+        LogHistogram phases[NUM_TIMING_PHASES];
+    };
+
+    FamilyStats families[NUM_ENDPOINT_FAMILIES];
+};
+
+//! Declares smart pointer type for request statistics
+typedef boost::shared_ptr<RequestStats> RequestStatsPtr;
+
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*!
+ * This file defines the buffer that libcurl writes http response
+ * bodies into.  The buffer is sized once from the Content-Length
+ * header so that large volume fetches are not repeatedly reallocated
+ * and copied as data streams in.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef RESPONSEBUFFER_H
+#define RESPONSEBUFFER_H
+
+#include "BinaryData.h"
+#include "ResponseSink.h"
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace libdvid {
+
+/*!
+ * Response sink that accumulates the body into a BinaryData object.
+ * If the server reports a Content-Length, the destination is reserved
+ * once and every write is appended in place.  Otherwise, data is
+ * gathered into a list of fixed-size chunks that are assembled with
+ * a single copy when the transfer finishes.  Alternatively, the body
+ * can be written straight into caller-owned memory of fixed capacity.
+ * One buffer should be used for one request.
+*/
+class ResponseBuffer : public ResponseSink {
+  public:
+    /*!
+     * Create a buffer that writes into the given binary data.
+     * \param results_ empty binary data that will hold the response
+    */
+    explicit ResponseBuffer(BinaryDataPtr results_);
+
+    /*!
+     * Create a buffer that writes into caller-owned memory.  The
+     * transfer is aborted if the body does not fit.
+     * \param external_ destination memory
+     * \param capacity_ number of bytes available in external_
+    */
+    ResponseBuffer(char* external_, size_t capacity_);
+
+    /*!
+     * Reserves the destination from the Content-Length.
+    */
+    void begin(int status, long long content_length);
+
+    /*!
+     * Appends data to the response.
+     * \param data bytes received
+     * \param length number of bytes
+    */
+    void write(const char* data, size_t length);
+
+    /*!
+     * Moves any chunked data into the destination.
+    */
+    void finish();
+
+    /*!
+     * Content-Length reported by the server.
+     * \return expected body size or -1 if unknown
+    */
+    long long get_expected_length() const
+    {
+        return expected_length;
+    }
+
+    /*!
+     * Number of body bytes received.
+    */
+    size_t get_bytes_received() const
+    {
+        return bytes_received;
+    }
+
+    /*!
+     * Number of bytes memcpy'd to build the response, including the
+     * data moved when the destination had to grow.  A response that
+     * is received in place copies each byte exactly once.
+    */
+    size_t get_bytes_copied() const
+    {
+        return bytes_copied;
+    }
+
+    //! size of each chunk when the length is not known
+    static const size_t CHUNK_SIZE = 1 << 20;
+
+  private:
+    //! destination of the response
+    BinaryDataPtr results;
+
+    //! caller-owned destination (used instead of results if set)
+    char* external;
+
+    //! size of the caller-owned destination
+    size_t capacity;
+
+    //! data gathered when the length is unknown
+    std::vector<std::string> chunks;
+
+    //! value of the Content-Length header (-1 if unknown)
+    long long expected_length;
+
+    //! body bytes received
+    size_t bytes_received;
+
+    //! bytes copied (including reallocation)
+    size_t bytes_copied;
+};
+
+}
+
+#endif
@@ -0,0 +1,195 @@
+/*!
+ * This file defines sinks that consume an http response body
+ * incrementally as it is downloaded.  Sinks allow large responses
+ * to be decoded, decompressed, or written to disk without first
+ * materializing the whole body in memory.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef RESPONSESINK_H
+#define RESPONSESINK_H
+
+#include <boost/function.hpp>
+#include <ostream>
+#include <string>
+#include <cstddef>
+
+namespace libdvid {
+
+/*!
+ * Interface for consuming a response body.  begin is called once
+ * the response headers are known and before any data is written.
+ * write is then called for each piece of the body in order, and
+ * finish is called once the transfer is complete.  Implementations
+ * report errors by throwing an exception which aborts the transfer.
+*/
+class ResponseSink {
+  public:
+    virtual ~ResponseSink() {}
+
+    /*!
+     * Called before the first write.
+     * \param status http status code
+     * \param content_length body size or -1 if unknown
+    */
+    virtual void begin(int status, long long content_length) {}
+
+    /*!
+     * Consume the next piece of the body.
+     * \param data bytes received
+     * \param length number of bytes
+    */
+    virtual void write(const char* data, size_t length) = 0;
+
+    /*!
+     * Called after the last write.
+    */
+    virtual void finish() {}
+};
+
+/*!
+ * Writes the body to an output stream (e.g., an ofstream).
+*/
+class OStreamSink : public ResponseSink {
+  public:
+    explicit OStreamSink(std::ostream& stream_) : stream(stream_) {}
+
+    void write(const char* data, size_t length);
+
+    void finish();
+
+  private:
+    std::ostream& stream;
+};
+
+/*!
+ * Function called with each span decoded from a sparse volume
+ * (x, y, z of the first element and the number of elements along X).
+*/
+typedef boost::function<void (int x, int y, int z, int length)> SpanCallback;
+
+/*!
+ * Decodes the span encoding used by DVID sparsevol and sparsevol-coarse
+ * responses as the data arrives.  The encoding is 8 header bytes,
+ * a 4-byte span count, and then x, y, z, length (int32 little endian)
+ * for each span.
+*/
+class SparseVolSpanSink : public ResponseSink {
+  public:
+    explicit SparseVolSpanSink(SpanCallback callback_) :
+        callback(callback_), header_remaining(12), num_spans(0),
+        spans_decoded(0) {}
+
+    void write(const char* data, size_t length);
+
+    void finish();
+
+    /*!
+     * Number of spans decoded so far.
+    */
+    unsigned int get_num_decoded() const
+    {
+        return spans_decoded;
+    }
+
+  private:
+    SpanCallback callback;
+
+    //! bytes of the header still to be read
+    int header_remaining;
+
+    //! header bytes (last 4 hold the span count)
+    char header[12];
+
+    //! bytes of a span that straddle writes
+    std::string partial;
+
+    //! number of spans reported in the header
+    unsigned int num_spans;
+
+    //! number of spans delivered to the callback
+    unsigned int spans_decoded;
+};
+
+/*!
+ * Connects a ResponseSink to the libcurl header and write callbacks.
+ * The status line and Content-Length are parsed from the headers
+ * so the sink can be told about the response before the body
+ * arrives.  Exceptions thrown by the sink are caught (they cannot
+ * cross libcurl) and the transfer is aborted.  Optionally, the body
+ * of a response that is not 2xx is diverted into a string instead
+ * of the sink.
+*/
+class ResponseSinkAdapter {
+  public:
+    /*!
+     * \param sink_ consumer of the body
+     * \param divert_errors_ keep non-2xx bodies out of the sink
+    */
+    ResponseSinkAdapter(ResponseSink& sink_, bool divert_errors_) :
+        sink(sink_), divert_errors(divert_errors_), status(0),
+        content_length(-1), started(false) {}
+
+    //! libcurl CURLOPT_WRITEFUNCTION (user pointer is the adapter)
+    static size_t write_callback(void* contents, size_t size,
+            size_t nmemb, void* userp);
+
+    //! libcurl CURLOPT_HEADERFUNCTION (user pointer is the adapter)
+    static size_t header_callback(char* buffer, size_t size,
+            size_t nmemb, void* userp);
+
+    /*!
+     * Finishes the sink once the transfer is done.  Any error from
+     * the sink is reported through get_error.
+    */
+    void complete();
+
+    /*!
+     * Message of an exception thrown by the sink (empty if none).
+    */
+    const std::string& get_error() const
+    {
+        return error;
+    }
+
+    /*!
+     * Body of a diverted (non-2xx) response.
+    */
+    const std::string& get_error_body() const
+    {
+        return error_body;
+    }
+
+  private:
+    //! calls begin on the sink if it has not been called
+    void start();
+
+    //! true if the body should not go to the sink
+    bool diverting() const
+    {
+        return divert_errors && ((status < 200) || (status >= 300));
+    }
+
+    ResponseSink& sink;
+    bool divert_errors;
+
+    //! status from the last status line
+    int status;
+
+    //! Content-Length of the response or -1
+    long long content_length;
+
+    //! set once begin has been called
+    bool started;
+
+    //! exception message from the sink
+    std::string error;
+
+    //! body of a diverted response
+    std::string error_body;
+};
+
+}
+
+#endif
@@ -0,0 +1,229 @@
+/*!
+ * This file defines the policy used to retry DVID requests that
+ * fail because the server is busy or the connection had a
+ * temporary problem.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef RETRYPOLICY_H
+#define RETRYPOLICY_H
+
+#include <set>
+
+namespace libdvid {
+
+/*!
+ * Describes when and how often a request is retried.  Delays grow
+ * exponentially from the initial delay up to the maximum delay and
+ * are randomized by the jitter fraction so that many clients do
+ * not retry in lockstep.  Retrying stops after the maximum number
+ * of attempts or once the deadline (measured from the first attempt)
+ * would be exceeded.  Responses with a retryable status are retried
+ * for any method.  Transient connection errors (e.g., connection
+ * refused, timed out) are only retried for idempotent requests.
+ *
+ * The defaults retry 503 (server busy) starting at 50 ms, doubling
+ * up to 2 s, for at most 10 minutes.  Connection errors are retried
+ * at most 3 times.
+*/
+class RetryPolicy {
+  public:
+    /*!
+     * Create the default policy.
+    */
+    RetryPolicy();
+
+    /*!
+     * Create a policy that never retries.
+    */
+    static RetryPolicy no_retry();
+
+    /*!
+     * Set the delay before the first retry.
+     * \param seconds delay in seconds
+    */
+    void set_initial_delay(double seconds)
+    {
+        initial_delay = seconds;
+    }
+
+    /*!
+     * Set the longest delay between attempts.
+     * \param seconds delay in seconds
+    */
+    void set_max_delay(double seconds)
+    {
+        max_delay = seconds;
+    }
+
+    /*!
+     * Set the factor the delay grows by after each retry.
+     * \param multiplier_ growth factor (at least 1)
+    */
+    void set_multiplier(double multiplier_)
+    {
+        multiplier = multiplier_;
+    }
+
+    /*!
+     * Set the randomization of each delay.  A jitter of 0.5 picks a
+     * delay between 50% and 100% of the backoff.
+     * \param jitter_ fraction between 0 and 1
+    */
+    void set_jitter(double jitter_)
+    {
+        jitter = jitter_;
+    }
+
+    /*!
+     * Set the maximum number of attempts (including the first).
+     * \param max_attempts_ attempt limit (0 for no limit)
+    */
+    void set_max_attempts(int max_attempts_)
+    {
+        max_attempts = max_attempts_;
+    }
+
+    /*!
+     * Set the total time allowed for all attempts.
+     * \param seconds deadline in seconds (0 for no limit)
+    */
+    void set_deadline(double seconds)
+    {
+        deadline = seconds;
+    }
+
+    /*!
+     * Add a status code that should be retried.
+    */
+    void add_retryable_status(int status)
+    {
+        retryable_statuses.insert(status);
+    }
+
+    /*!
+     * Remove all retryable status codes.
+    */
+    void clear_retryable_statuses()
+    {
+        retryable_statuses.clear();
+    }
+
+    /*!
+     * Enable retrying idempotent requests on transient connection errors.
+    */
+    void set_retry_transient_errors(bool retry)
+    {
+        retry_transient_errors = retry;
+    }
+
+    /*!
+     * Set how many times a transient connection error is retried.
+     * This is independent of the attempt limit so that an unreachable
+     * server fails quickly while a busy server is waited on.
+     * \param retries retry limit for connection errors
+    */
+    void set_max_transient_retries(int retries)
+    {
+        max_transient_retries = retries;
+    }
+
+    /*!
+     * True if a response with the status should be retried.
+    */
+    bool is_retryable_status(int status) const
+    {
+        return retryable_statuses.count(status) > 0;
+    }
+
+    /*!
+     * True if transient connection errors are retried.
+    */
+    bool get_retry_transient_errors() const
+    {
+        return retry_transient_errors;
+    }
+
+    /*!
+     * Compute the randomized delay before a retry.
+     * \param retry number of the retry (0 for the first)
+     * \return delay in seconds
+    */
+    double get_delay(int retry) const;
+
+    int get_max_attempts() const
+    {
+        return max_attempts;
+    }
+
+    double get_deadline() const
+    {
+        return deadline;
+    }
+
+    int get_max_transient_retries() const
+    {
+        return max_transient_retries;
+    }
+
+  private:
+    double initial_delay;
+    double max_delay;
+    double multiplier;
+    double jitter;
+    int max_attempts;
+    double deadline;
+    std::set<int> retryable_statuses;
+    bool retry_transient_errors;
+    int max_transient_retries;
+};
+
+/*!
+ * Tracks the attempts made for one request under a policy.
+*/
+class RetryState {
+  public:
+    /*!
+     * Starts the clock for the deadline.
+    */
+    explicit RetryState(const RetryPolicy& policy_);
+
+    /*!
+     * Decide whether another attempt is allowed.
+     * \param delay returns seconds to wait before the next attempt
+     * \return false if attempts or time are exhausted
+    */
+    bool next(double& delay);
+
+    /*!
+     * Decide whether to retry after a transient connection error.
+     * This also counts against the limits used by next.
+     * \param delay returns seconds to wait before the next attempt
+     * \return false if connection retries, attempts, or time are exhausted
+    */
+    bool next_transient(double& delay);
+
+    /*!
+     * Number of attempts made so far (including the first).
+    */
+    int get_attempts() const
+    {
+        return attempts;
+    }
+
+  private:
+    RetryPolicy policy;
+    int attempts;
+    int transient_retries;
+    double start_time;
+};
+
+/*!
+ * Sleep for the given number of seconds.
+*/
+void retry_sleep(double seconds);
+
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*!
+ * This file defines a lightweight tracing facility that records
+ * when library operations (http requests, decompression, reshaping,
+ * JSON parsing) start and finish on each thread.  Traces are written
+ * in the Chrome trace event format, which can be loaded into
+ * chrome://tracing or https://ui.perfetto.dev to see the operations
+ * on a timeline.
+ *
+ * Tracing is off by default and costs a single atomic load per
+ * operation when disabled.  It is enabled with Trace::enable or by
+ * setting the environment variable LIBDVID_TRACE to an output file,
+ * in which case the trace is written when the program exits.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <boost/atomic.hpp>
+#include <string>
+
+namespace libdvid {
+
+/*!
+ * Process-wide collection of trace events.  All functions are
+ * thread-safe.
+*/
+class Trace {
+  public:
+    /*!
+     * Start recording events.
+    */
+    static void enable();
+
+    /*!
+     * Stop recording events.  Events already recorded are kept.
+    */
+    static void disable();
+
+    /*!
+     * True if events are being recorded.
+    */
+    static bool is_enabled()
+    {
+        return enabled.load(boost::memory_order_relaxed);
+    }
+
+    /*!
+     * Discard all recorded events.
+    */
+    static void clear();
+
+    /*!
+     * Number of events recorded (events beyond the limit are dropped).
+    */
+    static size_t num_events();
+
+    /*!
+     * Recorded events in the Chrome trace event JSON format.
+    */
+    static std::string to_json();
+
+    /*!
+     * Write the recorded events to a file in the Chrome trace
+     * event JSON format.
+     * \param filename output file
+    */
+    static void write(const std::string& filename);
+
+    /*!
+     * Current time in microseconds on the clock used for events.
+    */
+    static double now();
+
+    /*!
+     * Record a completed operation on the calling thread.
+     * \param name name of the operation (must be a string literal)
+     * \param category group of the operation (must be a string literal)
+     * \param start_us start time from now()
+     * \param end_us end time from now()
+     * \param detail optional description (e.g., url) shown with the event
+    */
+    static void record(const char* name, const char* category,
+            double start_us, double end_us,
+            const std::string& detail = std::string());
+
+    //! maximum number of events kept
+    static const size_t MAX_EVENTS = 4000000;
+
+  private:
+    static boost::atomic<bool> enabled;
+};
+
+/*!
+ * Records the lifetime of the scope as a trace event (when tracing
+ * is enabled at construction).
+*/
+class TraceScope {
+  public:
+    /*!
+     * \param name_ name of the operation (must be a string literal)
+     * \param category_ group of the operation (must be a string literal)
+    */
+    TraceScope(const char* name_, const char* category_) :
+        name(name_), category(category_),
+        start(Trace::is_enabled() ? Trace::now() : -1) {}
+
+    /*!
+     * \param name_ name of the operation (must be a string literal)
+     * \param category_ group of the operation (must be a string literal)
+     * \param detail_ description shown with the event (only copied
+     * if tracing is enabled)
+    */
+    TraceScope(const char* name_, const char* category_,
+            const std::string& detail_) :
+        name(name_), category(category_),
+        start(Trace::is_enabled() ? Trace::now() : -1)
+    {
+        if (start >= 0) {
+            detail = detail_;
+        }
+    }
+
+    ~TraceScope()
+    {
+        finish();
+    }
+
+    /*!
+     * End the event before the scope ends.
+    */
+    void finish()
+    {
+        if (start >= 0) {
+            Trace::record(name, category, start, Trace::now(), detail);
+            start = -1;
+        }
+    }
+
+  private:
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+
+    const char* name;
+    const char* category;
+    double start;
+    std::string detail;
+};
+
+}
+
+#endif
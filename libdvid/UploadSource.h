@@ -0,0 +1,150 @@
+/*!
+ * This file defines sources of data that can be streamed to DVID
+ * without loading the whole payload into memory first.  libcurl
+ * pulls data from the source as the request body is sent.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#ifndef UPLOADSOURCE_H
+#define UPLOADSOURCE_H
+
+#include <boost/function.hpp>
+#include <istream>
+#include <cstddef>
+
+namespace libdvid {
+
+/*!
+ * Interface for a request body that is produced incrementally.
+ * If the size is not known in advance, the body is sent with
+ * chunked transfer encoding.  A source that can be rewound can
+ * be resent (e.g., when the server is busy).
+*/
+class UploadSource {
+  public:
+    virtual ~UploadSource() {}
+
+    /*!
+     * Total number of bytes that will be produced.
+     * \return size in bytes or -1 if unknown
+    */
+    virtual long long size() const = 0;
+
+    /*!
+     * Copy the next bytes of the body into the buffer.  Errors
+     * should be reported by throwing an exception (the request is aborted).
+     * \param buffer destination
+     * \param length maximum number of bytes to write
+     * \return number of bytes written (0 when there is no more data)
+    */
+    virtual size_t read(char* buffer, size_t length) = 0;
+
+    /*!
+     * Restart the body from the beginning.
+     * \return false if the source cannot be replayed
+    */
+    virtual bool rewind()
+    {
+        return false;
+    }
+};
+
+/*!
+ * Streams the remainder of an input stream (e.g., an ifstream).
+ * The size is determined by seeking if the stream supports it.
+*/
+class IStreamUploadSource : public UploadSource {
+  public:
+    /*!
+     * \param stream_ stream positioned at the start of the body
+    */
+    explicit IStreamUploadSource(std::istream& stream_);
+
+    long long size() const
+    {
+        return total_size;
+    }
+
+    size_t read(char* buffer, size_t length);
+
+    bool rewind();
+
+  private:
+    std::istream& stream;
+
+    //! starting position of the body
+    std::streampos start;
+
+    //! bytes in the body or -1 if unknown
+    long long total_size;
+};
+
+/*!
+ * Streams from a file descriptor starting at its current offset.
+ * The size is known for regular files; pipes and sockets are sent
+ * chunked and cannot be rewound.
+*/
+class FileDescriptorUploadSource : public UploadSource {
+  public:
+    /*!
+     * \param fd_ open file descriptor (not closed by this object)
+    */
+    explicit FileDescriptorUploadSource(int fd_);
+
+    long long size() const
+    {
+        return total_size;
+    }
+
+    size_t read(char* buffer, size_t length);
+
+    bool rewind();
+
+  private:
+    int fd;
+
+    //! starting offset of the body (-1 if not seekable)
+    long long start;
+
+    //! bytes in the body or -1 if unknown
+    long long total_size;
+};
+
+/*!
+ * Function that writes up to length bytes into buffer and returns
+ * the number written (0 once the body is complete).
+*/
+typedef boost::function<size_t (char* buffer, size_t length)> UploadProducer;
+
+/*!
+ * Streams data generated by a user-supplied producer.
+*/
+class CallbackUploadSource : public UploadSource {
+  public:
+    /*!
+     * \param producer_ function that generates the body
+     * \param total_size_ bytes that will be produced or -1 if unknown
+    */
+    explicit CallbackUploadSource(UploadProducer producer_,
+            long long total_size_ = -1) :
+        producer(producer_), total_size(total_size_) {}
+
+    long long size() const
+    {
+        return total_size;
+    }
+
+    size_t read(char* buffer, size_t length)
+    {
+        return producer(buffer, length);
+    }
+
+  private:
+    UploadProducer producer;
+    long long total_size;
+};
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+/*!
+ * This file runs the mock DVID server so the tests and load tests
+ * can run without a DVID installation.  When given a command after
+ * "--", the server runs only for the duration of the command, every
+ * "{url}" in the command's arguments is replaced with the server
+ * address (http://host:port or unix:///path), every "{addr}" with the
+ * host and port (or socket path), and the exit status of the command
+ * is returned.  Otherwise the server runs until the program is killed.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDMockServer.h>
+#include <libdvid/DVIDException.h>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using std::cerr; using std::cout; using std::endl;
+using namespace libdvid;
+using std::vector;
+using std::string;
+
+//! Replace every occurrence of pattern in an argument with addr
+static string substitute_addr(string arg, const string& pattern,
+        const string& addr)
+{
+    size_t pos = 0;
+    while ((pos = arg.find(pattern, pos)) != string::npos) {
+        arg.replace(pos, pattern.size(), addr);
+        pos += addr.size();
+    }
+    return arg;
+}
+
+//! Run a command and return its exit status
+static int run_command(const vector<string>& command)
+{
+    vector<char*> args;
+    for (unsigned int i = 0; i < command.size(); ++i) {
+        args.push_back(const_cast<char*>(command[i].c_str()));
+    }
+    args.push_back(0);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        cerr << "Could not start " << command[0] << endl;
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(args[0], &args[0]);
+        cerr << "Could not run " << command[0] << endl;
+        _exit(127);
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+int main(int argc, char** argv)
+{
+    int port = 0;
+    string unix_socket;
+    double latency = 0, bandwidth = 0, busy_rate = 0;
+    double straggler_rate = 0, straggler_delay = 0;
+    unsigned int seed = 0;
+    vector<string> command;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--") {
+            command.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        if ((i + 1) >= argc) {
+            arg = "";
+        }
+        if (arg == "--port") {
+            port = atoi(argv[++i]);
+        } else if (arg == "--unix") {
+            unix_socket = argv[++i];
+        } else if (arg == "--latency") {
+            latency = atof(argv[++i]);
+        } else if (arg == "--bandwidth") {
+            bandwidth = atof(argv[++i]);
+        } else if (arg == "--busy-rate") {
+            busy_rate = atof(argv[++i]);
+        } else if (arg == "--straggler-rate") {
+            straggler_rate = atof(argv[++i]);
+        } else if (arg == "--straggler-delay") {
+            straggler_delay = atof(argv[++i]);
+        } else if (arg == "--seed") {
+            seed = atoi(argv[++i]);
+        } else {
+            cout << "Usage: <program> [--port <port> | --unix <socket>] "
+                "[--latency <seconds>] [--bandwidth <bytes/s>] "
+                "[--busy-rate <fraction>] [--straggler-rate <fraction>] "
+                "[--straggler-delay <seconds>] [--seed <seed>] "
+                "[-- <command with {url}> ...]" << endl;
+            return -1;
+        }
+    }
+
+    try {
+        boost::shared_ptr<DVIDMockServer> server_ptr(unix_socket.empty() ?
+                new DVIDMockServer(port) : new DVIDMockServer(unix_socket));
+        DVIDMockServer& server = *server_ptr;
+        server.set_latency(latency);
+        server.set_bandwidth(bandwidth);
+        server.set_busy_rate(busy_rate, seed);
+        server.set_straggler_rate(straggler_rate, straggler_delay, seed);
+        server.start();
+
+        if (command.empty()) {
+            cout << "Mock DVID server listening on " << server.get_url() <<
+                endl;
+            while (true) {
+                pause();
+            }
+        }
+
+        for (unsigned int i = 0; i < command.size(); ++i) {
+            command[i] = substitute_addr(command[i], "{url}",
+                    server.get_url());
+            command[i] = substitute_addr(command[i], "{addr}",
+                    server.get_addr());
+        }
+        int status = run_command(command);
+        cout << "Mock server handled " << server.get_num_requests() <<
+            " requests (" << server.get_num_busy() << " busy)" << endl;
+        server.stop();
+        return status;
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+}
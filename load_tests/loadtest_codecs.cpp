@@ -0,0 +1,197 @@
+/*!
+ * This file compares the compression ratio and throughput of the
+ * registered codecs.  The data is either a grayscale and a label
+ * subvolume fetched from DVID or a list of local files (raw voxels,
+ * or jpeg/png images which are decoded first).  Each codec encodes and
+ * decodes every data set at a fast, the default, and a high level.
+ * Labels from DVID are reordered into 32x32x32 blocks so the label
+ * block codec can be compared with the others.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDNodeService.h>
+#include <libdvid/Codec.h>
+#include "ScopeTime.h"
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using std::cerr; using std::cout; using std::endl;
+using std::string; using std::vector; using std::ifstream;
+using namespace libdvid;
+
+//! Minimum time spent on each measurement (seconds)
+static const double MIN_SECONDS = 0.2;
+
+//! Size of a label block
+static const size_t LabelBlockBytes =
+    sizeof(uint64) * DEFBLOCKSIZE * DEFBLOCKSIZE * DEFBLOCKSIZE;
+
+/*!
+ * Levels tried for a codec (fast, default, high).
+*/
+vector<int> get_levels(string codec_name)
+{
+    vector<int> levels;
+    if (codec_name == "lz4") {
+        levels.push_back(-8); levels.push_back(0); levels.push_back(9);
+    } else if (codec_name == "gzip") {
+        levels.push_back(1); levels.push_back(0); levels.push_back(9);
+    } else if (codec_name == "zstd") {
+        levels.push_back(-5); levels.push_back(0); levels.push_back(19);
+    } else {
+        levels.push_back(0);
+    }
+    return levels;
+}
+
+/*!
+ * Encode and decode the data with every codec and print the results.
+*/
+void run_codecs(string name, BinaryDataPtr data)
+{
+    double megabytes = data->length() / 1000000.0;
+    cout << name << " (" << megabytes << " MB)" << endl;
+
+    CodecRegistry& registry = CodecRegistry::get_registry();
+    vector<string> codecs = registry.get_codec_names(
+            CODEC_ENCODE | CODEC_DECODE | CODEC_LOSSLESS);
+    for (unsigned int i = 0; i < codecs.size(); ++i) {
+        CodecPtr codec = registry.get_codec(codecs[i]);
+        if (codec->has_capabilities(CODEC_LABEL_BLOCKS) &&
+                (data->length() % LabelBlockBytes)) {
+            continue;
+        }
+        vector<int> levels = get_levels(codecs[i]);
+        for (unsigned int j = 0; j < levels.size(); ++j) {
+            BinaryDataPtr encoded;
+            int num_encodes = 0;
+            ScopeTime encode_timer(false);
+            do {
+                encoded = codec->encode(data, levels[j]);
+                ++num_encodes;
+            } while (encode_timer.getElapsed() < MIN_SECONDS);
+            double encode_seconds = encode_timer.getElapsed() / num_encodes;
+
+            vector<byte> decoded(data->length());
+            int num_decodes = 0;
+            ScopeTime decode_timer(false);
+            do {
+                codec->decode(encoded, &decoded[0], decoded.size());
+                ++num_decodes;
+            } while (decode_timer.getElapsed() < MIN_SECONDS);
+            double decode_seconds = decode_timer.getElapsed() / num_decodes;
+
+            if (!std::equal(decoded.begin(), decoded.end(),
+                        data->get_raw())) {
+                throw ErrMsg(codecs[i] + " did not round trip");
+            }
+
+            cout << "  " << codecs[i] << " level " << levels[j] <<
+                ": ratio " << double(data->length()) / encoded->length() <<
+                ", encode " << megabytes / encode_seconds << " MB/s" <<
+                ", decode " << megabytes / decode_seconds << " MB/s" << endl;
+        }
+    }
+}
+
+/*!
+ * Reorder a cube of labels into blocks (the layout of label block
+ * transfers).
+*/
+BinaryDataPtr to_blocks(BinaryDataPtr volume, int size)
+{
+    const uint64* labels = (const uint64*) volume->get_raw();
+    BinaryDataPtr blocks = BinaryData::create_binary_data();
+    blocks->get_data().resize(volume->length());
+    uint64* block_iter = (uint64*) &(blocks->get_data()[0]);
+    int grid = size / DEFBLOCKSIZE;
+    for (int bz = 0; bz < grid; ++bz) {
+        for (int by = 0; by < grid; ++by) {
+            for (int bx = 0; bx < grid; ++bx) {
+                for (int z = 0; z < DEFBLOCKSIZE; ++z) {
+                    for (int y = 0; y < DEFBLOCKSIZE; ++y) {
+                        const uint64* row = labels +
+                            (size_t(bz * DEFBLOCKSIZE + z) * size +
+                             by * DEFBLOCKSIZE + y) * size +
+                            bx * DEFBLOCKSIZE;
+                        block_iter = std::copy(row, row + DEFBLOCKSIZE,
+                                block_iter);
+                    }
+                }
+            }
+        }
+    }
+    return blocks;
+}
+
+/*!
+ * Read a file (images are decoded to 8-bit grayscale).
+*/
+BinaryDataPtr read_file(string filename)
+{
+    ifstream fin(filename.c_str());
+    if (!fin) {
+        throw ErrMsg("Could not open " + filename);
+    }
+    BinaryDataPtr data = BinaryData::create_binary_data(fin);
+    ImageFormat format = BinaryData::get_image_format(data);
+    if (format == JPEG_IMAGE) {
+        unsigned int width, height;
+        data = BinaryData::decompress_jpeg(data, width, height);
+    } else if (format == PNG_IMAGE) {
+        unsigned int width, height;
+        data = BinaryData::decompress_png8(data, width, height);
+    }
+    return data;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        cout << "Usage: <program> <server_name> <uuid> <grayscale name> <labels name> <x> <y> <z> <size: opt (multiple of 32)>" << endl;
+        cout << "       <program> <file> [<file> ...]" << endl;
+        return -1;
+    }
+
+    try {
+        string target = argv[1];
+        bool use_dvid = (target.find("://") != string::npos);
+        if (!use_dvid) {
+            for (int i = 1; i < argc; ++i) {
+                run_codecs(argv[i], read_file(argv[i]));
+            }
+            return 0;
+        }
+
+        if (argc < 8) {
+            cerr << "DVID requires instance names and an offset" << endl;
+            return -1;
+        }
+        DVIDNodeService dvid_node(target, argv[2]);
+        vector<int> offset;
+        offset.push_back(atoi(argv[5]));
+        offset.push_back(atoi(argv[6]));
+        offset.push_back(atoi(argv[7]));
+        int size = (argc > 8) ? atoi(argv[8]) : 256;
+        size = std::max(size / DEFBLOCKSIZE, 1) * DEFBLOCKSIZE;
+        Dims_t dims(3, size);
+
+        Grayscale3D gray = dvid_node.get_gray3D(argv[3], dims, offset,
+                false);
+        run_codecs(string("grayscale ") + argv[3], gray.get_binary());
+        Labels3D labels = dvid_node.get_labels3D(argv[4], dims, offset,
+                false);
+        run_codecs(string("labels ") + argv[4],
+                to_blocks(labels.get_binary(), size));
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/*!
+ * This file measures how many bytes are copied while receiving
+ * an http response body.  It replays a response of the given size
+ * through the response sink in CURL_MAX_WRITE_SIZE pieces
+ * (no server is needed) and compares appending into an unreserved
+ * string (the previous behavior) with ResponseBuffer when the
+ * Content-Length is and is not known.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/ResponseBuffer.h>
+#include "ScopeTime.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using std::cout; using std::endl;
+using std::string; using std::vector;
+using namespace libdvid;
+
+// size of each write from libcurl (CURL_MAX_WRITE_SIZE)
+const size_t WRITE_SIZE = 16384;
+
+// number of times each strategy is repeated
+const int NUM_TRIALS = 5;
+
+/*!
+ * Appends into a string without reserving and counts the bytes moved
+ * by reallocation.
+*/
+size_t receive_unreserved(const vector<char>& source, string& dest)
+{
+    size_t copied = 0;
+    for (size_t pos = 0; pos < source.size(); pos += WRITE_SIZE) {
+        size_t amount = source.size() - pos;
+        if (amount > WRITE_SIZE) {
+            amount = WRITE_SIZE;
+        }
+        size_t old_capacity = dest.capacity();
+        size_t old_size = dest.size();
+        dest.append(&source[pos], amount);
+        if (dest.capacity() != old_capacity) {
+            copied += old_size;
+        }
+        copied += amount;
+    }
+    return copied;
+}
+
+/*!
+ * Sends the response through a ResponseBuffer.
+*/
+size_t receive_buffered(const vector<char>& source, BinaryDataPtr dest,
+        bool send_length)
+{
+    ResponseBuffer buffer(dest);
+    buffer.begin(200, send_length ? (long long)(source.size()) : -1);
+    for (size_t pos = 0; pos < source.size(); pos += WRITE_SIZE) {
+        size_t amount = source.size() - pos;
+        if (amount > WRITE_SIZE) {
+            amount = WRITE_SIZE;
+        }
+        buffer.write(&source[pos], amount);
+    }
+    buffer.finish();
+    return buffer.get_bytes_copied();
+}
+
+void report(string name, size_t copied, size_t total, double seconds)
+{
+    cout << name << ": " << copied << " bytes copied (" <<
+        double(copied) / total << "x), " << seconds / NUM_TRIALS <<
+        " seconds per response" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        cout << "Usage: <program> <response size in MB>" << endl;
+        return -1;
+    }
+
+    size_t total = size_t(atoi(argv[1])) << 20;
+    vector<char> source(total);
+    for (size_t i = 0; i < total; ++i) {
+        source[i] = char(i);
+    }
+
+    size_t copied = 0;
+    double seconds = 0;
+    {
+        ScopeTime timer(false);
+        for (int trial = 0; trial < NUM_TRIALS; ++trial) {
+            string dest;
+            copied = receive_unreserved(source, dest);
+        }
+        seconds = timer.getElapsed();
+    }
+    report("unreserved string", copied, total, seconds);
+
+    {
+        ScopeTime timer(false);
+        for (int trial = 0; trial < NUM_TRIALS; ++trial) {
+            BinaryDataPtr dest = BinaryData::create_binary_data();
+            copied = receive_buffered(source, dest, true);
+            if (size_t(dest->length()) != total) {
+                cout << "Incorrect response size" << endl;
+                return -1;
+            }
+        }
+        seconds = timer.getElapsed();
+    }
+    report("Content-Length reserve", copied, total, seconds);
+
+    {
+        ScopeTime timer(false);
+        for (int trial = 0; trial < NUM_TRIALS; ++trial) {
+            BinaryDataPtr dest = BinaryData::create_binary_data();
+            copied = receive_buffered(source, dest, false);
+            if (size_t(dest->length()) != total) {
+                cout << "Incorrect response size" << endl;
+                return -1;
+            }
+        }
+        seconds = timer.getElapsed();
+    }
+    report("chunked (no length)", copied, total, seconds);
+
+    return 0;
+}
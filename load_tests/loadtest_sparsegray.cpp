@@ -1,4 +1,6 @@
 #include <libdvid/DVIDThreadedFetch.h>
+#include <libdvid/BlockBufferPool.h>
+#include <libdvid/Trace.h>
 
 #include "ScopeTime.h"
 #include <string>
@@ -8,17 +10,20 @@ using std::cout; using std::endl;
 using std::string;
 using std::vector;
 
-const char * USAGE = "<prog> <dvid-server> <uuid> <label name> <gray name> <body id>";
-const char * HELP = "Program takes a body id and fetches the sparse volume in grayscale";
+const char * USAGE = "<prog> <dvid-server> <uuid> <label name> <gray name> <body id> [trace file]";
+const char * HELP = "Program takes a body id and fetches the sparse volume in grayscale (optionally writing a Chrome trace)";
 
 
 int main(int argc, char** argv)
 {
-    if (argc != 6) {
+    if (argc != 6 && argc != 7) {
         cout << USAGE << endl;
         cout << HELP << endl;
         exit(1);
     }
+    if (argc == 7) {
+        libdvid::Trace::enable();
+    }
     
     // create DVID node accessor 
     libdvid::DVIDNodeService dvid_node(argv[1], argv[2]);
@@ -59,6 +64,15 @@ int main(int argc, char** argv)
         }
     }
 
+    libdvid::BlockBufferPool& pool = libdvid::BlockBufferPool::get_pool();
+    cout << "Block buffer pool: " << pool.get_num_requests() <<
+        " buffers, hit rate " << pool.get_hit_rate() << ", peak " <<
+        pool.get_peak_bytes_in_use() << " bytes" << endl;
+
+    if (argc == 7) {
+        libdvid::Trace::write(argv[6]);
+    }
+
     return 0;
 }
 
@@ -0,0 +1,128 @@
+/*!
+ * This file compares request throughput over loopback TCP and over
+ * a unix domain socket.  Two mock DVID servers (one per transport) are
+ * started in this process and loaded with the same grayscale volume.
+ * Several threads then fetch block aligned subvolumes spanning the
+ * given number of blocks from each server.  Small spans emphasize per-request transport overhead while
+ * large spans emphasize copying.
+ *
+ * \author Stephen Plaza (plazas@janelia.hhmi.org)
+*/
+
+#include <libdvid/DVIDMockServer.h>
+#include <libdvid/DVIDServerService.h>
+#include <libdvid/DVIDNodeService.h>
+#include "ScopeTime.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using std::cerr; using std::cout; using std::endl;
+using std::string; using std::vector;
+using namespace libdvid;
+
+// assume all blocks are BLK_SIZE in each dimension
+int BLK_SIZE = 32;
+
+// number of blocks along each dimension of the volume
+int VOLUME_BLOCKS = 8;
+
+/*!
+ * Fetch block aligned subvolumes at pseudo-random locations.
+*/
+void fetch_spans(DVIDNodeService* service, int num_requests, int span,
+        unsigned int seed)
+{
+    DVIDNodeService node(*service);
+    Dims_t dims(3, BLK_SIZE);
+    dims[0] = BLK_SIZE * span;
+    vector<int> offset(3);
+    for (int i = 0; i < num_requests; ++i) {
+        seed = seed * 1103515245 + 12345;
+        offset[0] = ((seed >> 8) % (VOLUME_BLOCKS - span + 1)) * BLK_SIZE;
+        offset[1] = ((seed >> 12) % VOLUME_BLOCKS) * BLK_SIZE;
+        offset[2] = ((seed >> 16) % VOLUME_BLOCKS) * BLK_SIZE;
+        node.get_gray3D("grayscale", dims, offset, false);
+    }
+}
+
+/*!
+ * Load the volume on the server and time the fetches.
+*/
+void run_transport(string name, DVIDMockServer& server, int num_threads,
+        int num_requests, int span)
+{
+    server.start();
+    DVIDServerService dvid_server(server.get_url());
+    string uuid = dvid_server.create_new_repo("transport", "load test");
+    DVIDNodeService dvid_node(server.get_url(), uuid);
+    dvid_node.create_grayscale8("grayscale");
+
+    int size = VOLUME_BLOCKS * BLK_SIZE;
+    vector<unsigned char> voxels(size_t(size) * size * size);
+    for (size_t i = 0; i < voxels.size(); ++i) {
+        voxels[i] = (unsigned char)(i * 7);
+    }
+    Dims_t dims(3, size);
+    Grayscale3D volume(&voxels[0], (unsigned int)(voxels.size()), dims);
+    vector<int> offset(3, 0);
+    dvid_node.put_gray3D("grayscale", volume, offset, false);
+
+    // warm the connections before timing
+    fetch_spans(&dvid_node, num_threads, span, 1);
+
+    ScopeTime timer(false);
+    boost::thread_group threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.create_thread(boost::bind(fetch_spans, &dvid_node,
+                    num_requests, span, i + 1));
+    }
+    threads.join_all();
+    double seconds = timer.getElapsed();
+
+    int total = num_threads * num_requests;
+    double megabytes = double(total) * span * BLK_SIZE * BLK_SIZE *
+        BLK_SIZE / 1000000.0;
+    cout << name << ": " << total << " requests in " << seconds <<
+        " seconds (" << total / seconds << " requests/s, " <<
+        megabytes / seconds << " MB/s)" << endl;
+    server.stop();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 4) {
+        cout << "Usage: <program> <num threads: opt> <requests per thread: opt> <blocks per request: opt>" << endl;
+        return -1;
+    }
+    int num_threads = (argc > 1) ? atoi(argv[1]) : 4;
+    int num_requests = (argc > 2) ? atoi(argv[2]) : 2000;
+    int span = (argc > 3) ? atoi(argv[3]) : 1;
+    if (num_threads <= 0 || num_requests <= 0 || span <= 0 ||
+            span > VOLUME_BLOCKS) {
+        cerr << "Invalid arguments" << endl;
+        return -1;
+    }
+
+    try {
+        DVIDMockServer tcp_server;
+        run_transport("loopback tcp", tcp_server, num_threads, num_requests,
+                span);
+
+        char socket_path[64];
+        snprintf(socket_path, sizeof(socket_path), "/tmp/libdvid_%d.sock",
+                int(getpid()));
+        DVIDMockServer unix_server((string(socket_path)));
+        run_transport("unix socket", unix_server, num_threads, num_requests,
+                span);
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -223,8 +223,8 @@ namespace libdvid { namespace python {
 
     	static PyObject* convert(BinaryDataPtr const& binary_data)
         {
-            return PyString_FromStringAndSize( binary_data->get_data().c_str(),
-            								   binary_data->get_data().size() );
+            return PyString_FromStringAndSize( (const char*) binary_data->get_raw(),
+            								   binary_data->length() );
         }
     };
 
@@ -199,8 +199,8 @@ namespace libdvid { namespace python {
         void (DVIDNodeService::*put_binary)(std::string, std::string, BinaryDataPtr) = &DVIDNodeService::put;
         Grayscale3D (DVIDNodeService::*get_gray3D)(std::string, Dims_t, std::vector<int>, bool, bool, std::string) = &DVIDNodeService::get_gray3D;
         Labels3D (DVIDNodeService::*get_labels3D)(std::string, Dims_t, std::vector<int>, bool, bool, std::string) = &DVIDNodeService::get_labels3D;
-        void (DVIDNodeService::*put_gray3D)(std::string, Grayscale3D const&, std::vector<int>, bool, bool) = &DVIDNodeService::put_gray3D;
-        void (DVIDNodeService::*put_labels3D)(std::string, Labels3D const&, std::vector<int>, bool, bool, std::string) = &DVIDNodeService::put_labels3D;
+        void (DVIDNodeService::*put_gray3D)(std::string, Grayscale3D const&, std::vector<int>, bool, bool, int) = &DVIDNodeService::put_gray3D;
+        void (DVIDNodeService::*put_labels3D)(std::string, Labels3D const&, std::vector<int>, bool, bool, std::string, int) = &DVIDNodeService::put_labels3D;
         bool (DVIDNodeService::*create_labelblk)(std::string, std::string) = &DVIDNodeService::create_labelblk;
 
         // DVIDNodeService python class definition
@@ -211,6 +211,7 @@ namespace libdvid { namespace python {
 
             // keyvalue
             .def("create_keyvalue", &DVIDNodeService::create_keyvalue)
+            .def("create_labelarray", &DVIDNodeService::create_labelarray)
             .def("put", put_binary)
             .def("get", &DVIDNodeService::get)
             .def("get_json", &DVIDNodeService::get_json)
@@ -220,7 +221,7 @@ namespace libdvid { namespace python {
             .def("get_gray3D", get_gray3D,
                 ( arg("service"), arg("instance"), arg("dims"), arg("offset"), arg("throttle")=true, arg("compress")=false, arg("roi")=object() ))
             .def("put_gray3D", put_gray3D,
-                ( arg("service"), arg("instance"), arg("ndarray"), arg("offset"), arg("throttle")=true, arg("compress")=false))
+                ( arg("service"), arg("instance"), arg("ndarray"), arg("offset"), arg("throttle")=true, arg("compress")=false, arg("level")=0))
 
             // labels
             .def("create_labelblk", create_labelblk, (arg("service"), arg("instance"), arg("instance2")=object() ))
@@ -228,7 +229,7 @@ namespace libdvid { namespace python {
                 ( arg("service"), arg("instance"), arg("dims"), arg("offset"), arg("throttle")=true, arg("compress")=false, arg("roi")=object() ))
             .def("get_label_by_location",  &DVIDNodeService::get_label_by_location)
             .def("put_labels3D", put_labels3D,
-                ( arg("service"), arg("instance"), arg("ndarray"), arg("offset"), arg("throttle")=true, arg("compress")=false, arg("roi")=object() ))
+                ( arg("service"), arg("instance"), arg("ndarray"), arg("offset"), arg("throttle")=true, arg("compress")=false, arg("roi")=object(), arg("level")=0 ))
             .def("body_exists", &DVIDNodeService::body_exists)
 
             // 2D slices
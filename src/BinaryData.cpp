@@ -1,16 +1,34 @@
 #include "BinaryData.h"
+#include "Codec.h"
 #include "DVIDException.h"
+#include "Globals.h"
+#include "Trace.h"
 
-#include <png++/png.hpp>
+#include <png.h>
 
 extern "C" {
 #include <lz4.h>
+#include <lz4hc.h>
 #include <jpeglib.h>
 #include <setjmp.h>
 }
 
+#include <boost/thread/tss.hpp>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 using std::string;
-using std::istringstream;
+using std::ifstream;
+using std::streampos;
 
 /***** Contains JPEG LIB helper functions (copied from libjpeg) ****/
 
@@ -148,140 +166,653 @@ void my_error_exit (j_common_ptr cinfo)
 
 namespace libdvid {
 
+/*!
+ * Reusable libjpeg decompressor that decodes 8-bit grayscale images
+ * directly into caller-owned memory.  Creating the decompressor (and
+ * its memory pools) once per thread avoids setting it up per tile.
+ * An image is decoded with read_header followed by read_pixels (or
+ * abort); errors leave the decompressor ready for the next image.
+*/
+class JpegDecoder {
+  public:
+    JpegDecoder()
+    {
+        cinfo.err = jpeg_std_error((jpeg_error_mgr*)&jerr);
+        jerr.pub.error_exit = my_error_exit;
+        jpeg_create_decompress(&cinfo);
+    }
+
+    ~JpegDecoder()
+    {
+        jpeg_destroy_decompress(&cinfo);
+    }
+
+    /*!
+     * Start decoding and return the size of the image.
+    */
+    void read_header(const BinaryDataPtr jpegbinary, unsigned int& width,
+            unsigned int& height)
+    {
+        if (setjmp(jerr.setjmp_buffer)) {
+            jpeg_abort_decompress(&cinfo);
+            throw ErrMsg("Invalid JPEG");
+        }
+
+        jpeg_mem_src(&cinfo, (unsigned char*) jpegbinary->get_raw(),
+                jpegbinary->length());
+        jpeg_read_header(&cinfo, TRUE);
+        cinfo.out_color_space = JCS_GRAYSCALE;
+        jpeg_start_decompress(&cinfo);
+
+        width = cinfo.output_width;
+        height = cinfo.output_height;
+    }
+
+    /*!
+     * Decode the image started by read_header into output.
+    */
+    void read_pixels(byte* output)
+    {
+        // point a row at every line so libjpeg can return as many
+        // scanlines per call as it decodes at once
+        rows.resize(cinfo.output_height);
+        for (unsigned int y = 0; y < cinfo.output_height; ++y) {
+            rows[y] = output + y * cinfo.output_width;
+        }
+
+        if (setjmp(jerr.setjmp_buffer)) {
+            jpeg_abort_decompress(&cinfo);
+            throw ErrMsg("Invalid JPEG");
+        }
+
+        while (cinfo.output_scanline < cinfo.output_height) {
+            jpeg_read_scanlines(&cinfo, &rows[cinfo.output_scanline],
+                    cinfo.output_height - cinfo.output_scanline);
+        }
+        (void) jpeg_finish_decompress(&cinfo);
+    }
+
+    /*!
+     * Abandon the image started by read_header.
+    */
+    void abort()
+    {
+        jpeg_abort_decompress(&cinfo);
+    }
+
+  private:
+    JpegDecoder(const JpegDecoder&);
+    JpegDecoder& operator=(const JpegDecoder&);
+
+    struct jpeg_decompress_struct cinfo;
+    struct my_error_mgr jerr;
+
+    //! row pointers into the output
+    std::vector<JSAMPROW> rows;
+};
+
+//! decompressor for the calling thread
+static boost::thread_specific_ptr<JpegDecoder> jpeg_decoder;
+
+/*!
+ * In-memory source of png data for libpng.
+*/
+struct PngSource {
+    const byte* data;
+    size_t length;
+    size_t offset;
+};
+
+/*!
+ * Supplies libpng with the next bytes of the in-memory png.
+*/
+static void read_png_memory(png_structp png, png_bytep out, png_size_t count)
+{
+    PngSource* source = (PngSource*) png_get_io_ptr(png);
+    if (count > (source->length - source->offset)) {
+        png_error(png, "Truncated PNG");
+    }
+    memcpy(out, source->data + source->offset, count);
+    source->offset += count;
+}
+
+/*!
+ * Returns control to the setjmp point without printing libpng errors.
+*/
+static void png_silent_error(png_structp png, png_const_charp msg)
+{
+    longjmp(png_jmpbuf(png), 1);
+}
+
+/*!
+ * Ignores libpng warnings.
+*/
+static void png_silent_warning(png_structp png, png_const_charp msg)
+{
+}
+
+/*!
+ * Converts RGBA pixels to 8-bit gray with the Rec. 709 weights used
+ * by libpng's rgb_to_gray (alpha is ignored).
+*/
+static void rgba_to_gray(const byte* rgba, byte* gray, unsigned int width)
+{
+    // weights in 1/32768 units
+    const int red_weight = 6968, green_weight = 23434, blue_weight = 2366;
+
+    unsigned int x = 0;
+#ifdef __SSE2__
+    // 8 pixels per iteration: multiply-add the 16-bit channels, sum
+    // the red+green and blue+alpha halves, and pack to bytes
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_setr_epi16(red_weight, green_weight,
+            blue_weight, 0, red_weight, green_weight, blue_weight, 0);
+    const __m128i round = _mm_set1_epi32(1 << 14);
+    for (; (x + 8) <= width; x += 8) {
+        __m128i gray32[2];
+        for (int half = 0; half < 2; ++half) {
+            __m128i pixels = _mm_loadu_si128(
+                    (const __m128i*) (rgba + 4 * x + 16 * half));
+            __m128i low = _mm_madd_epi16(
+                    _mm_unpacklo_epi8(pixels, zero), weights);
+            __m128i high = _mm_madd_epi16(
+                    _mm_unpackhi_epi8(pixels, zero), weights);
+            low = _mm_shuffle_epi32(low, _MM_SHUFFLE(3, 1, 2, 0));
+            high = _mm_shuffle_epi32(high, _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(low, high),
+                    _mm_unpackhi_epi64(low, high));
+            gray32[half] = _mm_srli_epi32(_mm_add_epi32(sum, round), 15);
+        }
+        __m128i gray16 = _mm_packs_epi32(gray32[0], gray32[1]);
+        _mm_storel_epi64((__m128i*) (gray + x),
+                _mm_packus_epi16(gray16, gray16));
+    }
+#endif
+    for (; x < width; ++x) {
+        const byte* pixel = rgba + 4 * x;
+        gray[x] = (red_weight * pixel[0] + green_weight * pixel[1] +
+                blue_weight * pixel[2] + (1 << 14)) >> 15;
+    }
+}
+
+/*!
+ * libpng decoder that writes 8-bit gray rows straight into
+ * caller-owned memory.  Gray images of any depth are expanded or
+ * stripped to 8 bits and their alpha is dropped; palette and RGB(A)
+ * images are read as RGBA and converted to gray.  An image is decoded
+ * with read_header followed by read_pixels (or abort).  The row
+ * buffers are kept between images.
+*/
+class PngDecoder {
+  public:
+    PngDecoder() : png(0), info(0), color(false), passes(1) {}
+
+    ~PngDecoder()
+    {
+        abort();
+    }
+
+    /*!
+     * Start decoding and return the size of the image.
+    */
+    void read_header(const BinaryDataPtr pngbinary, unsigned int& width,
+            unsigned int& height)
+    {
+        abort();
+        source.data = pngbinary->get_raw();
+        source.length = pngbinary->length();
+        source.offset = 0;
+
+        png = png_create_read_struct(PNG_LIBPNG_VER_STRING, 0,
+                png_silent_error, png_silent_warning);
+        if (png) {
+            info = png_create_info_struct(png);
+        }
+        if (!info) {
+            abort();
+            throw ErrMsg("Could not create PNG decoder");
+        }
+
+        if (setjmp(png_jmpbuf(png))) {
+            abort();
+            throw ErrMsg("Invalid PNG");
+        }
+
+        png_set_read_fn(png, &source, read_png_memory);
+        png_read_info(png, info);
+
+        int bit_depth = png_get_bit_depth(png, info);
+        int color_type = png_get_color_type(png, info);
+        if (color_type == PNG_COLOR_TYPE_PALETTE) {
+            png_set_palette_to_rgb(png);
+        }
+        if ((color_type == PNG_COLOR_TYPE_GRAY) && (bit_depth < 8)) {
+            png_set_expand_gray_1_2_4_to_8(png);
+        }
+        if (bit_depth == 16) {
+            png_set_strip_16(png);
+        }
+
+        color = (color_type & PNG_COLOR_MASK_COLOR) != 0;
+        if (color) {
+            png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+        } else if (color_type & PNG_COLOR_MASK_ALPHA) {
+            png_set_strip_alpha(png);
+        }
+        passes = png_set_interlace_handling(png);
+        png_read_update_info(png, info);
+
+        width = png_get_image_width(png, info);
+        height = png_get_image_height(png, info);
+        if (png_get_rowbytes(png, info) != (color ? 4 * width : width)) {
+            abort();
+            throw ErrMsg("Unsupported PNG format");
+        }
+    }
+
+    /*!
+     * Decode the image started by read_header into output.
+    */
+    void read_pixels(byte* output)
+    {
+        png_uint_32 width = png_get_image_width(png, info);
+        png_uint_32 height = png_get_image_height(png, info);
+
+        // gray rows are decoded in place; color rows are converted
+        // from one RGBA row (or the whole image if interlaced)
+        rows.resize(height);
+        if (!color) {
+            for (png_uint_32 y = 0; y < height; ++y) {
+                rows[y] = output + uint64(y) * width;
+            }
+        } else if (passes > 1) {
+            scratch.resize(uint64(4) * width * height);
+            for (png_uint_32 y = 0; y < height; ++y) {
+                rows[y] = &scratch[uint64(4) * y * width];
+            }
+        } else {
+            scratch.resize(4 * width);
+        }
+
+        if (setjmp(png_jmpbuf(png))) {
+            abort();
+            throw ErrMsg("Invalid PNG");
+        }
+
+        if (!color) {
+            png_read_image(png, &rows[0]);
+        } else if (passes > 1) {
+            png_read_image(png, &rows[0]);
+            for (png_uint_32 y = 0; y < height; ++y) {
+                rgba_to_gray(rows[y], output + uint64(y) * width, width);
+            }
+        } else {
+            for (png_uint_32 y = 0; y < height; ++y) {
+                png_read_row(png, &scratch[0], 0);
+                rgba_to_gray(&scratch[0], output + uint64(y) * width,
+                        width);
+            }
+        }
+        png_read_end(png, 0);
+        abort();
+    }
+
+    /*!
+     * Release the image started by read_header.
+    */
+    void abort()
+    {
+        if (png) {
+            png_destroy_read_struct(&png, info ? &info : 0, 0);
+        }
+        png = 0;
+        info = 0;
+    }
+
+  private:
+    PngDecoder(const PngDecoder&);
+    PngDecoder& operator=(const PngDecoder&);
+
+    png_structp png;
+    png_infop info;
+    PngSource source;
+
+    //! true if the image is read as RGBA
+    bool color;
+
+    //! number of interlace passes
+    int passes;
+
+    //! row pointers and RGBA rows
+    std::vector<png_bytep> rows;
+    std::vector<byte> scratch;
+};
+
+//! png decoder for the calling thread
+static boost::thread_specific_ptr<PngDecoder> png_decoder;
+
+/*!
+ * Retrieve the png decoder for the calling thread.
+*/
+static PngDecoder& get_png_decoder()
+{
+    PngDecoder* decoder = png_decoder.get();
+    if (!decoder) {
+        decoder = new PngDecoder;
+        png_decoder.reset(decoder);
+    }
+    return *decoder;
+}
+
+/*!
+ * Retrieve the decompressor for the calling thread.
+*/
+static JpegDecoder& get_jpeg_decoder()
+{
+    JpegDecoder* decoder = jpeg_decoder.get();
+    if (!decoder) {
+        decoder = new JpegDecoder;
+        jpeg_decoder.reset(decoder);
+    }
+    return *decoder;
+}
+
+/*!
+ * Unmaps a memory-mapped file when the last view of it is released.
+*/
+struct MappedRegion {
+    MappedRegion(void* addr_, size_t length_) : addr(addr_),
+        length(length_) {}
+
+    ~MappedRegion()
+    {
+        munmap(addr, length);
+    }
+
+    void* addr;
+    size_t length;
+};
+
+BinaryData::BinaryData(ifstream& fin) : view_data(0), view_length(0),
+    view_writable(false)
+{
+    // read the rest of the file at once if its size is known
+    streampos start = fin.tellg();
+    if (start >= 0) {
+        fin.seekg(0, std::ios::end);
+        streampos end = fin.tellg();
+        fin.seekg(start);
+        if ((end >= start) && fin.good()) {
+            data.resize(size_t(end - start));
+            if (!data.empty()) {
+                fin.read(&data[0], data.size());
+                data.resize(size_t(fin.gcount()));
+            }
+            return;
+        }
+        fin.clear();
+        fin.seekg(start);
+    }
+
+    data.assign( (std::istreambuf_iterator<char>(fin) ),
+            (std::istreambuf_iterator<char>()    ) ); 
+}
+
+BinaryDataPtr BinaryData::create_binary_data_view(BinaryDataPtr source,
+        uint64 offset, uint64 length)
+{
+    if ((offset + length) > source->length()) {
+        throw ErrMsg("Binary data view is out of range");
+    }
+    const byte* start = source->get_raw() + offset;
+    if (source->view_owner) {
+        // reference the original memory rather than chaining views
+        return BinaryDataPtr(new BinaryData(source->view_owner, start,
+                    length, source->view_writable));
+    }
+    return BinaryDataPtr(new BinaryData(source, start, length, false));
+}
+
+BinaryDataPtr BinaryData::create_binary_data_mapped(const string& filename,
+        MapMode mode)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw ErrMsg("Could not open " + filename);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw ErrMsg("Could not read the size of " + filename);
+    }
+    size_t length = size_t(file_stat.st_size);
+    if (length == 0) {
+        close(fd);
+        return create_binary_data();
+    }
+
+    bool writable = (mode == MAP_COPY_ON_WRITE);
+    void* addr = mmap(0, length, writable ? (PROT_READ | PROT_WRITE) :
+            PROT_READ, writable ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw ErrMsg("Could not map " + filename);
+    }
+    // mapped files are usually consumed front to back (e.g., posted)
+    madvise(addr, length, MADV_SEQUENTIAL);
+
+    boost::shared_ptr<const void> region(new MappedRegion(addr, length));
+    return BinaryDataPtr(new BinaryData(region, (const byte*) addr,
+                uint64(length), writable));
+}
+
+byte* BinaryData::get_writable_raw()
+{
+    if (view_owner && view_writable) {
+        return const_cast<byte*>(view_data);
+    }
+    string& buffer = get_data();
+    return buffer.empty() ? 0 : (byte*) &buffer[0];
+}
+
+void BinaryData::detach_view()
+{
+    data.assign((const char*) view_data, view_length);
+    view_owner.reset();
+    view_data = 0;
+    view_length = 0;
+    view_writable = false;
+}
+
 BinaryDataPtr BinaryData::decompress_lz4(const BinaryDataPtr lz4binary,
         int uncompressed_size)
 {
-    const char* lz4_source = (char*) lz4binary->get_raw();
-    
     BinaryDataPtr binary(new BinaryData());
     // create a string buffer to fit the uncompressed result
     binary->data.resize(uncompressed_size);
 
     // dangerous write directly to string buffer
     char* uncompressed_data = &(binary->data[0]);
+    decompress_lz4(lz4binary, uncompressed_size, uncompressed_data);
+
+    return binary;
+}
 
-    int bytes_read = 
-        LZ4_decompress_fast(lz4_source, uncompressed_data, uncompressed_size);
+void BinaryData::decompress_lz4(const BinaryDataPtr lz4binary,
+        int uncompressed_size, char* uncompressed_data)
+{
+    TraceScope trace("lz4 decompress", "codec");
+    const char* lz4_source = (char*) lz4binary->get_raw();
+    if (lz4binary->length() > uint64(INT_MAX)) {
+        throw ErrMsg("LZ4 data is too large");
+    }
 
-    if (bytes_read < 0) {
+    // the safe decoder never reads or writes outside the given buffers
+    // (corrupt or truncated input returns a negative size)
+    int bytes_written = LZ4_decompress_safe(lz4_source, uncompressed_data,
+            lz4binary->length(), uncompressed_size);
+
+    if (bytes_written != uncompressed_size) {
         throw ErrMsg("Decompression of LZ4 failed");
     }     
-
-    return binary;
 }
 
-BinaryDataPtr BinaryData::compress_lz4(const BinaryDataPtr lz4binary)
+BinaryDataPtr BinaryData::compress_lz4(const BinaryDataPtr lz4binary,
+        int level)
 {
+    TraceScope trace("lz4 compress", "codec");
     const char* orig_data = (char*) lz4binary->get_raw();
-    int input_size = lz4binary->length();
+    if (lz4binary->length() > uint64(LZ4_MAX_INPUT_SIZE)) {
+        throw ErrMsg("Data is too large for LZ4 compression");
+    }
+    int input_size = int(lz4binary->length());
     
-    // create buffer for lz4 data
+    // compress directly into the string buffer of the result
     int max_compressed_size = LZ4_compressBound(input_size);
-    char *temp_buffer = new char[max_compressed_size];
+    if (max_compressed_size <= 0) {
+        throw ErrMsg("Data is too large for LZ4 compression");
+    }
+    BinaryDataPtr binary(new BinaryData());
+    binary->data.resize(max_compressed_size);
+    char* compressed_data = &(binary->data[0]);
 
-    int lz4_size = 
-        LZ4_compress(orig_data, temp_buffer, input_size);
+    int lz4_size = 0;
+    if (level > 0) {
+        if (level > LZ4HC_CLEVEL_MAX) {
+            level = LZ4HC_CLEVEL_MAX;
+        }
+        lz4_size = LZ4_compress_HC(orig_data, compressed_data, input_size,
+                max_compressed_size, level);
+    } else {
+        lz4_size = LZ4_compress_fast(orig_data, compressed_data, input_size,
+                max_compressed_size, (level < 0) ? -level : 1);
+    }
 
     if (lz4_size <= 0) {
         throw ErrMsg("Compression of LZ4 failed");
     }     
 
-    // create binary data from buffer
-    // double copy could be reduced by working off the string
-    // buffer and then resize the string
-    BinaryDataPtr binary(new BinaryData(temp_buffer, lz4_size));
-    delete []temp_buffer;
+    // release the unused bound when it is large (copies only the
+    // compressed bytes)
+    if (lz4_size < (max_compressed_size / 2)) {
+        string(compressed_data, lz4_size).swap(binary->data);
+    } else {
+        binary->data.resize(lz4_size);
+    }
     return binary;
 }
 
 BinaryDataPtr BinaryData::decompress_png8(const BinaryDataPtr pngbinary,
         unsigned int& width, unsigned int& height)
 {
-    // ?! currently no check if it is grayscale
-    
-    // retrieve PNG
-    string& png_image = pngbinary->get_data();
-    istringstream sstr2(png_image);
-    png::image<png::gray_pixel> image;         
-    image.read(sstr2);
-
-    width = image.get_width();
-    height = image.get_height();
+    TraceScope trace("png decode", "codec");
+    PngDecoder& decoder = get_png_decoder();
+    decoder.read_header(pngbinary, width, height);
 
     // direct access of string buffer
     BinaryDataPtr binary(new BinaryData());
-    binary->data.resize(image.get_width()*image.get_height());
-    char* ptr = &binary->data[0];
-
-    for (unsigned int y = 0; y < image.get_height(); ++y) {
-        for (unsigned int x = 0; x < image.get_width(); ++x) {
-            *ptr = image[y][x];
-            ++ptr;
-        }
+    binary->data.resize(uint64(width) * height);
+    if (binary->data.empty()) {
+        decoder.abort();
+        return binary;
     }
+    decoder.read_pixels((byte*) &binary->data[0]);
 
     return binary;
 }
 
-BinaryDataPtr BinaryData::decompress_jpeg(const BinaryDataPtr jpegbinary,
+void BinaryData::decompress_png8(const BinaryDataPtr pngbinary,
+        byte* output, unsigned int capacity,
         unsigned int& width, unsigned int& height)
 {
-    struct jpeg_decompress_struct cinfo;
-    struct my_error_mgr       jerr;
-    cinfo.err = jpeg_std_error((jpeg_error_mgr*)&jerr);
-    jerr.pub.error_exit = my_error_exit;
-    
-    // handle error handling for libjpeg library
-    if (setjmp(jerr.setjmp_buffer)) {
-        // destroy datastructures and indicate error
-        //cinfo.err->output_message(cinfo);
-        jpeg_destroy_decompress(&cinfo);
-        throw ErrMsg("Invalid JPEG");
+    TraceScope trace("png decode", "codec");
+    PngDecoder& decoder = get_png_decoder();
+    decoder.read_header(pngbinary, width, height);
+    if (uint64(width) * height > capacity) {
+        decoder.abort();
+        throw ErrMsg("PNG image does not fit in the buffer");
     }
-    
-    jpeg_create_decompress(&cinfo);
-
-    // specify data source
-    jpeg_mem_src(&cinfo, (unsigned char*) jpegbinary->get_raw(),
-            jpegbinary->length());
-
-    // read the header
-    jpeg_read_header(&cinfo, TRUE);
-
-    // decompress
-    jpeg_start_decompress(&cinfo);
+    decoder.read_pixels(output);
+}
 
-    // get image width
-    int row_stride = cinfo.output_width * cinfo.output_components;
+BinaryDataPtr BinaryData::decompress_jpeg(const BinaryDataPtr jpegbinary,
+        unsigned int& width, unsigned int& height)
+{
+    TraceScope trace("jpeg decode", "codec");
+    JpegDecoder& decoder = get_jpeg_decoder();
+    decoder.read_header(jpegbinary, width, height);
     
     BinaryDataPtr binary(new BinaryData());
     // create a string buffer to fit the uncompressed result
-    binary->data.resize(row_stride * cinfo.output_height);
+    binary->data.resize(width * height);
 
     // dangerous write directly to string buffer
-    char* uncompressed_data = &(binary->data[0]);
-    unsigned char* buffer = (unsigned char*) uncompressed_data;
-
-    width = cinfo.output_width;
-    height = cinfo.output_height;
+    decoder.read_pixels((byte*) &(binary->data[0]));
 
-    // use the library's state variable cinfo.output_scanline
-    // as the loop counter
-    while (cinfo.output_scanline < cinfo.output_height) {
-        // try to read as many lines as possible
-        int lines_read = jpeg_read_scanlines(&cinfo, &buffer, 1);
+    return binary;
+}
 
-        // update buffer position
-        buffer += (row_stride * lines_read);
+void BinaryData::decompress_jpeg(const BinaryDataPtr jpegbinary,
+        byte* output, unsigned int capacity,
+        unsigned int& width, unsigned int& height)
+{
+    TraceScope trace("jpeg decode", "codec");
+    JpegDecoder& decoder = get_jpeg_decoder();
+    decoder.read_header(jpegbinary, width, height);
+    if (uint64(width) * height > capacity) {
+        decoder.abort();
+        throw ErrMsg("JPEG image does not fit in the buffer");
     }
+    decoder.read_pixels(output);
+}
+
+BinaryDataPtr BinaryData::encode(const BinaryDataPtr binary,
+        const string& codec_name, int level)
+{
+    return CodecRegistry::get_registry().get_codec(codec_name)->encode(
+            binary, level);
+}
 
-    // finish decompression
-    (void) jpeg_finish_decompress(&cinfo);
+BinaryDataPtr BinaryData::decode(const BinaryDataPtr binary,
+        const string& codec_name, uint64 decoded_size)
+{
+    return CodecRegistry::get_registry().get_codec(codec_name)->decode(
+            binary, decoded_size);
+}
 
-    // release memory
-    jpeg_destroy_decompress(&cinfo);
+ImageFormat BinaryData::get_image_format(const BinaryDataPtr binary)
+{
+    static const byte jpeg_magic[] = {0xFF, 0xD8, 0xFF};
+    static const byte png_magic[] = {0x89, 'P', 'N', 'G', '\r', '\n',
+        0x1A, '\n'};
+
+    const byte* raw = binary->get_raw();
+    uint64 length = binary->length();
+    if ((length >= sizeof(jpeg_magic)) &&
+            !memcmp(raw, jpeg_magic, sizeof(jpeg_magic))) {
+        return JPEG_IMAGE;
+    }
+    if ((length >= sizeof(png_magic)) &&
+            !memcmp(raw, png_magic, sizeof(png_magic))) {
+        return PNG_IMAGE;
+    }
+    return UNKNOWN_IMAGE;
+}
 
-    return binary;
+void BinaryData::decompress_image(const BinaryDataPtr binary,
+        byte* output, unsigned int capacity,
+        unsigned int& width, unsigned int& height)
+{
+    switch (get_image_format(binary)) {
+        case JPEG_IMAGE:
+            decompress_jpeg(binary, output, capacity, width, height);
+            break;
+        case PNG_IMAGE:
+            decompress_png8(binary, output, capacity, width, height);
+            break;
+        default:
+            throw ErrMsg("Unrecognized image format");
+    }
 }
 
 }
@@ -0,0 +1,171 @@
+#include "BlockBufferPool.h"
+
+using std::vector;
+
+//! Default cap on the bytes held in the caches
+static const libdvid::uint64 DEFAULT_MAX_CACHED_BYTES = 256 * 1024 * 1024;
+
+//! Default number of buffers of each size cached per thread
+static const int DEFAULT_THREAD_CACHE_SIZE = 16;
+
+namespace libdvid {
+
+struct BlockBufferPool::ThreadCache {
+    explicit ThreadCache(BlockBufferPool* pool_) : pool(pool_) {}
+
+    ~ThreadCache()
+    {
+        pool->absorb(buffers);
+    }
+
+    BlockBufferPool* pool;
+    BufferCache buffers;
+};
+
+struct BlockBufferPool::RecycleBuffer {
+    RecycleBuffer(BlockBufferPool* pool_, unsigned int size_) :
+        pool(pool_), size(size_) {}
+
+    void operator()(BinaryData* binary)
+    {
+        pool->recycle(binary, size);
+    }
+
+    BlockBufferPool* pool;
+    unsigned int size;
+};
+
+BlockBufferPool& BlockBufferPool::get_pool()
+{
+    // intentionally leaked so that buffers released during exit are safe
+    static BlockBufferPool* pool = new BlockBufferPool;
+    return *pool;
+}
+
+BlockBufferPool::BlockBufferPool() :
+    max_cached_bytes(DEFAULT_MAX_CACHED_BYTES),
+    thread_cache_size(DEFAULT_THREAD_CACHE_SIZE), num_requests(0),
+    num_hits(0), bytes_in_use(0), peak_bytes_in_use(0), cached_bytes(0)
+{
+}
+
+BinaryDataPtr BlockBufferPool::create_binary_data(unsigned int size)
+{
+    ++num_requests;
+    BinaryData* binary = take(size);
+    if (binary) {
+        ++num_hits;
+    } else {
+        binary = new BinaryData();
+        binary->data.resize(size);
+    }
+
+    uint64 in_use = (bytes_in_use += size);
+    uint64 peak = peak_bytes_in_use.load(boost::memory_order_relaxed);
+    while ((in_use > peak) &&
+            !peak_bytes_in_use.compare_exchange_weak(peak, in_use)) {
+    }
+
+    return BinaryDataPtr(binary, RecycleBuffer(this, size));
+}
+
+BinaryData* BlockBufferPool::take(unsigned int size)
+{
+    // the thread's own cache needs no locking
+    ThreadCache* cache = thread_cache.get();
+    if (cache) {
+        BufferCache::iterator iter = cache->buffers.find(size);
+        if ((iter != cache->buffers.end()) && !iter->second.empty()) {
+            BinaryData* binary = iter->second.back();
+            iter->second.pop_back();
+            cached_bytes -= size;
+            return binary;
+        }
+    }
+
+    boost::mutex::scoped_lock lock(mutex);
+    BufferCache::iterator iter = shared_cache.find(size);
+    if ((iter == shared_cache.end()) || iter->second.empty()) {
+        return 0;
+    }
+    BinaryData* binary = iter->second.back();
+    iter->second.pop_back();
+    cached_bytes -= size;
+    return binary;
+}
+
+void BlockBufferPool::recycle(BinaryData* binary, unsigned int size)
+{
+    bytes_in_use -= size;
+
+    // the buffer may have been reallocated through get_data
+    if ((binary->data.capacity() < size) ||
+            ((cached_bytes.load(boost::memory_order_relaxed) + size) >
+             max_cached_bytes.load(boost::memory_order_relaxed))) {
+        delete binary;
+        return;
+    }
+    binary->data.resize(size);
+    cached_bytes += size;
+
+    ThreadCache* cache = thread_cache.get();
+    if (!cache) {
+        cache = new ThreadCache(this);
+        thread_cache.reset(cache);
+    }
+    vector<BinaryData*>& buffers = cache->buffers[size];
+    if (int(buffers.size()) <
+            thread_cache_size.load(boost::memory_order_relaxed)) {
+        buffers.push_back(binary);
+        return;
+    }
+
+    boost::mutex::scoped_lock lock(mutex);
+    shared_cache[size].push_back(binary);
+}
+
+void BlockBufferPool::absorb(BufferCache& cache)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    for (BufferCache::iterator iter = cache.begin(); iter != cache.end();
+            ++iter) {
+        vector<BinaryData*>& buffers = shared_cache[iter->first];
+        buffers.insert(buffers.end(), iter->second.begin(),
+                iter->second.end());
+    }
+    cache.clear();
+}
+
+void BlockBufferPool::set_max_cached_bytes(uint64 max_bytes)
+{
+    max_cached_bytes = max_bytes;
+}
+
+void BlockBufferPool::set_thread_cache_size(int num_buffers)
+{
+    thread_cache_size = num_buffers;
+}
+
+void BlockBufferPool::clear()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    for (BufferCache::iterator iter = shared_cache.begin();
+            iter != shared_cache.end(); ++iter) {
+        for (unsigned int i = 0; i < iter->second.size(); ++i) {
+            cached_bytes -= iter->first;
+            delete iter->second[i];
+        }
+    }
+    shared_cache.clear();
+}
+
+double BlockBufferPool::get_hit_rate() const
+{
+    uint64 requests = get_num_requests();
+    if (requests == 0) {
+        return 0;
+    }
+    return double(get_num_hits()) / requests;
+}
+
+}
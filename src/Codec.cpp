@@ -0,0 +1,473 @@
+#include "Codec.h"
+#include "LabelBlockCodec.h"
+#include "DVIDException.h"
+#include "Trace.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#ifdef LIBDVID_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef LIBDVID_HAVE_SNAPPY
+#include <snappy-c.h>
+#endif
+
+using std::string; using std::vector; using std::map;
+
+namespace libdvid {
+
+BinaryDataPtr Codec::encode(const BinaryDataPtr binary, int level) const
+{
+    throw ErrMsg("Codec " + get_name() + " cannot encode");
+}
+
+void Codec::decode(const BinaryDataPtr binary, byte* output,
+        uint64 decoded_size) const
+{
+    BinaryDataPtr decoded = decode(binary, decoded_size);
+    if (uint64(decoded->length()) != decoded_size) {
+        throw ErrMsg("Codec " + get_name() + " decoded an unexpected size");
+    }
+    memcpy(output, decoded->get_raw(), decoded_size);
+}
+
+/*!
+ * LZ4 block format (the format DVID uses for compression=lz4).  The
+ * level is passed to BinaryData::compress_lz4.
+*/
+class Lz4Codec : public Codec {
+  public:
+    string get_name() const
+    {
+        return "lz4";
+    }
+
+    unsigned int get_capabilities() const
+    {
+        return CODEC_ENCODE | CODEC_DECODE | CODEC_LOSSLESS |
+            CODEC_DVID_VOLUME;
+    }
+
+    BinaryDataPtr encode(const BinaryDataPtr binary, int level) const
+    {
+        return BinaryData::compress_lz4(binary, level);
+    }
+
+    BinaryDataPtr decode(const BinaryDataPtr binary,
+            uint64 decoded_size) const
+    {
+        check_size(decoded_size);
+        return BinaryData::decompress_lz4(binary, int(decoded_size));
+    }
+
+    void decode(const BinaryDataPtr binary, byte* output,
+            uint64 decoded_size) const
+    {
+        check_size(decoded_size);
+        BinaryData::decompress_lz4(binary, int(decoded_size),
+                (char*) output);
+    }
+
+  private:
+    //! lz4 blocks do not record their size
+    static void check_size(uint64 decoded_size)
+    {
+        if (!decoded_size || (decoded_size > INT_MAX)) {
+            throw ErrMsg("lz4 requires a decoded size below 2 GB");
+        }
+    }
+};
+
+/*!
+ * gzip (zlib deflate with a gzip header).  Levels 1 to 9 trade speed
+ * for ratio.  Decoding also accepts zlib streams.
+*/
+class GzipCodec : public Codec {
+  public:
+    string get_name() const
+    {
+        return "gzip";
+    }
+
+    unsigned int get_capabilities() const
+    {
+        return CODEC_ENCODE | CODEC_DECODE | CODEC_LOSSLESS |
+            CODEC_DVID_VOLUME;
+    }
+
+    BinaryDataPtr encode(const BinaryDataPtr binary, int level) const
+    {
+        TraceScope trace("gzip compress", "codec");
+        if (level == 0) {
+            level = Z_DEFAULT_COMPRESSION;
+        } else if (level < 1) {
+            level = 1;
+        } else if (level > 9) {
+            level = 9;
+        }
+
+        check_size(binary->length());
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8,
+                    Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw ErrMsg("Could not initialize gzip compression");
+        }
+
+        // compress in one call into a buffer of the worst-case size
+        BinaryDataPtr encoded = BinaryData::create_binary_data();
+        string& data = encoded->get_data();
+        try {
+            data.resize(deflateBound(&stream, binary->length()));
+        } catch (...) {
+            deflateEnd(&stream);
+            throw;
+        }
+        stream.next_in = (Bytef*) binary->get_raw();
+        stream.avail_in = binary->length();
+        stream.next_out = (Bytef*) &data[0];
+        stream.avail_out = data.size();
+        int status = deflate(&stream, Z_FINISH);
+        uLong encoded_size = stream.total_out;
+        deflateEnd(&stream);
+
+        if (status != Z_STREAM_END) {
+            throw ErrMsg("Compression of gzip failed");
+        }
+        data.resize(encoded_size);
+        return encoded;
+    }
+
+    BinaryDataPtr decode(const BinaryDataPtr binary,
+            uint64 decoded_size) const
+    {
+        BinaryDataPtr decoded = BinaryData::create_binary_data();
+        string& data = decoded->get_data();
+        if (decoded_size) {
+            data.resize(decoded_size);
+            decode(binary, (byte*) &data[0], decoded_size);
+            return decoded;
+        }
+
+        TraceScope trace("gzip decompress", "codec");
+        z_stream stream;
+        start_inflate(binary, stream);
+
+        // grow the output until the stream ends
+        int status = Z_OK;
+        try {
+            data.resize(binary->length() * 4 + 1024);
+            while (status == Z_OK) {
+                if (stream.total_out == data.size()) {
+                    data.resize(data.size() * 2);
+                }
+                stream.next_out = (Bytef*) &data[stream.total_out];
+                stream.avail_out = std::min(data.size() - stream.total_out,
+                        size_t(UINT_MAX));
+                status = inflate(&stream, Z_NO_FLUSH);
+            }
+        } catch (...) {
+            inflateEnd(&stream);
+            throw;
+        }
+        uLong total_out = stream.total_out;
+        inflateEnd(&stream);
+
+        if (status != Z_STREAM_END) {
+            throw ErrMsg("Decompression of gzip failed");
+        }
+        data.resize(total_out);
+        return decoded;
+    }
+
+    void decode(const BinaryDataPtr binary, byte* output,
+            uint64 decoded_size) const
+    {
+        TraceScope trace("gzip decompress", "codec");
+        check_size(decoded_size);
+        z_stream stream;
+        start_inflate(binary, stream);
+        stream.next_out = output;
+        stream.avail_out = decoded_size;
+        int status = inflate(&stream, Z_FINISH);
+        uLong total_out = stream.total_out;
+        inflateEnd(&stream);
+
+        if ((status != Z_STREAM_END) || (total_out != decoded_size)) {
+            throw ErrMsg("Decompression of gzip failed");
+        }
+    }
+
+  private:
+    //! zlib counts the bytes of one call in 32 bits
+    static void check_size(uint64 size)
+    {
+        if (size > UINT_MAX) {
+            throw ErrMsg("gzip requires data below 4 GB");
+        }
+    }
+
+    //! prepares to inflate a gzip or zlib stream
+    static void start_inflate(const BinaryDataPtr binary, z_stream& stream)
+    {
+        check_size(binary->length());
+        memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+            throw ErrMsg("Could not initialize gzip decompression");
+        }
+        stream.next_in = (Bytef*) binary->get_raw();
+        stream.avail_in = binary->length();
+    }
+};
+
+#ifdef LIBDVID_HAVE_ZSTD
+/*!
+ * Zstandard frames.  Levels follow zstd (negative levels are faster).
+*/
+class ZstdCodec : public Codec {
+  public:
+    string get_name() const
+    {
+        return "zstd";
+    }
+
+    unsigned int get_capabilities() const
+    {
+        return CODEC_ENCODE | CODEC_DECODE | CODEC_LOSSLESS;
+    }
+
+    BinaryDataPtr encode(const BinaryDataPtr binary, int level) const
+    {
+        TraceScope trace("zstd compress", "codec");
+        if (level > ZSTD_maxCLevel()) {
+            level = ZSTD_maxCLevel();
+        }
+
+        BinaryDataPtr encoded = BinaryData::create_binary_data();
+        string& data = encoded->get_data();
+        data.resize(ZSTD_compressBound(binary->length()));
+        size_t encoded_size = ZSTD_compress(&data[0], data.size(),
+                binary->get_raw(), binary->length(), level);
+        if (ZSTD_isError(encoded_size)) {
+            throw ErrMsg("Compression of zstd failed");
+        }
+        data.resize(encoded_size);
+        return encoded;
+    }
+
+    BinaryDataPtr decode(const BinaryDataPtr binary,
+            uint64 decoded_size) const
+    {
+        // frames normally record their size
+        if (!decoded_size) {
+            unsigned long long frame_size = ZSTD_getFrameContentSize(
+                    binary->get_raw(), binary->length());
+            if ((frame_size == ZSTD_CONTENTSIZE_UNKNOWN) ||
+                    (frame_size == ZSTD_CONTENTSIZE_ERROR)) {
+                throw ErrMsg("zstd frame does not record its size");
+            }
+            decoded_size = frame_size;
+        }
+
+        BinaryDataPtr decoded = BinaryData::create_binary_data();
+        string& data = decoded->get_data();
+        data.resize(decoded_size);
+        if (decoded_size) {
+            decode(binary, (byte*) &data[0], decoded_size);
+        }
+        return decoded;
+    }
+
+    void decode(const BinaryDataPtr binary, byte* output,
+            uint64 decoded_size) const
+    {
+        TraceScope trace("zstd decompress", "codec");
+        size_t size = ZSTD_decompress(output, decoded_size,
+                binary->get_raw(), binary->length());
+        if (ZSTD_isError(size) || (size != decoded_size)) {
+            throw ErrMsg("Decompression of zstd failed");
+        }
+    }
+};
+#endif
+
+#ifdef LIBDVID_HAVE_SNAPPY
+/*!
+ * Snappy raw format (no levels).
+*/
+class SnappyCodec : public Codec {
+  public:
+    string get_name() const
+    {
+        return "snappy";
+    }
+
+    unsigned int get_capabilities() const
+    {
+        return CODEC_ENCODE | CODEC_DECODE | CODEC_LOSSLESS;
+    }
+
+    BinaryDataPtr encode(const BinaryDataPtr binary, int level) const
+    {
+        TraceScope trace("snappy compress", "codec");
+        BinaryDataPtr encoded = BinaryData::create_binary_data();
+        string& data = encoded->get_data();
+        size_t encoded_size = snappy_max_compressed_length(binary->length());
+        data.resize(encoded_size);
+        if (snappy_compress((const char*) binary->get_raw(),
+                    binary->length(), &data[0], &encoded_size) != SNAPPY_OK) {
+            throw ErrMsg("Compression of snappy failed");
+        }
+        data.resize(encoded_size);
+        return encoded;
+    }
+
+    BinaryDataPtr decode(const BinaryDataPtr binary,
+            uint64 decoded_size) const
+    {
+        size_t size = 0;
+        if (snappy_uncompressed_length((const char*) binary->get_raw(),
+                    binary->length(), &size) != SNAPPY_OK) {
+            throw ErrMsg("Decompression of snappy failed");
+        }
+
+        BinaryDataPtr decoded = BinaryData::create_binary_data();
+        string& data = decoded->get_data();
+        data.resize(size);
+        if (size) {
+            decode(binary, (byte*) &data[0], size);
+        }
+        return decoded;
+    }
+
+    void decode(const BinaryDataPtr binary, byte* output,
+            uint64 decoded_size) const
+    {
+        TraceScope trace("snappy decompress", "codec");
+        size_t size = 0;
+        if ((snappy_uncompressed_length((const char*) binary->get_raw(),
+                    binary->length(), &size) != SNAPPY_OK) ||
+                (size != decoded_size)) {
+            throw ErrMsg("Decompression of snappy failed");
+        }
+        if (snappy_uncompress((const char*) binary->get_raw(),
+                    binary->length(), (char*) output, &size) != SNAPPY_OK) {
+            throw ErrMsg("Decompression of snappy failed");
+        }
+    }
+};
+#endif
+
+/*!
+ * Decode-only codec for the jpeg and png tiles served by DVID.
+*/
+class ImageCodec : public Codec {
+  public:
+    explicit ImageCodec(ImageFormat format_) : format(format_) {}
+
+    string get_name() const
+    {
+        return (format == JPEG_IMAGE) ? "jpeg" : "png";
+    }
+
+    unsigned int get_capabilities() const
+    {
+        return CODEC_DECODE | CODEC_IMAGE;
+    }
+
+    BinaryDataPtr decode(const BinaryDataPtr binary,
+            uint64 decoded_size) const
+    {
+        unsigned int width, height;
+        BinaryDataPtr decoded = (format == JPEG_IMAGE) ?
+            BinaryData::decompress_jpeg(binary, width, height) :
+            BinaryData::decompress_png8(binary, width, height);
+        if (decoded_size && (uint64(decoded->length()) != decoded_size)) {
+            throw ErrMsg("Image does not have the expected size");
+        }
+        return decoded;
+    }
+
+    void decode(const BinaryDataPtr binary, byte* output,
+            uint64 decoded_size) const
+    {
+        unsigned int width, height;
+        if (format == JPEG_IMAGE) {
+            BinaryData::decompress_jpeg(binary, output, decoded_size,
+                    width, height);
+        } else {
+            BinaryData::decompress_png8(binary, output, decoded_size,
+                    width, height);
+        }
+        if (uint64(width) * height != decoded_size) {
+            throw ErrMsg("Image does not have the expected size");
+        }
+    }
+
+  private:
+    ImageFormat format;
+};
+
+CodecRegistry& CodecRegistry::get_registry()
+{
+    // intentionally leaked so that codecs can be used during exit
+    static CodecRegistry* registry = new CodecRegistry;
+    return *registry;
+}
+
+CodecRegistry::CodecRegistry()
+{
+    register_codec(CodecPtr(new Lz4Codec));
+    register_codec(CodecPtr(new GzipCodec));
+#ifdef LIBDVID_HAVE_ZSTD
+    register_codec(CodecPtr(new ZstdCodec));
+#endif
+#ifdef LIBDVID_HAVE_SNAPPY
+    register_codec(CodecPtr(new SnappyCodec));
+#endif
+    register_codec(CodecPtr(new ImageCodec(JPEG_IMAGE)));
+    register_codec(CodecPtr(new ImageCodec(PNG_IMAGE)));
+    register_codec(CodecPtr(new LabelBlockCodec));
+}
+
+void CodecRegistry::register_codec(CodecPtr codec)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    codecs[codec->get_name()] = codec;
+}
+
+bool CodecRegistry::has_codec(const string& name)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return codecs.find(name) != codecs.end();
+}
+
+CodecPtr CodecRegistry::get_codec(const string& name)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    map<string, CodecPtr>::iterator iter = codecs.find(name);
+    if (iter == codecs.end()) {
+        throw ErrMsg("Codec " + name + " is not registered");
+    }
+    return iter->second;
+}
+
+vector<string> CodecRegistry::get_codec_names(unsigned int capabilities)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    vector<string> names;
+    for (map<string, CodecPtr>::iterator iter = codecs.begin();
+            iter != codecs.end(); ++iter) {
+        if (iter->second->has_capabilities(capabilities)) {
+            names.push_back(iter->first);
+        }
+    }
+    return names;
+}
+
+}
@@ -1,7 +1,18 @@
 #include <cstring>
+#include <cstdio>
 
 #include "DVIDConnection.h"
+#include "DVIDRequestEngine.h"
 #include "DVIDException.h"
+#include "ResponseBuffer.h"
+#include "UploadSource.h"
+#include "Trace.h"
+#include "RetryPolicy.h"
+
+#include <boost/exception_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread_time.hpp>
 
 extern "C" {
 #include <curl/curl.h>
@@ -9,51 +20,180 @@ extern "C" {
 
 using std::string;
 
+namespace libdvid {
+
 /*!
- * Initializes libcurl libraries.  This could probably be a singleton
- * but the static scope make unauthorized access unlikely
+ * State shared with the curl upload callbacks.  Exceptions cannot cross
+ * the curl C interface so a failure is recorded and rethrown afterwards.
 */
-struct CurlEnv {
-    CurlEnv() { curl_global_init(CURL_GLOBAL_ALL); }
-    ~CurlEnv() { curl_global_cleanup(); }
+struct UploadContext {
+    explicit UploadContext(UploadSource* source_) : source(source_) {}
+    UploadSource* source;
+    string error;
 };
-static CurlEnv curl_env;
 
-//! Function for libcurl that writes results into a string buffer
+//! Function for libcurl that pulls the request body from an UploadSource
 static size_t
-WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp)
+UploadReadCallback(char* buffer, size_t size, size_t nitems, void* userp)
 {
-    size_t realsize = size * nmemb;
-    string* str = (string*) userp;
-    str->append((const char*) contents, realsize);
-    return realsize;
+    UploadContext* context = (UploadContext*) userp;
+    try {
+        return context->source->read(buffer, size * nitems);
+    } catch (std::exception& e) {
+        context->error = e.what();
+    } catch (...) {
+        context->error = "Unknown error reading upload";
+    }
+    return CURL_READFUNC_ABORT;
 }
 
-namespace libdvid {
+//! Function for libcurl that restarts an UploadSource (only to the start)
+static int UploadSeekCallback(void* userp, curl_off_t offset, int origin)
+{
+    UploadContext* context = (UploadContext*) userp;
+    if ((offset != 0) || (origin != SEEK_SET)) {
+        return CURL_SEEKFUNC_CANTSEEK;
+    }
+    return context->source->rewind() ? CURL_SEEKFUNC_OK :
+        CURL_SEEKFUNC_CANTSEEK;
+}
+
+/*!
+ * Completes a promise with the response of an asynchronous request.
+ * Transfer failures are stored as a DVIDException.
+*/
+struct FulfillResponse {
+    FulfillResponse(boost::shared_ptr<boost::promise<DVIDResponse> > promise_,
+            string url_) : promise(promise_), url(url_) {}
+
+    void operator()(DVIDResponse& response)
+    {
+        if (response.curl_code != CURLE_OK) {
+            promise->set_exception(boost::copy_exception(
+                DVIDConnectionException("DVIDConnection error: " + url +
+                    "\n" + response.error_msg, response.status,
+                    response.curl_code,
+                    DVIDConnection::is_transient_error(response.curl_code))));
+        } else {
+            promise->set_value(response);
+        }
+    }
+
+    boost::shared_ptr<boost::promise<DVIDResponse> > promise;
+    string url;
+};
+
+/*!
+ * Responses of the original request (0) and the hedge (1) of a hedged
+ * read.  The first successful response wins; a failure only wins if
+ * no other attempt is outstanding.
+*/
+struct HedgeRace {
+    HedgeRace() : outstanding(0), done(false), winner(-1)
+    {
+        ids[0] = ids[1] = 0;
+    }
+
+    boost::mutex mutex;
+    boost::condition_variable finished;
+
+    //! engine ids of the attempts (0 if not sent)
+    uint64 ids[2];
+
+    //! attempts that have not responded
+    int outstanding;
+
+    //! set once the winning response is stored
+    bool done;
+
+    //! attempt that won
+    int winner;
+
+    //! winning response
+    DVIDResponse response;
+};
+
+/*!
+ * Records the response of one attempt of a hedged read.
+*/
+struct FinishHedge {
+    FinishHedge(boost::shared_ptr<HedgeRace> race_, int attempt_) :
+        race(race_), attempt(attempt_) {}
+
+    void operator()(DVIDResponse& response)
+    {
+        boost::mutex::scoped_lock lock(race->mutex);
+        --(race->outstanding);
+        if (race->done) {
+            return;
+        }
+        bool succeeded = (response.curl_code == CURLE_OK) &&
+            (response.status < 500);
+        if (succeeded || (race->outstanding == 0)) {
+            race->done = true;
+            race->winner = attempt;
+            race->response = response;
+            race->finished.notify_all();
+        }
+    }
+
+    boost::shared_ptr<HedgeRace> race;
+    int attempt;
+};
 
 const int DVIDConnection::DEFAULT_TIMEOUT;
 
 //! Defines DVID prefix -- this might have a version ID eventually 
 const char* DVIDConnection::DVID_PREFIX = "/api";
 
-DVIDConnection::DVIDConnection(string addr_) : addr(addr_)
+DVIDConnection::DVIDConnection(string addr_) : addr(addr_), url_root(addr_),
+    priority(NORMAL_PRIORITY), hedging(false)
 {
-    curl_connection = curl_easy_init();
+    pool = DVIDConnectionPool::get_pool(addr);
+    if (!pool->get_unix_socket().empty()) {
+        url_root = "http://localhost";
+    }
 }
 
-DVIDConnection::DVIDConnection(const DVIDConnection& copy_connection)
+DVIDConnection::DVIDConnection(const DVIDConnection& copy_connection) :
+    pool(copy_connection.pool), addr(copy_connection.addr),
+    url_root(copy_connection.url_root), priority(copy_connection.priority),
+    hedging(copy_connection.hedging)
 {
-    addr = copy_connection.addr;
-    curl_connection = curl_easy_init();
 }
 
 DVIDConnection::~DVIDConnection()
 {
-    curl_easy_cleanup(curl_connection);
+}
+
+const char* DVIDConnection::get_trace_name(ConnectionMethod method)
+{
+    static const char* names[] = { "HTTP HEAD", "HTTP GET", "HTTP POST",
+        "HTTP PUT", "HTTP DELETE" };
+    return names[method];
+}
+
+bool DVIDConnection::is_transient_error(int curl_code)
+{
+    switch (curl_code) {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+            return true;
+        default:
+            return false;
+    }
 }
 
 int DVIDConnection::make_head_request(string endpoint) {
     CURLcode result;
+    retry_sleep(pool->get_flow_controller()->reserve(0));
+    DVIDConnectionPool::PooledHandle handle(pool, priority);
+    void* curl_connection = handle.get();
 
     // load url
     string url = get_uri_root() + endpoint;
@@ -63,17 +203,24 @@ int DVIDConnection::make_head_request(string endpoint) {
     struct curl_slist *headers=0;
     curl_easy_setopt(curl_connection, CURLOPT_NOBODY, 1);
     curl_easy_setopt(curl_connection, CURLOPT_HTTPHEADER, headers);
-    result = curl_easy_perform(curl_connection);
+    {
+        TraceScope trace(get_trace_name(HEAD), "http", endpoint);
+        result = curl_easy_perform(curl_connection);
+    }
+    RequestTiming timing = get_request_timing(curl_connection);
+    pool->get_stats()->record(RequestStats::classify_endpoint(endpoint),
+            timing, result != CURLE_OK);
     
     // get the error code
     long http_code = 0;
     curl_easy_getinfo (curl_connection, CURLINFO_RESPONSE_CODE, &http_code);
-    
-    curl_easy_setopt(curl_connection, CURLOPT_NOBODY, 0);
+    pool->get_flow_controller()->end(int(http_code), result != CURLE_OK,
+            timing);
 
     // throw exception if connection doesn't work
     if (result != CURLE_OK) {
-        throw DVIDException("DVIDConnection error: " + string(url), http_code);
+        throw DVIDConnectionException("DVIDConnection error: " + string(url),
+                http_code, int(result), is_transient_error(int(result)));
     }
     return int(http_code);
 }
@@ -82,8 +229,79 @@ int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
         BinaryDataPtr payload, BinaryDataPtr results, string& error_msg,
         ConnectionType type, int timeout)
 {
+    // results should be an empty binary array
+    assert(results);
+    assert(results->length() == 0);
+
+    // response is sized from Content-Length when the server provides it
+    ResponseBuffer buffer(results);
+    return perform_request(endpoint, method, payload, 0, buffer, false,
+            error_msg, type, timeout);
+}
+
+int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
+        BinaryDataPtr payload, ResponseSink& sink, string& error_msg,
+        ConnectionType type, int timeout)
+{
+    return perform_request(endpoint, method, payload, 0, sink, true,
+            error_msg, type, timeout);
+}
+
+int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
+        UploadSource& source, BinaryDataPtr results, string& error_msg,
+        ConnectionType type, int timeout)
+{
+    // results should be an empty binary array
+    assert(results);
+    assert(results->length() == 0);
+
+    ResponseBuffer buffer(results);
+    return perform_request(endpoint, method, BinaryDataPtr(), &source,
+            buffer, false, error_msg, type, timeout);
+}
+
+int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
+        BinaryDataPtr payload, char* results, size_t capacity,
+        size_t& length, string& error_msg, ConnectionType type, int timeout)
+{
+    ResponseBuffer buffer(results, capacity);
+    int status = perform_request(endpoint, method, payload, 0, buffer,
+            false, error_msg, type, timeout);
+    length = buffer.get_bytes_received();
+    return status;
+}
+
+int DVIDConnection::perform_request(string endpoint, ConnectionMethod method,
+        BinaryDataPtr payload, UploadSource* source, ResponseSink& sink,
+        bool divert_errors, string& error_msg, ConnectionType type,
+        int timeout)
+{
+    // reads that are slow compared to recent requests are duplicated
+    // (except in engine callbacks, which would wait on themselves)
+    if (hedging && (method == GET) && !payload && !source &&
+            !DVIDRequestEngine::get_engine().in_io_thread()) {
+        double delay = pool->get_hedger()->begin_request(
+                RequestStats::classify_endpoint(endpoint));
+        if (delay >= 0) {
+            return perform_hedged_request(endpoint, sink, divert_errors,
+                    error_msg, type, timeout, delay);
+        }
+    }
+
     CURLcode result;
 
+    // wait for the client-side limits before taking a handle
+    uint64 upload_bytes = 0;
+    if (source) {
+        upload_bytes = (source->size() > 0) ? uint64(source->size()) : 0;
+    } else if (payload) {
+        upload_bytes = payload->length();
+    }
+    retry_sleep(pool->get_flow_controller()->reserve(upload_bytes));
+
+    DVIDConnectionPool::PooledHandle handle(pool, priority);
+    void* curl_connection = handle.get();
+
     // pass the custom headers
     struct curl_slist *headers=0;
     if (type == JSON) {
@@ -91,8 +309,12 @@ int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
     } else if (type == BINARY) {
         headers = curl_slist_append(headers, "Content-Type: application/octet-stream");
     } 
+
+    // stream the body if its size is unknown
+    if (source && (source->size() < 0)) {
+        headers = curl_slist_append(headers, "Transfer-Encoding: chunked");
+    }
     curl_easy_setopt(curl_connection, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl_connection, CURLOPT_NOSIGNAL, 1);
 
     // load url
     string url = get_uri_root() + endpoint;
@@ -116,25 +338,38 @@ int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
     curl_easy_setopt(curl_connection, CURLOPT_TIMEOUT, long(timeout));
 
     // post binary data
-    if (payload) {
+    UploadContext upload(source);
+    if (source) {
+        // body is pulled from the source as it is sent
+        curl_easy_setopt(curl_connection, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl_connection, CURLOPT_READFUNCTION,
+                UploadReadCallback);
+        curl_easy_setopt(curl_connection, CURLOPT_READDATA, (void *)&upload);
+        curl_easy_setopt(curl_connection, CURLOPT_SEEKFUNCTION,
+                UploadSeekCallback);
+        curl_easy_setopt(curl_connection, CURLOPT_SEEKDATA, (void *)&upload);
+        if (source->size() >= 0) {
+            curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDSIZE_LARGE,
+                    curl_off_t(source->size()));
+        }
+    } else if (payload) {
         // set binary payload and indicate size
         curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDS, payload->get_raw());
-        curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDSIZE, long(payload->length()));
+        curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDSIZE_LARGE,
+                curl_off_t(payload->length()));
     } else {
         curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDS, 0);
         curl_easy_setopt(curl_connection, CURLOPT_POSTFIELDSIZE, long(0));
     }
     
-    // results should be an empty binary array
-    assert(results);
-    assert(results->length() == 0);
-
-    // pass the raw pointer to the write data command
-    string& raw_data = results->get_data();
-
-    // set callback for writing data
-    curl_easy_setopt(curl_connection, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl_connection, CURLOPT_WRITEDATA, (void *)&raw_data);
+    // set callbacks for writing data
+    ResponseSinkAdapter adapter(sink, divert_errors);
+    curl_easy_setopt(curl_connection, CURLOPT_WRITEFUNCTION,
+            ResponseSinkAdapter::write_callback);
+    curl_easy_setopt(curl_connection, CURLOPT_WRITEDATA, (void *)&adapter);
+    curl_easy_setopt(curl_connection, CURLOPT_HEADERFUNCTION,
+            ResponseSinkAdapter::header_callback);
+    curl_easy_setopt(curl_connection, CURLOPT_HEADERDATA, (void *)&adapter);
 
     // set verbose only for debug
     //curl_easy_setopt(curl_connection, CURLOPT_VERBOSE, 1L);
@@ -145,22 +380,151 @@ int DVIDConnection::make_request(string endpoint, ConnectionMethod method,
     curl_easy_setopt(curl_connection, CURLOPT_ERRORBUFFER, error_buf);
 
     // actually perform the request
-    result = curl_easy_perform(curl_connection);
+    {
+        TraceScope trace(get_trace_name(method), "http", endpoint);
+        result = curl_easy_perform(curl_connection);
+    }
+    curl_slist_free_all(headers);
+    RequestTiming timing = get_request_timing(curl_connection);
+    pool->get_stats()->record(RequestStats::classify_endpoint(endpoint),
+            timing, result != CURLE_OK);
     
     // get the error code
     long http_code = 0;
     curl_easy_getinfo (curl_connection, CURLINFO_RESPONSE_CODE, &http_code);
+    pool->get_flow_controller()->end(int(http_code), result != CURLE_OK,
+            timing);
+
+    if (result == CURLE_OK) {
+        adapter.complete();
+    }
     
+    if (!adapter.get_error().empty()) {
+        throw ErrMsg("Response from " + url + " failed: " + adapter.get_error());
+    }
+    if (!upload.error.empty()) {
+        throw ErrMsg("Upload to " + url + " failed: " + upload.error);
+    }
+
     // throw exception if connection doesn't work
     if (result != CURLE_OK) {
-        throw DVIDException("DVIDConnection error: " + string(url), http_code);
+        throw DVIDConnectionException("DVIDConnection error: " + string(url),
+                http_code, int(result), is_transient_error(int(result)));
     }
 
     // load error if there is one
     error_msg = error_buf;
+    if (!adapter.get_error_body().empty()) {
+        if (!error_msg.empty()) {
+            error_msg += "\n";
+        }
+        error_msg += adapter.get_error_body();
+    }
 
     // return status
     return int(http_code);
 }
 
+int DVIDConnection::perform_hedged_request(string endpoint,
+        ResponseSink& sink, bool divert_errors, string& error_msg,
+        ConnectionType type, int timeout, double delay)
+{
+    DVIDRequestEngine& engine = DVIDRequestEngine::get_engine();
+    string url = get_uri_root() + endpoint;
+    boost::shared_ptr<HedgeRace> race(new HedgeRace);
+    race->outstanding = 1;
+    race->ids[0] = engine.submit(url, GET, BinaryDataPtr(), type, timeout,
+            FinishHedge(race, 0), 0, pool, priority);
+
+    boost::mutex::scoped_lock lock(race->mutex);
+    boost::system_time deadline = boost::get_system_time() +
+        boost::posix_time::microseconds((long long)(delay * 1000000));
+    while (!race->done && race->finished.timed_wait(lock, deadline)) {
+    }
+
+    // send the hedge if the original is still outstanding
+    if (!race->done && pool->get_hedger()->try_hedge()) {
+        ++(race->outstanding);
+        lock.unlock();
+        try {
+            uint64 id = engine.submit(url, GET, BinaryDataPtr(), type,
+                    timeout, FinishHedge(race, 1), 0, pool, priority);
+            lock.lock();
+            race->ids[1] = id;
+            lock.unlock();
+        } catch (std::exception&) {
+            // the original request is still outstanding
+            lock.lock();
+            --(race->outstanding);
+            lock.unlock();
+        }
+        lock.lock();
+    }
+    while (!race->done) {
+        race->finished.wait(lock);
+    }
+    if (race->winner == 1) {
+        pool->get_hedger()->record_hedge_win();
+    }
+    DVIDResponse response = race->response;
+    uint64 loser = (race->outstanding > 0) ? race->ids[1 - race->winner] : 0;
+    lock.unlock();
+
+    // the losing attempt would only occupy a connection
+    if (loser) {
+        engine.cancel(loser);
+    }
+
+    error_msg = response.error_msg;
+    if (response.curl_code != CURLE_OK) {
+        throw DVIDConnectionException("DVIDConnection error: " + url,
+                response.status, response.curl_code,
+                is_transient_error(response.curl_code));
+    }
+
+    // replay the winning body into the sink
+    const string& body = response.data->get_data();
+    if (divert_errors && ((response.status < 200) ||
+                (response.status >= 300))) {
+        if (!error_msg.empty()) {
+            error_msg += "\n";
+        }
+        error_msg += body;
+        return response.status;
+    }
+    try {
+        sink.begin(response.status, (long long)(body.size()));
+        if (!body.empty()) {
+            sink.write(body.data(), body.size());
+        }
+        sink.finish();
+    } catch (std::exception& e) {
+        throw ErrMsg("Response from " + url + " failed: " + e.what());
+    }
+    return response.status;
+}
+
+DVIDResponseFuture DVIDConnection::make_request_async(string endpoint,
+        ConnectionMethod method, BinaryDataPtr payload,
+        ConnectionType type, int timeout)
+{
+    boost::shared_ptr<boost::promise<DVIDResponse> > promise(
+            new boost::promise<DVIDResponse>);
+    DVIDResponseFuture future(promise->get_future());
+
+    string url = get_uri_root() + endpoint;
+    DVIDRequestEngine::get_engine().submit(url, method, payload, type,
+            timeout, FulfillResponse(promise, url), 0, pool, priority);
+    return future;
+}
+
+void DVIDConnection::make_request_async(string endpoint,
+        ConnectionMethod method, BinaryDataPtr payload,
+        ResponseCallback callback, ConnectionType type, int timeout,
+        double delay)
+{
+    DVIDRequestEngine::get_engine().submit(get_uri_root() + endpoint,
+            method, payload, type, timeout, callback, delay, pool, priority);
+}
+
 }
@@ -0,0 +1,206 @@
+#include "DVIDConnectionPool.h"
+#include "DVIDException.h"
+
+#include <map>
+
+extern "C" {
+#include <curl/curl.h>
+}
+
+using std::string;
+using std::map;
+
+/*!
+ * Initializes libcurl libraries.  This could probably be a singleton
+ * but the static scope make unauthorized access unlikely.  It is
+ * defined before the pool registry so that it outlives every pool.
+*/
+struct CurlEnv {
+    CurlEnv() { curl_global_init(CURL_GLOBAL_ALL); }
+    ~CurlEnv() { curl_global_cleanup(); }
+};
+static CurlEnv curl_env;
+
+namespace libdvid {
+
+//! Number of share locks allocated per pool
+static const int NUM_SHARE_LOCKS = 8;
+
+//! All pools in the process keyed by server address
+static map<string, DVIDConnectionPoolPtr> pool_registry;
+
+//! Protects the pool registry
+static boost::mutex pool_registry_mutex;
+
+const int DVIDConnectionPool::DEFAULT_MAX_HANDLES;
+
+//! curl callback that locks the mutex associated with the shared data
+static void lock_share(CURL* handle, curl_lock_data data,
+        curl_lock_access access, void* userptr)
+{
+    boost::mutex* locks = (boost::mutex*) userptr;
+    locks[int(data) % NUM_SHARE_LOCKS].lock();
+}
+
+//! curl callback that unlocks the mutex associated with the shared data
+static void unlock_share(CURL* handle, curl_lock_data data, void* userptr)
+{
+    boost::mutex* locks = (boost::mutex*) userptr;
+    locks[int(data) % NUM_SHARE_LOCKS].unlock();
+}
+
+DVIDConnectionPoolPtr DVIDConnectionPool::get_pool(string addr)
+{
+    boost::mutex::scoped_lock lock(pool_registry_mutex);
+    map<string, DVIDConnectionPoolPtr>::iterator iter = pool_registry.find(addr);
+    if (iter != pool_registry.end()) {
+        return iter->second;
+    }
+    DVIDConnectionPoolPtr pool(new DVIDConnectionPool(addr));
+    pool_registry[addr] = pool;
+    return pool;
+}
+
+string DVIDConnectionPool::parse_unix_socket(const string& addr)
+{
+    const string prefix = "unix://";
+    if (addr.compare(0, prefix.size(), prefix) != 0) {
+        return "";
+    }
+    return addr.substr(prefix.size());
+}
+
+DVIDConnectionPool::DVIDConnectionPool(string addr_) : addr(addr_),
+    unix_socket(parse_unix_socket(addr_)), total_handles(0), max_handles(DEFAULT_MAX_HANDLES),
+    stats(new RequestStats), coalescer(new RequestCoalescer),
+    flow(new FlowController),
+    scheduler(new RequestScheduler(DEFAULT_MAX_HANDLES, flow)),
+    hedger(new RequestHedger(stats))
+{
+#if LIBCURL_VERSION_NUM < 0x072800
+    // unix domain sockets were added in curl 7.40.0
+    if (!unix_socket.empty()) {
+        throw ErrMsg("libcurl is too old for unix socket address " + addr);
+    }
+#endif
+    if (!unix_socket.empty() && unix_socket[0] != '/') {
+        throw ErrMsg("Unix socket address must be absolute: " + addr);
+    }
+    curl_share = curl_share_init();
+    curl_share_setopt(curl_share, CURLSHOPT_LOCKFUNC, lock_share);
+    curl_share_setopt(curl_share, CURLSHOPT_UNLOCKFUNC, unlock_share);
+    curl_share_setopt(curl_share, CURLSHOPT_USERDATA, (void*) share_locks);
+    curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    // connection cache sharing was added in curl 7.57.0
+    curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+}
+
+DVIDConnectionPool::~DVIDConnectionPool()
+{
+    for (unsigned int i = 0; i < idle_handles.size(); ++i) {
+        curl_easy_cleanup(idle_handles[i]);
+    }
+    curl_share_cleanup(curl_share);
+}
+
+void DVIDConnectionPool::init_handle(void* handle)
+{
+    curl_easy_setopt(handle, CURLOPT_SHARE, curl_share);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+#if LIBCURL_VERSION_NUM >= 0x072800
+    if (!unix_socket.empty()) {
+        curl_easy_setopt(handle, CURLOPT_UNIX_SOCKET_PATH,
+                unix_socket.c_str());
+    }
+#endif
+}
+
+void* DVIDConnectionPool::acquire(RequestPriority priority)
+{
+    scheduler->acquire(priority);
+    try {
+        return take_handle();
+    } catch (...) {
+        scheduler->release(priority);
+        throw;
+    }
+}
+
+void* DVIDConnectionPool::take_handle()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    while (idle_handles.empty() && (total_handles >= max_handles)) {
+        handle_available.wait(lock);
+    }
+
+    if (!idle_handles.empty()) {
+        void* handle = idle_handles.back();
+        idle_handles.pop_back();
+        return handle;
+    }
+
+    void* handle = curl_easy_init();
+    if (!handle) {
+        throw ErrMsg("Could not create curl handle for " + addr);
+    }
+    init_handle(handle);
+    ++total_handles;
+    return handle;
+}
+
+void DVIDConnectionPool::release(void* handle, RequestPriority priority)
+{
+    // clears per-request options (e.g., pointers to stack buffers)
+    // but keeps live connections and the caches
+    curl_easy_reset(handle);
+    init_handle(handle);
+
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (total_handles > max_handles) {
+            // cap was lowered while the handle was checked out
+            --total_handles;
+            curl_easy_cleanup(handle);
+        } else {
+            idle_handles.push_back(handle);
+        }
+    }
+    handle_available.notify_one();
+    scheduler->release(priority);
+}
+
+void DVIDConnectionPool::set_max_handles(int max_handles_)
+{
+    if (max_handles_ <= 0) {
+        throw ErrMsg("Connection pool must allow at least one handle");
+    }
+    scheduler->set_capacity(max_handles_);
+    boost::mutex::scoped_lock lock(mutex);
+    max_handles = max_handles_;
+
+    // drop idle handles that exceed the new cap
+    while (!idle_handles.empty() && (total_handles > max_handles)) {
+        curl_easy_cleanup(idle_handles.back());
+        idle_handles.pop_back();
+        --total_handles;
+    }
+    handle_available.notify_all();
+}
+
+int DVIDConnectionPool::get_max_handles()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return max_handles;
+}
+
+int DVIDConnectionPool::num_handles()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return total_handles;
+}
+
+}
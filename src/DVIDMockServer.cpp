@@ -0,0 +1,1779 @@
+#include "DVIDMockServer.h"
+#include "DVIDException.h"
+#include "BinaryData.h"
+#include "Codec.h"
+#include "DVIDRoi.h"
+#include "RetryPolicy.h"
+#include "Globals.h"
+
+#include <json/json.h>
+#include <png++/png.hpp>
+#include <boost/bind.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <map>
+#include <vector>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+using std::pair;
+using std::make_pair;
+using std::stringstream;
+using std::ostringstream;
+
+//! Largest request header accepted
+static const size_t MaxHeaderSize = 1 << 20;
+
+//! Size of the pieces a rate limited body is sent in
+static const size_t SendChunkSize = 1 << 16;
+
+//! Edge of the square tiles returned by imagetile instances
+static const int TileSize = 512;
+
+namespace libdvid {
+
+//! Vertex pair for an edge (smallest id first)
+typedef pair<uint64, uint64> EdgeKey;
+
+//! Transaction id for each vertex
+typedef map<uint64, uint64> TransactionMap;
+
+/*!
+ * A datatype instance.  Only the members for its type are used.
+*/
+struct MockInstance {
+    //! DVID type name (e.g., uint8blk)
+    string type;
+
+    //! name of the instance this one is synced to
+    string sync;
+
+    //! voxel blocks for uint8blk and the label types
+    map<BlockXYZ, string> blocks;
+
+    //! values for keyvalue
+    map<string, string> values;
+
+    //! blocks for roi
+    set<BlockXYZ> roi;
+
+    //! vertex weights for labelgraph
+    map<uint64, double> vertices;
+
+    //! edge weights for labelgraph
+    map<EdgeKey, double> edges;
+
+    //! vertex properties by property key
+    map<string, map<uint64, string> > vertex_properties;
+
+    //! edge properties by property key
+    map<string, map<EdgeKey, string> > edge_properties;
+
+    //! current transaction id of each vertex
+    TransactionMap transactions;
+
+    //! true for labelarray and labelmap (which take compressed blocks)
+    bool has_label_blocks() const
+    {
+        return (type == "labelarray") || (type == "labelmap");
+    }
+
+    //! true for the types with voxels
+    bool has_voxels() const
+    {
+        return (type == "uint8blk") || (type == "labelblk") ||
+            has_label_blocks();
+    }
+
+    //! bytes per voxel for the voxel types
+    int voxel_size() const
+    {
+        return (type == "uint8blk") ? 1 : 8;
+    }
+};
+
+//! Instances in a repository by name
+typedef map<string, MockInstance> MockRepo;
+
+struct DVIDMockServer::Store {
+    Store() : next_repo(1) {}
+
+    //! repositories by uuid
+    map<string, MockRepo> repos;
+
+    //! counter used to create uuids
+    int next_repo;
+
+    //! protects all data
+    boost::mutex mutex;
+};
+
+//! Error response generated while handling a request
+struct MockError {
+    MockError(int status_, string msg_) : status(status_), msg(msg_) {}
+    int status;
+    string msg;
+};
+
+/******************** socket helpers ********************/
+
+//! Send the whole buffer
+static bool send_all(int fd, const char* data, size_t length)
+{
+#ifdef MSG_NOSIGNAL
+    int flags = MSG_NOSIGNAL;
+#else
+    int flags = 0;
+#endif
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+/*!
+ * Buffered reader for one connection.
+*/
+class ConnectionReader {
+  public:
+    explicit ConnectionReader(int fd_) : fd(fd_), pos(0) {}
+
+    //! read until the delimiter and return the text before it
+    bool read_until(const string& delimiter, string& text, size_t limit)
+    {
+        while (true) {
+            size_t found = buffer.find(delimiter, pos);
+            if (found != string::npos) {
+                text = buffer.substr(pos, found - pos);
+                pos = found + delimiter.size();
+                return true;
+            }
+            if ((buffer.size() - pos) > limit || !fill()) {
+                return false;
+            }
+        }
+    }
+
+    //! read exactly length bytes
+    bool read_bytes(size_t length, string& data)
+    {
+        while ((buffer.size() - pos) < length) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        data.append(buffer, pos, length);
+        pos += length;
+        return true;
+    }
+
+  private:
+    bool fill()
+    {
+        // drop consumed data
+        if (pos > 0) {
+            buffer.erase(0, pos);
+            pos = 0;
+        }
+        char chunk[65536];
+        while (true) {
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                return false;
+            }
+            buffer.append(chunk, received);
+            return true;
+        }
+    }
+
+    int fd;
+    string buffer;
+    size_t pos;
+};
+
+/******************** parsing helpers ********************/
+
+//! Split a string on a delimiter
+static vector<string> split(const string& str, char delimiter)
+{
+    vector<string> parts;
+    size_t start = 0;
+    while (true) {
+        size_t end = str.find(delimiter, start);
+        if (end == string::npos) {
+            parts.push_back(str.substr(start));
+            break;
+        }
+        parts.push_back(str.substr(start, end - start));
+        start = end + 1;
+    }
+    return parts;
+}
+
+//! Lower case copy of a string
+static string to_lower(string str)
+{
+    for (unsigned int i = 0; i < str.size(); ++i) {
+        str[i] = tolower(str[i]);
+    }
+    return str;
+}
+
+//! Parse a list of integers like 32_32_32
+static vector<int> parse_ints(const string& str, unsigned int count)
+{
+    vector<string> parts = split(str, '_');
+    if (parts.size() != count) {
+        throw MockError(400, "Expected " + str + " to have 3 values");
+    }
+    vector<int> values;
+    for (unsigned int i = 0; i < parts.size(); ++i) {
+        char* end = 0;
+        long value = strtol(parts[i].c_str(), &end, 10);
+        if (parts[i].empty() || *end) {
+            throw MockError(400, "Bad coordinate " + str);
+        }
+        values.push_back(int(value));
+    }
+    return values;
+}
+
+//! Parse an unsigned 64 bit id
+static uint64 parse_id(const string& str)
+{
+    char* end = 0;
+    unsigned long long value = strtoull(str.c_str(), &end, 10);
+    if (str.empty() || *end) {
+        throw MockError(400, "Bad id " + str);
+    }
+    return uint64(value);
+}
+
+//! Decode a JSON request body
+static Json::Value parse_body(const string& body)
+{
+    Json::Value data;
+    Json::Reader json_reader;
+    if (!json_reader.parse(body, data)) {
+        throw MockError(400, "Could not decode JSON");
+    }
+    return data;
+}
+
+//! Encode JSON for a response
+static string write_json(const Json::Value& data)
+{
+    Json::FastWriter writer;
+    return writer.write(data);
+}
+
+//! Floor of a / b for positive b
+static int floor_div(int a, int b)
+{
+    return (a >= 0) ? (a / b) : -((-a + b - 1) / b);
+}
+
+//! Read a little endian uint64 from a request body
+static uint64 read_uint64(const string& data, size_t& pos)
+{
+    if ((pos + 8) > data.size()) {
+        throw MockError(400, "Truncated binary request");
+    }
+    uint64 value;
+    memcpy(&value, data.data() + pos, 8);
+    pos += 8;
+    return value;
+}
+
+//! Read a little endian int32 from a request body
+static int read_int32(const string& data, size_t& pos)
+{
+    if ((pos + 4) > data.size()) {
+        throw MockError(400, "Truncated binary request");
+    }
+    int value;
+    memcpy(&value, data.data() + pos, 4);
+    pos += 4;
+    return value;
+}
+
+//! Append a uint64 to a response
+static void write_uint64(string& data, uint64 value)
+{
+    data.append((const char*) &value, 8);
+}
+
+//! Append an int32 to a response
+static void write_int32(string& data, int value)
+{
+    data.append((const char*) &value, 4);
+}
+
+/******************** voxel helpers ********************/
+
+//! Number of voxels in a block
+static const size_t BlockVoxels = DEFBLOCKSIZE * DEFBLOCKSIZE * DEFBLOCKSIZE;
+
+/*!
+ * Copies a subvolume between the block store and a buffer
+ * ordered x, y, z.  When reading, missing blocks are zero.
+ * Blocks not in the mask (if given) are skipped (zero when reading).
+*/
+static void copy_volume(MockInstance& instance, vector<int> sizes,
+        vector<int> offset, char* buffer, bool write,
+        const set<BlockXYZ>* mask)
+{
+    int vsize = instance.voxel_size();
+    size_t row_bytes = size_t(sizes[0]) * vsize;
+
+    for (int z = 0; z < sizes[2]; ++z) {
+        int gz = offset[2] + z;
+        int bz = floor_div(gz, DEFBLOCKSIZE);
+        int lz = gz - bz * DEFBLOCKSIZE;
+        for (int y = 0; y < sizes[1]; ++y) {
+            int gy = offset[1] + y;
+            int by = floor_div(gy, DEFBLOCKSIZE);
+            int ly = gy - by * DEFBLOCKSIZE;
+            char* row = buffer + (size_t(z) * sizes[1] + y) * row_bytes;
+
+            // copy runs that stay within one block
+            int x = 0;
+            while (x < sizes[0]) {
+                int gx = offset[0] + x;
+                int bx = floor_div(gx, DEFBLOCKSIZE);
+                int lx = gx - bx * DEFBLOCKSIZE;
+                int run = DEFBLOCKSIZE - lx;
+                if (run > (sizes[0] - x)) {
+                    run = sizes[0] - x;
+                }
+
+                BlockXYZ coord(bx, by, bz);
+                bool masked = mask && (mask->find(coord) == mask->end());
+                size_t block_pos = ((size_t(lz) * DEFBLOCKSIZE + ly) *
+                        DEFBLOCKSIZE + lx) * vsize;
+                char* data = row + size_t(x) * vsize;
+                if (write) {
+                    if (!masked) {
+                        string& block = instance.blocks[coord];
+                        if (block.empty()) {
+                            block.assign(BlockVoxels * vsize, '\0');
+                        }
+                        memcpy(&block[block_pos], data, size_t(run) * vsize);
+                    }
+                } else {
+                    map<BlockXYZ, string>::iterator iter =
+                        instance.blocks.find(coord);
+                    if (masked || iter == instance.blocks.end()) {
+                        memset(data, 0, size_t(run) * vsize);
+                    } else {
+                        memcpy(data, &(iter->second[block_pos]),
+                                size_t(run) * vsize);
+                    }
+                }
+                x += run;
+            }
+        }
+    }
+}
+
+//! Runs of voxels (x start, x end inclusive) for each z, y row
+typedef map<pair<int, int>, vector<pair<int, int> > > VoxelRuns;
+
+/*!
+ * Find the voxel runs of a body in a label instance.
+*/
+static void find_body(MockInstance& labels, uint64 bodyid, VoxelRuns* runs,
+        set<BlockXYZ>& blocks)
+{
+    for (map<BlockXYZ, string>::iterator iter = labels.blocks.begin();
+            iter != labels.blocks.end(); ++iter) {
+        const uint64* data = (const uint64*) iter->second.data();
+        bool found = false;
+        for (int z = 0; z < DEFBLOCKSIZE; ++z) {
+            for (int y = 0; y < DEFBLOCKSIZE; ++y) {
+                int start = -1;
+                for (int x = 0; x <= DEFBLOCKSIZE; ++x) {
+                    bool inside = (x < DEFBLOCKSIZE) &&
+                        (data[(z * DEFBLOCKSIZE + y) * DEFBLOCKSIZE + x] ==
+                         bodyid);
+                    if (inside && start < 0) {
+                        start = x;
+                    } else if (!inside && start >= 0) {
+                        found = true;
+                        if (!runs) {
+                            break;
+                        }
+                        int gx = iter->first.x * DEFBLOCKSIZE;
+                        int gy = iter->first.y * DEFBLOCKSIZE + y;
+                        int gz = iter->first.z * DEFBLOCKSIZE + z;
+                        vector<pair<int, int> >& row =
+                            (*runs)[make_pair(gz, gy)];
+                        // merge with a run ending at the block boundary
+                        if (!row.empty() &&
+                                row.back().second == (gx + start - 1)) {
+                            row.back().second = gx + x - 1;
+                        } else {
+                            row.push_back(make_pair(gx + start, gx + x - 1));
+                        }
+                        start = -1;
+                    }
+                }
+                if (found && !runs) {
+                    break;
+                }
+            }
+            if (found && !runs) {
+                break;
+            }
+        }
+        if (found) {
+            blocks.insert(iter->first);
+        }
+    }
+}
+
+//! Start a sparse volume encoding with the number of spans
+static string sparsevol_header(unsigned int num_spans)
+{
+    string data;
+    data += char(0); // payload descriptor
+    data += char(3); // dimensions
+    data += char(0); // dimension of the run
+    data += char(0); // reserved
+    write_int32(data, 0); // voxel count (unused)
+    write_int32(data, int(num_spans));
+    return data;
+}
+
+/******************** request handlers ********************/
+
+/*!
+ * Handles one request against the store.  Helper functions throw
+ * MockError for bad requests.
+*/
+class MockHandler {
+  public:
+    MockHandler(map<string, MockRepo>& repos_, int& next_repo_) :
+        repos(repos_), next_repo(next_repo_) {}
+
+    int handle(const string& method, const vector<string>& path,
+            const map<string, string>& query, const string& body,
+            string& response, string& content_type)
+    {
+        content_type = "application/json";
+        if (path.size() == 2 && path[0] == "server" && path[1] == "info") {
+            Json::Value data;
+            data["Server"] = "libdvid mock";
+            response = write_json(data);
+            return 200;
+        }
+        if (path.size() == 1 && path[0] == "repos" && method == "POST") {
+            return create_repo(response);
+        }
+        if (path.size() == 3 && path[0] == "repo") {
+            MockRepo& repo = get_repo(path[1]);
+            if (path[2] == "info") {
+                Json::Value data;
+                data["Root"] = path[1];
+                response = write_json(data);
+                return 200;
+            }
+            if (path[2] == "instance" && method == "POST") {
+                return create_instance(repo, body, response);
+            }
+        }
+        if (path.size() >= 4 && path[0] == "node") {
+            MockRepo& repo = get_repo(path[1]);
+            MockRepo::iterator iter = repo.find(path[2]);
+            if (iter == repo.end()) {
+                throw MockError(400, "No instance " + path[2]);
+            }
+            vector<string> args(path.begin() + 4, path.end());
+            return handle_instance(repo, iter->first, iter->second,
+                    method, path[3], args, query, body, response,
+                    content_type);
+        }
+        throw MockError(400, "Unsupported request");
+    }
+
+  private:
+    MockRepo& get_repo(const string& uuid)
+    {
+        map<string, MockRepo>::iterator iter = repos.find(uuid);
+        if (iter == repos.end()) {
+            throw MockError(400, "No repo " + uuid);
+        }
+        return iter->second;
+    }
+
+    MockInstance& get_synced(MockRepo& repo, MockInstance& instance,
+            const string& type)
+    {
+        MockRepo::iterator iter = repo.find(instance.sync);
+        if (iter == repo.end() || iter->second.type != type) {
+            throw MockError(400, "Instance is not synced to a " + type);
+        }
+        return iter->second;
+    }
+
+    int create_repo(string& response)
+    {
+        char uuid[40];
+        snprintf(uuid, sizeof(uuid), "%032x", next_repo++);
+        repos[uuid] = MockRepo();
+        Json::Value data;
+        data["root"] = uuid;
+        response = write_json(data);
+        return 200;
+    }
+
+    int create_instance(MockRepo& repo, const string& body, string& response)
+    {
+        Json::Value data = parse_body(body);
+        string name = data["dataname"].asString();
+        string type = data["typename"].asString();
+        if (name.empty() || repo.find(name) != repo.end()) {
+            throw MockError(400, "Instance " + name + " cannot be created");
+        }
+        if (type != "uint8blk" && type != "labelblk" &&
+                type != "labelarray" && type != "labelmap" &&
+                type != "labelvol" &&
+                type != "keyvalue" && type != "roi" && type != "labelgraph" &&
+                type != "imagetile") {
+            throw MockError(400, "Unsupported type " + type);
+        }
+        MockInstance& instance = repo[name];
+        instance.type = type;
+        instance.sync = data.get("Sync", data.get("Source", "")).asString();
+        response.clear();
+        return 200;
+    }
+
+    int handle_instance(MockRepo& repo, const string& name,
+            MockInstance& instance, const string& method,
+            const string& action, const vector<string>& args,
+            const map<string, string>& query, const string& body,
+            string& response, string& content_type)
+    {
+        if (action == "info" && (method == "GET" || method == "HEAD")) {
+            Json::Value data;
+            data["Base"]["TypeName"] = instance.type;
+            data["Base"]["Name"] = name;
+            data["Extended"] = Json::Value(Json::objectValue);
+            response = write_json(data);
+            return 200;
+        }
+
+        content_type = "application/octet-stream";
+        const string& type = instance.type;
+        if (instance.has_voxels() && action == "raw") {
+            return handle_raw(repo, instance, method, args, query, body,
+                    response);
+        }
+        if (instance.has_label_blocks() && action == "blocks") {
+            return handle_label_blocks(instance, method, args, query, body,
+                    response);
+        }
+        if ((type == "uint8blk" || type == "labelblk") &&
+                action == "blocks") {
+            return handle_blocks(instance, method, args, body, response);
+        }
+        if (type == "labelvol" && (action == "sparsevol" ||
+                    action == "sparsevol-coarse") && args.size() == 1) {
+            return handle_sparsevol(get_synced(repo, instance, "labelblk"),
+                    method, action == "sparsevol-coarse", parse_id(args[0]),
+                    response);
+        }
+        if (type == "imagetile" && action == "tile" && args.size() == 3) {
+            content_type = "image/png";
+            return handle_tile(get_synced(repo, instance, "uint8blk"), args,
+                    response);
+        }
+        if (type == "keyvalue") {
+            return handle_keyvalue(instance, method, action, args, body,
+                    response, content_type);
+        }
+        if (type == "roi") {
+            content_type = "application/json";
+            return handle_roi(instance, method, action, query, body,
+                    response);
+        }
+        if (type == "labelgraph") {
+            return handle_graph(instance, method, action, args, body,
+                    response, content_type);
+        }
+        throw MockError(400, "Unsupported action " + action + " for " + type);
+    }
+
+    int handle_raw(MockRepo& repo, MockInstance& instance,
+            const string& method, const vector<string>& args,
+            const map<string, string>& query, const string& body,
+            string& response)
+    {
+        if (args.size() != 3 || args[0] != "0_1_2") {
+            throw MockError(400, "Only 3D 0_1_2 volumes are supported");
+        }
+        vector<int> sizes = parse_ints(args[1], 3);
+        vector<int> offset = parse_ints(args[2], 3);
+        if (sizes[0] <= 0 || sizes[1] <= 0 || sizes[2] <= 0) {
+            throw MockError(400, "Bad volume size");
+        }
+        size_t volume_size = size_t(sizes[0]) * sizes[1] * sizes[2] *
+            instance.voxel_size();
+
+        // accept the codecs that DVID accepts for volumes
+        CodecPtr codec;
+        map<string, string>::const_iterator compress =
+            query.find("compression");
+        if (compress != query.end()) {
+            CodecRegistry& registry = CodecRegistry::get_registry();
+            if (registry.has_codec(compress->second)) {
+                codec = registry.get_codec(compress->second);
+            }
+            if (!codec || !codec->has_capabilities(CODEC_DVID_VOLUME)) {
+                throw MockError(400, "Unsupported compression");
+            }
+        }
+
+        const set<BlockXYZ>* mask = 0;
+        map<string, string>::const_iterator roi = query.find("roi");
+        if (roi != query.end() && !roi->second.empty()) {
+            MockRepo::iterator iter = repo.find(roi->second);
+            if (iter == repo.end() || iter->second.type != "roi") {
+                throw MockError(400, "No roi " + roi->second);
+            }
+            mask = &(iter->second.roi);
+        }
+
+        if (method == "GET") {
+            BinaryDataPtr volume = BinaryData::create_binary_data();
+            volume->get_data().resize(volume_size);
+            copy_volume(instance, sizes, offset, &(volume->get_data()[0]),
+                    false, mask);
+            if (codec) {
+                volume = codec->encode(volume);
+            }
+            response.swap(volume->get_data());
+            return 200;
+        }
+        if (method == "POST" || method == "PUT") {
+            BinaryDataPtr volume = BinaryData::create_binary_data(
+                    body.data(), body.size());
+            if (codec) {
+                volume = codec->decode(volume, volume_size);
+            }
+            if (volume->length() != volume_size) {
+                throw MockError(400, "Volume size does not match dimensions");
+            }
+            copy_volume(instance, sizes, offset, &(volume->get_data()[0]),
+                    true, mask);
+            return 200;
+        }
+        throw MockError(400, "Unsupported method for raw");
+    }
+
+    int handle_blocks(MockInstance& instance, const string& method,
+            const vector<string>& args, const string& body, string& response)
+    {
+        if (args.size() != 2) {
+            throw MockError(400, "Blocks require a start block and span");
+        }
+        vector<int> start = parse_ints(args[0], 3);
+        int span = atoi(args[1].c_str());
+        if (span <= 0) {
+            throw MockError(400, "Bad block span");
+        }
+        size_t block_bytes = BlockVoxels * instance.voxel_size();
+
+        if (method == "GET") {
+            response.assign(block_bytes * span, '\0');
+            for (int i = 0; i < span; ++i) {
+                map<BlockXYZ, string>::iterator iter = instance.blocks.find(
+                        BlockXYZ(start[0] + i, start[1], start[2]));
+                if (iter != instance.blocks.end()) {
+                    memcpy(&response[block_bytes * i], iter->second.data(),
+                            block_bytes);
+                }
+            }
+            return 200;
+        }
+        if (method == "POST" || method == "PUT") {
+            if (body.size() != block_bytes * span) {
+                throw MockError(400, "Block data does not match the span");
+            }
+            for (int i = 0; i < span; ++i) {
+                instance.blocks[BlockXYZ(start[0] + i, start[1], start[2])] =
+                    body.substr(block_bytes * i, block_bytes);
+            }
+            return 200;
+        }
+        throw MockError(400, "Unsupported method for blocks");
+    }
+
+    /*!
+     * Blocks endpoints of labelarray and labelmap.  GET
+     * blocks/<size>/<offset> returns the stored blocks of a block
+     * aligned subvolume and POST blocks stores blocks.  Each block is
+     * framed by its block coordinate and byte count (4 x int32) and is
+     * a gzip compressed label block ("blocks", the default) or raw
+     * labels ("uncompressed").
+    */
+    int handle_label_blocks(MockInstance& instance, const string& method,
+            const vector<string>& args, const map<string, string>& query,
+            const string& body, string& response)
+    {
+        string compression = "blocks";
+        map<string, string>::const_iterator iter = query.find("compression");
+        if (iter != query.end()) {
+            compression = iter->second;
+        }
+        if (compression != "blocks" && compression != "uncompressed") {
+            throw MockError(400, "Unsupported compression");
+        }
+        CodecRegistry& registry = CodecRegistry::get_registry();
+        CodecPtr block_codec = registry.get_codec("blocks");
+        CodecPtr gzip_codec = registry.get_codec("gzip");
+        size_t block_bytes = BlockVoxels * instance.voxel_size();
+
+        if (method == "GET") {
+            if (args.size() != 2) {
+                throw MockError(400, "Blocks require a size and offset");
+            }
+            vector<int> sizes = parse_ints(args[0], 3);
+            vector<int> offset = parse_ints(args[1], 3);
+            for (int dim = 0; dim < 3; ++dim) {
+                if ((sizes[dim] <= 0) || (sizes[dim] % DEFBLOCKSIZE) ||
+                        (offset[dim] % DEFBLOCKSIZE)) {
+                    throw MockError(400, "Blocks must be block aligned");
+                }
+                sizes[dim] /= DEFBLOCKSIZE;
+                offset[dim] = floor_div(offset[dim], DEFBLOCKSIZE);
+            }
+            response.clear();
+            for (int z = offset[2]; z < offset[2] + sizes[2]; ++z) {
+                for (int y = offset[1]; y < offset[1] + sizes[1]; ++y) {
+                    for (int x = offset[0]; x < offset[0] + sizes[0]; ++x) {
+                        map<BlockXYZ, string>::iterator block =
+                            instance.blocks.find(BlockXYZ(x, y, z));
+                        if (block == instance.blocks.end()) {
+                            continue;
+                        }
+                        BinaryDataPtr data = BinaryData::create_binary_data(
+                                block->second.data(), block_bytes);
+                        if (compression == "blocks") {
+                            data = gzip_codec->encode(
+                                    block_codec->encode(data));
+                        }
+                        write_int32(response, x);
+                        write_int32(response, y);
+                        write_int32(response, z);
+                        write_int32(response, int(data->length()));
+                        response.append((const char*) data->get_raw(),
+                                data->length());
+                    }
+                }
+            }
+            return 200;
+        }
+        if (method == "POST") {
+            if (!args.empty()) {
+                throw MockError(400, "Blocks are posted without a location");
+            }
+            size_t pos = 0;
+            while (pos < body.size()) {
+                int x = read_int32(body, pos);
+                int y = read_int32(body, pos);
+                int z = read_int32(body, pos);
+                int length = read_int32(body, pos);
+                if ((length < 0) || (pos + length > body.size())) {
+                    throw MockError(400, "Truncated block data");
+                }
+                BinaryDataPtr data = BinaryData::create_binary_data(
+                        body.data() + pos, length);
+                pos += length;
+                try {
+                    if (compression == "blocks") {
+                        data = block_codec->decode(gzip_codec->decode(data),
+                                block_bytes);
+                    }
+                } catch (ErrMsg& error) {
+                    throw MockError(400, error.what());
+                }
+                if (data->length() != block_bytes) {
+                    throw MockError(400, "Block data has the wrong size");
+                }
+                instance.blocks[BlockXYZ(x, y, z)] = data->get_data();
+            }
+            return 200;
+        }
+        throw MockError(400, "Unsupported method for blocks");
+    }
+
+    int handle_sparsevol(MockInstance& labels, const string& method,
+            bool coarse, uint64 bodyid, string& response)
+    {
+        set<BlockXYZ> blocks;
+        if (method == "HEAD") {
+            find_body(labels, bodyid, 0, blocks);
+            return blocks.empty() ? 204 : 200;
+        }
+        if (method != "GET") {
+            throw MockError(400, "Unsupported method for sparsevol");
+        }
+
+        VoxelRuns runs;
+        find_body(labels, bodyid, coarse ? 0 : &runs, blocks);
+        if (blocks.empty()) {
+            throw MockError(404, "Body does not exist");
+        }
+
+        string spans;
+        unsigned int num_spans = 0;
+        if (coarse) {
+            // blocks are ordered z, y, x so runs are consecutive
+            set<BlockXYZ>::iterator iter = blocks.begin();
+            while (iter != blocks.end()) {
+                BlockXYZ first = *iter;
+                int length = 1;
+                ++iter;
+                while (iter != blocks.end() && iter->z == first.z &&
+                        iter->y == first.y && iter->x == first.x + length) {
+                    ++length;
+                    ++iter;
+                }
+                write_int32(spans, first.x);
+                write_int32(spans, first.y);
+                write_int32(spans, first.z);
+                write_int32(spans, length);
+                ++num_spans;
+            }
+        } else {
+            for (VoxelRuns::iterator iter = runs.begin(); iter != runs.end();
+                    ++iter) {
+                for (unsigned int i = 0; i < iter->second.size(); ++i) {
+                    write_int32(spans, iter->second[i].first);
+                    write_int32(spans, iter->first.second);
+                    write_int32(spans, iter->first.first);
+                    write_int32(spans, iter->second[i].second -
+                            iter->second[i].first + 1);
+                    ++num_spans;
+                }
+            }
+        }
+        response = sparsevol_header(num_spans) + spans;
+        return 200;
+    }
+
+    int handle_tile(MockInstance& gray, const vector<string>& args,
+            string& response)
+    {
+        int scale = atoi(args[1].c_str());
+        vector<int> loc = parse_ints(args[2], 3);
+        if (scale < 0 || scale > 16) {
+            throw MockError(400, "Bad tile scale");
+        }
+
+        // axes spanned by the tile and the axis of the slice
+        int axis1 = 0, axis2 = 1, slice_axis = 2;
+        if (args[0] == "XZ" || args[0] == "xz") {
+            axis2 = 2; slice_axis = 1;
+        } else if (args[0] == "YZ" || args[0] == "yz") {
+            axis1 = 1; axis2 = 2; slice_axis = 0;
+        } else if (args[0] != "XY" && args[0] != "xy") {
+            throw MockError(400, "Bad tile plane " + args[0]);
+        }
+
+        // sample the volume at the tile scale (nearest voxel)
+        png::image<png::gray_pixel> image(TileSize, TileSize);
+        vector<int> point(3);
+        vector<int> single(3, 1);
+        point[slice_axis] = loc[slice_axis] << scale;
+        for (int j = 0; j < TileSize; ++j) {
+            for (int i = 0; i < TileSize; ++i) {
+                point[axis1] = (loc[axis1] * TileSize + i) << scale;
+                point[axis2] = (loc[axis2] * TileSize + j) << scale;
+                char value = 0;
+                copy_volume(gray, single, point, &value, false, 0);
+                image[j][i] = png::gray_pixel((unsigned char)(value));
+            }
+        }
+
+        ostringstream stream;
+        image.write_stream(stream);
+        response = stream.str();
+        return 200;
+    }
+
+    int handle_keyvalue(MockInstance& instance, const string& method,
+            const string& action, const vector<string>& args,
+            const string& body, string& response, string& content_type)
+    {
+        if (action == "keys" && method == "GET") {
+            content_type = "application/json";
+            Json::Value data(Json::arrayValue);
+            for (map<string, string>::iterator iter = instance.values.begin();
+                    iter != instance.values.end(); ++iter) {
+                data.append(iter->first);
+            }
+            response = write_json(data);
+            return 200;
+        }
+        if (action != "key" || args.size() != 1) {
+            throw MockError(400, "Unsupported keyvalue request");
+        }
+
+        const string& key = args[0];
+        if (method == "POST" || method == "PUT") {
+            instance.values[key] = body;
+            return 200;
+        }
+        if (method == "DELETE") {
+            instance.values.erase(key);
+            return 200;
+        }
+        map<string, string>::iterator iter = instance.values.find(key);
+        if (iter == instance.values.end()) {
+            throw MockError(404, "Key " + key + " does not exist");
+        }
+        if (method == "GET") {
+            response = iter->second;
+        }
+        return 200;
+    }
+
+    int handle_roi(MockInstance& instance, const string& method,
+            const string& action, const map<string, string>& query,
+            const string& body, string& response)
+    {
+        if (action == "roi" && (method == "POST" || method == "PUT")) {
+            // posting replaces the roi
+            Json::Value data = parse_body(body);
+            instance.roi.clear();
+            for (unsigned int i = 0; i < data.size(); ++i) {
+                int z = data[i][0].asInt();
+                int y = data[i][1].asInt();
+                for (int x = data[i][2].asInt(); x <= data[i][3].asInt(); ++x) {
+                    instance.roi.insert(BlockXYZ(x, y, z));
+                }
+            }
+            return 200;
+        }
+        if (action == "roi" && method == "GET") {
+            Json::Value data(Json::arrayValue);
+            set<BlockXYZ>::iterator iter = instance.roi.begin();
+            while (iter != instance.roi.end()) {
+                BlockXYZ first = *iter;
+                int last = first.x;
+                ++iter;
+                while (iter != instance.roi.end() && iter->z == first.z &&
+                        iter->y == first.y && iter->x == last + 1) {
+                    last = iter->x;
+                    ++iter;
+                }
+                Json::Value span(Json::arrayValue);
+                span.append(first.z);
+                span.append(first.y);
+                span.append(first.x);
+                span.append(last);
+                data.append(span);
+            }
+            response = write_json(data);
+            return 200;
+        }
+        if (action == "partition" && method == "GET") {
+            return partition_roi(instance, query, response);
+        }
+        if (action == "ptquery" && (method == "POST" || method == "GET")) {
+            Json::Value points = parse_body(body);
+            Json::Value data(Json::arrayValue);
+            for (unsigned int i = 0; i < points.size(); ++i) {
+                BlockXYZ block(floor_div(points[i][0].asInt(), DEFBLOCKSIZE),
+                        floor_div(points[i][1].asInt(), DEFBLOCKSIZE),
+                        floor_div(points[i][2].asInt(), DEFBLOCKSIZE));
+                data.append(instance.roi.find(block) != instance.roi.end());
+            }
+            response = write_json(data);
+            return 200;
+        }
+        throw MockError(400, "Unsupported roi request");
+    }
+
+    /*!
+     * Divide the roi into cubes of batchsize blocks aligned to the
+     * smallest block coordinates of the roi and return the cubes
+     * that contain part of the roi.
+    */
+    int partition_roi(MockInstance& instance,
+            const map<string, string>& query, string& response)
+    {
+        map<string, string>::const_iterator batch = query.find("batchsize");
+        int batchsize = (batch == query.end()) ? 8 : atoi(batch->second.c_str());
+        if (batchsize <= 0) {
+            throw MockError(400, "Bad batch size");
+        }
+
+        int minx = 0, miny = 0, minz = 0;
+        for (set<BlockXYZ>::iterator iter = instance.roi.begin();
+                iter != instance.roi.end(); ++iter) {
+            if (iter == instance.roi.begin() || iter->x < minx) {
+                minx = iter->x;
+            }
+            if (iter == instance.roi.begin() || iter->y < miny) {
+                miny = iter->y;
+            }
+            if (iter == instance.roi.begin() || iter->z < minz) {
+                minz = iter->z;
+            }
+        }
+
+        set<BlockXYZ> substacks;
+        for (set<BlockXYZ>::iterator iter = instance.roi.begin();
+                iter != instance.roi.end(); ++iter) {
+            substacks.insert(BlockXYZ(
+                        minx + floor_div(iter->x - minx, batchsize) * batchsize,
+                        miny + floor_div(iter->y - miny, batchsize) * batchsize,
+                        minz + floor_div(iter->z - minz, batchsize) * batchsize));
+        }
+
+        Json::Value data;
+        Json::Value subvolumes(Json::arrayValue);
+        int extent = batchsize * DEFBLOCKSIZE;
+        for (set<BlockXYZ>::iterator iter = substacks.begin();
+                iter != substacks.end(); ++iter) {
+            Json::Value subvolume;
+            Json::Value min_point(Json::arrayValue);
+            Json::Value max_point(Json::arrayValue);
+            min_point.append(iter->x * DEFBLOCKSIZE);
+            min_point.append(iter->y * DEFBLOCKSIZE);
+            min_point.append(iter->z * DEFBLOCKSIZE);
+            max_point.append(iter->x * DEFBLOCKSIZE + extent - 1);
+            max_point.append(iter->y * DEFBLOCKSIZE + extent - 1);
+            max_point.append(iter->z * DEFBLOCKSIZE + extent - 1);
+            subvolume["MinPoint"] = min_point;
+            subvolume["MaxPoint"] = max_point;
+            subvolumes.append(subvolume);
+        }
+        data["Subvolumes"] = subvolumes;
+        data["NumTotalBlocks"] = Json::UInt64(uint64(substacks.size()) *
+                batchsize * batchsize * batchsize);
+        data["NumActiveBlocks"] = Json::UInt64(instance.roi.size());
+        data["NumSubvolumes"] = Json::UInt64(substacks.size());
+        response = write_json(data);
+        return 200;
+    }
+
+    //! Add a vertex to a graph response
+    static void add_vertex(Json::Value& graph, uint64 id, double weight)
+    {
+        Json::Value vertex;
+        vertex["Id"] = Json::UInt64(id);
+        vertex["Weight"] = weight;
+        graph["Vertices"].append(vertex);
+    }
+
+    //! Add an edge to a graph response
+    static void add_edge(Json::Value& graph, const EdgeKey& edge,
+            double weight)
+    {
+        Json::Value data;
+        data["Id1"] = Json::UInt64(edge.first);
+        data["Id2"] = Json::UInt64(edge.second);
+        data["Weight"] = weight;
+        graph["Edges"].append(data);
+    }
+
+    static EdgeKey make_edge(uint64 id1, uint64 id2)
+    {
+        return (id1 < id2) ? make_pair(id1, id2) : make_pair(id2, id1);
+    }
+
+    int handle_graph(MockInstance& instance, const string& method,
+            const string& action, const vector<string>& args,
+            const string& body, string& response, string& content_type)
+    {
+        if (action == "weight" && (method == "POST" || method == "PUT")) {
+            // weights are incremented by the posted amounts
+            Json::Value data = parse_body(body);
+            Json::Value vertices = data["Vertices"];
+            for (unsigned int i = 0; i < vertices.size(); ++i) {
+                instance.vertices[vertices[i]["Id"].asUInt64()] +=
+                    vertices[i]["Weight"].asDouble();
+            }
+            Json::Value edges = data["Edges"];
+            for (unsigned int i = 0; i < edges.size(); ++i) {
+                uint64 id1 = edges[i]["Id1"].asUInt64();
+                uint64 id2 = edges[i]["Id2"].asUInt64();
+                instance.vertices[id1] += 0;
+                instance.vertices[id2] += 0;
+                instance.edges[make_edge(id1, id2)] +=
+                    edges[i]["Weight"].asDouble();
+            }
+            return 200;
+        }
+
+        content_type = "application/json";
+        Json::Value graph;
+        graph["Vertices"] = Json::Value(Json::arrayValue);
+        graph["Edges"] = Json::Value(Json::arrayValue);
+
+        if (action == "neighbors" && method == "GET" && args.size() == 1) {
+            uint64 id = parse_id(args[0]);
+            map<uint64, double>::iterator vertex = instance.vertices.find(id);
+            if (vertex == instance.vertices.end()) {
+                throw MockError(400, "Vertex " + args[0] + " does not exist");
+            }
+            add_vertex(graph, id, vertex->second);
+            for (map<EdgeKey, double>::iterator iter = instance.edges.begin();
+                    iter != instance.edges.end(); ++iter) {
+                if (iter->first.first == id || iter->first.second == id) {
+                    uint64 other = (iter->first.first == id) ?
+                        iter->first.second : iter->first.first;
+                    add_vertex(graph, other, instance.vertices[other]);
+                    add_edge(graph, iter->first, iter->second);
+                }
+            }
+            response = write_json(graph);
+            return 200;
+        }
+
+        if (action == "subgraph" && method == "GET") {
+            // the whole graph unless vertices are given
+            set<uint64> selected;
+            if (!body.empty()) {
+                Json::Value data = parse_body(body);
+                for (unsigned int i = 0; i < data["Vertices"].size(); ++i) {
+                    selected.insert(data["Vertices"][i]["Id"].asUInt64());
+                }
+            }
+            for (map<uint64, double>::iterator iter =
+                    instance.vertices.begin(); iter != instance.vertices.end();
+                    ++iter) {
+                if (selected.empty() || selected.count(iter->first)) {
+                    add_vertex(graph, iter->first, iter->second);
+                }
+            }
+            for (map<EdgeKey, double>::iterator iter = instance.edges.begin();
+                    iter != instance.edges.end(); ++iter) {
+                if (selected.empty() || (selected.count(iter->first.first) &&
+                            selected.count(iter->first.second))) {
+                    add_edge(graph, iter->first, iter->second);
+                }
+            }
+            response = write_json(graph);
+            return 200;
+        }
+
+        if (action == "propertytransaction" && !args.empty() &&
+                (args.size() == 2 || (args.size() == 3 && args[2].empty()))) {
+            content_type = "application/octet-stream";
+            bool edges = (args[0] == "edges");
+            if (!edges && args[0] != "vertices") {
+                throw MockError(400, "Bad property transaction");
+            }
+            if (method == "GET") {
+                return get_properties(instance, edges, args[1], body,
+                        response);
+            }
+            if (method == "POST") {
+                return set_properties(instance, edges, args[1], body,
+                        response);
+            }
+        }
+        throw MockError(400, "Unsupported labelgraph request");
+    }
+
+    //! Read the transaction list at the start of a request
+    static TransactionMap read_transactions(const string& body, size_t& pos)
+    {
+        TransactionMap transactions;
+        uint64 count = read_uint64(body, pos);
+        for (uint64 i = 0; i < count; ++i) {
+            uint64 vertex = read_uint64(body, pos);
+            transactions[vertex] = read_uint64(body, pos);
+        }
+        return transactions;
+    }
+
+    //! Write transactions that succeeded and the vertices that failed
+    static void write_transactions(string& response,
+            const TransactionMap& transactions, const set<uint64>& failed)
+    {
+        write_uint64(response, transactions.size());
+        for (TransactionMap::const_iterator iter = transactions.begin();
+                iter != transactions.end(); ++iter) {
+            write_uint64(response, iter->first);
+            write_uint64(response, iter->second);
+        }
+        write_uint64(response, failed.size());
+        for (set<uint64>::const_iterator iter = failed.begin();
+                iter != failed.end(); ++iter) {
+            write_uint64(response, *iter);
+        }
+    }
+
+    int get_properties(MockInstance& instance, bool edges, const string& key,
+            const string& body, string& response)
+    {
+        size_t pos = 0;
+        TransactionMap requested = read_transactions(body, pos);
+
+        // current transaction ids for the vertices involved
+        TransactionMap current;
+        for (TransactionMap::iterator iter = requested.begin();
+                iter != requested.end(); ++iter) {
+            current[iter->first] = instance.transactions[iter->first];
+        }
+        write_transactions(response, current, set<uint64>());
+
+        uint64 count = read_uint64(body, pos);
+        write_uint64(response, count);
+        for (uint64 i = 0; i < count; ++i) {
+            uint64 id1 = read_uint64(body, pos);
+            string* value = 0;
+            if (edges) {
+                uint64 id2 = read_uint64(body, pos);
+                write_uint64(response, id1);
+                write_uint64(response, id2);
+                value = &(instance.edge_properties[key][make_edge(id1, id2)]);
+            } else {
+                write_uint64(response, id1);
+                value = &(instance.vertex_properties[key][id1]);
+            }
+            write_uint64(response, value->size());
+            response += *value;
+        }
+        return 200;
+    }
+
+    int set_properties(MockInstance& instance, bool edges, const string& key,
+            const string& body, string& response)
+    {
+        size_t pos = 0;
+        TransactionMap given = read_transactions(body, pos);
+
+        // vertices whose transaction id is out of date fail
+        set<uint64> failed;
+        for (TransactionMap::iterator iter = given.begin();
+                iter != given.end(); ++iter) {
+            if (instance.transactions[iter->first] != iter->second) {
+                failed.insert(iter->first);
+            }
+        }
+
+        set<uint64> updated;
+        uint64 count = read_uint64(body, pos);
+        for (uint64 i = 0; i < count; ++i) {
+            uint64 id1 = read_uint64(body, pos);
+            uint64 id2 = edges ? read_uint64(body, pos) : id1;
+            uint64 size = read_uint64(body, pos);
+            if ((pos + size) > body.size()) {
+                throw MockError(400, "Truncated property");
+            }
+            string value = body.substr(pos, size);
+            pos += size;
+            if (failed.count(id1) || failed.count(id2)) {
+                continue;
+            }
+            if (edges) {
+                instance.edge_properties[key][make_edge(id1, id2)] = value;
+            } else {
+                instance.vertex_properties[key][id1] = value;
+            }
+            updated.insert(id1);
+            updated.insert(id2);
+        }
+
+        TransactionMap succeeded;
+        for (set<uint64>::iterator iter = updated.begin();
+                iter != updated.end(); ++iter) {
+            succeeded[*iter] = ++instance.transactions[*iter];
+        }
+        write_transactions(response, succeeded, failed);
+        return 200;
+    }
+
+    map<string, MockRepo>& repos;
+    int& next_repo;
+};
+
+/******************** server ********************/
+
+DVIDMockServer::DVIDMockServer(int port_) : port(port_), listen_fd(-1),
+    stopping(false), latency(0), bandwidth(0), busy_rate(0),
+    straggler_rate(0), straggler_delay(0), busy_pending(0), num_requests(0), num_busy(0), store(new Store)
+{
+}
+
+DVIDMockServer::DVIDMockServer(const string& unix_socket_) : port(0),
+    unix_socket(unix_socket_), listen_fd(-1), stopping(false), latency(0),
+    bandwidth(0), busy_rate(0), straggler_rate(0), straggler_delay(0),
+    busy_pending(0), num_requests(0),
+    num_busy(0), store(new Store)
+{
+}
+
+DVIDMockServer::~DVIDMockServer()
+{
+    stop();
+}
+
+void DVIDMockServer::start()
+{
+    if (accept_thread) {
+        return;
+    }
+
+    if (!unix_socket.empty()) {
+        start_unix();
+        return;
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw ErrMsg("Mock server could not create a socket");
+    }
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) < 0 ||
+            listen(listen_fd, 128) < 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        stringstream sstr;
+        sstr << "Mock server could not listen on port " << port;
+        throw ErrMsg(sstr.str());
+    }
+
+    // find the port picked by the system
+    socklen_t length = sizeof(address);
+    getsockname(listen_fd, (struct sockaddr*) &address, &length);
+    port = ntohs(address.sin_port);
+
+    stopping = false;
+    accept_thread.reset(new boost::thread(&DVIDMockServer::accept_loop,
+                this));
+}
+
+void DVIDMockServer::start_unix()
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    if (unix_socket.size() >= sizeof(address.sun_path)) {
+        throw ErrMsg("Mock server socket path is too long: " + unix_socket);
+    }
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, unix_socket.c_str(),
+            sizeof(address.sun_path) - 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw ErrMsg("Mock server could not create a socket");
+    }
+    unlink(unix_socket.c_str());
+    if (bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) < 0 ||
+            listen(listen_fd, 128) < 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        throw ErrMsg("Mock server could not listen on " + unix_socket);
+    }
+
+    stopping = false;
+    accept_thread.reset(new boost::thread(&DVIDMockServer::accept_loop,
+                this));
+}
+
+void DVIDMockServer::stop()
+{
+    if (!accept_thread) {
+        return;
+    }
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stopping = true;
+        for (set<int>::iterator iter = connections.begin();
+                iter != connections.end(); ++iter) {
+            shutdown(*iter, SHUT_RDWR);
+        }
+    }
+    accept_thread->join();
+    accept_thread.reset();
+    connection_threads.join_all();
+    close(listen_fd);
+    listen_fd = -1;
+    if (!unix_socket.empty()) {
+        unlink(unix_socket.c_str());
+    }
+}
+
+string DVIDMockServer::get_addr() const
+{
+    if (!unix_socket.empty()) {
+        return unix_socket;
+    }
+    stringstream sstr;
+    sstr << "127.0.0.1:" << port;
+    return sstr.str();
+}
+
+string DVIDMockServer::get_url() const
+{
+    if (!unix_socket.empty()) {
+        return "unix://" + unix_socket;
+    }
+    return "http://" + get_addr();
+}
+
+void DVIDMockServer::set_latency(double seconds)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    latency = seconds;
+}
+
+void DVIDMockServer::set_bandwidth(double bytes_per_second)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    bandwidth = bytes_per_second;
+}
+
+void DVIDMockServer::set_busy_rate(double fraction, unsigned int seed)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    busy_rate = fraction;
+    busy_generator.seed(seed);
+}
+
+void DVIDMockServer::set_straggler_rate(double fraction, double seconds,
+        unsigned int seed)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    straggler_rate = fraction;
+    straggler_delay = seconds;
+    straggler_generator.seed(seed);
+}
+
+void DVIDMockServer::inject_busy(int count)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    busy_pending += count;
+}
+
+int DVIDMockServer::get_num_requests()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return num_requests;
+}
+
+int DVIDMockServer::get_num_busy()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return num_busy;
+}
+
+void DVIDMockServer::accept_loop()
+{
+    while (true) {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (stopping) {
+                break;
+            }
+        }
+
+        // wake up periodically to check for stop
+        struct pollfd poll_fd;
+        poll_fd.fd = listen_fd;
+        poll_fd.events = POLLIN;
+        poll_fd.revents = 0;
+        if (poll(&poll_fd, 1, 100) <= 0) {
+            continue;
+        }
+
+        int fd = accept(listen_fd, 0, 0);
+        if (fd < 0) {
+            continue;
+        }
+        if (unix_socket.empty()) {
+            int nodelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay,
+                    sizeof(nodelay));
+        }
+
+        boost::mutex::scoped_lock lock(mutex);
+        if (stopping) {
+            close(fd);
+            break;
+        }
+        connections.insert(fd);
+        connection_threads.create_thread(boost::bind(
+                    &DVIDMockServer::serve_connection, this, fd));
+    }
+}
+
+bool DVIDMockServer::should_reject()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    ++num_requests;
+    bool reject = false;
+    if (busy_pending > 0) {
+        --busy_pending;
+        reject = true;
+    } else if (busy_rate > 0) {
+        boost::uniform_real<double> fraction(0.0, 1.0);
+        reject = fraction(busy_generator) < busy_rate;
+    }
+    if (reject) {
+        ++num_busy;
+    }
+    return reject;
+}
+
+bool DVIDMockServer::send_response(int fd, int status, const string& body,
+        bool head, const string& content_type)
+{
+    double delay, rate;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        delay = latency;
+        rate = bandwidth;
+        if (straggler_rate > 0) {
+            boost::uniform_real<double> fraction(0.0, 1.0);
+            if (fraction(straggler_generator) < straggler_rate) {
+                delay += straggler_delay;
+            }
+        }
+    }
+    retry_sleep(delay);
+
+    const char* reason = "OK";
+    if (status == 204) {
+        reason = "No Content";
+    } else if (status == 400) {
+        reason = "Bad Request";
+    } else if (status == 404) {
+        reason = "Not Found";
+    } else if (status == 503) {
+        reason = "Service Unavailable";
+    } else if (status >= 400) {
+        reason = "Error";
+    }
+
+    stringstream header;
+    header << "HTTP/1.1 " << status << " " << reason << "\r\n";
+    header << "Content-Type: " << content_type << "\r\n";
+    header << "Content-Length: " << ((status == 204) ? 0 : body.size()) <<
+        "\r\n\r\n";
+    string header_str = header.str();
+    if (!send_all(fd, header_str.data(), header_str.size())) {
+        return false;
+    }
+    if (head || status == 204) {
+        return true;
+    }
+
+    if (rate <= 0) {
+        return send_all(fd, body.data(), body.size());
+    }
+
+    // pace the body to the bandwidth limit
+    size_t sent = 0;
+    while (sent < body.size()) {
+        size_t amount = body.size() - sent;
+        if (amount > SendChunkSize) {
+            amount = SendChunkSize;
+        }
+        if (!send_all(fd, body.data() + sent, amount)) {
+            return false;
+        }
+        sent += amount;
+        retry_sleep(amount / rate);
+    }
+    return true;
+}
+
+/*!
+ * Read one request from the connection.
+*/
+static bool read_request(ConnectionReader& reader, int fd,
+        string& method, string& target, string& body, bool& keep_alive)
+{
+    string head;
+    if (!reader.read_until("\r\n\r\n", head, MaxHeaderSize)) {
+        return false;
+    }
+
+    vector<string> lines = split(head, '\n');
+    vector<string> request_line = split(lines[0], ' ');
+    if (request_line.size() < 3) {
+        return false;
+    }
+    method = request_line[0];
+    target = request_line[1];
+    keep_alive = (request_line[2].find("1.0") == string::npos);
+
+    long long content_length = 0;
+    bool chunked = false;
+    bool expect_continue = false;
+    for (unsigned int i = 1; i < lines.size(); ++i) {
+        string line = lines[i];
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        size_t colon = line.find(':');
+        if (colon == string::npos) {
+            continue;
+        }
+        string name = to_lower(line.substr(0, colon));
+        string value = line.substr(colon + 1);
+        while (!value.empty() && value[0] == ' ') {
+            value.erase(0, 1);
+        }
+        if (name == "content-length") {
+            content_length = atoll(value.c_str());
+        } else if (name == "transfer-encoding") {
+            chunked = (to_lower(value).find("chunked") != string::npos);
+        } else if (name == "expect") {
+            expect_continue = (to_lower(value) == "100-continue");
+        } else if (name == "connection") {
+            keep_alive = (to_lower(value) != "close");
+        }
+    }
+
+    if (expect_continue) {
+        static const char* cont = "HTTP/1.1 100 Continue\r\n\r\n";
+        if (!send_all(fd, cont, strlen(cont))) {
+            return false;
+        }
+    }
+
+    body.clear();
+    if (chunked) {
+        while (true) {
+            string size_line;
+            if (!reader.read_until("\r\n", size_line, 1024)) {
+                return false;
+            }
+            size_t size = strtoul(size_line.c_str(), 0, 16);
+            if (size == 0) {
+                // skip trailers
+                string trailer;
+                do {
+                    if (!reader.read_until("\r\n", trailer, MaxHeaderSize)) {
+                        return false;
+                    }
+                } while (!trailer.empty());
+                break;
+            }
+            string crlf;
+            if (!reader.read_bytes(size, body) ||
+                    !reader.read_bytes(2, crlf)) {
+                return false;
+            }
+        }
+    } else if (content_length > 0) {
+        body.reserve(content_length);
+        if (!reader.read_bytes(size_t(content_length), body)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void DVIDMockServer::serve_connection(int fd)
+{
+    ConnectionReader reader(fd);
+    while (true) {
+        string method, target, body;
+        bool keep_alive = true;
+        if (!read_request(reader, fd, method, target, body, keep_alive)) {
+            break;
+        }
+
+        // split the path and query string
+        string path = target;
+        map<string, string> query;
+        size_t question = target.find('?');
+        if (question != string::npos) {
+            path = target.substr(0, question);
+            vector<string> params = split(target.substr(question + 1), '&');
+            for (unsigned int i = 0; i < params.size(); ++i) {
+                size_t equals = params[i].find('=');
+                if (equals == string::npos) {
+                    query[params[i]] = "";
+                } else {
+                    query[params[i].substr(0, equals)] =
+                        params[i].substr(equals + 1);
+                }
+            }
+        }
+
+        int status = 200;
+        string response;
+        string content_type = "text/plain";
+        if (should_reject()) {
+            status = 503;
+            response = "Server busy";
+        } else if (path.compare(0, 5, "/api/") != 0) {
+            status = 400;
+            response = "Requests must start with /api";
+        } else {
+            vector<string> parts = split(path.substr(5), '/');
+            try {
+                boost::mutex::scoped_lock lock(store->mutex);
+                MockHandler handler(store->repos, store->next_repo);
+                status = handler.handle(method, parts, query, body, response,
+                        content_type);
+            } catch (MockError& error) {
+                status = error.status;
+                response = error.msg;
+                content_type = "text/plain";
+            } catch (std::exception& error) {
+                status = 400;
+                response = error.what();
+                content_type = "text/plain";
+            }
+        }
+
+        if (!send_response(fd, status, response, method == "HEAD",
+                    content_type) || !keep_alive) {
+            break;
+        }
+    }
+
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        connections.erase(fd);
+    }
+    close(fd);
+}
+
+}
@@ -1,7 +1,15 @@
 #include "DVIDNodeService.h"
 #include "DVIDException.h"
+#include "Trace.h"
 
 #include <json/json.h>
+#include <boost/exception_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <algorithm>
+#include <cstring>
 #include <set>
 
 using std::string; using std::vector;
@@ -12,17 +20,739 @@ using std::ifstream; using std::set; using std::stringstream;
 //! Gives the limit for how many vertice can be operated on in one call
 static const unsigned int TransactionLimit = 1000;
 
+//! Target size (uncompressed) of the slabs of a pipelined volume post
+static const libdvid::uint64 CompressionSlabBytes = 16 * 1024 * 1024;
+
+//! Default largest volume transferred in one request
+static const libdvid::uint64 DefaultMaxRequestBytes = 1024 * 1024 * 1024;
+
+//! Default number of sub-requests of a split volume that run at once
+static const int DefaultTransferThreads = 4;
+
+//! Size of a decoded label block
+static const libdvid::uint64 LabelBlockBytes = sizeof(libdvid::uint64) *
+    libdvid::DEFBLOCKSIZE * libdvid::DEFBLOCKSIZE * libdvid::DEFBLOCKSIZE;
+
+//! Marks a key value encoded by a codec
+static const char CodecMagic[4] = {'L', 'D', 'V', 'C'};
 
 namespace libdvid {
 
-DVIDNodeService::DVIDNodeService(string web_addr_, UUID uuid_) :
-    connection(web_addr_), uuid(uuid_)
+/*!
+ * Decodes a JSON response.
+ * \param binary response body
+ * \param data returns the decoded JSON
+*/
+static void parse_json(BinaryDataPtr binary, Json::Value& data)
+{
+    TraceScope trace("json parse", "json");
+    Json::Reader json_reader;
+    if (!json_reader.parse(binary->get_data(), data)) {
+        throw ErrMsg("Could not decode JSON");
+    }
+}
+
+/*!
+ * Adds every block in a decoded sparse volume span to a set.
+*/
+struct InsertSpanBlocks {
+    explicit InsertSpanBlocks(set<BlockXYZ>& blocks_) : blocks(blocks_) {}
+
+    void operator()(int x, int y, int z, int length)
+    {
+        int xsize = x + length;
+        for (int xiter = x; xiter < xsize; ++xiter) {
+            blocks.insert(BlockXYZ(xiter, y, z));
+        }
+    }
+
+    set<BlockXYZ>& blocks;
+};
+
+/*!
+ * Encodes a key value and prefixes it with a header: the magic
+ * bytes, the length of the codec name (1 byte), the name, and the
+ * decoded size (8 bytes, little endian).
+*/
+static BinaryDataPtr encode_value(const Codec& codec, BinaryDataPtr value)
+{
+    BinaryDataPtr encoded = codec.encode(value);
+    string name = codec.get_name();
+
+    BinaryDataPtr framed = BinaryData::create_binary_data();
+    string& data = framed->get_data();
+    data.reserve(sizeof(CodecMagic) + 1 + name.size() + 8 +
+            encoded->length());
+    data.append(CodecMagic, sizeof(CodecMagic));
+    data.push_back(char(name.size()));
+    data.append(name);
+    uint64 size = value->length();
+    for (int i = 0; i < 8; ++i) {
+        data.push_back(char((size >> (8 * i)) & 0xFF));
+    }
+    data.append((const char*) encoded->get_raw(), encoded->length());
+    return framed;
+}
+
+/*!
+ * Decodes a key value written by encode_value.  Values without a
+ * valid header (the magic bytes, a registered lossless codec, and a
+ * complete size field) are returned unchanged.
+*/
+static BinaryDataPtr decode_value(BinaryDataPtr value)
+{
+    const byte* raw = value->get_raw();
+    uint64 length = value->length();
+    if ((length < sizeof(CodecMagic) + 1) ||
+            memcmp(raw, CodecMagic, sizeof(CodecMagic))) {
+        return value;
+    }
+    uint64 name_length = raw[sizeof(CodecMagic)];
+    uint64 header_length = sizeof(CodecMagic) + 1 + name_length + 8;
+    if ((name_length == 0) || (length < header_length)) {
+        return value;
+    }
+
+    string name((const char*) raw + sizeof(CodecMagic) + 1, name_length);
+    CodecRegistry& registry = CodecRegistry::get_registry();
+    if (!registry.has_codec(name)) {
+        return value;
+    }
+    CodecPtr codec = registry.get_codec(name);
+    if (!codec->has_capabilities(CODEC_DECODE | CODEC_LOSSLESS)) {
+        return value;
+    }
+
+    uint64 size = 0;
+    for (int i = 0; i < 8; ++i) {
+        size |= uint64(raw[header_length - 8 + i]) << (8 * i);
+    }
+    // some codecs (e.g., lz4) reject a decoded size of 0
+    if (size == 0) {
+        return BinaryData::create_binary_data();
+    }
+    return codec->decode(BinaryData::create_binary_data_view(value,
+                header_length, length - header_length), size);
+}
+
+/*!
+ * Label blocks in the framing of the labelarray and labelmap blocks
+ * endpoints.  Each block is preceded by its block coordinate and
+ * byte count (4 x int32, little endian) and is a label block in the
+ * block codec's format, gzip compressed.  The blocks of a span are
+ * consecutive along X; blocks the server does not send are zero.
+*/
+class LabelBlockSpanCodec : public Codec {
+  public:
+    LabelBlockSpanCodec(CodecPtr block_codec_, vector<int> block_coords_,
+            int span_) : block_codec(block_codec_),
+        gzip_codec(CodecRegistry::get_registry().get_codec("gzip")),
+        block_coords(block_coords_), span(span_) {}
+
+    string get_name() const
+    {
+        return block_codec->get_name();
+    }
+
+    unsigned int get_capabilities() const
+    {
+        return CODEC_ENCODE | CODEC_DECODE | CODEC_LOSSLESS;
+    }
+
+    BinaryDataPtr encode(const BinaryDataPtr binary, int level) const
+    {
+        if (binary->length() != uint64(span) * LabelBlockBytes) {
+            throw ErrMsg("Label block data does not match the span");
+        }
+        BinaryDataPtr framed = BinaryData::create_binary_data();
+        string& data = framed->get_data();
+        for (int i = 0; i < span; ++i) {
+            BinaryDataPtr block = gzip_codec->encode(block_codec->encode(
+                        BinaryData::create_binary_data_view(binary,
+                            i * LabelBlockBytes, LabelBlockBytes)), level);
+            append_int32(data, block_coords[0] + i);
+            append_int32(data, block_coords[1]);
+            append_int32(data, block_coords[2]);
+            append_int32(data, int(block->length()));
+            data.append((const char*) block->get_raw(), block->length());
+        }
+        return framed;
+    }
+
+    BinaryDataPtr decode(const BinaryDataPtr binary,
+            uint64 decoded_size) const
+    {
+        BinaryDataPtr decoded = BinaryData::create_binary_data();
+        string& data = decoded->get_data();
+        data.resize(uint64(span) * LabelBlockBytes);
+        decode(binary, (byte*) &data[0], data.size());
+        return decoded;
+    }
+
+    void decode(const BinaryDataPtr binary, byte* output,
+            uint64 decoded_size) const
+    {
+        if (decoded_size != uint64(span) * LabelBlockBytes) {
+            throw ErrMsg("Label block data does not match the span");
+        }
+        memset(output, 0, decoded_size);
+
+        const byte* raw = binary->get_raw();
+        uint64 length = binary->length();
+        uint64 pos = 0;
+        while (pos < length) {
+            if ((length - pos) < 16) {
+                throw ErrMsg("Truncated label block data");
+            }
+            int header[4];
+            memcpy(header, raw + pos, sizeof(header));
+            pos += sizeof(header);
+            int index = header[0] - block_coords[0];
+            if ((index < 0) || (index >= span) ||
+                    (header[1] != block_coords[1]) ||
+                    (header[2] != block_coords[2])) {
+                throw ErrMsg("Unexpected block in label block data");
+            }
+            if ((header[3] < 0) || (uint64(header[3]) > (length - pos))) {
+                throw ErrMsg("Truncated label block data");
+            }
+            BinaryDataPtr block = BinaryData::create_binary_data_view(
+                    binary, pos, header[3]);
+            pos += header[3];
+            block_codec->decode(gzip_codec->decode(block),
+                    output + index * LabelBlockBytes, LabelBlockBytes);
+        }
+    }
+
+  private:
+    //! appends a little endian int32
+    static void append_int32(string& data, int value)
+    {
+        data.append((const char*) &value, sizeof(value));
+    }
+
+    //! format of each block
+    CodecPtr block_codec;
+
+    //! compression of each block
+    CodecPtr gzip_codec;
+
+    //! first block of the span
+    vector<int> block_coords;
+
+    //! number of blocks
+    int span;
+};
+
+/*!
+ * Verifies that a volume to be posted is 3D and block aligned.
+*/
+static void check_put_volume(const vector<unsigned int>& sizes,
+        const vector<int>& offset)
+{
+    // make sure volume specified is legal and block aligned
+    if ((sizes.size() != 3) || (offset.size() != 3)) {
+        throw ErrMsg("Did not correctly specify 3D volume");
+    }
+    
+    if ((offset[0] % DEFBLOCKSIZE != 0) || (offset[1] % DEFBLOCKSIZE != 0)
+            || (offset[2] % DEFBLOCKSIZE != 0)) {
+        throw ErrMsg("Label POST error: Not block aligned");
+    }
+
+    if ((sizes[0] % DEFBLOCKSIZE != 0) || (sizes[1] % DEFBLOCKSIZE != 0)
+            || (sizes[2] % DEFBLOCKSIZE != 0)) {
+        throw ErrMsg("Label POST error: Region is not a multiple of block size");
+    }
+}
+
+/*!
+ * Part of a volume transferred by one sub-request.  The sizes, offset,
+ * and start (within the whole volume) are in the order of the volume
+ * dimensions.
+*/
+struct VolumePart {
+    Dims_t sizes;
+    vector<int> offset;
+    vector<unsigned int> start;
+};
+
+/*!
+ * Divides a volume into block-aligned parts of at most max_bytes (a
+ * part that is one block thick in each divided dimension may be
+ * larger).  The last dimension is divided first so that the parts are
+ * contiguous in the volume when possible.
+*/
+static vector<VolumePart> split_volume(const Dims_t& sizes,
+        const vector<int>& offset, unsigned int voxel_size,
+        uint64 max_bytes)
+{
+    // thickness of the parts along each dimension (a block multiple
+    // unless the dimension is not divided)
+    Dims_t thickness = sizes;
+    for (int dim = 2; dim >= 0; --dim) {
+        uint64 part_bytes = uint64(thickness[0]) * thickness[1] *
+            thickness[2] * voxel_size;
+        if (part_bytes <= max_bytes) {
+            break;
+        }
+        uint64 block_bytes = part_bytes / thickness[dim] * DEFBLOCKSIZE;
+        uint64 num_blocks = std::max(max_bytes / block_bytes, uint64(1));
+        thickness[dim] = std::min(uint64(sizes[dim]),
+                num_blocks * DEFBLOCKSIZE);
+    }
+
+    // divide at multiples of the thickness in DVID coordinates so
+    // that every part (except at the edges) is block aligned
+    vector<vector<unsigned int> > starts(3);
+    for (int dim = 0; dim < 3; ++dim) {
+        starts[dim].push_back(0);
+        if (thickness[dim] >= sizes[dim]) {
+            continue;
+        }
+        long long step = thickness[dim];
+        long long boundary = offset[dim] / step;
+        if ((offset[dim] % step) < 0) {
+            --boundary;
+        }
+        boundary = (boundary + 1) * step - offset[dim];
+        for (; boundary < sizes[dim]; boundary += step) {
+            starts[dim].push_back((unsigned int)(boundary));
+        }
+    }
+
+    vector<VolumePart> parts;
+    for (unsigned int z = 0; z < starts[2].size(); ++z) {
+        for (unsigned int y = 0; y < starts[1].size(); ++y) {
+            for (unsigned int x = 0; x < starts[0].size(); ++x) {
+                unsigned int index[3] = {x, y, z};
+                VolumePart part;
+                for (int dim = 0; dim < 3; ++dim) {
+                    unsigned int start = starts[dim][index[dim]];
+                    unsigned int end = (index[dim] + 1 < starts[dim].size()) ?
+                        starts[dim][index[dim] + 1] : sizes[dim];
+                    part.sizes.push_back(end - start);
+                    part.offset.push_back(offset[dim] + int(start));
+                    part.start.push_back(start);
+                }
+                parts.push_back(part);
+            }
+        }
+    }
+    return parts;
+}
+
+/*!
+ * State shared by the threads of a split volume transfer.
+*/
+struct DVIDNodeService::VolumeTransfer {
+    VolumeTransfer() : throttle(false), compress(false), level(0),
+        voxel_size(0), buffer(0), next_part(0), error_status(0) {}
+
+    //! volume parameters (as for get_volume3D and put_volume)
+    string datatype_instance;
+    Dims_t sizes;
+    vector<int> offset;
+    vector<unsigned int> channels;
+    bool throttle;
+    bool compress;
+    string roi;
+    int level;
+    unsigned int voxel_size;
+
+    //! destination of a GET (null for a PUT)
+    char* buffer;
+
+    //! source of a PUT
+    BinaryDataPtr volume;
+
+    //! sub-volumes and the next one to transfer
+    vector<VolumePart> parts;
+    unsigned int next_part;
+
+    //! first error (and its DVID status if any)
+    string error;
+    int error_status;
+
+    //! protects next_part and the error
+    boost::mutex mutex;
+};
+
+/*!
+ * Compresses consecutive slabs of a volume with a codec on worker threads
+ * while the caller takes (and uploads) the compressed slabs in order.
+ * Workers stay at most two slabs per thread ahead of the caller so
+ * that only a few compressed slabs are held at once.  The destructor
+ * stops the workers (after their current slab) and joins them.
+*/
+class SlabCompressor {
+  public:
+    SlabCompressor(BinaryDataPtr volume_, uint64 slab_bytes_,
+            int num_slabs_, CodecPtr codec_, int level_, int num_threads) :
+        volume(volume_), slab_bytes(slab_bytes_), num_slabs(num_slabs_),
+        codec(codec_), level(level_), window(2 * num_threads), next_slab(0),
+        taken_slabs(0), stopped(false), results(num_slabs_)
+    {
+        for (int i = 0; (i < num_threads) && (i < num_slabs); ++i) {
+            threads.create_thread(boost::bind(&SlabCompressor::run, this));
+        }
+    }
+
+    ~SlabCompressor()
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            stopped = true;
+        }
+        changed.notify_all();
+        threads.join_all();
+    }
+
+    /*!
+     * Wait for the next slab to be compressed (slabs must be taken
+     * in order).  Throws if compression failed.
+    */
+    BinaryDataPtr take(int slab)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        while (!results[slab] && error.empty()) {
+            changed.wait(lock);
+        }
+        if (!error.empty()) {
+            throw ErrMsg(error);
+        }
+        BinaryDataPtr compressed = results[slab];
+        results[slab].reset();
+        taken_slabs = slab + 1;
+        changed.notify_all();
+        return compressed;
+    }
+
+  private:
+    void run()
+    {
+        while (true) {
+            int slab;
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                while (!stopped && (next_slab < num_slabs) &&
+                        (next_slab >= (taken_slabs + window))) {
+                    changed.wait(lock);
+                }
+                if (stopped || (next_slab >= num_slabs)) {
+                    return;
+                }
+                slab = next_slab++;
+            }
+
+            BinaryDataPtr compressed;
+            try {
+                uint64 start = slab * slab_bytes;
+                uint64 length = std::min(slab_bytes,
+                        uint64(volume->length()) - start);
+                compressed = codec->encode(
+                        BinaryData::create_binary_data_view(volume,
+                            start, length), level);
+            } catch (std::exception& e) {
+                boost::mutex::scoped_lock lock(mutex);
+                error = e.what();
+                changed.notify_all();
+                return;
+            }
+
+            boost::mutex::scoped_lock lock(mutex);
+            results[slab] = compressed;
+            changed.notify_all();
+        }
+    }
+
+    BinaryDataPtr volume;
+    uint64 slab_bytes;
+    int num_slabs;
+    CodecPtr codec;
+    int level;
+
+    //! slabs compressed ahead of the caller
+    int window;
+
+    //! next slab to compress and number of slabs taken
+    int next_slab, taken_slabs;
+
+    bool stopped;
+    std::string error;
+
+    //! compressed slabs not yet taken
+    vector<BinaryDataPtr> results;
+
+    boost::mutex mutex;
+    boost::condition_variable changed;
+    boost::thread_group threads;
+};
+
+/*!
+ * Completes a promise with the body of an asynchronous node request.
+ * Statuses other than 200 are stored as a DVIDException.  Retryable
+ * statuses and transient errors (for idempotent requests) reissue
+ * the request after the delay given by the retry policy.
+ * When a codec is given, the body is decoded to decoded_size bytes.
+ * The functor owns a copy of the connection so it does not depend on
+ * the lifetime of the service that issued the request.
+*/
+struct FulfillBinary {
+    FulfillBinary(const DVIDConnection& connection_, string endpoint_,
+            ConnectionMethod method_, BinaryDataPtr payload_,
+            ConnectionType type_, const RetryPolicy& policy_,
+            bool idempotent_, CodecPtr codec_, uint64 decoded_size_,
+            boost::shared_ptr<boost::promise<BinaryDataPtr> > promise_) :
+        connection(connection_), endpoint(endpoint_), method(method_),
+        payload(payload_), type(type_), policy(policy_), retry(policy_),
+        idempotent(idempotent_), codec(codec_),
+        decoded_size(decoded_size_), promise(promise_) {}
+
+    void operator()(DVIDResponse& response)
+    {
+        bool failed = (response.curl_code != 0);
+        bool transient = failed && idempotent &&
+            DVIDConnection::is_transient_error(response.curl_code);
+
+        // try again later if the server is busy or the connection dropped
+        double delay = 0;
+        if ((transient && retry.next_transient(delay)) || (!failed &&
+                    policy.is_retryable_status(response.status) &&
+                    retry.next(delay))) {
+            try {
+                connection.make_request_async(endpoint, method, payload,
+                        *this, type, DVIDConnection::DEFAULT_TIMEOUT, delay);
+            } catch (std::exception& e) {
+                promise->set_exception(boost::copy_exception(ErrMsg(e.what())));
+            }
+            return;
+        }
+
+        if (failed) {
+            promise->set_exception(boost::copy_exception(
+                DVIDConnectionException("DVIDConnection error: " + endpoint +
+                    "\n" + response.error_msg, response.status,
+                    response.curl_code,
+                    DVIDConnection::is_transient_error(response.curl_code))));
+            return;
+        }
+
+        if (response.status != 200) {
+            promise->set_exception(boost::copy_exception(
+                DVIDException(response.error_msg + "\n" +
+                    response.data->get_data(), response.status)));
+            return;
+        }
+
+        if (codec) {
+            try {
+                promise->set_value(codec->decode(response.data,
+                            decoded_size));
+            } catch (ErrMsg& error) {
+                promise->set_exception(boost::copy_exception(error));
+            } catch (std::exception& e) {
+                // e.g., bad_alloc for a large volume
+                promise->set_exception(boost::copy_exception(
+                            ErrMsg(e.what())));
+            } catch (...) {
+                promise->set_exception(boost::copy_exception(
+                            ErrMsg("Could not decode " + endpoint)));
+            }
+            return;
+        }
+
+        promise->set_value(response.data);
+    }
+
+    DVIDConnection connection;
+    string endpoint;
+    ConnectionMethod method;
+    BinaryDataPtr payload;
+    ConnectionType type;
+    RetryPolicy policy;
+    RetryState retry;
+    bool idempotent;
+    CodecPtr codec;
+    uint64 decoded_size;
+    boost::shared_ptr<boost::promise<BinaryDataPtr> > promise;
+};
+
+/*!
+ * One attempt of a request whose response is stored in a new
+ * binary buffer.
+*/
+struct BinaryAttempt {
+    BinaryAttempt(DVIDConnection& connection_, string endpoint_,
+            ConnectionMethod method_, BinaryDataPtr payload_,
+            ConnectionType type_, BinaryDataPtr& results_,
+            string& respdata_) : connection(connection_),
+        endpoint(endpoint_), method(method_), payload(payload_),
+        type(type_), results(results_), respdata(respdata_) {}
+
+    int operator()()
+    {
+        results = BinaryData::create_binary_data();
+        return connection.make_request(endpoint, method, payload, results,
+                respdata, type);
+    }
+
+    DVIDConnection& connection;
+    string endpoint;
+    ConnectionMethod method;
+    BinaryDataPtr payload;
+    ConnectionType type;
+    BinaryDataPtr& results;
+    string& respdata;
+};
+
+/*!
+ * One attempt of a GET whose response is written to caller memory.
+*/
+struct BufferAttempt {
+    BufferAttempt(DVIDConnection& connection_, string endpoint_,
+            char* buffer_, size_t capacity_, size_t& length_,
+            string& respdata_) : connection(connection_),
+        endpoint(endpoint_), buffer(buffer_), capacity(capacity_),
+        length(length_), respdata(respdata_) {}
+
+    int operator()()
+    {
+        return connection.make_request(endpoint, GET, BinaryDataPtr(),
+                buffer, capacity, length, respdata, BINARY);
+    }
+
+    DVIDConnection& connection;
+    string endpoint;
+    char* buffer;
+    size_t capacity;
+    size_t& length;
+    string& respdata;
+};
+
+/*!
+ * One attempt of a request whose body is streamed from a source.
+ * The source is rewound before every attempt after the first.
+*/
+struct UploadAttempt {
+    UploadAttempt(DVIDConnection& connection_, string endpoint_,
+            UploadSource& source_, BinaryDataPtr& results_,
+            string& respdata_) : connection(connection_),
+        endpoint(endpoint_), source(source_), results(results_),
+        respdata(respdata_), first(true) {}
+
+    int operator()()
+    {
+        if (!first && !source.rewind()) {
+            throw ErrMsg("Upload to " + endpoint + " cannot be resent");
+        }
+        first = false;
+        results = BinaryData::create_binary_data();
+        return connection.make_request(endpoint, POST, source, results,
+                respdata, BINARY);
+    }
+
+    DVIDConnection& connection;
+    string endpoint;
+    UploadSource& source;
+    BinaryDataPtr& results;
+    string& respdata;
+    bool first;
+};
+
+/*!
+ * One attempt of a request whose response is fed to a sink.  The
+ * body of a failed response is not given to the sink so retrying on
+ * status is safe.
+*/
+struct SinkAttempt {
+    SinkAttempt(DVIDConnection& connection_, string endpoint_,
+            ConnectionMethod method_, BinaryDataPtr payload_,
+            ResponseSink& sink_, string& respdata_) :
+        connection(connection_), endpoint(endpoint_), method(method_),
+        payload(payload_), sink(sink_), respdata(respdata_) {}
+
+    int operator()()
+    {
+        return connection.make_request(endpoint, method, payload, sink,
+                respdata, BINARY);
+    }
+
+    DVIDConnection& connection;
+    string endpoint;
+    ConnectionMethod method;
+    BinaryDataPtr payload;
+    ResponseSink& sink;
+    string& respdata;
+};
+
+/*!
+ * One attempt of a HEAD request.
+*/
+struct HeadAttempt {
+    HeadAttempt(DVIDConnection& connection_, string endpoint_) :
+        connection(connection_), endpoint(endpoint_) {}
+
+    int operator()()
+    {
+        return connection.make_head_request(endpoint);
+    }
+
+    DVIDConnection& connection;
+    string endpoint;
+};
+
+/*!
+ * Verifies that a volume request is 3D.
+*/
+static void check_volume3D(const Dims_t& sizes, const vector<int>& offset,
+        const vector<unsigned int>& channels)
+{
+    // ensure volume is 3D
+    if ((sizes.size() != 3) || (offset.size() != 3) ||
+            (channels.size() != 3)) {
+        throw ErrMsg("Did not correctly specify 3D volume");
+    }
+}
+
+int DVIDNodeService::perform_with_retry(boost::function<int ()> attempt,
+        bool idempotent)
+{
+    RetryState state(retry_policy);
+    while (true) {
+        int status_code = 0;
+        double delay = 0;
+        try {
+            status_code = attempt();
+        } catch (DVIDConnectionException& error) {
+            if (!idempotent || !error.is_transient() ||
+                    !state.next_transient(delay)) {
+                throw;
+            }
+            retry_sleep(delay);
+            continue;
+        }
+
+        if (!retry_policy.is_retryable_status(status_code) ||
+                !state.next(delay)) {
+            return status_code;
+        }
+        retry_sleep(delay);
+    }
+}
+
+DVIDNodeService::DVIDNodeService(string web_addr_, UUID uuid_,
+        RetryPolicy retry_policy_) :
+    connection(web_addr_), uuid(uuid_), retry_policy(retry_policy_),
+    coalesce_gets(false), compression_threads(1),
+    max_request_bytes(DefaultMaxRequestBytes),
+    transfer_threads(DefaultTransferThreads)
 {
     string endpoint = "/repo/" + uuid + "/info";
     string respdata;
-    BinaryDataPtr binary = BinaryData::create_binary_data();
-    int status_code = connection.make_request(endpoint, GET, BinaryDataPtr(),
-            binary, respdata, DEFAULT);
+    BinaryDataPtr binary;
+    int status_code = perform_with_retry(BinaryAttempt(connection, endpoint,
+                GET, BinaryDataPtr(), DEFAULT, binary, respdata), true);
     if (status_code != 200) {
         throw DVIDException(respdata + "\n" + binary->get_data(), status_code);
     }
@@ -35,17 +765,82 @@ BinaryDataPtr DVIDNodeService::custom_request(string endpoint,
     if (!endpoint.empty() && (endpoint[0] != '/')) {
         endpoint = '/' + endpoint;
     }
-    string respdata;
     string node_endpoint = "/node/" + uuid + endpoint;
-    BinaryDataPtr resp_binary = BinaryData::create_binary_data();
-    int status_code = connection.make_request(node_endpoint, method, payload,
-            resp_binary, respdata, BINARY);
+    if (coalesce_gets && (method == GET) && !payload) {
+        return get_request_coalescer()->run(node_endpoint,
+                boost::bind(&DVIDNodeService::fetch_binary, this,
+                    node_endpoint, payload, method));
+    }
+    return fetch_binary(node_endpoint, payload, method);
+}
+
+BinaryDataPtr DVIDNodeService::fetch_binary(string node_endpoint,
+        BinaryDataPtr payload, ConnectionMethod method)
+{
+    string respdata;
+    BinaryDataPtr resp_binary;
+    int status_code = perform_with_retry(BinaryAttempt(connection,
+                node_endpoint, method, payload, BINARY, resp_binary,
+                respdata), method != POST);
     if (status_code != 200) {
         throw DVIDException(respdata + "\n" + resp_binary->get_data(), status_code);
     }
 
     return resp_binary; 
 }
+
+void DVIDNodeService::custom_request(string endpoint, BinaryDataPtr payload,
+        ConnectionMethod method, ResponseSink& sink)
+{
+    // append '/' to the endpoint if it is not provided
+    if (!endpoint.empty() && (endpoint[0] != '/')) {
+        endpoint = '/' + endpoint;
+    }
+    string node_endpoint = "/node/" + uuid + endpoint;
+
+    // a shared response is downloaded in full and then replayed
+    if (coalesce_gets && (method == GET) && !payload) {
+        BinaryDataPtr binary = get_request_coalescer()->run(node_endpoint,
+                boost::bind(&DVIDNodeService::fetch_binary, this,
+                    node_endpoint, payload, method));
+        const string& data = binary->get_data();
+        sink.begin(200, (long long)(data.size()));
+        if (!data.empty()) {
+            sink.write(data.data(), data.size());
+        }
+        sink.finish();
+        return;
+    }
+
+    string respdata;
+
+    // a dropped connection may have fed the sink partial data so only
+    // retryable statuses are retried
+    int status_code = perform_with_retry(SinkAttempt(connection,
+                node_endpoint, method, payload, sink, respdata), false);
+    if (status_code != 200) {
+        throw DVIDException(respdata, status_code);
+    }
+}
+
+BinaryDataFuture DVIDNodeService::custom_request_async(string endpoint,
+        BinaryDataPtr payload, ConnectionMethod method)
+{
+    // append '/' to the endpoint if it is not provided
+    if (!endpoint.empty() && (endpoint[0] != '/')) {
+        endpoint = '/' + endpoint;
+    }
+    string node_endpoint = "/node/" + uuid + endpoint;
+
+    boost::shared_ptr<boost::promise<BinaryDataPtr> > promise(
+            new boost::promise<BinaryDataPtr>);
+    BinaryDataFuture future(promise->get_future());
+    connection.make_request_async(node_endpoint, method, payload,
+            FulfillBinary(connection, node_endpoint, method, payload,
+                BINARY, retry_policy, method != POST, CodecPtr(), 0,
+                promise), BINARY);
+    return future;
+}
     
 Json::Value DVIDNodeService::get_typeinfo(string datatype_name)
 {
@@ -53,10 +848,7 @@ Json::Value DVIDNodeService::get_typeinfo(string datatype_name)
    
     // read into json from binary string 
     Json::Value data;
-    Json::Reader json_reader;
-    if (!json_reader.parse(binary->get_data(), data)) {
-        throw ErrMsg("Could not decode JSON");
-    }
+    parse_json(binary, data);
     return data;
 }
 
@@ -76,6 +868,11 @@ bool DVIDNodeService::create_labelblk(string datatype_name,
     return is_created && is_created2;
 }
 
+bool DVIDNodeService::create_labelarray(string datatype_name)
+{
+    return create_datatype("labelarray", datatype_name);
+}
+
 bool DVIDNodeService::create_keyvalue(string keyvalue)
 {
     return create_datatype("keyvalue", keyvalue);
@@ -91,6 +888,69 @@ bool DVIDNodeService::create_roi(string name)
     return create_datatype("roi", name);
 }
 
+void DVIDNodeService::set_codec(string datatype_instance, string codec_name)
+{
+    if (codec_name.empty()) {
+        instance_codecs.erase(datatype_instance);
+        return;
+    }
+    // make sure the codec exists
+    CodecPtr codec = CodecRegistry::get_registry().get_codec(codec_name);
+
+    // only labelarray and labelmap transfer compressed label blocks
+    if (codec->has_capabilities(CODEC_LABEL_BLOCKS)) {
+        Json::Value info = get_typeinfo(datatype_instance);
+        string type = info["Base"]["TypeName"].asString();
+        if ((type != "labelarray") && (type != "labelmap")) {
+            throw ErrMsg(codec_name + " requires a labelarray or labelmap "
+                    "instance: " + datatype_instance);
+        }
+    }
+    instance_codecs[datatype_instance] = codec_name;
+}
+
+string DVIDNodeService::get_codec(string datatype_instance) const
+{
+    std::map<string, string>::const_iterator iter =
+        instance_codecs.find(datatype_instance);
+    return (iter == instance_codecs.end()) ? "" : iter->second;
+}
+
+CodecPtr DVIDNodeService::negotiate_codec(string datatype_instance,
+        unsigned int capabilities, string fallback) const
+{
+    CodecRegistry& registry = CodecRegistry::get_registry();
+    string name = get_codec(datatype_instance);
+    if (!name.empty() && registry.has_codec(name)) {
+        CodecPtr codec = registry.get_codec(name);
+        if (codec->has_capabilities(capabilities)) {
+            return codec;
+        }
+    }
+    if (fallback.empty()) {
+        return CodecPtr();
+    }
+    return registry.get_codec(fallback);
+}
+
+CodecPtr DVIDNodeService::get_volume_codec(string datatype_instance) const
+{
+    return negotiate_codec(datatype_instance, CODEC_ENCODE | CODEC_DECODE |
+            CODEC_LOSSLESS | CODEC_DVID_VOLUME, "lz4");
+}
+
+CodecPtr DVIDNodeService::get_key_codec(string datatype_instance) const
+{
+    return negotiate_codec(datatype_instance, CODEC_ENCODE | CODEC_DECODE |
+            CODEC_LOSSLESS, "");
+}
+
+CodecPtr DVIDNodeService::get_block_codec(string datatype_instance) const
+{
+    return negotiate_codec(datatype_instance, CODEC_ENCODE | CODEC_DECODE |
+            CODEC_LOSSLESS | CODEC_LABEL_BLOCKS, "");
+}
+
 Grayscale2D DVIDNodeService::get_tile_slice(string datatype_instance,
         Slice2D slice, unsigned int scaling, vector<int> tile_loc)
 {
@@ -98,19 +958,16 @@ Grayscale2D DVIDNodeService::get_tile_slice(string datatype_instance,
             slice, scaling, tile_loc);
     Dims_t dim_size;
 
-    // retrieve JPEG
-    try {
-        unsigned int width, height;
-        binary_response = 
-            BinaryData::decompress_jpeg(binary_response, width, height);
-        dim_size.push_back(width); dim_size.push_back(height);
-        
-    } catch (ErrMsg& msg) {
-        unsigned int width, height;
+    // tiles are JPEG unless the magic bytes indicate PNG
+    unsigned int width, height;
+    if (BinaryData::get_image_format(binary_response) == PNG_IMAGE) {
         binary_response = 
             BinaryData::decompress_png8(binary_response, width, height);
-        dim_size.push_back(width); dim_size.push_back(height);
+    } else {
+        binary_response = 
+            BinaryData::decompress_jpeg(binary_response, width, height);
     }
+    dim_size.push_back(width); dim_size.push_back(height);
 
     Grayscale2D grayimage(binary_response, dim_size);
     return grayimage;
@@ -118,6 +975,23 @@ Grayscale2D DVIDNodeService::get_tile_slice(string datatype_instance,
 
 BinaryDataPtr DVIDNodeService::get_tile_slice_binary(string datatype_instance,
         Slice2D slice, unsigned int scaling, vector<int> tile_loc)
+{
+    string endpoint = construct_tile_uri(datatype_instance, slice, scaling,
+            tile_loc);
+    return custom_request(endpoint, BinaryDataPtr(), GET);
+}
+
+BinaryDataFuture DVIDNodeService::get_tile_slice_binary_async(
+        string datatype_instance, Slice2D slice, unsigned int scaling,
+        vector<int> tile_loc)
+{
+    string endpoint = construct_tile_uri(datatype_instance, slice, scaling,
+            tile_loc);
+    return custom_request_async(endpoint, BinaryDataPtr(), GET);
+}
+
+string DVIDNodeService::construct_tile_uri(string datatype_instance,
+        Slice2D slice, unsigned int scaling, vector<int> tile_loc)
 {
     if (tile_loc.size() != 3) {
         throw ErrMsg("Tile identification requires 3 numbers");
@@ -138,22 +1012,33 @@ BinaryDataPtr DVIDNodeService::get_tile_slice_binary(string datatype_instance,
         sstr << "_" << tile_loc[i];
     }
 
-    string endpoint = sstr.str();
-    return custom_request(endpoint, BinaryDataPtr(), GET);
+    return sstr.str();
 }
 
 Grayscale3D DVIDNodeService::get_gray3D(string datatype_instance, Dims_t sizes,
         vector<int> offset, vector<unsigned int> channels,
         bool throttle, bool compress, string roi)
 {
+    // volumes too large for one request are assembled in place
+    check_volume3D(sizes, offset, channels);
+    uint64 volume_size = uint64(sizes[0])*sizes[1]*sizes[2]*sizeof(uint8);
+    if (volume_size > max_request_bytes) {
+        BinaryDataPtr data = BinaryData::create_binary_data();
+        data->get_data().resize(volume_size);
+        get_volume3D(datatype_instance, sizes, offset, channels, throttle,
+                compress, roi, &(data->get_data()[0]), volume_size, sizeof(uint8));
+        return Grayscale3D(data, sizes);
+    }
+
     BinaryDataPtr data = get_volume3D(datatype_instance,
             sizes, offset, channels, throttle, compress, roi);
    
-    // decompress using lz4
+    // decompress with the codec for the instance
     if (compress) {
         // determined number of returned bytes
-        int decomp_size = sizes[0]*sizes[1]*sizes[2];
-        data = BinaryData::decompress_lz4(data, decomp_size);
+        uint64 decoded_size = uint64(sizes[0])*sizes[1]*sizes[2];
+        data = get_volume_codec(datatype_instance)->decode(data,
+                decoded_size);
     }
 
     Grayscale3D grayvol(data, sizes);
@@ -173,14 +1058,26 @@ Labels3D DVIDNodeService::get_labels3D(string datatype_instance, Dims_t sizes,
         vector<int> offset, vector<unsigned int> channels,
         bool throttle, bool compress, string roi)
 {
+    // volumes too large for one request are assembled in place
+    check_volume3D(sizes, offset, channels);
+    uint64 volume_size = uint64(sizes[0])*sizes[1]*sizes[2]*sizeof(uint64);
+    if (volume_size > max_request_bytes) {
+        BinaryDataPtr data = BinaryData::create_binary_data();
+        data->get_data().resize(volume_size);
+        get_volume3D(datatype_instance, sizes, offset, channels, throttle,
+                compress, roi, &(data->get_data()[0]), volume_size, sizeof(uint64));
+        return Labels3D(data, sizes);
+    }
+
     BinaryDataPtr data = get_volume3D(datatype_instance,
             sizes, offset, channels, throttle, compress, roi);
    
-    // decompress using lz4
+    // decompress with the codec for the instance
     if (compress) {
         // determined number of returned bytes
-        int decomp_size = sizes[0]*sizes[1]*sizes[2]*8;
-        data = BinaryData::decompress_lz4(data, decomp_size);
+        uint64 decoded_size = uint64(sizes[0])*sizes[1]*sizes[2]*8;
+        data = get_volume_codec(datatype_instance)->decode(data,
+                decoded_size);
     }
 
 
@@ -197,6 +1094,48 @@ Labels3D DVIDNodeService::get_labels3D(string datatype_instance, Dims_t sizes,
             throttle, compress, roi);
 }
 
+void DVIDNodeService::get_gray3D(string datatype_instance, Dims_t sizes,
+        vector<int> offset, vector<unsigned int> channels, uint8* buffer,
+        size_t capacity, bool throttle, bool compress, string roi)
+{
+    get_volume3D(datatype_instance, sizes, offset, channels, throttle,
+            compress, roi, (char*) buffer, capacity, sizeof(uint8));
+}
+
+void DVIDNodeService::get_labels3D(string datatype_instance, Dims_t sizes,
+        vector<int> offset, vector<unsigned int> channels, uint64* buffer,
+        size_t capacity, bool throttle, bool compress, string roi)
+{
+    get_volume3D(datatype_instance, sizes, offset, channels, throttle,
+            compress, roi, (char*) buffer, capacity, sizeof(uint64));
+}
+
+BinaryDataFuture DVIDNodeService::get_volume3D_async(string datatype_inst,
+        Dims_t sizes, vector<int> offset, vector<unsigned int> channels,
+        unsigned int voxel_size, bool throttle, bool compress, string roi)
+{
+    check_volume3D(sizes, offset, channels);
+    string endpoint = 
+        construct_volume_uri(datatype_inst, sizes, offset,
+                channels, throttle, compress, roi);
+
+    CodecPtr codec;
+    uint64 decoded_size = 0;
+    if (compress) {
+        codec = get_volume_codec(datatype_inst);
+        decoded_size = uint64(sizes[0])*sizes[1]*sizes[2]*voxel_size;
+    }
+
+    boost::shared_ptr<boost::promise<BinaryDataPtr> > promise(
+            new boost::promise<BinaryDataPtr>);
+    BinaryDataFuture future(promise->get_future());
+    connection.make_request_async(endpoint, GET, BinaryDataPtr(),
+            FulfillBinary(connection, endpoint, GET, BinaryDataPtr(),
+                BINARY, retry_policy, true, codec, decoded_size, promise),
+            BINARY);
+    return future;
+}
+
 uint64 DVIDNodeService::get_label_by_location(std::string datatype_instance, unsigned int x,
             unsigned int y, unsigned int z)
 {
@@ -209,21 +1148,36 @@ uint64 DVIDNodeService::get_label_by_location(std::string datatype_instance, uns
 }
 
 void DVIDNodeService::put_labels3D(string datatype_instance, Labels3D const & volume,
-            vector<int> offset, bool throttle, bool compress, string roi)
+            vector<int> offset, bool throttle, bool compress, string roi,
+            int level)
 {
     Dims_t sizes = volume.get_dims();
     put_volume(datatype_instance, volume.get_binary(), sizes,
-            offset, throttle, compress, roi);
+            offset, throttle, compress, roi, level);
 }
 
 void DVIDNodeService::put_gray3D(string datatype_instance, Grayscale3D const & volume,
-            vector<int> offset, bool throttle, bool compress)
+            vector<int> offset, bool throttle, bool compress, int level)
 {
     Dims_t sizes = volume.get_dims();
     put_volume(datatype_instance, volume.get_binary(), sizes,
-            offset, throttle, compress, "");
+            offset, throttle, compress, "", level);
+}
+
+
+void DVIDNodeService::put_gray3D(string datatype_instance, Dims_t sizes,
+        vector<int> offset, UploadSource& source, bool throttle)
+{
+    put_volume(datatype_instance, source, sizes, offset, throttle, "",
+            sizeof(uint8));
 }
 
+void DVIDNodeService::put_labels3D(string datatype_instance, Dims_t sizes,
+        vector<int> offset, UploadSource& source, bool throttle, string roi)
+{
+    put_volume(datatype_instance, source, sizes, offset, throttle, roi,
+            sizeof(uint64));
+}
 
 GrayscaleBlocks DVIDNodeService::get_grayblocks(string datatype_instance,
         vector<int> block_coords, unsigned int span)
@@ -240,10 +1194,46 @@ GrayscaleBlocks DVIDNodeService::get_grayblocks(string datatype_instance,
     return GrayscaleBlocks(data, ret_span);
 } 
 
+void DVIDNodeService::get_grayblocks(string datatype_instance,
+        vector<int> block_coords, unsigned int span, uint8* buffer,
+        size_t capacity)
+{
+    size_t expected = DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE*sizeof(uint8)*
+        size_t(span);
+    if (capacity < expected) {
+        throw ErrMsg("Buffer too small for the requested blocks");
+    }
+
+    string endpoint = "/node/" + uuid +
+        construct_blocks_uri(datatype_instance, block_coords, span);
+    string respdata;
+    size_t length = 0;
+    int status_code = perform_with_retry(BufferAttempt(connection, endpoint,
+                (char*) buffer, capacity, length, respdata), true);
+    if (status_code != 200) {
+        throw DVIDException(respdata + "\n" +
+                string((const char*) buffer, length), status_code);
+    }
+
+    // make sure this data encodes blocks of grayscale
+    if (length != expected) {
+        throw ErrMsg("Expected 1-byte values from " + datatype_instance);
+    }
+}
+
 LabelBlocks DVIDNodeService::get_labelblocks(string datatype_instance,
            vector<int> block_coords, unsigned int span)
 {
     int ret_span = span;
+    CodecPtr codec = get_block_codec(datatype_instance);
+    if (codec) {
+        BinaryDataPtr data = custom_request(construct_label_blocks_uri(
+                    datatype_instance, block_coords, span, codec),
+                BinaryDataPtr(), GET);
+        data = LabelBlockSpanCodec(codec, block_coords, span).decode(data,
+                uint64(span) * LabelBlockBytes);
+        return LabelBlocks(data, ret_span);
+    }
     BinaryDataPtr data = get_blocks(datatype_instance, block_coords, span);
 
     // make sure this data encodes blocks of grayscale
@@ -266,14 +1256,37 @@ void DVIDNodeService::put_grayblocks(string datatype_instance,
 void DVIDNodeService::put_labelblocks(string datatype_instance,
             LabelBlocks blocks, vector<int> block_coords)
 {
+    CodecPtr codec = get_block_codec(datatype_instance);
+    if (codec) {
+        if (block_coords.size() != 3) {
+            throw ErrMsg("Block identification requires 3 numbers");
+        }
+        BinaryDataPtr data = LabelBlockSpanCodec(codec, block_coords,
+                blocks.get_num_blocks()).encode(blocks.get_binary(), 0);
+        custom_request("/" + datatype_instance + "/blocks", data, POST);
+        return;
+    }
     put_blocks(datatype_instance, blocks.get_binary(),
             blocks.get_num_blocks(), block_coords);
 }
 
 void DVIDNodeService::put(string keyvalue, string key, ifstream& fin)
 {
-    BinaryDataPtr data = BinaryData::create_binary_data(fin);
-    put(keyvalue, key, data);
+    IStreamUploadSource source(fin);
+    put(keyvalue, key, source);
+}
+
+void DVIDNodeService::put(string keyvalue, string key, UploadSource& source)
+{
+    string endpoint = "/node/" + uuid + "/" + keyvalue + "/key/" + key;
+    string respdata;
+    BinaryDataPtr binary_result;
+    int status_code = perform_with_retry(UploadAttempt(connection, endpoint,
+                source, binary_result, respdata), true);
+    if (status_code != 200) {
+        throw DVIDException(respdata + "\n" + binary_result->get_data(),
+                status_code);
+    }
 }
 
 void DVIDNodeService::put(string keyvalue, string key, Json::Value& data)
@@ -289,13 +1302,29 @@ void DVIDNodeService::put(string keyvalue, string key, Json::Value& data)
 void DVIDNodeService::put(string keyvalue, string key, BinaryDataPtr value)
 {
     string endpoint = "/" + keyvalue + "/key/" + key;
+    CodecPtr codec = get_key_codec(keyvalue);
+    if (codec) {
+        value = encode_value(*codec, value);
+    }
     custom_request(endpoint, value, POST);
 }
 
 
 BinaryDataPtr DVIDNodeService::get(string keyvalue, string key)
 {
-    return custom_request("/" + keyvalue + "/key/" + key, BinaryDataPtr(), GET);
+    BinaryDataPtr value = custom_request("/" + keyvalue + "/key/" + key,
+                BinaryDataPtr(), GET);
+
+    // only instances with a codec hold encoded values
+    if (!get_key_codec(keyvalue)) {
+        return value;
+    }
+    return decode_value(value);
+}
+
+void DVIDNodeService::get(string keyvalue, string key, ResponseSink& sink)
+{
+    custom_request("/" + keyvalue + "/key/" + key, BinaryDataPtr(), GET, sink);
 }
 
 Json::Value DVIDNodeService::get_json(string keyvalue, string key)
@@ -304,10 +1333,7 @@ Json::Value DVIDNodeService::get_json(string keyvalue, string key)
    
     // read into json from binary string 
     Json::Value data;
-    Json::Reader json_reader;
-    if (!json_reader.parse(binary->get_data(), data)) {
-        throw ErrMsg("Could not decode JSON");
-    }
+    parse_json(binary, data);
     return data;
 }
 
@@ -331,11 +1357,8 @@ void DVIDNodeService::get_subgraph(string graph_name,
            binary_data, GET);
 
     // read json from binary string into graph    
-    Json::Reader json_reader;
     Json::Value returned_data;
-    if (!json_reader.parse(binary->get_data(), returned_data)) {
-        throw ErrMsg("Could not decode JSON");
-    }
+    parse_json(binary, returned_data);
     graph.import_json(returned_data);
 }
 
@@ -349,11 +1372,8 @@ void DVIDNodeService::get_vertex_neighbors(string graph_name, Vertex vertex,
             BinaryDataPtr(), GET);
     
     // read into json from binary string 
-    Json::Reader json_reader;
     Json::Value data;
-    if (!json_reader.parse(binary->get_data(), data)) {
-        throw ErrMsg("Could not decode JSON");
-    }
+    parse_json(binary, data);
     graph.import_json(data);
 }
 
@@ -809,11 +1829,8 @@ void DVIDNodeService::get_roi(std::string roi_name,
             BinaryDataPtr(), GET);
 
     // read json from binary string  
-    Json::Reader json_reader;
     Json::Value returned_data;
-    if (!json_reader.parse(binary->get_data(), returned_data)) {
-        throw ErrMsg("Could not decode JSON");
-    }
+    parse_json(binary, returned_data);
 
     // order the blocks (might be redundant depending on DVID output order)
     set<BlockXYZ> sorted_blocks;
@@ -850,11 +1867,8 @@ double DVIDNodeService::get_roi_partition(std::string roi_name,
             BinaryDataPtr(), GET);
 
     // read json from binary string  
-    Json::Reader json_reader;
     Json::Value returned_data;
-    if (!json_reader.parse(binary->get_data(), returned_data)) {
-        throw ErrMsg("Could not decode JSON");
-    }
+    parse_json(binary, returned_data);
 
     // order the substacks (might be redundant depending on DVID output order)
     set<SubstackXYZ> sorted_substacks;
@@ -908,11 +1922,8 @@ void DVIDNodeService::roi_ptquery(std::string roi_name,
 
     
     // read json from binary string  
-    Json::Reader json_reader;
     Json::Value returned_data;
-    if (!json_reader.parse(binary->get_data(), returned_data)) {
-        throw ErrMsg("Could not decode JSON");
-    }
+    parse_json(binary, returned_data);
 
     // insert status of each point (true if in ROI) (true if in ROI) (true if in ROI) 
     for (unsigned int i = 0; i < returned_data.size(); ++i) {
@@ -927,7 +1938,8 @@ bool DVIDNodeService::body_exists(string labelvol_name, uint64 bodyid)
     sstr << "/" << labelvol_name << "/sparsevol/";
     sstr << bodyid;
     string node_endpoint = "/node/" + uuid + sstr.str();
-    int status_code = connection.make_head_request(node_endpoint);
+    int status_code = perform_with_retry(HeadAttempt(connection,
+                node_endpoint), true);
     if (status_code == 200) {
         return true;
     } else if (status_code == 204) {
@@ -991,45 +2003,20 @@ bool DVIDNodeService::get_coarse_body(string labelvol_name, uint64 bodyid,
     sstr << "/" << labelvol_name << "/sparsevol-coarse/";
     sstr << bodyid;
 
-    BinaryDataPtr binary;
+    // order the blocks (might be redundant depending on DVID output order)
+    set<BlockXYZ> sorted_blocks;
+    
+    // spans are decoded as the response streams in
+    InsertSpanBlocks insert_blocks(sorted_blocks);
+    SparseVolSpanSink span_sink(insert_blocks);
     try {
-        binary = custom_request(sstr.str(), BinaryDataPtr(), GET);
+        custom_request(sstr.str(), BinaryDataPtr(), GET, span_sink);
     } catch (DVIDException& error) {
         // body does not exist (or something else is wrong)
         // either way body doesn't exist at this moment at this endpoint
         return false;
     }
 
-    // order the blocks (might be redundant depending on DVID output order)
-    set<BlockXYZ> sorted_blocks;
-    
-    // retrieve data: ignore first 8 bytes
-    // next 4 bytes encodes the number of spans
-    // patterns of x,y,z,xspan (int32 little endian)
-
-    // assume little endian machine for now
-    const uint8* bytearray = binary->get_raw();
-    unsigned int spot = 8;
-    unsigned int* num_spans = (unsigned int*)(bytearray+spot);
-    spot += 4;
-
-    // decode spans
-    for (unsigned int i = 0; i < *num_spans; ++i) {
-        int* xblock = (int*)(bytearray+spot);
-        spot += 4;
-        int* yblock = (int*)(bytearray+spot);
-        spot += 4;
-        int* zblock = (int*)(bytearray+spot);
-        spot += 4;
-        int* spans = (int*)(bytearray+spot);
-        spot += 4;
-        
-        int xsize = *xblock + int(*spans);
-        for (int xiter = *xblock; xiter < xsize; ++xiter) {
-            sorted_blocks.insert(BlockXYZ(xiter, *yblock, *zblock));
-        }
-    }
-
     // returned sorted blocks back to caller
     for (set<BlockXYZ>::iterator iter = sorted_blocks.begin();
             iter != sorted_blocks.end(); ++iter) {
@@ -1049,31 +2036,52 @@ bool DVIDNodeService::get_coarse_body(string labelvol_name, uint64 bodyid,
 
 void DVIDNodeService::put_volume(string datatype_instance, BinaryDataPtr volume,
             vector<unsigned int> sizes, vector<int> offset,
-            bool throttle, bool compress, string roi)
+            bool throttle, bool compress, string roi, int level)
 {
-    // make sure volume specified is legal and block aligned
-    if ((sizes.size() != 3) || (offset.size() != 3)) {
-        throw ErrMsg("Did not correctly specify 3D volume");
-    }
-    
-    if ((offset[0] % DEFBLOCKSIZE != 0) || (offset[1] % DEFBLOCKSIZE != 0)
-            || (offset[2] % DEFBLOCKSIZE != 0)) {
-        throw ErrMsg("Label POST error: Not block aligned");
+    check_put_volume(sizes, offset);
+
+    // post volumes too large for one request as concurrent sub-volumes
+    uint64 num_voxels = uint64(sizes[0]) * sizes[1] * sizes[2];
+    if (volume->length() > max_request_bytes) {
+        VolumeTransfer transfer;
+        transfer.datatype_instance = datatype_instance;
+        transfer.sizes = sizes;
+        transfer.offset = offset;
+        transfer.throttle = throttle;
+        transfer.compress = compress;
+        transfer.roi = roi;
+        transfer.level = level;
+        transfer.voxel_size = (unsigned int)(volume->length() / num_voxels);
+        transfer.volume = volume;
+        if (transfer_split_volume(transfer)) {
+            return;
+        }
     }
 
-    if ((sizes[0] % DEFBLOCKSIZE != 0) || (sizes[1] % DEFBLOCKSIZE != 0)
-            || (sizes[2] % DEFBLOCKSIZE != 0)) {
-        throw ErrMsg("Label POST error: Region is not a multiple of block size");
+    // split large compressed volumes into block-aligned slabs so that
+    // compression runs in parallel and overlaps the upload
+    if (compress && (compression_threads > 1) && (sizes[2] > 0)) {
+        uint64 plane_bytes = volume->length() / sizes[2];
+        uint64 slab_blocks = CompressionSlabBytes /
+            std::max(plane_bytes * DEFBLOCKSIZE, uint64(1));
+        unsigned int slab_depth = std::max(slab_blocks, uint64(1)) *
+            DEFBLOCKSIZE;
+        if (sizes[2] > slab_depth) {
+            put_volume_slabs(datatype_instance, volume, sizes, offset,
+                    throttle, roi, level, slab_depth);
+            return;
+        }
     }
 
-    // make sure requests do not involve more bytes than fit in an int
-    // (use 8-byte label to create this bound)
-    uint64 total_size = uint64(sizes[0]) * uint64(sizes[1]) * uint64(sizes[2]);
-    if (total_size > INT_MAX) {
-        throw ErrMsg("Trying to post too large of a volume");
-    }
+    post_volume(datatype_instance, volume, sizes, offset, throttle,
+            compress, roi, level);
+}
 
-    bool waiting = true;
+void DVIDNodeService::post_volume(string datatype_instance,
+        BinaryDataPtr volume, vector<unsigned int> sizes,
+        vector<int> offset, bool throttle, bool compress, string roi,
+        int level)
+{
     int status_code;
     string respdata;
     vector<unsigned int> channels;
@@ -1085,24 +2093,233 @@ void DVIDNodeService::put_volume(string datatype_instance, BinaryDataPtr volume,
             datatype_instance, sizes, offset,
             channels, throttle, compress, roi);
 
-    // compress using lz4
+    // compress with the codec for the instance
     if (compress) {
-        volume = BinaryData::compress_lz4(volume);
+        volume = get_volume_codec(datatype_instance)->encode(volume,
+                level);
     }
 
-    // try posting until DVID is available (no contention)
-    while (waiting) {
-        binary_result = BinaryData::create_binary_data();
-        status_code = connection.make_request(endpoint, POST, volume,
-                binary_result, respdata, BINARY);
+    // retry while DVID is busy (writing a volume is idempotent)
+    status_code = perform_with_retry(BinaryAttempt(connection, endpoint,
+                POST, volume, BINARY, binary_result, respdata), true);
 
-        // wait 1 second if the server is busy
-        if (status_code == 503) {
-            sleep(1);
-        } else {
-            waiting = false;
+    if (status_code != 200) {
+        throw DVIDException(respdata + "\n" + binary_result->get_data(),
+                status_code);
+    } 
+}
+
+void DVIDNodeService::put_volume_slabs(string datatype_instance,
+            BinaryDataPtr volume, vector<unsigned int> sizes,
+            vector<int> offset, bool throttle, string roi, int level,
+            unsigned int slab_depth)
+{
+    vector<unsigned int> channels;
+    channels.push_back(0); channels.push_back(1); channels.push_back(2); 
+
+    int num_slabs = (sizes[2] + slab_depth - 1) / slab_depth;
+    uint64 slab_bytes = uint64(volume->length() / sizes[2]) * slab_depth;
+    SlabCompressor compressor(volume, slab_bytes, num_slabs,
+            get_volume_codec(datatype_instance), level,
+            compression_threads);
+
+    for (int slab = 0; slab < num_slabs; ++slab) {
+        vector<unsigned int> slab_sizes = sizes;
+        vector<int> slab_offset = offset;
+        slab_offset[2] += slab * slab_depth;
+        slab_sizes[2] = std::min(slab_depth, sizes[2] - slab * slab_depth);
+
+        string endpoint = construct_volume_uri(datatype_instance,
+                slab_sizes, slab_offset, channels, throttle, true, roi);
+        BinaryDataPtr compressed = compressor.take(slab);
+
+        // retry while DVID is busy (writing a volume is idempotent)
+        string respdata;
+        BinaryDataPtr binary_result;
+        int status_code = perform_with_retry(BinaryAttempt(connection,
+                    endpoint, POST, compressed, BINARY, binary_result,
+                    respdata), true);
+
+        if (status_code != 200) {
+            throw DVIDException(respdata + "\n" + binary_result->get_data(),
+                    status_code);
         }
     }
+}
+
+bool DVIDNodeService::transfer_split_volume(VolumeTransfer& transfer)
+{
+    // sizes are along the channels while offsets are in DVID coordinates
+    vector<int> offset = transfer.offset;
+    const vector<unsigned int>& channels = transfer.channels;
+    for (unsigned int dim = 0; dim < channels.size(); ++dim) {
+        offset[dim] = transfer.offset[channels[dim]];
+    }
+    transfer.parts = split_volume(transfer.sizes, offset,
+            transfer.voxel_size, max_request_bytes);
+    if (transfer.parts.size() < 2) {
+        return false;
+    }
+    for (unsigned int i = 0; i < transfer.parts.size(); ++i) {
+        vector<int>& part_offset = transfer.parts[i].offset;
+        offset = part_offset;
+        for (unsigned int dim = 0; dim < channels.size(); ++dim) {
+            part_offset[channels[dim]] = offset[dim];
+        }
+    }
+
+    // the calling thread transfers parts too
+    int num_threads = std::min(int(transfer.parts.size()), transfer_threads);
+    boost::thread_group threads;
+    try {
+        for (int i = 1; i < num_threads; ++i) {
+            threads.create_thread(boost::bind(
+                        &DVIDNodeService::transfer_volume_parts, this,
+                        &transfer));
+        }
+    } catch (...) {
+        // stop the started workers before the transfer goes away
+        {
+            boost::mutex::scoped_lock lock(transfer.mutex);
+            transfer.error = "Could not start volume transfer threads";
+        }
+        threads.join_all();
+        throw;
+    }
+    transfer_volume_parts(&transfer);
+    threads.join_all();
+
+    if (!transfer.error.empty()) {
+        if (transfer.error_status) {
+            throw DVIDException(transfer.error, transfer.error_status);
+        }
+        throw ErrMsg(transfer.error);
+    }
+    return true;
+}
+
+void DVIDNodeService::transfer_volume_parts(VolumeTransfer* transfer)
+{
+    const Dims_t& sizes = transfer->sizes;
+    unsigned int voxel_size = transfer->voxel_size;
+    while (true) {
+        unsigned int index;
+        {
+            boost::mutex::scoped_lock lock(transfer->mutex);
+            if ((transfer->next_part >= transfer->parts.size()) ||
+                    !transfer->error.empty()) {
+                return;
+            }
+            index = transfer->next_part++;
+        }
+        const VolumePart& part = transfer->parts[index];
+
+        // a part spanning the first two dimensions is contiguous in
+        // the volume; other parts are staged and copied row by row
+        uint64 row_bytes = uint64(part.sizes[0]) * voxel_size;
+        uint64 part_bytes = row_bytes * part.sizes[1] * part.sizes[2];
+        uint64 start = ((uint64(part.start[2]) * sizes[1] + part.start[1]) *
+                sizes[0] + part.start[0]) * voxel_size;
+        uint64 plane_stride = uint64(sizes[0]) * sizes[1] * voxel_size;
+        uint64 row_stride = uint64(sizes[0]) * voxel_size;
+        bool contiguous = (part.sizes[0] == sizes[0]) &&
+            (part.sizes[1] == sizes[1]);
+
+        try {
+            if (transfer->buffer) {
+                char* dest = transfer->buffer + start;
+                if (contiguous) {
+                    get_volume3D(transfer->datatype_instance, part.sizes,
+                            part.offset, transfer->channels,
+                            transfer->throttle, transfer->compress,
+                            transfer->roi, dest, part_bytes, voxel_size);
+                    continue;
+                }
+                vector<char> staging(part_bytes);
+                get_volume3D(transfer->datatype_instance, part.sizes,
+                        part.offset, transfer->channels, transfer->throttle,
+                        transfer->compress, transfer->roi, &staging[0],
+                        part_bytes, voxel_size);
+                const char* source = &staging[0];
+                for (unsigned int z = 0; z < part.sizes[2]; ++z) {
+                    for (unsigned int y = 0; y < part.sizes[1]; ++y) {
+                        memcpy(dest + z * plane_stride + y * row_stride,
+                                source, row_bytes);
+                        source += row_bytes;
+                    }
+                }
+            } else {
+                BinaryDataPtr part_volume;
+                if (contiguous) {
+                    part_volume = BinaryData::create_binary_data_view(
+                            transfer->volume, start, part_bytes);
+                } else {
+                    part_volume = BinaryData::create_binary_data();
+                    string& data = part_volume->get_data();
+                    data.resize(part_bytes);
+                    const char* source =
+                        (const char*) transfer->volume->get_raw() + start;
+                    char* dest = &data[0];
+                    for (unsigned int z = 0; z < part.sizes[2]; ++z) {
+                        for (unsigned int y = 0; y < part.sizes[1]; ++y) {
+                            memcpy(dest, source + z * plane_stride +
+                                    y * row_stride, row_bytes);
+                            dest += row_bytes;
+                        }
+                    }
+                }
+                post_volume(transfer->datatype_instance, part_volume,
+                        part.sizes, part.offset, transfer->throttle,
+                        transfer->compress, transfer->roi,
+                        transfer->level);
+            }
+        } catch (DVIDException& error) {
+            boost::mutex::scoped_lock lock(transfer->mutex);
+            if (transfer->error.empty()) {
+                transfer->error = error.what();
+                transfer->error_status = error.get_status();
+            }
+        } catch (std::exception& error) {
+            boost::mutex::scoped_lock lock(transfer->mutex);
+            if (transfer->error.empty()) {
+                transfer->error = error.what();
+            }
+        } catch (...) {
+            // nothing may escape a worker thread
+            boost::mutex::scoped_lock lock(transfer->mutex);
+            if (transfer->error.empty()) {
+                transfer->error = "Volume transfer failed";
+            }
+        }
+    }
+}
+
+void DVIDNodeService::put_volume(string datatype_instance,
+        UploadSource& source, vector<unsigned int> sizes, vector<int> offset,
+        bool throttle, string roi, unsigned int voxel_size)
+{
+    check_put_volume(sizes, offset);
+
+    long long volume_size = (long long)(sizes[0]) * sizes[1] * sizes[2] *
+        voxel_size;
+    if ((source.size() >= 0) && (source.size() != volume_size)) {
+        throw ErrMsg("Upload size does not match the volume dimensions");
+    }
+
+    int status_code;
+    string respdata;
+    vector<unsigned int> channels;
+    channels.push_back(0); channels.push_back(1); channels.push_back(2); 
+    
+    BinaryDataPtr binary_result;
+    
+    string endpoint =  construct_volume_uri(
+            datatype_instance, sizes, offset,
+            channels, throttle, false, roi);
+
+    // retry while DVID is busy (writing a volume is idempotent)
+    status_code = perform_with_retry(UploadAttempt(connection, endpoint,
+                source, binary_result, respdata), true);
 
     if (status_code != 200) {
         throw DVIDException(respdata + "\n" + binary_result->get_data(),
@@ -1113,30 +2330,75 @@ void DVIDNodeService::put_volume(string datatype_instance, BinaryDataPtr volume,
 BinaryDataPtr DVIDNodeService::get_blocks(string datatype_instance,
         vector<int> block_coords, int span)
 {
-    string prefix = "/" + datatype_instance + "/blocks/";
-    stringstream sstr;
-    // encode starting block
-    sstr << block_coords[0] << "_" << block_coords[1] << "_" << block_coords[2];
-    sstr << "/" << span;
-    string endpoint = prefix + sstr.str();
+    string endpoint = construct_blocks_uri(datatype_instance, block_coords,
+            span);
   
     // first 4 bytes no longer include span (always grab what the user wants)
-    BinaryDataPtr blockbinary = custom_request(endpoint, BinaryDataPtr(), GET);
+    return custom_request(endpoint, BinaryDataPtr(), GET);
+}
 
-    return blockbinary;
+BinaryDataFuture DVIDNodeService::get_blocks_async(string datatype_instance,
+        vector<int> block_coords, int span)
+{
+    CodecPtr codec = get_block_codec(datatype_instance);
+    if (!codec) {
+        return custom_request_async(construct_blocks_uri(datatype_instance,
+                    block_coords, span), BinaryDataPtr(), GET);
+    }
+
+    // compressed label blocks are decoded when the response arrives
+    string node_endpoint = "/node/" + uuid + construct_label_blocks_uri(
+            datatype_instance, block_coords, span, codec);
+    CodecPtr span_codec(new LabelBlockSpanCodec(codec, block_coords, span));
+    boost::shared_ptr<boost::promise<BinaryDataPtr> > promise(
+            new boost::promise<BinaryDataPtr>);
+    BinaryDataFuture future(promise->get_future());
+    connection.make_request_async(node_endpoint, GET, BinaryDataPtr(),
+            FulfillBinary(connection, node_endpoint, GET, BinaryDataPtr(),
+                BINARY, retry_policy, true, span_codec,
+                uint64(span) * LabelBlockBytes, promise), BINARY);
+    return future;
 }
 
 void DVIDNodeService::put_blocks(string datatype_instance,
         BinaryDataPtr binary, int span, vector<int> block_coords)
 {
+    string endpoint = construct_blocks_uri(datatype_instance, block_coords,
+            span);
+    custom_request(endpoint, binary, POST);
+}
+
+string DVIDNodeService::construct_blocks_uri(string datatype_instance,
+        vector<int> block_coords, int span)
+{
+    if (block_coords.size() != 3) {
+        throw ErrMsg("Block identification requires 3 numbers");
+    }
+
     string prefix = "/" + datatype_instance + "/blocks/";
     stringstream sstr;
     // encode starting block
     sstr << block_coords[0] << "_" << block_coords[1] << "_" << block_coords[2];
     sstr << "/" << span;
-    string endpoint = prefix + sstr.str();
-    
-    custom_request(endpoint, binary, POST);
+    return prefix + sstr.str();
+}
+
+string DVIDNodeService::construct_label_blocks_uri(string datatype_instance,
+        vector<int> block_coords, int span, CodecPtr codec)
+{
+    if (block_coords.size() != 3) {
+        throw ErrMsg("Block identification requires 3 numbers");
+    }
+
+    // the span is requested as a subvolume in voxel coordinates
+    string prefix = "/" + datatype_instance + "/blocks/";
+    stringstream sstr;
+    sstr << span * DEFBLOCKSIZE << "_" << DEFBLOCKSIZE << "_" << DEFBLOCKSIZE;
+    sstr << "/" << block_coords[0] * DEFBLOCKSIZE << "_" <<
+        block_coords[1] * DEFBLOCKSIZE << "_" <<
+        block_coords[2] * DEFBLOCKSIZE;
+    sstr << "?compression=" << codec->get_name();
+    return prefix + sstr.str();
 }
 
 bool DVIDNodeService::create_datatype(string datatype, string datatype_name,
@@ -1158,10 +2420,10 @@ bool DVIDNodeService::create_datatype(string datatype, string datatype_name,
     }
     BinaryDataPtr payload = 
         BinaryData::create_binary_data(data.c_str(), data.length());
-    BinaryDataPtr binary = BinaryData::create_binary_data();
+    BinaryDataPtr binary;
     
-    int status_code = connection.make_request(endpoint,
-            POST, payload, binary, respdata, JSON);
+    int status_code = perform_with_retry(BinaryAttempt(connection, endpoint,
+                POST, payload, JSON, binary, respdata), false);
 
     if (status_code != 200) {
         throw DVIDException(respdata + "\n" + binary->get_data(), status_code);
@@ -1174,9 +2436,10 @@ bool DVIDNodeService::exists(string datatype_endpoint)
 { 
     try {
         string respdata;
-        BinaryDataPtr binary = BinaryData::create_binary_data();
-        int status_code = connection.make_request(datatype_endpoint,
-                GET, BinaryDataPtr(), binary, respdata, DEFAULT);
+        BinaryDataPtr binary;
+        int status_code = perform_with_retry(BinaryAttempt(connection,
+                    datatype_endpoint, GET, BinaryDataPtr(), DEFAULT, binary,
+                    respdata), true);
     
         if (status_code != 200) {
             return false;
@@ -1192,41 +2455,19 @@ BinaryDataPtr DVIDNodeService::get_volume3D(string datatype_inst, Dims_t sizes,
         vector<int> offset, vector<unsigned int> channels,
         bool throttle, bool compress, string roi)
 {
-    bool waiting = true;
     int status_code;
     BinaryDataPtr binary_result; 
     string respdata;
 
-    // ensure volume is 3D
-    if ((sizes.size() != 3) || (offset.size() != 3) ||
-            (channels.size() != 3)) {
-        throw ErrMsg("Did not correctly specify 3D volume");
-    }
-
-    // make sure requests do not involve more bytes than fit in an int
-    // (use 8-byte label to create this bound)
-    uint64 total_size = uint64(sizes[0]) * uint64(sizes[1]) * uint64(sizes[2]);
-    if (total_size > INT_MAX) {
-        throw ErrMsg("Requested too large of a volume");
-    }
+    check_volume3D(sizes, offset, channels);
 
     string endpoint = 
         construct_volume_uri(datatype_inst, sizes, offset,
                 channels, throttle, compress, roi);
 
-    // try get until DVID is available (no contention)
-    while (waiting) {
-        binary_result = BinaryData::create_binary_data();
-        status_code = connection.make_request(endpoint, GET, BinaryDataPtr(),
-                binary_result, respdata, BINARY);
-       
-        // wait 1 second if the server is busy
-        if (status_code == 503) {
-            sleep(1);
-        } else {
-            waiting = false;
-        }
-    }
+    // retry while DVID is busy
+    status_code = perform_with_retry(BinaryAttempt(connection, endpoint,
+                GET, BinaryDataPtr(), BINARY, binary_result, respdata), true);
     
     if (status_code != 200) {
         throw DVIDException(respdata + "\n" + binary_result->get_data(),
@@ -1236,6 +2477,65 @@ BinaryDataPtr DVIDNodeService::get_volume3D(string datatype_inst, Dims_t sizes,
     return binary_result;
 }
 
+void DVIDNodeService::get_volume3D(string datatype_inst, Dims_t sizes,
+        vector<int> offset, vector<unsigned int> channels,
+        bool throttle, bool compress, string roi, char* buffer,
+        size_t capacity, unsigned int voxel_size)
+{
+    check_volume3D(sizes, offset, channels);
+
+    size_t volume_size = size_t(sizes[0]) * sizes[1] * sizes[2] * voxel_size;
+    if (capacity < volume_size) {
+        throw ErrMsg("Buffer too small for the requested volume");
+    }
+
+    // fetch volumes too large for one request as concurrent sub-volumes
+    if (volume_size > max_request_bytes) {
+        VolumeTransfer transfer;
+        transfer.datatype_instance = datatype_inst;
+        transfer.sizes = sizes;
+        transfer.offset = offset;
+        transfer.channels = channels;
+        transfer.throttle = throttle;
+        transfer.compress = compress;
+        transfer.roi = roi;
+        transfer.voxel_size = voxel_size;
+        transfer.buffer = buffer;
+        if (transfer_split_volume(transfer)) {
+            return;
+        }
+    }
+
+    // only the compressed stream is staged; it is decompressed in place
+    if (compress) {
+        BinaryDataPtr data = get_volume3D(datatype_inst, sizes, offset,
+                channels, throttle, compress, roi);
+        get_volume_codec(datatype_inst)->decode(data, (byte*) buffer,
+                volume_size);
+        return;
+    }
+
+    string endpoint = 
+        construct_volume_uri(datatype_inst, sizes, offset,
+                channels, throttle, compress, roi);
+
+    int status_code;
+    size_t length = 0;
+    string respdata;
+
+    // retry while DVID is busy
+    status_code = perform_with_retry(BufferAttempt(connection, endpoint,
+                buffer, capacity, length, respdata), true);
+    
+    if (status_code != 200) {
+        throw DVIDException(respdata + "\n" + string(buffer, length),
+                status_code);
+    }
+    if (length != volume_size) {
+        throw ErrMsg("Unexpected volume size returned from " + datatype_inst);
+    }
+}
+
 string DVIDNodeService::construct_volume_uri(string datatype_inst, Dims_t sizes,
         vector<int> offset, vector<unsigned int> channels,
         bool throttle, bool compress, string roi)
@@ -1286,10 +2586,9 @@ string DVIDNodeService::construct_volume_uri(string datatype_inst, Dims_t sizes,
         sstr << "?throttle=on";
     }
     
-    if (compress && !throttle) {
-        sstr << "?compression=lz4";
-    } else if (compress) {
-        sstr << "&compression=lz4";
+    if (compress) {
+        sstr << (throttle ? "&" : "?") << "compression="
+             << get_volume_codec(datatype_inst)->get_name();
     }
 
     if ((compress || throttle) && roi != "") {
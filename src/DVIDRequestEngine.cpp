@@ -0,0 +1,704 @@
+#include "DVIDRequestEngine.h"
+#include "Trace.h"
+#include "DVIDException.h"
+#include "ResponseBuffer.h"
+
+#include <boost/bind.hpp>
+#include <cstring>
+#include <algorithm>
+#include <time.h>
+
+extern "C" {
+#include <curl/curl.h>
+}
+
+using std::string;
+using std::multimap;
+using std::map;
+using std::vector;
+using std::deque;
+using std::set;
+
+//! Longest time (ms) the I/O thread sleeps without checking for work
+static const int MAX_POLL_MS = 1000;
+
+//! Time (seconds) between retries of requests waiting for a scheduler
+//! slot when no scheduler reported one (guards against missed wakeups)
+static const double SLOT_CHECK_INTERVAL = 1.0;
+
+//! curl_multi_wakeup was added in curl 7.68.0
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define LIBDVID_CURL_HAS_WAKEUP 1
+#endif
+
+//! Monotonic time in seconds
+static double monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+namespace libdvid {
+
+const int DVIDRequestEngine::DEFAULT_MAX_HOST_CONNECTIONS;
+
+struct DVIDRequestEngine::Request {
+    Request() : id(0), priority(NORMAL_PRIORITY), flow_reserved(false),
+        sched_waiting(false), flow_slot(false), trace_start(-1),
+        headers(0),
+        results(BinaryData::create_binary_data()),
+        buffer(results), adapter(buffer, false)
+    {
+        memset(error_buf, 0, CURL_ERROR_SIZE);
+    }
+
+    //! id returned by submit
+    uint64 id;
+
+    string url;
+    ConnectionMethod method;
+    BinaryDataPtr payload;
+    ConnectionType type;
+    int timeout;
+    ResponseCallback callback;
+
+    //! pool for the server (may be null)
+    DVIDConnectionPoolPtr pool;
+
+    //! priority lane in the scheduler of the pool
+    RequestPriority priority;
+
+    //! true once the rate limits have been applied
+    bool flow_reserved;
+
+    //! true while the request is counted as waiting by the scheduler
+    bool sched_waiting;
+
+    //! true while the request holds a scheduler slot
+    bool flow_slot;
+
+    //! time the transfer started for tracing (negative if not traced)
+    double trace_start;
+
+    //! custom headers (freed when the request completes)
+    struct curl_slist* headers;
+
+    //! response body
+    BinaryDataPtr results;
+
+    //! writes the response body into results
+    ResponseBuffer buffer;
+
+    //! connects the buffer to curl
+    ResponseSinkAdapter adapter;
+
+    //! curl error message
+    char error_buf[CURL_ERROR_SIZE];
+};
+
+//! Orders requests by priority lane (highest first)
+struct DVIDRequestEngine::HigherPriority {
+    bool operator()(const Request* request1, const Request* request2) const
+    {
+        return request1->priority < request2->priority;
+    }
+};
+
+DVIDRequestEngine& DVIDRequestEngine::get_engine()
+{
+    // constructed on first use so it is destroyed before curl is cleaned up
+    static DVIDRequestEngine engine;
+    return engine;
+}
+
+DVIDRequestEngine::DVIDRequestEngine() :
+    max_host_connections(DEFAULT_MAX_HOST_CONNECTIONS),
+    max_host_connections_dirty(true), num_slot_waiters(0),
+    last_slot_check(0), next_id(1), stopping(false)
+{
+    multi_handle = curl_multi_init();
+    if (!multi_handle) {
+        throw ErrMsg("Could not create curl multi handle");
+    }
+}
+
+DVIDRequestEngine::~DVIDRequestEngine()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    if (io_thread) {
+#ifdef LIBDVID_CURL_HAS_WAKEUP
+        curl_multi_wakeup(multi_handle);
+#endif
+        io_thread->join();
+    }
+
+    // abandon requests that never finished
+    for (map<void*, Request*>::iterator iter = active.begin();
+            iter != active.end(); ++iter) {
+        curl_multi_remove_handle(multi_handle, iter->first);
+        curl_easy_cleanup(iter->first);
+        curl_slist_free_all(iter->second->headers);
+        delete iter->second;
+    }
+    for (multimap<double, Request*>::iterator iter = pending.begin();
+            iter != pending.end(); ++iter) {
+        delete iter->second;
+    }
+    for (map<RequestScheduler*, SlotQueue>::iterator iter =
+            slot_waiters.begin(); iter != slot_waiters.end(); ++iter) {
+        // the scheduler may outlive the engine
+        iter->first->set_slot_listener(SlotListener());
+        for (int lane = 0; lane < NUM_PRIORITIES; ++lane) {
+            deque<Request*>& waiters = iter->second.lanes[lane];
+            for (unsigned int i = 0; i < waiters.size(); ++i) {
+                iter->first->abandon(waiters[i]->priority,
+                        waiters[i]->sched_waiting);
+                delete waiters[i];
+            }
+        }
+    }
+    for (unsigned int i = 0; i < idle_handles.size(); ++i) {
+        curl_easy_cleanup(idle_handles[i]);
+    }
+    curl_multi_cleanup(multi_handle);
+}
+
+uint64 DVIDRequestEngine::submit(string url, ConnectionMethod method,
+        BinaryDataPtr payload, ConnectionType type, int timeout,
+        ResponseCallback callback, double delay, DVIDConnectionPoolPtr pool,
+        RequestPriority priority)
+{
+    Request* request = new Request;
+    request->url = url;
+    request->method = method;
+    request->payload = payload;
+    request->type = type;
+    request->timeout = timeout;
+    request->callback = callback;
+    request->pool = pool;
+    request->priority = priority;
+
+    uint64 id = 0;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (stopping) {
+            delete request;
+            throw ErrMsg("Request engine is shutting down");
+        }
+        id = request->id = next_id++;
+        pending.insert(std::make_pair(monotonic_seconds() + delay, request));
+        if (!io_thread) {
+            io_thread.reset(new boost::thread(&DVIDRequestEngine::run, this));
+        }
+    }
+#ifdef LIBDVID_CURL_HAS_WAKEUP
+    curl_multi_wakeup(multi_handle);
+#endif
+    return id;
+}
+
+void DVIDRequestEngine::cancel(uint64 id)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (stopping || !io_thread) {
+            return;
+        }
+        cancelled_ids.push_back(id);
+    }
+#ifdef LIBDVID_CURL_HAS_WAKEUP
+    curl_multi_wakeup(multi_handle);
+#endif
+}
+
+bool DVIDRequestEngine::in_io_thread()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return io_thread && (io_thread->get_id() == boost::this_thread::get_id());
+}
+
+void DVIDRequestEngine::set_max_host_connections(int max_connections)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    max_host_connections = max_connections;
+    max_host_connections_dirty = true;
+}
+
+int DVIDRequestEngine::num_outstanding()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return int(pending.size() + active.size()) + num_slot_waiters;
+}
+
+void* DVIDRequestEngine::prepare_handle(Request* request)
+{
+    void* handle = 0;
+    if (!idle_handles.empty()) {
+        handle = idle_handles.back();
+        idle_handles.pop_back();
+    } else {
+        handle = curl_easy_init();
+        if (!handle) {
+            throw ErrMsg("Could not create curl handle");
+        }
+    }
+
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_URL, request->url.c_str());
+#if LIBCURL_VERSION_NUM >= 0x072800
+    if (request->pool && !request->pool->get_unix_socket().empty()) {
+        // curl copies the path
+        curl_easy_setopt(handle, CURLOPT_UNIX_SOCKET_PATH,
+                request->pool->get_unix_socket().c_str());
+    }
+#endif
+
+    if (request->type == JSON) {
+        request->headers = curl_slist_append(request->headers,
+                "Content-Type: application/json");
+    } else if (request->type == BINARY) {
+        request->headers = curl_slist_append(request->headers,
+                "Content-Type: application/octet-stream");
+    }
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, request->headers);
+
+    // set the method
+    if (request->method == HEAD) {
+        curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "HEAD");
+        curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+    } else if (request->method == GET) {
+        curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "GET");
+    } else if (request->method == POST) {
+        curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "POST");
+    } else if (request->method == PUT) {
+        curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "PUT");
+    } else if (request->method == DELETE) {
+        curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "DELETE");
+    }
+
+    // set to 0 for infinite
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, long(request->timeout));
+
+    // post binary data (the payload is kept alive by the request)
+    if (request->payload) {
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDS,
+                request->payload->get_raw());
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE,
+                curl_off_t(request->payload->length()));
+    }
+
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION,
+            ResponseSinkAdapter::write_callback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void *)&(request->adapter));
+    if (request->method != HEAD) {
+        // HEAD reports the length of a body that is never sent
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION,
+                ResponseSinkAdapter::header_callback);
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA,
+                (void *)&(request->adapter));
+    }
+    curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, request->error_buf);
+
+    return handle;
+}
+
+bool DVIDRequestEngine::admit_request(Request* request)
+{
+    if (!request->pool) {
+        return true;
+    }
+    FlowControllerPtr flow = request->pool->get_flow_controller();
+
+    // the rate limits are applied once
+    double wait = 0;
+    if (!request->flow_reserved) {
+        request->flow_reserved = true;
+        wait = flow->reserve(request->payload ?
+                uint64(request->payload->length()) : 0);
+    }
+    if (wait > 0) {
+        boost::mutex::scoped_lock lock(mutex);
+        pending.insert(std::make_pair(monotonic_seconds() + wait, request));
+        return false;
+    }
+
+    RequestScheduler* scheduler = request->pool->get_scheduler().get();
+    if (scheduler->try_acquire(request->priority, request->sched_waiting)) {
+        request->flow_slot = true;
+        return true;
+    }
+
+    // wait in FIFO order for the scheduler to report a free slot (the
+    // queued request keeps the pool and so the scheduler alive)
+    SlotQueue& queue = slot_waiters[scheduler];
+    bool first_waiter = true;
+    for (int lane = 0; lane < NUM_PRIORITIES; ++lane) {
+        if (!queue.lanes[lane].empty()) {
+            first_waiter = false;
+        }
+    }
+    queue.lanes[request->priority].push_back(request);
+    if (first_waiter) {
+        scheduler->set_slot_listener(boost::bind(
+                    &DVIDRequestEngine::wake_scheduler, this, scheduler));
+    }
+
+    boost::mutex::scoped_lock lock(mutex);
+    ++num_slot_waiters;
+    if (first_waiter) {
+        // a slot may have been freed before the listener was set
+        woken_schedulers.insert(scheduler);
+    }
+    return false;
+}
+
+void DVIDRequestEngine::start_slot_waiters(RequestScheduler* scheduler,
+        vector<Request*>& started)
+{
+    map<RequestScheduler*, SlotQueue>::iterator iter =
+        slot_waiters.find(scheduler);
+    if (iter == slot_waiters.end()) {
+        return;
+    }
+
+    // a waiter that cannot start also holds back the lower lanes, so
+    // only the head of each queue is ever refused
+    unsigned int num_started = 0;
+    bool blocked = false;
+    bool empty = true;
+    for (int lane = 0; lane < NUM_PRIORITIES; ++lane) {
+        deque<Request*>& waiters = iter->second.lanes[lane];
+        while (!blocked && !waiters.empty()) {
+            Request* request = waiters.front();
+            if (!scheduler->try_acquire(request->priority,
+                        request->sched_waiting)) {
+                blocked = true;
+                break;
+            }
+            request->flow_slot = true;
+            waiters.pop_front();
+            started.push_back(request);
+            ++num_started;
+        }
+        if (!waiters.empty()) {
+            empty = false;
+        }
+    }
+
+    if (empty) {
+        scheduler->set_slot_listener(SlotListener());
+        slot_waiters.erase(iter);
+    }
+    boost::mutex::scoped_lock lock(mutex);
+    num_slot_waiters -= num_started;
+}
+
+void DVIDRequestEngine::wake_scheduler(RequestScheduler* scheduler)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (stopping) {
+            return;
+        }
+        woken_schedulers.insert(scheduler);
+    }
+#ifdef LIBDVID_CURL_HAS_WAKEUP
+    curl_multi_wakeup(multi_handle);
+#endif
+}
+
+void DVIDRequestEngine::cancel_requests()
+{
+    vector<uint64> ids;
+    vector<Request*> removed;
+    vector<void*> handles;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        ids.swap(cancelled_ids);
+        if (ids.empty()) {
+            return;
+        }
+        for (multimap<double, Request*>::iterator iter = pending.begin();
+                iter != pending.end(); ) {
+            if (std::find(ids.begin(), ids.end(), iter->second->id) !=
+                    ids.end()) {
+                removed.push_back(iter->second);
+                pending.erase(iter++);
+            } else {
+                ++iter;
+            }
+        }
+        for (map<void*, Request*>::iterator iter = active.begin();
+                iter != active.end(); ) {
+            if (std::find(ids.begin(), ids.end(), iter->second->id) !=
+                    ids.end()) {
+                handles.push_back(iter->first);
+                removed.push_back(iter->second);
+                active.erase(iter++);
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    // stopped transfers give back their handle and scheduler slot
+    for (unsigned int i = 0; i < handles.size(); ++i) {
+        curl_multi_remove_handle(multi_handle, handles[i]);
+        curl_easy_reset(handles[i]);
+        idle_handles.push_back(handles[i]);
+    }
+
+    // requests waiting for a slot stop waiting
+    int num_removed = 0;
+    for (map<RequestScheduler*, SlotQueue>::iterator iter =
+            slot_waiters.begin(); iter != slot_waiters.end(); ) {
+        bool empty = true;
+        for (int lane = 0; lane < NUM_PRIORITIES; ++lane) {
+            deque<Request*>& waiters = iter->second.lanes[lane];
+            for (deque<Request*>::iterator request = waiters.begin();
+                    request != waiters.end(); ) {
+                if (std::find(ids.begin(), ids.end(), (*request)->id) !=
+                        ids.end()) {
+                    iter->first->abandon((*request)->priority,
+                            (*request)->sched_waiting);
+                    removed.push_back(*request);
+                    request = waiters.erase(request);
+                    ++num_removed;
+                } else {
+                    ++request;
+                }
+            }
+            if (!waiters.empty()) {
+                empty = false;
+            }
+        }
+        if (empty) {
+            iter->first->set_slot_listener(SlotListener());
+            slot_waiters.erase(iter++);
+        } else {
+            ++iter;
+        }
+    }
+    if (num_removed) {
+        boost::mutex::scoped_lock lock(mutex);
+        num_slot_waiters -= num_removed;
+    }
+
+    for (unsigned int i = 0; i < removed.size(); ++i) {
+        Request* request = removed[i];
+        if (request->flow_slot) {
+            request->flow_slot = false;
+            request->pool->get_scheduler()->release(request->priority);
+        }
+        DVIDResponse response;
+        response.curl_code = int(CURLE_ABORTED_BY_CALLBACK);
+        response.data = request->results;
+        response.error_msg = "Request cancelled";
+        try {
+            request->callback(response);
+        } catch (...) {
+        }
+        curl_slist_free_all(request->headers);
+        delete request;
+    }
+}
+
+void DVIDRequestEngine::start_ready_requests()
+{
+    vector<Request*> ready;
+    vector<RequestScheduler*> woken;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        double now = monotonic_seconds();
+        woken.assign(woken_schedulers.begin(), woken_schedulers.end());
+        woken_schedulers.clear();
+        if (!slot_waiters.empty() &&
+                ((now - last_slot_check) >= SLOT_CHECK_INTERVAL)) {
+            woken.clear();
+            for (map<RequestScheduler*, SlotQueue>::iterator iter =
+                    slot_waiters.begin(); iter != slot_waiters.end();
+                    ++iter) {
+                woken.push_back(iter->first);
+            }
+            last_slot_check = now;
+        }
+        while (!pending.empty() && (pending.begin()->first <= now)) {
+            ready.push_back(pending.begin()->second);
+            pending.erase(pending.begin());
+        }
+
+        // higher lanes are admitted first (stable within a lane)
+        std::stable_sort(ready.begin(), ready.end(), HigherPriority());
+
+        if (max_host_connections_dirty) {
+            curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    long(max_host_connections));
+            max_host_connections_dirty = false;
+        }
+    }
+
+    // requests that waited for a slot go before new ones
+    vector<Request*> started;
+    for (unsigned int i = 0; i < woken.size(); ++i) {
+        start_slot_waiters(woken[i], started);
+    }
+    for (unsigned int i = 0; i < started.size(); ++i) {
+        start_request(started[i]);
+    }
+
+    for (unsigned int i = 0; i < ready.size(); ++i) {
+        if (admit_request(ready[i])) {
+            start_request(ready[i]);
+        }
+    }
+}
+
+void DVIDRequestEngine::start_request(Request* request)
+{
+    void* handle = 0;
+    try {
+        handle = prepare_handle(request);
+    } catch (std::exception& e) {
+        DVIDResponse response;
+        response.curl_code = int(CURLE_FAILED_INIT);
+        response.data = request->results;
+        response.error_msg = e.what();
+        if (request->flow_slot) {
+            request->pool->get_scheduler()->release(request->priority);
+        }
+        try {
+            request->callback(response);
+        } catch (...) {
+        }
+        curl_slist_free_all(request->headers);
+        delete request;
+        return;
+    }
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        active[handle] = request;
+    }
+    if (Trace::is_enabled()) {
+        request->trace_start = Trace::now();
+    }
+    curl_multi_add_handle(multi_handle, handle);
+}
+
+void DVIDRequestEngine::finish_completed_requests()
+{
+    int msgs_left = 0;
+    CURLMsg* msg = 0;
+    while ((msg = curl_multi_info_read(multi_handle, &msgs_left))) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        void* handle = msg->easy_handle;
+        CURLcode result = msg->data.result;
+        curl_multi_remove_handle(multi_handle, handle);
+
+        Request* request = 0;
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            map<void*, Request*>::iterator iter = active.find(handle);
+            request = iter->second;
+            active.erase(iter);
+        }
+
+        long http_code = 0;
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &http_code);
+        if (request->trace_start >= 0) {
+            Trace::record(DVIDConnection::get_trace_name(request->method),
+                    "http async", request->trace_start, Trace::now(),
+                    request->url);
+        }
+        if (request->pool) {
+            RequestTiming timing = get_request_timing(handle);
+            request->pool->get_stats()->record(
+                    RequestStats::classify_endpoint(request->url),
+                    timing, result != CURLE_OK);
+            if (request->flow_slot) {
+                request->flow_slot = false;
+                request->pool->get_flow_controller()->end(int(http_code),
+                        result != CURLE_OK, timing);
+                request->pool->get_scheduler()->release(request->priority);
+            }
+        }
+
+        if (result == CURLE_OK) {
+            request->adapter.complete();
+        }
+
+        DVIDResponse response;
+        response.status = int(http_code);
+        response.curl_code = int(result);
+        response.data = request->results;
+        response.error_msg = request->error_buf;
+        if (!request->adapter.get_error().empty()) {
+            response.error_msg = request->adapter.get_error();
+        } else if ((result != CURLE_OK) && response.error_msg.empty()) {
+            response.error_msg = curl_easy_strerror(result);
+        }
+
+        // recycle the handle (keeps its connection alive)
+        curl_slist_free_all(request->headers);
+        request->headers = 0;
+        curl_easy_reset(handle);
+        idle_handles.push_back(handle);
+
+        // callbacks must not take down the I/O thread
+        try {
+            request->callback(response);
+        } catch (...) {
+        }
+        delete request;
+    }
+}
+
+void DVIDRequestEngine::run()
+{
+    while (true) {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (stopping) {
+                break;
+            }
+        }
+
+        cancel_requests();
+        start_ready_requests();
+
+        int running = 0;
+        curl_multi_perform(multi_handle, &running);
+        finish_completed_requests();
+
+        // sleep until there is network activity, a new submission,
+        // a free scheduler slot, or a delayed request becomes ready
+        int wait_ms = MAX_POLL_MS;
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (!woken_schedulers.empty() || !cancelled_ids.empty()) {
+                wait_ms = 0;
+            } else if (!pending.empty()) {
+                double delta = pending.begin()->first - monotonic_seconds();
+                wait_ms = (delta <= 0) ? 0 : int(delta * 1000) + 1;
+                if (wait_ms > MAX_POLL_MS) {
+                    wait_ms = MAX_POLL_MS;
+                }
+            }
+        }
+
+#ifdef LIBDVID_CURL_HAS_WAKEUP
+        curl_multi_poll(multi_handle, 0, 0, wait_ms, 0);
+#else
+        // without wakeup support new submissions are noticed by polling
+        curl_multi_wait(multi_handle, 0, 0, (wait_ms > 10) ? 10 : wait_ms, 0);
+#endif
+    }
+}
+
+}
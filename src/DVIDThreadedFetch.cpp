@@ -1,8 +1,12 @@
 #include <libdvid/DVIDThreadedFetch.h>
 #include <libdvid/DVIDException.h>
+#include <libdvid/BlockBufferPool.h>
+#include <libdvid/Trace.h>
 
 #include <vector>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <iostream>
 
 using std::string;
 using std::vector;
@@ -22,10 +26,11 @@ struct FetchGrayBlocks {
 
     void operator()()
     {
-        uint8* blockdata = 0;
-        if ((request_efficiency == 1) && !use_blocks) {
-            blockdata = new uint8[DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE];
-        }
+        const int block_bytes = DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE;
+
+        // raw volumes for a span are fetched into one reusable buffer
+        vector<uint8> span_buffer;
+
         // iterate only for the threads parts 
         for (int index = start; index < (start+count); ++index) {
             // load span info
@@ -37,15 +42,16 @@ struct FetchGrayBlocks {
             int block_index = span[4];
 
             if (use_blocks) {
-                // use block interface (currently most re-copy)
+                // use block interface (blocks are already contiguous
+                // so each block references the response)
                 vector<int> block_coords;
                 block_coords.push_back(xmin);
                 block_coords.push_back(y);
                 block_coords.push_back(z);
-                GrayscaleBlocks blocks2 = service.get_grayblocks(grayscale_name, block_coords, curr_runlength);
+                GrayscaleBlocks span_blocks = service.get_grayblocks(
+                        grayscale_name, block_coords, curr_runlength);
                 for (int j = 0; j < curr_runlength; ++j) {
-                    BinaryDataPtr ptr = BinaryData::create_binary_data((const char*)blocks2[j], DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE);
-                    (*blocks)[block_index] = ptr;
+                    (*blocks)[block_index] = span_blocks.get_block(j);
                     ++block_index;
                 }
             } else {
@@ -58,22 +64,34 @@ struct FetchGrayBlocks {
                 offset.push_back(y*DEFBLOCKSIZE);
                 offset.push_back(z*DEFBLOCKSIZE);
 
-                Grayscale3D grayvol = service.get_gray3D(grayscale_name,
-                        dims, offset, false); 
-
                 if (curr_runlength == 1) {
-                    // do a simple copy for just one block
+                    // a single block is already in block order
+                    Grayscale3D grayvol = service.get_gray3D(grayscale_name,
+                            dims, offset, false); 
                     (*blocks)[block_index] = grayvol.get_binary();
                     ++block_index;
                 } else {
-                    const uint8* raw_data = grayvol.get_raw();
-
-                    // otherwise create a buffer and do something more complicated 
+                    size_t span_bytes = size_t(block_bytes) * curr_runlength;
+                    if (span_buffer.size() < span_bytes) {
+                        span_buffer.resize(span_bytes);
+                    }
+                    vector<unsigned int> channels;
+                    channels.push_back(0);
+                    channels.push_back(1);
+                    channels.push_back(2);
+                    service.get_gray3D(grayscale_name, dims, offset, channels,
+                            &span_buffer[0], span_buffer.size(), false);
+                    const uint8* raw_data = &span_buffer[0];
+
+                    // reshape each block straight into its own buffer
+                    TraceScope trace("reshape gray blocks", "reshape");
                     for (int j = 0; j < curr_runlength; ++j) {
                         int offsetx = j * DEFBLOCKSIZE;
                         int offsety = curr_runlength*DEFBLOCKSIZE;
                         int offsetz = curr_runlength*DEFBLOCKSIZE*DEFBLOCKSIZE;
-                        uint8* mod_data_iter = blockdata; 
+                        BinaryDataPtr ptr = BlockBufferPool::get_pool().
+                            create_binary_data(block_bytes);
+                        uint8* mod_data_iter = (uint8*) &(ptr->get_data()[0]);
 
                         for (int ziter = 0; ziter < DEFBLOCKSIZE; ++ziter) {
                             const uint8* data_iter = raw_data + ziter * offsetz;    
@@ -87,21 +105,16 @@ struct FetchGrayBlocks {
                                 data_iter += ((offsety) - DEFBLOCKSIZE);
                             }
                         }
-                        BinaryDataPtr ptr = BinaryData::create_binary_data((const char*) blockdata, DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE);
                         (*blocks)[block_index] = ptr;
                         ++block_index;
                     }
                 }
             }
         }
-
-        if (blockdata) {
-            delete []blockdata;
-        }
     }
 
 
-    DVIDNodeService service;
+    DVIDNodeService& service;
     string grayscale_name;
     bool use_blocks;
     int request_efficiency;
@@ -118,8 +131,9 @@ struct FetchLabelBlocks {
 
     void operator()()
     {
-        uint64* blockdata = 0;
-        blockdata = new uint64[DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE];
+        const unsigned int block_bytes =
+            sizeof(uint64)*DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE;
+
         // iterate only for the threads parts 
         for (int index = start; index < (start+count); ++index) {
             // load span info
@@ -149,12 +163,15 @@ struct FetchLabelBlocks {
             } else {
                 const uint64* raw_data = labelvol.get_raw();
 
-                // otherwise create a buffer and do something more complicated 
+                // otherwise reshape each block straight into a pooled buffer
+                TraceScope trace("reshape label blocks", "reshape");
                 for (int j = 0; j < curr_runlength; ++j) {
                     int offsetx = j * DEFBLOCKSIZE;
                     int offsety = curr_runlength*DEFBLOCKSIZE;
                     int offsetz = curr_runlength*DEFBLOCKSIZE*DEFBLOCKSIZE;
-                    uint64* mod_data_iter = blockdata; 
+                    BinaryDataPtr ptr = BlockBufferPool::get_pool().
+                        create_binary_data(block_bytes);
+                    uint64* mod_data_iter = (uint64*) &(ptr->get_data()[0]);
 
                     for (int ziter = 0; ziter < DEFBLOCKSIZE; ++ziter) {
                         const uint64* data_iter = raw_data + ziter * offsetz;    
@@ -168,21 +185,15 @@ struct FetchLabelBlocks {
                             data_iter += ((offsety) - DEFBLOCKSIZE);
                         }
                     }
-                    BinaryDataPtr ptr = BinaryData::create_binary_data((const char*) blockdata,
-                            sizeof(uint64)*DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE);
                     (*blocks)[block_index] = ptr;
                     ++block_index;
                 }
             }
         }
-
-        if (blockdata) {
-            delete []blockdata;
-        }
     }
 
 
-    DVIDNodeService service;
+    DVIDNodeService& service;
     string labelsname;
     int start; int count;
     vector<vector<int> >* spans;
@@ -216,9 +227,15 @@ struct WriteLabelBlocks {
             offset.push_back(y*DEFBLOCKSIZE);
             offset.push_back(z*DEFBLOCKSIZE);
 
-            uint64* blockdata = new uint64[DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE*curr_runlength];
+            // the span is reshaped into a pooled buffer (recycled once
+            // the request completes)
+            BinaryDataPtr span_data = BlockBufferPool::get_pool().
+                create_binary_data(sizeof(uint64)*DEFBLOCKSIZE*DEFBLOCKSIZE*
+                        DEFBLOCKSIZE*curr_runlength);
+            uint64* blockdata = (uint64*) &(span_data->get_data()[0]);
 
             // otherwise create a buffer and do something more complicated 
+            TraceScope trace("reshape label volume", "reshape");
             for (int j = 0; j < curr_runlength; ++j) {
                 int offsetx = j * DEFBLOCKSIZE;
                 int offsety = curr_runlength*DEFBLOCKSIZE;
@@ -239,16 +256,16 @@ struct WriteLabelBlocks {
                 }
                 ++block_index;
             }
+            trace.finish();
 
             // actually put label volume
-            Labels3D volume(blockdata, DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE*curr_runlength, dims);
+            Labels3D volume(span_data, dims);
             service.put_labels3D(labelsname, volume, offset, false); 
-            delete []blockdata;
         }
     }
 
 
-    DVIDNodeService service;
+    DVIDNodeService& service;
     string labelsname;
     int start; int count;
     vector<vector<int> >* spans;
@@ -277,7 +294,7 @@ struct FetchTiles {
         }     
     }
 
-    DVIDNodeService service;
+    DVIDNodeService& service;
     Slice2D orientation;
     string instance;
     unsigned int scaling;
@@ -472,10 +489,21 @@ vector<BinaryDataPtr> get_tile_array_binary(DVIDNodeService& service,
         string datatype_instance, Slice2D orientation, unsigned int scaling,
         const vector<vector<int> >& tile_locs_array, int num_threads)
 {
+    vector<BinaryDataPtr> results(tile_locs_array.size());
+
+    // issue every request at once on the asynchronous engine
     if (!num_threads) {
-        num_threads = tile_locs_array.size();
+        vector<BinaryDataFuture> futures;
+        for (unsigned int i = 0; i < tile_locs_array.size(); ++i) {
+            futures.push_back(service.get_tile_slice_binary_async(
+                        datatype_instance, orientation, scaling,
+                        tile_locs_array[i]));
+        }
+        for (unsigned int i = 0; i < futures.size(); ++i) {
+            results[i] = futures[i].get();
+        }
+        return results;
     }
-    vector<BinaryDataPtr> results(tile_locs_array.size());
     
     // launch threads
     boost::thread_group threads;
@@ -499,4 +527,87 @@ vector<BinaryDataPtr> get_tile_array_binary(DVIDNodeService& service,
     return results;
 }
 
+/*!
+ * Decodes a range of tiles into their slots of a contiguous buffer.
+ * The first error is recorded for the caller.
+*/
+struct DecodeTiles {
+    DecodeTiles(const vector<BinaryDataPtr>& tiles_, unsigned int width_,
+            unsigned int height_, byte* output_, int start_, int count_,
+            boost::mutex& mutex_, string& error_) :
+        tiles(tiles_), width(width_), height(height_), output(output_),
+        start(start_), count(count_), mutex(mutex_), error(error_) {}
+
+    void operator()()
+    {
+        unsigned int tile_bytes = width * height;
+        try {
+            for (int i = start; i < (start + count); ++i) {
+                unsigned int tile_width, tile_height;
+                BinaryData::decompress_image(tiles[i],
+                        output + uint64(i) * tile_bytes, tile_bytes,
+                        tile_width, tile_height);
+                if ((tile_width != width) || (tile_height != height)) {
+                    throw ErrMsg("Tile does not have the expected size");
+                }
+            }
+        } catch (std::exception& e) {
+            boost::mutex::scoped_lock lock(mutex);
+            if (error.empty()) {
+                error = e.what();
+            }
+        }
+    }
+
+    const vector<BinaryDataPtr>& tiles;
+    unsigned int width, height;
+    byte* output;
+    int start, count;
+    boost::mutex& mutex;
+    string& error;
+};
+
+void decode_tile_array(const vector<BinaryDataPtr>& tiles,
+        unsigned int tile_width, unsigned int tile_height, byte* output,
+        int num_threads)
+{
+    int num_tiles = tiles.size();
+    if (!num_threads) {
+        num_threads = boost::thread::hardware_concurrency();
+    }
+    if (num_threads > num_tiles) {
+        num_threads = num_tiles;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    boost::mutex mutex;
+    string error;
+
+    // decode in the calling thread if there is nothing to split
+    if (num_threads == 1) {
+        DecodeTiles(tiles, tile_width, tile_height, output, 0, num_tiles,
+                mutex, error)();
+    } else {
+        boost::thread_group threads;
+        int incr = num_tiles / num_threads;
+        int start = 0;
+        for (int i = 0; i < num_threads; ++i) {
+            int count = incr;
+            if (i == (num_threads-1)) {
+                count = num_tiles - start;
+            }
+            threads.create_thread(DecodeTiles(tiles, tile_width,
+                        tile_height, output, start, count, mutex, error));
+            start += incr;
+        }
+        threads.join_all();
+    }
+
+    if (!error.empty()) {
+        throw ErrMsg(error);
+    }
+}
+
 }
@@ -0,0 +1,179 @@
+#include "FlowControl.h"
+
+#include <time.h>
+
+namespace libdvid {
+
+//! Weight of a new sample in the smoothed latency
+static const double LatencySmoothing = 0.2;
+
+//! Rate that the baseline latency drifts toward the smoothed latency
+static const double BaselineDrift = 0.001;
+
+//! Shortest time between decreases when no latency is known (seconds)
+static const double MinDecreaseInterval = 0.1;
+
+//! Monotonic time in seconds
+static double monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+void TokenBucket::set_rate(double rate_, double burst_)
+{
+    rate = (rate_ > 0) ? rate_ : 0;
+    burst = (burst_ > 0) ? burst_ : rate;
+    tokens = burst;
+    last_refill = 0;
+}
+
+void TokenBucket::refill(double now)
+{
+    if (last_refill > 0) {
+        tokens += (now - last_refill) * rate;
+        if (tokens > burst) {
+            tokens = burst;
+        }
+    }
+    last_refill = now;
+}
+
+double TokenBucket::reserve(double amount, double now)
+{
+    if (rate <= 0) {
+        return 0;
+    }
+    refill(now);
+    tokens -= amount;
+    return (tokens >= 0) ? 0 : (-tokens / rate);
+}
+
+FlowController::FlowController() : adaptive(false), min_limit(1),
+    max_limit(1), latency_tolerance(2.0), limit(1), slow_start(true),
+    smoothed_latency(0), baseline_latency(0),
+    last_decrease(0), num_decreases(0)
+{
+}
+
+void FlowController::set_request_rate(double requests_per_second,
+        double burst)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    request_bucket.set_rate(requests_per_second, burst);
+}
+
+void FlowController::set_byte_rate(double bytes_per_second, double burst)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    byte_bucket.set_rate(bytes_per_second, burst);
+}
+
+void FlowController::enable_adaptive(int min_limit_, int max_limit_,
+        double latency_tolerance_)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    min_limit = (min_limit_ > 0) ? min_limit_ : 1;
+    max_limit = (max_limit_ > min_limit) ? max_limit_ : min_limit;
+    latency_tolerance = (latency_tolerance_ > 1.0) ? latency_tolerance_ : 1.0;
+    limit = min_limit;
+    slow_start = true;
+    smoothed_latency = 0;
+    baseline_latency = 0;
+    last_decrease = 0;
+    adaptive = true;
+}
+
+void FlowController::disable_adaptive()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    adaptive = false;
+}
+
+bool FlowController::is_enabled()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return adaptive || (request_bucket.get_rate() > 0) ||
+        (byte_bucket.get_rate() > 0);
+}
+
+double FlowController::reserve(uint64 upload_bytes)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    double now = monotonic_seconds();
+    double wait = request_bucket.reserve(1, now);
+    if (upload_bytes) {
+        double byte_wait = byte_bucket.reserve(double(upload_bytes), now);
+        if (byte_wait > wait) {
+            wait = byte_wait;
+        }
+    }
+    return wait;
+}
+
+void FlowController::end(int status, bool failed, const RequestTiming& timing)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    double now = monotonic_seconds();
+
+    // downloads are paid for after the fact
+    if (timing.bytes_received) {
+        byte_bucket.reserve(double(timing.bytes_received), now);
+    }
+    if (!adaptive) {
+        return;
+    }
+
+    bool congested = failed || (status == 503);
+    double latency = timing.times[STARTTRANSFER_TIME];
+    if (!failed && (latency > 0)) {
+        smoothed_latency = (smoothed_latency > 0) ? (smoothed_latency +
+                LatencySmoothing * (latency - smoothed_latency)) : latency;
+
+        // the baseline follows lasting changes slowly
+        if ((baseline_latency <= 0) || (smoothed_latency < baseline_latency)) {
+            baseline_latency = smoothed_latency;
+        } else {
+            baseline_latency += BaselineDrift *
+                (smoothed_latency - baseline_latency);
+        }
+        if (smoothed_latency > (latency_tolerance * baseline_latency)) {
+            congested = true;
+        }
+    }
+
+    if (congested) {
+        // decrease at most once per round trip
+        double interval = (smoothed_latency > MinDecreaseInterval) ?
+            smoothed_latency : MinDecreaseInterval;
+        if ((now - last_decrease) >= interval) {
+            limit /= 2;
+            if (limit < min_limit) {
+                limit = min_limit;
+            }
+            slow_start = false;
+            last_decrease = now;
+            ++num_decreases;
+        }
+    } else if (limit < max_limit) {
+        limit += slow_start ? 1.0 : (1.0 / limit);
+        if (limit > max_limit) {
+            limit = max_limit;
+        }
+    }
+}
+
+int FlowController::get_concurrency_limit()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return adaptive ? int(limit) : 0;
+}
+
+uint64 FlowController::get_num_decreases()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return num_decreases;
+}
+
+}
@@ -0,0 +1,629 @@
+#include "LabelBlockCodec.h"
+#include "DVIDException.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::string; using std::vector;
+
+//! Voxels along each dimension of a sub-block
+static const unsigned int SubBlockSize = 8;
+
+//! Voxels in a sub-block
+static const unsigned int SubBlockVoxels =
+    SubBlockSize * SubBlockSize * SubBlockSize;
+
+namespace libdvid {
+
+//! Integer types of the serialized blocks
+typedef boost::uint16_t uint16;
+typedef boost::uint32_t uint32;
+
+/*!
+ * True if the labels all equal value.
+*/
+static bool labels_equal(const uint64* labels, unsigned int count,
+        uint64 value)
+{
+    unsigned int i = 0;
+#ifdef __SSE2__
+    const __m128i target = _mm_set1_epi64x(value);
+    __m128i diff = _mm_setzero_si128();
+    for (; (i + 2) <= count; i += 2) {
+        diff = _mm_or_si128(diff, _mm_xor_si128(target,
+                    _mm_loadu_si128((const __m128i*) (labels + i))));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) !=
+            0xFFFF) {
+        return false;
+    }
+#endif
+    for (; i < count; ++i) {
+        if (labels[i] != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * Set count labels to value.
+*/
+static void fill_labels(uint64* labels, unsigned int count, uint64 value)
+{
+    unsigned int i = 0;
+#ifdef __SSE2__
+    const __m128i target = _mm_set1_epi64x(value);
+    for (; (i + 2) <= count; i += 2) {
+        _mm_storeu_si128((__m128i*) (labels + i), target);
+    }
+#endif
+    for (; i < count; ++i) {
+        labels[i] = value;
+    }
+}
+
+/*!
+ * Bits per voxel for a sub-block with the given number of labels.
+*/
+static unsigned int index_bits(unsigned int num_labels)
+{
+    unsigned int bits = 0;
+    while ((1U << bits) < num_labels) {
+        ++bits;
+    }
+    return bits;
+}
+
+#ifdef __SSE2__
+/*!
+ * True if SSE2 packs and unpacks indices of the width.  Widths that
+ * divide a byte never straddle bytes, so each round of pack_indices
+ * or unpack_indices merges or splits the fields of every byte in
+ * place with 16-bit shifts and masks (SSE2 has no byte shuffle for
+ * the other widths).
+*/
+static bool simd_index_bits(unsigned int bits)
+{
+    return (bits == 1) || (bits == 2) || (bits == 4) || (bits == 8);
+}
+
+/*!
+ * Pack the indices of a sub-block (each below 2^bits) most
+ * significant bit first.
+*/
+static void pack_indices(const boost::uint16_t* indices, unsigned int bits,
+        string& packed)
+{
+    byte fields[SubBlockVoxels];
+    for (unsigned int i = 0; i < SubBlockVoxels; i += 16) {
+        _mm_storeu_si128((__m128i*) (fields + i), _mm_packus_epi16(
+                    _mm_loadu_si128((const __m128i*) (indices + i)),
+                    _mm_loadu_si128((const __m128i*) (indices + i + 8))));
+    }
+
+    // each round joins the fields of byte pairs (the first field is
+    // the more significant)
+    const __m128i low_byte = _mm_set1_epi16(0xFF);
+    unsigned int count = SubBlockVoxels;
+    for (unsigned int width = bits; width < 8; width *= 2, count /= 2) {
+        const __m128i shift = _mm_cvtsi32_si128(width);
+        for (unsigned int i = 0; i < count; i += 32) {
+            __m128i pairs0 = _mm_loadu_si128((const __m128i*) (fields + i));
+            __m128i pairs1 = _mm_loadu_si128(
+                    (const __m128i*) (fields + i + 16));
+            pairs0 = _mm_or_si128(_mm_sll_epi16(
+                        _mm_and_si128(pairs0, low_byte), shift),
+                    _mm_srli_epi16(pairs0, 8));
+            pairs1 = _mm_or_si128(_mm_sll_epi16(
+                        _mm_and_si128(pairs1, low_byte), shift),
+                    _mm_srli_epi16(pairs1, 8));
+            _mm_storeu_si128((__m128i*) (fields + i / 2),
+                    _mm_packus_epi16(pairs0, pairs1));
+        }
+    }
+    packed.append((const char*) fields, count);
+}
+
+/*!
+ * Unpack the indices of a sub-block (one per byte).
+*/
+static void unpack_indices(const byte* packed, unsigned int bits,
+        byte* indices)
+{
+    unsigned int count = SubBlockVoxels / 8 * bits;
+    memcpy(indices, packed, count);
+
+    // each round splits every byte into two fields, working from the
+    // end so the output does not overwrite unread bytes
+    const __m128i zero = _mm_setzero_si128();
+    for (unsigned int width = 4; width >= bits; width /= 2, count *= 2) {
+        const __m128i shift = _mm_cvtsi32_si128(width);
+        const __m128i mask = _mm_set1_epi16((1 << width) - 1);
+        for (int i = int(count) - 16; i >= 0; i -= 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*) (indices + i));
+            __m128i words0 = _mm_unpacklo_epi8(bytes, zero);
+            __m128i words1 = _mm_unpackhi_epi8(bytes, zero);
+            words0 = _mm_or_si128(_mm_srl_epi16(words0, shift),
+                    _mm_slli_epi16(_mm_and_si128(words0, mask), 8));
+            words1 = _mm_or_si128(_mm_srl_epi16(words1, shift),
+                    _mm_slli_epi16(_mm_and_si128(words1, mask), 8));
+            _mm_storeu_si128((__m128i*) (indices + 2 * i), words0);
+            _mm_storeu_si128((__m128i*) (indices + 2 * i + 16), words1);
+        }
+        if (width == 1) {
+            break;
+        }
+    }
+}
+#endif
+
+/*!
+ * Read a little-endian value from unaligned memory.
+*/
+template <typename T>
+static T read_value(const byte* data)
+{
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+/*!
+ * Append a little-endian value.
+*/
+template <typename T>
+static void write_value(string& output, T value)
+{
+    output.append((const char*) &value, sizeof(T));
+}
+
+/*!
+ * Open-addressing map from labels to their index in the label table
+ * of a block.  Entries are invalidated by bumping a generation count
+ * so the table is reused across the blocks of a span without clearing.
+*/
+class LabelIndexTable {
+  public:
+    LabelIndexTable() : shift(64), generation(0)
+    {
+        resize(10);
+    }
+
+    /*!
+     * Forget all labels.
+    */
+    void reset()
+    {
+        if (++generation == 0) {
+            std::fill(stamps.begin(), stamps.end(), 0);
+            generation = 1;
+        }
+    }
+
+    /*!
+     * Index of the label in labels (appended if new).
+    */
+    uint32 find_or_insert(uint64 label, vector<uint64>& labels)
+    {
+        size_t mask = keys.size() - 1;
+        size_t slot = hash(label);
+        while (stamps[slot] == generation) {
+            if (keys[slot] == label) {
+                return values[slot];
+            }
+            slot = (slot + 1) & mask;
+        }
+
+        // keep the table at most half full
+        if ((labels.size() + 1) * 2 > keys.size()) {
+            resize(64 - shift + 1);
+            for (unsigned int i = 0; i < labels.size(); ++i) {
+                insert(labels[i], i);
+            }
+            return find_or_insert(label, labels);
+        }
+        stamps[slot] = generation;
+        keys[slot] = label;
+        values[slot] = uint32(labels.size());
+        labels.push_back(label);
+        return values[slot];
+    }
+
+  private:
+    size_t hash(uint64 label) const
+    {
+        return size_t((label * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+
+    void resize(unsigned int bits)
+    {
+        shift = 64 - bits;
+        keys.assign(size_t(1) << bits, 0);
+        values.assign(size_t(1) << bits, 0);
+        stamps.assign(size_t(1) << bits, 0);
+        generation = 1;
+    }
+
+    void insert(uint64 label, uint32 index)
+    {
+        size_t mask = keys.size() - 1;
+        size_t slot = hash(label);
+        while (stamps[slot] == generation) {
+            slot = (slot + 1) & mask;
+        }
+        stamps[slot] = generation;
+        keys[slot] = label;
+        values[slot] = index;
+    }
+
+    unsigned int shift;
+    uint32 generation;
+    vector<uint64> keys;
+    vector<uint32> values;
+    vector<uint32> stamps;
+};
+
+/*!
+ * Encodes label blocks of one size.  The scratch space is reused
+ * across the blocks of a span.
+*/
+class LabelBlockEncoder {
+  public:
+    explicit LabelBlockEncoder(unsigned int block_size_) :
+        block_size(block_size_), stamp(0) {}
+
+    void encode(const uint64* labels, string& output)
+    {
+        unsigned int grid = block_size / SubBlockSize;
+        size_t plane = size_t(block_size) * block_size;
+
+        // a solid block is stored as its label
+        bool solid = true;
+        for (size_t row = 0; solid && (row < plane); ++row) {
+            solid = labels_equal(labels + row * block_size, block_size,
+                    labels[0]);
+        }
+        write_value<uint32>(output, grid);
+        write_value<uint32>(output, grid);
+        write_value<uint32>(output, grid);
+        if (solid) {
+            write_value<uint32>(output, 1);
+            write_value<uint64>(output, labels[0]);
+            return;
+        }
+
+        table.reset();
+        block_labels.clear();
+        sub_counts.clear();
+        sub_indices.clear();
+        packed.clear();
+
+        for (unsigned int sz = 0; sz < grid; ++sz) {
+            for (unsigned int sy = 0; sy < grid; ++sy) {
+                for (unsigned int sx = 0; sx < grid; ++sx) {
+                    encode_sub_block(labels + sz * SubBlockSize * plane +
+                            sy * SubBlockSize * block_size +
+                            sx * SubBlockSize);
+                }
+            }
+        }
+
+        write_value<uint32>(output, uint32(block_labels.size()));
+        output.append((const char*) &block_labels[0],
+                block_labels.size() * sizeof(uint64));
+        output.append((const char*) &sub_counts[0],
+                sub_counts.size() * sizeof(uint16));
+        output.append((const char*) &sub_indices[0],
+                sub_indices.size() * sizeof(uint32));
+        output.append(packed);
+    }
+
+  private:
+    //! adds the labels and packed indices of one sub-block
+    void encode_sub_block(const uint64* origin)
+    {
+        size_t plane = size_t(block_size) * block_size;
+        uint64 first = origin[0];
+        bool uniform = true;
+        for (unsigned int z = 0; uniform && (z < SubBlockSize); ++z) {
+            for (unsigned int y = 0; uniform && (y < SubBlockSize); ++y) {
+                uniform = labels_equal(origin + z * plane + y * block_size,
+                        SubBlockSize, first);
+            }
+        }
+        if (uniform) {
+            sub_counts.push_back(1);
+            sub_indices.push_back(table.find_or_insert(first,
+                        block_labels));
+            return;
+        }
+
+        // each block label gets a sub-block index the first time it
+        // appears (stamps mark the labels seen in this sub-block)
+        ++stamp;
+        size_t first_index = sub_indices.size();
+        uint64 prev_label = ~first;
+        uint16 prev_index = 0;
+        uint16* voxel = voxel_indices;
+        for (unsigned int z = 0; z < SubBlockSize; ++z) {
+            for (unsigned int y = 0; y < SubBlockSize; ++y) {
+                const uint64* row = origin + z * plane + y * block_size;
+                for (unsigned int x = 0; x < SubBlockSize; ++x, ++voxel) {
+                    if (row[x] != prev_label) {
+                        prev_label = row[x];
+                        uint32 block_index = table.find_or_insert(
+                                prev_label, block_labels);
+                        if (block_index >= local_stamps.size()) {
+                            local_stamps.resize(block_labels.size(), 0);
+                            local_indices.resize(block_labels.size(), 0);
+                        }
+                        if (local_stamps[block_index] != stamp) {
+                            local_stamps[block_index] = stamp;
+                            local_indices[block_index] =
+                                uint16(sub_indices.size() - first_index);
+                            sub_indices.push_back(block_index);
+                        }
+                        prev_index = local_indices[block_index];
+                    }
+                    *voxel = prev_index;
+                }
+            }
+        }
+        unsigned int num_labels = sub_indices.size() - first_index;
+        sub_counts.push_back(uint16(num_labels));
+
+        // pack the indices most significant bit first (512 voxels
+        // always fill whole bytes)
+        unsigned int bits = index_bits(num_labels);
+#ifdef __SSE2__
+        if (simd_index_bits(bits)) {
+            pack_indices(voxel_indices, bits, packed);
+            return;
+        }
+#endif
+        uint64 accum = 0;
+        unsigned int num_bits = 0;
+        for (unsigned int i = 0; i < SubBlockVoxels; ++i) {
+            accum = (accum << bits) | voxel_indices[i];
+            num_bits += bits;
+            while (num_bits >= 8) {
+                num_bits -= 8;
+                packed.push_back(char(accum >> num_bits));
+            }
+        }
+    }
+
+    unsigned int block_size;
+    LabelIndexTable table;
+    vector<uint64> block_labels;
+    vector<uint16> sub_counts;
+    vector<uint32> sub_indices;
+    string packed;
+
+    //! sub-block index of each block label (valid if its stamp matches)
+    vector<uint16> local_indices;
+    vector<uint32> local_stamps;
+    uint32 stamp;
+
+    //! sub-block index of each voxel in the current sub-block
+    uint16 voxel_indices[SubBlockVoxels];
+};
+
+LabelBlockCodec::LabelBlockCodec(unsigned int block_size_) :
+    block_size(block_size_)
+{
+    if ((block_size == 0) || (block_size % SubBlockSize)) {
+        throw ErrMsg("Label blocks must be a multiple of 8 voxels");
+    }
+}
+
+void LabelBlockCodec::encode_block(const uint64* labels,
+        string& output) const
+{
+    LabelBlockEncoder encoder(block_size);
+    encoder.encode(labels, output);
+}
+
+BinaryDataPtr LabelBlockCodec::encode(const BinaryDataPtr binary,
+        int level) const
+{
+    TraceScope trace("label block compress", "codec");
+    size_t block_bytes = get_block_bytes();
+    if (binary->length() % block_bytes) {
+        throw ErrMsg("Label data is not a whole number of blocks");
+    }
+
+    BinaryDataPtr encoded = BinaryData::create_binary_data();
+    string& output = encoded->get_data();
+    LabelBlockEncoder encoder(block_size);
+    const byte* raw = binary->get_raw();
+    for (size_t pos = 0; pos < binary->length(); pos += block_bytes) {
+        encoder.encode((const uint64*) (raw + pos), output);
+    }
+    return encoded;
+}
+
+size_t LabelBlockCodec::decode_block(const byte* data, size_t length,
+        uint64* labels) const
+{
+    unsigned int grid = block_size / SubBlockSize;
+    size_t plane = size_t(block_size) * block_size;
+    size_t voxels = plane * block_size;
+
+    if (length < 4 * sizeof(uint32)) {
+        throw ErrMsg("Label block is truncated");
+    }
+    if ((read_value<uint32>(data) != grid) ||
+            (read_value<uint32>(data + 4) != grid) ||
+            (read_value<uint32>(data + 8) != grid)) {
+        throw ErrMsg("Label block does not have the expected size");
+    }
+    size_t num_labels = read_value<uint32>(data + 12);
+    size_t pos = 16;
+    if ((length - pos) / sizeof(uint64) < num_labels) {
+        throw ErrMsg("Label block is truncated");
+    }
+    const byte* block_labels = data + pos;
+    pos += num_labels * sizeof(uint64);
+
+    if (num_labels <= 1) {
+        fill_labels(labels, voxels,
+                num_labels ? read_value<uint64>(block_labels) : 0);
+        return pos;
+    }
+
+    // sub-block label counts and their indices into the block labels
+    size_t num_sub_blocks = size_t(grid) * grid * grid;
+    if ((length - pos) / sizeof(uint16) < num_sub_blocks) {
+        throw ErrMsg("Label block is truncated");
+    }
+    const byte* sub_counts = data + pos;
+    pos += num_sub_blocks * sizeof(uint16);
+    size_t num_indices = 0;
+    size_t packed_bytes = 0;
+    for (size_t i = 0; i < num_sub_blocks; ++i) {
+        unsigned int count = read_value<uint16>(sub_counts + i * 2);
+        if (count > SubBlockVoxels) {
+            throw ErrMsg("Label sub-block has too many labels");
+        }
+        num_indices += count;
+        packed_bytes += SubBlockVoxels / 8 * index_bits(count);
+    }
+    if ((length - pos) / sizeof(uint32) < num_indices) {
+        throw ErrMsg("Label block is truncated");
+    }
+    const byte* sub_indices = data + pos;
+    pos += num_indices * sizeof(uint32);
+    if ((length - pos) < packed_bytes) {
+        throw ErrMsg("Label block is truncated");
+    }
+    const byte* packed = data + pos;
+    pos += packed_bytes;
+
+    // indices past the labels of a sub-block decode as 0
+    uint64 sub_labels[SubBlockVoxels];
+    size_t sub_block = 0;
+    for (unsigned int sz = 0; sz < grid; ++sz) {
+        for (unsigned int sy = 0; sy < grid; ++sy) {
+            for (unsigned int sx = 0; sx < grid; ++sx, ++sub_block) {
+                unsigned int count =
+                    read_value<uint16>(sub_counts + sub_block * 2);
+                unsigned int bits = index_bits(count);
+                for (unsigned int i = 0; i < (1U << bits); ++i) {
+                    uint32 index = 0;
+                    if (i < count) {
+                        index = read_value<uint32>(sub_indices + i * 4);
+                        if (index >= num_labels) {
+                            throw ErrMsg("Label block index out of range");
+                        }
+                    }
+                    sub_labels[i] = (i < count) ?
+                        read_value<uint64>(block_labels + index * 8) : 0;
+                }
+                sub_indices += count * sizeof(uint32);
+
+                uint64* origin = labels + sz * SubBlockSize * plane +
+                    sy * SubBlockSize * block_size + sx * SubBlockSize;
+                if (bits == 0) {
+                    // uninitialized (no labels) or uniform sub-block
+                    for (unsigned int z = 0; z < SubBlockSize; ++z) {
+                        for (unsigned int y = 0; y < SubBlockSize; ++y) {
+                            fill_labels(origin + z * plane + y * block_size,
+                                    SubBlockSize, sub_labels[0]);
+                        }
+                    }
+                    continue;
+                }
+
+#ifdef __SSE2__
+                if (simd_index_bits(bits)) {
+                    byte indices[SubBlockVoxels];
+                    unpack_indices(packed, bits, indices);
+                    packed += SubBlockVoxels / 8 * bits;
+                    const byte* index = indices;
+                    for (unsigned int z = 0; z < SubBlockSize; ++z) {
+                        for (unsigned int y = 0; y < SubBlockSize; ++y) {
+                            uint64* row = origin + z * plane +
+                                y * block_size;
+                            for (unsigned int x = 0; x < SubBlockSize; ++x) {
+                                row[x] = sub_labels[*index++];
+                            }
+                        }
+                    }
+                    continue;
+                }
+#endif
+                uint64 mask = (uint64(1) << bits) - 1;
+                uint64 accum = 0;
+                unsigned int num_bits = 0;
+                for (unsigned int z = 0; z < SubBlockSize; ++z) {
+                    for (unsigned int y = 0; y < SubBlockSize; ++y) {
+                        uint64* row = origin + z * plane + y * block_size;
+                        for (unsigned int x = 0; x < SubBlockSize; ++x) {
+                            while (num_bits < bits) {
+                                accum = (accum << 8) | *packed++;
+                                num_bits += 8;
+                            }
+                            num_bits -= bits;
+                            row[x] = sub_labels[(accum >> num_bits) & mask];
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return pos;
+}
+
+BinaryDataPtr LabelBlockCodec::decode(const BinaryDataPtr binary,
+        uint64 decoded_size) const
+{
+    if (decoded_size) {
+        BinaryDataPtr decoded = BinaryData::create_binary_data();
+        decoded->get_data().resize(decoded_size);
+        decode(binary, (byte*) &(decoded->get_data()[0]), decoded_size);
+        return decoded;
+    }
+
+    TraceScope trace("label block decompress", "codec");
+    size_t block_bytes = get_block_bytes();
+    BinaryDataPtr decoded = BinaryData::create_binary_data();
+    string& output = decoded->get_data();
+    const byte* raw = binary->get_raw();
+    size_t pos = 0;
+    while (pos < binary->length()) {
+        output.resize(output.size() + block_bytes);
+        pos += decode_block(raw + pos, binary->length() - pos,
+                (uint64*) &output[output.size() - block_bytes]);
+    }
+    return decoded;
+}
+
+void LabelBlockCodec::decode(const BinaryDataPtr binary, byte* output,
+        uint64 decoded_size) const
+{
+    TraceScope trace("label block decompress", "codec");
+    size_t block_bytes = get_block_bytes();
+    if (decoded_size % block_bytes) {
+        throw ErrMsg("Label data is not a whole number of blocks");
+    }
+    const byte* raw = binary->get_raw();
+    size_t pos = 0;
+    for (uint64 written = 0; written < decoded_size;
+            written += block_bytes) {
+        pos += decode_block(raw + pos, binary->length() - pos,
+                (uint64*) (output + written));
+    }
+    if (pos != binary->length()) {
+        throw ErrMsg("Label blocks do not have the expected size");
+    }
+}
+
+}
@@ -0,0 +1,58 @@
+#include "RequestCoalescer.h"
+#include "DVIDException.h"
+
+using std::string;
+
+namespace libdvid {
+
+BinaryDataPtr RequestCoalescer::run(const string& key,
+        boost::function<BinaryDataPtr ()> fetch)
+{
+    boost::promise<BinaryDataPtr> promise;
+    boost::shared_future<BinaryDataPtr> shared_result(promise.get_future());
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        std::map<string, boost::shared_future<BinaryDataPtr> >::iterator
+            iter = in_flight.find(key);
+        if (iter != in_flight.end()) {
+            // wait for the request already in flight
+            boost::shared_future<BinaryDataPtr> result = iter->second;
+            lock.unlock();
+            num_shared.fetch_add(1, boost::memory_order_relaxed);
+            return result.get();
+        }
+        in_flight[key] = shared_result;
+    }
+    num_fetches.fetch_add(1, boost::memory_order_relaxed);
+
+    // waiters receive copies of any exception
+    try {
+        promise.set_value(fetch());
+    } catch (DVIDConnectionException& error) {
+        promise.set_exception(boost::copy_exception(error));
+    } catch (DVIDException& error) {
+        promise.set_exception(boost::copy_exception(error));
+    } catch (ErrMsg& error) {
+        promise.set_exception(boost::copy_exception(error));
+    } catch (std::exception& error) {
+        promise.set_exception(boost::copy_exception(ErrMsg(error.what())));
+    } catch (...) {
+        // fail the waiters but pass the exception (e.g., a thread
+        // interruption) on unchanged
+        promise.set_exception(boost::copy_exception(
+                    ErrMsg("Request " + key + " failed")));
+        boost::mutex::scoped_lock lock(mutex);
+        in_flight.erase(key);
+        throw;
+    }
+
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        in_flight.erase(key);
+    }
+
+    // the leader sees the same result as the waiters
+    return shared_result.get();
+}
+
+}
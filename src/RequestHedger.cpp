@@ -0,0 +1,96 @@
+#include "RequestHedger.h"
+#include "DVIDException.h"
+
+namespace libdvid {
+
+RequestHedger::RequestHedger(RequestStatsPtr stats_) : stats(stats_),
+    percentile(0.95), min_samples(20), min_delay(0.001), max_delay(10.0),
+    budget(0.1), num_requests(0), num_hedges(0), num_hedge_wins(0)
+{
+}
+
+void RequestHedger::set_percentile(double fraction)
+{
+    if (fraction <= 0 || fraction >= 1) {
+        throw ErrMsg("Hedge percentile must be between 0 and 1");
+    }
+    boost::mutex::scoped_lock lock(mutex);
+    percentile = fraction;
+}
+
+double RequestHedger::get_percentile()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return percentile;
+}
+
+void RequestHedger::set_min_samples(uint64 min_samples_)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    min_samples = min_samples_;
+}
+
+void RequestHedger::set_delay_bounds(double min_delay_, double max_delay_)
+{
+    if (min_delay_ < 0 || max_delay_ < min_delay_) {
+        throw ErrMsg("Invalid bounds for the hedge delay");
+    }
+    boost::mutex::scoped_lock lock(mutex);
+    min_delay = min_delay_;
+    max_delay = max_delay_;
+}
+
+void RequestHedger::set_budget(double fraction)
+{
+    if (fraction < 0 || fraction > 1) {
+        throw ErrMsg("Hedge budget must be between 0 and 1");
+    }
+    boost::mutex::scoped_lock lock(mutex);
+    budget = fraction;
+}
+
+double RequestHedger::begin_request(EndpointFamily family)
+{
+    const LogHistogram& histogram = stats->get_histogram(family,
+            TOTAL_TIME);
+    double delay = 0;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if ((budget == 0) || (histogram.get_count() < min_samples)) {
+            return -1;
+        }
+        delay = histogram.get_percentile(percentile) / 1000000.0;
+        if (delay < min_delay) {
+            delay = min_delay;
+        }
+        if (delay > max_delay) {
+            delay = max_delay;
+        }
+    }
+    ++num_requests;
+    return delay;
+}
+
+bool RequestHedger::try_hedge()
+{
+    double allowed = 0;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        allowed = budget * num_requests.load(boost::memory_order_relaxed);
+    }
+    // concurrent callers may exceed the budget by a few hedges
+    if ((num_hedges.load(boost::memory_order_relaxed) + 1) > allowed) {
+        return false;
+    }
+    ++num_hedges;
+    return true;
+}
+
+void RequestHedger::reset()
+{
+    num_requests = 0;
+    num_hedges = 0;
+    num_hedge_wins = 0;
+}
+
+}
@@ -0,0 +1,221 @@
+#include "RequestScheduler.h"
+#include "DVIDException.h"
+
+namespace libdvid {
+
+//! Names of the lanes (in RequestPriority order)
+static const char* PriorityNames[NUM_PRIORITIES] = {
+    "interactive", "normal", "bulk" };
+
+//! Default share of the capacity for each lane
+static const double DefaultShares[NUM_PRIORITIES] = { 1.0, 0.9, 0.5 };
+
+RequestScheduler::RequestScheduler(int capacity_, FlowControllerPtr flow_) :
+    capacity(capacity_), total_in_flight(0), flow(flow_)
+{
+    if (capacity < 1) {
+        throw ErrMsg("Scheduler capacity must be positive");
+    }
+    for (int i = 0; i < NUM_PRIORITIES; ++i) {
+        shares[i] = DefaultShares[i];
+        in_flight[i] = 0;
+        waiting[i] = 0;
+        dispatched[i] = 0;
+    }
+}
+
+void RequestScheduler::set_capacity(int capacity_)
+{
+    if (capacity_ < 1) {
+        throw ErrMsg("Scheduler capacity must be positive");
+    }
+    SlotListener listener;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        capacity = capacity_;
+        listener = slot_freed();
+    }
+    if (listener) {
+        listener();
+    }
+}
+
+int RequestScheduler::get_capacity()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return capacity;
+}
+
+void RequestScheduler::set_lane_share(RequestPriority priority,
+        double fraction)
+{
+    if (fraction <= 0 || fraction > 1) {
+        throw ErrMsg("Lane share must be between 0 and 1");
+    }
+    SlotListener listener;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        shares[priority] = fraction;
+        listener = slot_freed();
+    }
+    if (listener) {
+        listener();
+    }
+}
+
+double RequestScheduler::get_lane_share(RequestPriority priority)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return shares[priority];
+}
+
+bool RequestScheduler::can_start(RequestPriority priority, bool queued)
+{
+    // higher lanes go first and newcomers queue behind waiters
+    for (int i = 0; i < priority; ++i) {
+        if (waiting[i] > 0) {
+            return false;
+        }
+    }
+    if (!queued && (waiting[priority] > 0)) {
+        return false;
+    }
+
+    int limit = capacity;
+    if (flow) {
+        int flow_limit = flow->get_concurrency_limit();
+        if ((flow_limit > 0) && (flow_limit < limit)) {
+            limit = flow_limit;
+        }
+    }
+    if (total_in_flight >= limit) {
+        return false;
+    }
+
+    int lane_limit = int(shares[priority] * limit);
+    if (lane_limit < 1) {
+        lane_limit = 1;
+    }
+    return in_flight[priority] < lane_limit;
+}
+
+SlotListener RequestScheduler::slot_freed()
+{
+    slot_available.notify_all();
+    return slot_listener;
+}
+
+void RequestScheduler::acquire(RequestPriority priority)
+{
+    SlotListener listener;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (!can_start(priority, false)) {
+            ++waiting[priority];
+            do {
+                slot_available.wait(lock);
+            } while (!can_start(priority, true));
+            --waiting[priority];
+            // lower lanes and the next waiter in the lane may start
+            listener = slot_freed();
+        }
+        ++in_flight[priority];
+        ++total_in_flight;
+        ++dispatched[priority];
+    }
+    if (listener) {
+        listener();
+    }
+}
+
+bool RequestScheduler::try_acquire(RequestPriority priority,
+        bool& is_waiting)
+{
+    SlotListener listener;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        bool allowed = can_start(priority, is_waiting);
+        if (!allowed) {
+            if (!is_waiting) {
+                ++waiting[priority];
+                is_waiting = true;
+            }
+            return false;
+        }
+        if (is_waiting) {
+            --waiting[priority];
+            is_waiting = false;
+            // lower lanes and the next waiter in the lane may start
+            listener = slot_freed();
+        }
+        ++in_flight[priority];
+        ++total_in_flight;
+        ++dispatched[priority];
+    }
+    if (listener) {
+        listener();
+    }
+    return true;
+}
+
+void RequestScheduler::abandon(RequestPriority priority, bool& is_waiting)
+{
+    SlotListener listener;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (!is_waiting) {
+            return;
+        }
+        --waiting[priority];
+        is_waiting = false;
+        listener = slot_freed();
+    }
+    if (listener) {
+        listener();
+    }
+}
+
+void RequestScheduler::release(RequestPriority priority)
+{
+    SlotListener listener;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        --in_flight[priority];
+        --total_in_flight;
+        listener = slot_freed();
+    }
+    if (listener) {
+        listener();
+    }
+}
+
+void RequestScheduler::set_slot_listener(SlotListener listener)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    slot_listener = listener;
+}
+
+int RequestScheduler::get_in_flight(RequestPriority priority)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return in_flight[priority];
+}
+
+int RequestScheduler::get_waiting(RequestPriority priority)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return waiting[priority];
+}
+
+uint64 RequestScheduler::get_num_dispatched(RequestPriority priority)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return dispatched[priority];
+}
+
+const char* RequestScheduler::get_priority_name(RequestPriority priority)
+{
+    return PriorityNames[priority];
+}
+
+}
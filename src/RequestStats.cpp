@@ -0,0 +1,260 @@
+#include "RequestStats.h"
+
+#include <json/json.h>
+
+extern "C" {
+#include <curl/curl.h>
+}
+
+using std::string;
+
+namespace libdvid {
+
+//! Names of the endpoint families (in EndpointFamily order)
+static const char* FamilyNames[NUM_ENDPOINT_FAMILIES] = {
+    "blocks", "raw", "tile", "sparsevol-coarse", "graph", "keyvalue",
+    "other" };
+
+//! Names of the timing phases (in TimingPhase order)
+static const char* PhaseNames[NUM_TIMING_PHASES] = {
+    "namelookup", "connect", "pretransfer", "starttransfer", "total" };
+
+//! Percentiles reported when dumping a histogram
+static const double Percentiles[] = { 0.5, 0.9, 0.99 };
+static const char* PercentileNames[] = { "p50", "p90", "p99" };
+
+RequestTiming get_request_timing(void* curl_handle)
+{
+    static const CURLINFO phase_info[NUM_TIMING_PHASES] = {
+        CURLINFO_NAMELOOKUP_TIME, CURLINFO_CONNECT_TIME,
+        CURLINFO_PRETRANSFER_TIME, CURLINFO_STARTTRANSFER_TIME,
+        CURLINFO_TOTAL_TIME };
+
+    RequestTiming timing;
+    for (int i = 0; i < NUM_TIMING_PHASES; ++i) {
+        double seconds = 0;
+        curl_easy_getinfo(curl_handle, phase_info[i], &seconds);
+        timing.times[i] = seconds;
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x073700
+    // integer sizes were added in curl 7.55.0
+    curl_off_t bytes = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_UPLOAD_T, &bytes);
+    timing.bytes_sent = uint64(bytes);
+    bytes = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    timing.bytes_received = uint64(bytes);
+#else
+    double bytes = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_UPLOAD, &bytes);
+    timing.bytes_sent = uint64(bytes);
+    bytes = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD, &bytes);
+    timing.bytes_received = uint64(bytes);
+#endif
+    return timing;
+}
+
+LogHistogram::LogHistogram() : count(0), sum(0), max_value(0)
+{
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        buckets[i].store(0, boost::memory_order_relaxed);
+    }
+}
+
+void LogHistogram::record(uint64 value)
+{
+    // bucket is the number of significant bits
+    int bucket = 0;
+    for (uint64 remaining = value; remaining; remaining >>= 1) {
+        ++bucket;
+    }
+
+    buckets[bucket].fetch_add(1, boost::memory_order_relaxed);
+    count.fetch_add(1, boost::memory_order_relaxed);
+    sum.fetch_add(value, boost::memory_order_relaxed);
+
+    uint64 current = max_value.load(boost::memory_order_relaxed);
+    while ((value > current) && !max_value.compare_exchange_weak(current,
+                value, boost::memory_order_relaxed)) {
+    }
+}
+
+double LogHistogram::get_mean() const
+{
+    uint64 num = get_count();
+    if (!num) {
+        return 0;
+    }
+    return double(get_sum()) / num;
+}
+
+uint64 LogHistogram::get_percentile(double fraction) const
+{
+    uint64 num = get_count();
+    if (!num) {
+        return 0;
+    }
+
+    uint64 target = uint64(fraction * num);
+    if (target >= num) {
+        target = num - 1;
+    }
+
+    uint64 seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        seen += get_bucket(i);
+        if (seen > target) {
+            if (i == 0) {
+                return 0;
+            }
+            uint64 upper = (i == 64) ? ~uint64(0) : ((uint64(1) << i) - 1);
+            // the largest value is a tighter bound for the last bucket
+            return (upper < get_max()) ? upper : get_max();
+        }
+    }
+    return get_max();
+}
+
+void LogHistogram::reset()
+{
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        buckets[i].store(0, boost::memory_order_relaxed);
+    }
+    count.store(0, boost::memory_order_relaxed);
+    sum.store(0, boost::memory_order_relaxed);
+    max_value.store(0, boost::memory_order_relaxed);
+}
+
+Json::Value LogHistogram::to_json() const
+{
+    Json::Value data(Json::objectValue);
+    data["count"] = Json::UInt64(get_count());
+    data["mean"] = get_mean();
+    data["max"] = Json::UInt64(get_max());
+    for (unsigned int i = 0; i < sizeof(Percentiles) / sizeof(double); ++i) {
+        data[PercentileNames[i]] = Json::UInt64(get_percentile(Percentiles[i]));
+    }
+    return data;
+}
+
+EndpointFamily RequestStats::classify_endpoint(const string& endpoint)
+{
+    // find the action in .../node/<uuid>/<instance>/<action>/...
+    size_t start = endpoint.find("/node/");
+    if (start == string::npos) {
+        return OTHER_ENDPOINT;
+    }
+    start += 6;
+    for (int skip = 0; skip < 2; ++skip) {
+        start = endpoint.find('/', start);
+        if (start == string::npos) {
+            return OTHER_ENDPOINT;
+        }
+        ++start;
+    }
+    size_t end = endpoint.find_first_of("/?", start);
+    string action = endpoint.substr(start,
+            (end == string::npos) ? string::npos : end - start);
+
+    if (action == "blocks" || action == "specificblocks") {
+        return BLOCKS_ENDPOINT;
+    }
+    if (action == "raw" || action == "isotropic") {
+        return RAW_ENDPOINT;
+    }
+    if (action == "tile") {
+        return TILE_ENDPOINT;
+    }
+    if (action == "sparsevol-coarse") {
+        return SPARSEVOL_COARSE_ENDPOINT;
+    }
+    if (action == "subgraph" || action == "neighbors" ||
+            action == "weight" || action == "propertytransaction" ||
+            action == "undirectededges") {
+        return GRAPH_ENDPOINT;
+    }
+    if (action == "key" || action == "keys" || action == "keyrange") {
+        return KEYVALUE_ENDPOINT;
+    }
+    return OTHER_ENDPOINT;
+}
+
+const char* RequestStats::get_family_name(EndpointFamily family)
+{
+    return FamilyNames[family];
+}
+
+const char* RequestStats::get_phase_name(TimingPhase phase)
+{
+    return PhaseNames[phase];
+}
+
+void RequestStats::record(EndpointFamily family, const RequestTiming& timing,
+        bool failed)
+{
+    FamilyStats& stats = families[family];
+    stats.requests.fetch_add(1, boost::memory_order_relaxed);
+    if (failed) {
+        stats.failures.fetch_add(1, boost::memory_order_relaxed);
+    }
+    stats.bytes_sent.fetch_add(timing.bytes_sent,
+            boost::memory_order_relaxed);
+    stats.bytes_received.fetch_add(timing.bytes_received,
+            boost::memory_order_relaxed);
+
+    // times are stored in microseconds
+    for (int i = 0; i < NUM_TIMING_PHASES; ++i) {
+        double micros = timing.times[i] * 1000000.0;
+        stats.phases[i].record((micros > 0) ? uint64(micros + 0.5) : 0);
+    }
+}
+
+void RequestStats::reset()
+{
+    for (int family = 0; family < NUM_ENDPOINT_FAMILIES; ++family) {
+        FamilyStats& stats = families[family];
+        stats.requests.store(0, boost::memory_order_relaxed);
+        stats.failures.store(0, boost::memory_order_relaxed);
+        stats.bytes_sent.store(0, boost::memory_order_relaxed);
+        stats.bytes_received.store(0, boost::memory_order_relaxed);
+        for (int i = 0; i < NUM_TIMING_PHASES; ++i) {
+            stats.phases[i].reset();
+        }
+    }
+}
+
+Json::Value RequestStats::to_json() const
+{
+    Json::Value data(Json::objectValue);
+    for (int family = 0; family < NUM_ENDPOINT_FAMILIES; ++family) {
+        EndpointFamily efamily = EndpointFamily(family);
+        if (!get_num_requests(efamily)) {
+            continue;
+        }
+
+        Json::Value family_data(Json::objectValue);
+        family_data["requests"] = Json::UInt64(get_num_requests(efamily));
+        family_data["failures"] = Json::UInt64(get_num_failures(efamily));
+        family_data["bytes_sent"] = Json::UInt64(get_bytes_sent(efamily));
+        family_data["bytes_received"] =
+            Json::UInt64(get_bytes_received(efamily));
+
+        Json::Value times(Json::objectValue);
+        for (int i = 0; i < NUM_TIMING_PHASES; ++i) {
+            times[PhaseNames[i]] = families[family].phases[i].to_json();
+        }
+        family_data["microseconds"] = times;
+        data[FamilyNames[family]] = family_data;
+    }
+    return data;
+}
+
+string RequestStats::dump_json() const
+{
+    Json::StyledWriter writer;
+    return writer.write(to_json());
+}
+
+}
@@ -0,0 +1,118 @@
+#include "ResponseBuffer.h"
+#include "DVIDException.h"
+
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+namespace libdvid {
+
+const size_t ResponseBuffer::CHUNK_SIZE;
+
+ResponseBuffer::ResponseBuffer(BinaryDataPtr results_) : results(results_),
+    external(0), capacity(0),
+    expected_length(-1), bytes_received(0), bytes_copied(0)
+{
+}
+
+ResponseBuffer::ResponseBuffer(char* external_, size_t capacity_) :
+    external(external_), capacity(capacity_),
+    expected_length(-1), bytes_received(0), bytes_copied(0)
+{
+}
+
+void ResponseBuffer::begin(int status, long long content_length)
+{
+    expected_length = content_length;
+    if (content_length < 0) {
+        return;
+    }
+
+    // caller-owned memory cannot grow so fail early
+    if (external) {
+        if (size_t(content_length) > capacity) {
+            throw ErrMsg("Response does not fit in the buffer");
+        }
+        return;
+    }
+
+    // only reserve before any data has arrived
+    string& data = results->get_data();
+    if (data.empty() && (size_t(content_length) < data.max_size())) {
+        data.reserve(size_t(content_length));
+    }
+}
+
+void ResponseBuffer::write(const char* data, size_t length)
+{
+    if (external) {
+        if ((bytes_received + length) > capacity) {
+            throw ErrMsg("Response does not fit in the buffer");
+        }
+        memcpy(external + bytes_received, data, length);
+        bytes_received += length;
+        bytes_copied += length;
+        return;
+    }
+
+    bytes_received += length;
+    string& dest = results->get_data();
+
+    // write in place when the destination was sized from the header
+    if (chunks.empty() && (expected_length >= 0)) {
+        if ((dest.size() + length) > dest.capacity()) {
+            // server sent more than advertised; string will reallocate
+            bytes_copied += dest.size();
+        }
+        dest.append(data, length);
+        bytes_copied += length;
+        return;
+    }
+
+    // otherwise fill fixed-size chunks so nothing is moved twice
+    while (length > 0) {
+        if (chunks.empty() || (chunks.back().size() == CHUNK_SIZE)) {
+            chunks.push_back(string());
+            chunks.back().reserve(CHUNK_SIZE);
+        }
+        string& chunk = chunks.back();
+        size_t amount = CHUNK_SIZE - chunk.size();
+        if (amount > length) {
+            amount = length;
+        }
+        chunk.append(data, amount);
+        bytes_copied += amount;
+        data += amount;
+        length -= amount;
+    }
+}
+
+void ResponseBuffer::finish()
+{
+    if (external || chunks.empty()) {
+        return;
+    }
+
+    string& dest = results->get_data();
+    if ((chunks.size() == 1) && dest.empty()) {
+        // a single chunk can be handed over without copying
+        dest.swap(chunks[0]);
+    } else {
+        size_t total = dest.size();
+        for (unsigned int i = 0; i < chunks.size(); ++i) {
+            total += chunks[i].size();
+        }
+        if (total > dest.capacity()) {
+            bytes_copied += dest.size();
+        }
+        dest.reserve(total);
+        for (unsigned int i = 0; i < chunks.size(); ++i) {
+            dest.append(chunks[i]);
+            bytes_copied += chunks[i].size();
+        }
+    }
+    chunks.clear();
+}
+
+}
@@ -0,0 +1,167 @@
+#include "ResponseSink.h"
+#include "DVIDException.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+using std::string;
+
+namespace libdvid {
+
+void OStreamSink::write(const char* data, size_t length)
+{
+    stream.write(data, length);
+    if (!stream) {
+        throw ErrMsg("Could not write response to stream");
+    }
+}
+
+void OStreamSink::finish()
+{
+    stream.flush();
+}
+
+void SparseVolSpanSink::write(const char* data, size_t length)
+{
+    // header: 8 bytes that are ignored followed by the span count
+    while ((header_remaining > 0) && (length > 0)) {
+        header[12 - header_remaining] = *data;
+        --header_remaining;
+        ++data;
+        --length;
+        if (header_remaining == 0) {
+            // assume little endian machine for now
+            memcpy(&num_spans, header + 8, 4);
+        }
+    }
+
+    const size_t span_size = 16;
+
+    // complete a span that straddled the previous write
+    if (!partial.empty()) {
+        size_t amount = span_size - partial.size();
+        if (amount > length) {
+            amount = length;
+        }
+        partial.append(data, amount);
+        data += amount;
+        length -= amount;
+        if (partial.size() < span_size) {
+            return;
+        }
+        int span[4];
+        memcpy(span, partial.data(), span_size);
+        partial.clear();
+        ++spans_decoded;
+        callback(span[0], span[1], span[2], span[3]);
+    }
+
+    // decode whole spans in place
+    while (length >= span_size) {
+        int span[4];
+        memcpy(span, data, span_size);
+        data += span_size;
+        length -= span_size;
+        ++spans_decoded;
+        callback(span[0], span[1], span[2], span[3]);
+    }
+
+    if (length > 0) {
+        partial.assign(data, length);
+    }
+}
+
+void SparseVolSpanSink::finish()
+{
+    if ((header_remaining > 0) || !partial.empty() ||
+            (spans_decoded != num_spans)) {
+        throw ErrMsg("Sparse volume encoding is truncated");
+    }
+}
+
+size_t ResponseSinkAdapter::write_callback(void* contents, size_t size,
+        size_t nmemb, void* userp)
+{
+    size_t realsize = size * nmemb;
+    ResponseSinkAdapter* adapter = (ResponseSinkAdapter*) userp;
+    if (!adapter->error.empty()) {
+        return 0;
+    }
+
+    try {
+        adapter->start();
+        if (adapter->diverting()) {
+            adapter->error_body.append((const char*) contents, realsize);
+        } else {
+            adapter->sink.write((const char*) contents, realsize);
+        }
+    } catch (std::exception& e) {
+        adapter->error = e.what();
+    } catch (...) {
+        adapter->error = "Unknown error in response sink";
+    }
+
+    // returning a short count aborts the transfer
+    return adapter->error.empty() ? realsize : 0;
+}
+
+size_t ResponseSinkAdapter::header_callback(char* line, size_t size,
+        size_t nmemb, void* userp)
+{
+    size_t realsize = size * nmemb;
+    ResponseSinkAdapter* adapter = (ResponseSinkAdapter*) userp;
+
+    // header lines are not null terminated
+    string header(line, realsize);
+
+    // a new status line starts a new set of headers (e.g., after
+    // 100 Continue) so forget any earlier length
+    if (header.compare(0, 5, "HTTP/") == 0) {
+        size_t space = header.find(' ');
+        adapter->status = (space == string::npos) ? 0 :
+            atoi(header.c_str() + space + 1);
+        adapter->content_length = -1;
+        return realsize;
+    }
+
+    static const char* field = "Content-Length:";
+    size_t field_len = strlen(field);
+    if ((realsize > field_len) && !strncasecmp(line, field, field_len)) {
+        char* end = 0;
+        long long length = strtoll(header.c_str() + field_len, &end, 10);
+        if ((end != header.c_str() + field_len) && (length >= 0)) {
+            adapter->content_length = length;
+        }
+    }
+    return realsize;
+}
+
+void ResponseSinkAdapter::start()
+{
+    if (!started) {
+        started = true;
+        if (!diverting()) {
+            sink.begin(status, content_length);
+        }
+    }
+}
+
+void ResponseSinkAdapter::complete()
+{
+    if (!error.empty()) {
+        return;
+    }
+    try {
+        start();
+        if (!diverting()) {
+            sink.finish();
+        }
+    } catch (std::exception& e) {
+        error = e.what();
+    } catch (...) {
+        error = "Unknown error in response sink";
+    }
+}
+
+}
@@ -0,0 +1,104 @@
+#include "RetryPolicy.h"
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cmath>
+#include <cerrno>
+#include <time.h>
+
+//! Monotonic time in seconds
+static double monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+namespace libdvid {
+
+//! Random source for jitter (shared by all policies)
+static boost::mt19937 jitter_generator(unsigned(time(0)));
+static boost::mutex jitter_mutex;
+
+RetryPolicy::RetryPolicy() : initial_delay(0.05), max_delay(2.0),
+    multiplier(2.0), jitter(0.5), max_attempts(0), deadline(600),
+    retry_transient_errors(true), max_transient_retries(3)
+{
+    retryable_statuses.insert(503);
+}
+
+RetryPolicy RetryPolicy::no_retry()
+{
+    RetryPolicy policy;
+    policy.set_max_attempts(1);
+    policy.clear_retryable_statuses();
+    policy.set_retry_transient_errors(false);
+    return policy;
+}
+
+double RetryPolicy::get_delay(int retry) const
+{
+    double delay = initial_delay * std::pow(multiplier, double(retry));
+    if (delay > max_delay) {
+        delay = max_delay;
+    }
+
+    if (jitter > 0) {
+        boost::uniform_real<double> fraction(1.0 - jitter, 1.0);
+        boost::mutex::scoped_lock lock(jitter_mutex);
+        delay *= fraction(jitter_generator);
+    }
+    return delay;
+}
+
+RetryState::RetryState(const RetryPolicy& policy_) : policy(policy_),
+    attempts(1), transient_retries(0), start_time(monotonic_seconds())
+{
+}
+
+bool RetryState::next(double& delay)
+{
+    if ((policy.get_max_attempts() > 0) &&
+            (attempts >= policy.get_max_attempts())) {
+        return false;
+    }
+
+    delay = policy.get_delay(attempts - 1);
+    if (policy.get_deadline() > 0) {
+        double elapsed = monotonic_seconds() - start_time;
+        if ((elapsed + delay) > policy.get_deadline()) {
+            return false;
+        }
+    }
+
+    ++attempts;
+    return true;
+}
+
+bool RetryState::next_transient(double& delay)
+{
+    if (!policy.get_retry_transient_errors() ||
+            (transient_retries >= policy.get_max_transient_retries())) {
+        return false;
+    }
+    if (!next(delay)) {
+        return false;
+    }
+    ++transient_retries;
+    return true;
+}
+
+void retry_sleep(double seconds)
+{
+    if (seconds <= 0) {
+        return;
+    }
+    struct timespec ts;
+    ts.tv_sec = time_t(seconds);
+    ts.tv_nsec = long((seconds - ts.tv_sec) * 1000000000.0);
+    while ((nanosleep(&ts, &ts) != 0) && (errno == EINTR)) {
+    }
+}
+
+}
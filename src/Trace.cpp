@@ -0,0 +1,184 @@
+#include "Trace.h"
+#include "DVIDException.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::ostringstream;
+
+namespace libdvid {
+
+//! A completed operation
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    double start;
+    double duration;
+    int thread;
+    string detail;
+};
+
+/*!
+ * Recorded events.  If LIBDVID_TRACE is set, tracing is enabled when
+ * the library is loaded and the trace is written to that file when
+ * the program exits.
+*/
+struct TraceLog {
+    TraceLog() : next_thread(1)
+    {
+        const char* filename = getenv("LIBDVID_TRACE");
+        if (filename && *filename) {
+            output = filename;
+            Trace::enable();
+        }
+    }
+
+    ~TraceLog()
+    {
+        if (!output.empty()) {
+            Trace::disable();
+            try {
+                Trace::write(output);
+            } catch (...) {
+            }
+        }
+    }
+
+    vector<TraceEvent> events;
+    int next_thread;
+    string output;
+    boost::mutex mutex;
+};
+
+boost::atomic<bool> Trace::enabled(false);
+
+const size_t Trace::MAX_EVENTS;
+
+//! small id for each thread that records an event
+static boost::thread_specific_ptr<int> trace_thread_id;
+
+//! defined last so tracing stops before the thread ids are destroyed
+static TraceLog trace_log;
+
+//! Escape a string for a JSON string literal
+static string escape_json(const string& str)
+{
+    string escaped;
+    for (unsigned int i = 0; i < str.size(); ++i) {
+        char c = str[i];
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char)(c) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", int(c));
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void Trace::enable()
+{
+    enabled.store(true);
+}
+
+void Trace::disable()
+{
+    enabled.store(false);
+}
+
+void Trace::clear()
+{
+    boost::mutex::scoped_lock lock(trace_log.mutex);
+    trace_log.events.clear();
+}
+
+size_t Trace::num_events()
+{
+    boost::mutex::scoped_lock lock(trace_log.mutex);
+    return trace_log.events.size();
+}
+
+double Trace::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+void Trace::record(const char* name, const char* category,
+        double start_us, double end_us, const string& detail)
+{
+    int* thread = trace_thread_id.get();
+
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.start = start_us;
+    event.duration = end_us - start_us;
+    event.detail = detail;
+
+    boost::mutex::scoped_lock lock(trace_log.mutex);
+    if (!thread) {
+        thread = new int(trace_log.next_thread++);
+        trace_thread_id.reset(thread);
+    }
+    event.thread = *thread;
+    if (trace_log.events.size() < MAX_EVENTS) {
+        trace_log.events.push_back(event);
+    }
+}
+
+string Trace::to_json()
+{
+    ostringstream stream;
+    stream.precision(3);
+    stream << std::fixed;
+    int pid = int(getpid());
+
+    boost::mutex::scoped_lock lock(trace_log.mutex);
+    stream << "{\"traceEvents\":[";
+    for (unsigned int i = 0; i < trace_log.events.size(); ++i) {
+        const TraceEvent& event = trace_log.events[i];
+        if (i > 0) {
+            stream << ",";
+        }
+        stream << "\n{\"name\":\"" << event.name << "\",\"cat\":\"" <<
+            event.category << "\",\"ph\":\"X\",\"ts\":" << event.start <<
+            ",\"dur\":" << event.duration << ",\"pid\":" << pid <<
+            ",\"tid\":" << event.thread;
+        if (!event.detail.empty()) {
+            stream << ",\"args\":{\"detail\":\"" <<
+                escape_json(event.detail) << "\"}";
+        }
+        stream << "}";
+    }
+    stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return stream.str();
+}
+
+void Trace::write(const string& filename)
+{
+    std::ofstream fout(filename.c_str());
+    if (!fout) {
+        throw ErrMsg("Could not open trace file " + filename);
+    }
+    fout << to_json();
+    if (!fout) {
+        throw ErrMsg("Could not write trace file " + filename);
+    }
+}
+
+}
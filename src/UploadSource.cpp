@@ -0,0 +1,80 @@
+#include "UploadSource.h"
+#include "DVIDException.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+using std::istream;
+using std::string;
+
+namespace libdvid {
+
+IStreamUploadSource::IStreamUploadSource(istream& stream_) : stream(stream_),
+    total_size(-1)
+{
+    start = stream.tellg();
+    if (start != std::streampos(-1)) {
+        stream.seekg(0, std::ios::end);
+        std::streampos end = stream.tellg();
+        stream.seekg(start);
+        if (end != std::streampos(-1)) {
+            total_size = (long long)(end - start);
+        }
+    }
+    stream.clear();
+}
+
+size_t IStreamUploadSource::read(char* buffer, size_t length)
+{
+    stream.read(buffer, length);
+    return size_t(stream.gcount());
+}
+
+bool IStreamUploadSource::rewind()
+{
+    if (start == std::streampos(-1)) {
+        return false;
+    }
+    stream.clear();
+    stream.seekg(start);
+    return !stream.fail();
+}
+
+FileDescriptorUploadSource::FileDescriptorUploadSource(int fd_) : fd(fd_),
+    start(-1), total_size(-1)
+{
+    struct stat info;
+    if ((fstat(fd, &info) == 0) && S_ISREG(info.st_mode)) {
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        if (offset >= 0) {
+            start = offset;
+            total_size = (long long)(info.st_size) - start;
+        }
+    }
+}
+
+size_t FileDescriptorUploadSource::read(char* buffer, size_t length)
+{
+    while (true) {
+        ssize_t amount = ::read(fd, buffer, length);
+        if (amount >= 0) {
+            return size_t(amount);
+        }
+        if (errno != EINTR) {
+            throw ErrMsg("Upload read failed: " + string(strerror(errno)));
+        }
+    }
+}
+
+bool FileDescriptorUploadSource::rewind()
+{
+    if (start < 0) {
+        return false;
+    }
+    return lseek(fd, off_t(start), SEEK_SET) == off_t(start);
+}
+
+}
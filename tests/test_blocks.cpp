@@ -147,7 +147,29 @@ int main(int argc, char** argv)
         if (!buffers_equal(gray_blocks[1], gray_blocks_comp[1], 
                     BLK_SIZE*BLK_SIZE*BLK_SIZE)) {
             throw ErrMsg("Retrieved incorrect grayscale block data");
-        }  
+        }
+
+        // a block view references the response without copying
+        BinaryDataPtr block_view = gray_blocks_comp.get_block(1);
+        if (!block_view->is_view() ||
+                (block_view->length() != uint64(BLK_SIZE)*BLK_SIZE*BLK_SIZE) ||
+                (block_view->get_raw() != gray_blocks_comp[1])) {
+            throw ErrMsg("Block view does not reference the block");
+        }
+        if (!buffers_equal(gray_blocks[1], block_view->get_raw(),
+                    BLK_SIZE*BLK_SIZE*BLK_SIZE)) {
+            throw ErrMsg("Retrieved incorrect grayscale block view");
+        }
+
+        // appending blocks leaves existing views intact
+        gray_blocks_comp.push_back(gray_blocks[0]);
+        if ((gray_blocks_comp.get_num_blocks() != 6) ||
+                !buffers_equal(gray_blocks[1], block_view->get_raw(),
+                    BLK_SIZE*BLK_SIZE*BLK_SIZE) ||
+                !buffers_equal(gray_blocks[0], gray_blocks_comp[5],
+                    BLK_SIZE*BLK_SIZE*BLK_SIZE)) {
+            throw ErrMsg("Appending blocks invalidated a block view");
+        }
         /*if (!buffers_equal(label_blocks[0], label_blocks_comp[0], 
                     BLK_SIZE*BLK_SIZE*BLK_SIZE)) {
             throw ErrMsg("Retrieved incorrect label block data");
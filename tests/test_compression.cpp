@@ -8,12 +8,20 @@
 */
 
 #include <libdvid/BinaryData.h>
+#include <libdvid/Codec.h>
+#include <libdvid/LabelBlockCodec.h>
 #include <libdvid/DVIDVoxels.h>
+#include <libdvid/DVIDThreadedFetch.h>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
 
 using std::cerr; using std::cout; using std::endl;
-using std::ifstream;
+using std::ifstream; using std::vector; using std::string;
 using namespace libdvid;
 
 /*!
@@ -45,6 +53,59 @@ bool is_equal(Grayscale2D gray1, Grayscale2D gray2)
     return true;
 } 
 
+/*!
+ * Check read-only and copy-on-write mappings of a file against the
+ * file contents, and the mapping of an empty file.
+ * \param filename non-empty file
+*/
+void test_mapped(const char* filename)
+{
+    ifstream fin(filename);
+    string contents = BinaryData::create_binary_data(fin)->get_data();
+    fin.close();
+
+    BinaryDataPtr mapped = BinaryData::create_binary_data_mapped(filename);
+    if (!mapped->is_view() || (mapped->length() != contents.size()) ||
+            (string((const char*) mapped->get_raw(), mapped->length()) !=
+             contents)) {
+        throw ErrMsg("Read-only mapping does not match the file");
+    }
+    // modifying a read-only mapping copies it first
+    if ((mapped->get_data() != contents) || mapped->is_view()) {
+        throw ErrMsg("Read-only mapping was not detached by get_data");
+    }
+
+    BinaryDataPtr writable = BinaryData::create_binary_data_mapped(
+            filename, BinaryData::MAP_COPY_ON_WRITE);
+    byte* raw = writable->get_writable_raw();
+    if (!writable->is_view() || (raw != writable->get_raw())) {
+        throw ErrMsg("Copy-on-write mapping is not modified in place");
+    }
+    raw[0] = ~raw[0];
+    if ((writable->get_raw()[0] == byte(contents[0])) ||
+            (memcmp(raw + 1, contents.data() + 1, contents.size() - 1) != 0)) {
+        throw ErrMsg("Copy-on-write mapping was not modified");
+    }
+    writable.reset();
+    ifstream fin2(filename);
+    if (BinaryData::create_binary_data(fin2)->get_data() != contents) {
+        throw ErrMsg("Copy-on-write mapping changed the file");
+    }
+    fin2.close();
+
+    char empty_name[] = "/tmp/libdvid_emptyXXXXXX";
+    int fd = mkstemp(empty_name);
+    if (fd < 0) {
+        throw ErrMsg("Could not create an empty file");
+    }
+    close(fd);
+    BinaryDataPtr empty = BinaryData::create_binary_data_mapped(empty_name);
+    unlink(empty_name);
+    if (empty->length() != 0) {
+        throw ErrMsg("Empty file was not mapped as empty data");
+    }
+}
+
 /*!
  * Loads the same image in different formats, decompresses them, and
  * verifies their equivalence.  The input files are assumed to represent
@@ -85,6 +146,30 @@ int main(int argc, char** argv)
         if (!is_equal(grayjpeg, graypng)) {
             throw ErrMsg("JPEG and PNG file are not equivalent");
         }
+
+        // formats are recognized from their magic bytes
+        if ((BinaryData::get_image_format(jpgbinary) != JPEG_IMAGE) ||
+                (BinaryData::get_image_format(pngbinary) != PNG_IMAGE)) {
+            throw ErrMsg("Image format not recognized");
+        }
+
+        // batch decode a mix of tiles into one buffer
+        vector<BinaryDataPtr> tiles;
+        for (int i = 0; i < 4; ++i) {
+            tiles.push_back(jpgbinary);
+            tiles.push_back(pngbinary);
+        }
+        unsigned int tile_bytes = width * height;
+        vector<byte> tile_buffer(tiles.size() * tile_bytes);
+        decode_tile_array(tiles, width, height, &tile_buffer[0], 3);
+        for (unsigned int i = 0; i < tiles.size(); ++i) {
+            const byte* expected = (i % 2) ? graypng.get_raw() :
+                grayjpeg.get_raw();
+            if (!std::equal(expected, expected + tile_bytes,
+                        &tile_buffer[i * tile_bytes])) {
+                throw ErrMsg("Batch decoded tile is not equivalent");
+            }
+        }
         
          // read binary (assume dims)
         ifstream fin3(argv[3]);
@@ -105,6 +190,106 @@ int main(int argc, char** argv)
         if (!is_equal(graylz4, graypng)) {
             throw ErrMsg("Binary and lz4 file are not equivalent");
         }
+
+        // accelerated and high compression levels use the same format
+        int levels[] = {-8, 1, 9, 100};
+        for (int i = 0; i < 4; ++i) {
+            BinaryDataPtr lz4level =
+                BinaryData::compress_lz4(binary, levels[i]);
+            BinaryDataPtr binary_level =
+                BinaryData::decompress_lz4(lz4level, uncompressed_size);
+            if (binary_level->get_data() != binary->get_data()) {
+                throw ErrMsg("lz4 level does not round trip");
+            }
+        }
+
+        // every lossless codec round trips (label block codecs only
+        // take whole blocks)
+        CodecRegistry& registry = CodecRegistry::get_registry();
+        vector<string> codecs = registry.get_codec_names(
+                CODEC_ENCODE | CODEC_DECODE | CODEC_LOSSLESS);
+        for (unsigned int i = 0; i < codecs.size(); ++i) {
+            if (registry.get_codec(codecs[i])->has_capabilities(
+                        CODEC_LABEL_BLOCKS)) {
+                continue;
+            }
+            BinaryDataPtr encoded = BinaryData::encode(binary, codecs[i]);
+            BinaryDataPtr decoded = BinaryData::decode(encoded, codecs[i],
+                    uncompressed_size);
+            if (decoded->get_data() != binary->get_data()) {
+                throw ErrMsg("Codec " + codecs[i] + " does not round trip");
+            }
+        }
+
+        // truncated lz4 data or a wrong size must be rejected
+        BinaryDataPtr truncated = BinaryData::create_binary_data(
+                (const char*) lz4binary->get_raw(), lz4binary->length() / 2);
+        bool rejected = false;
+        try {
+            BinaryData::decompress_lz4(truncated, uncompressed_size);
+        } catch (ErrMsg&) {
+            rejected = true;
+        }
+        try {
+            BinaryData::decompress_lz4(lz4binary, uncompressed_size + 1);
+            rejected = false;
+        } catch (ErrMsg&) {
+        }
+        if (!rejected) {
+            throw ErrMsg("Corrupt lz4 data was not rejected");
+        }
+
+        // label blocks: solid, a few labels, and a sub-block with more
+        // than 256 labels (9-bit indices)
+        const int block_voxels = DEFBLOCKSIZE*DEFBLOCKSIZE*DEFBLOCKSIZE;
+        vector<uint64> labels(block_voxels * 3);
+        for (int z = 0; z < DEFBLOCKSIZE; ++z) {
+            for (int y = 0; y < DEFBLOCKSIZE; ++y) {
+                for (int x = 0; x < DEFBLOCKSIZE; ++x) {
+                    int voxel = (z * DEFBLOCKSIZE + y) * DEFBLOCKSIZE + x;
+                    labels[voxel] = 4000000000ULL;
+                    labels[block_voxels + voxel] =
+                        1000 + x / 5 + (y / 7) * 10 + (z / 11) * 100;
+                    labels[2 * block_voxels + voxel] =
+                        (x < 8 && y < 8 && z < 8) ? rand() % 400 : 7;
+                }
+            }
+        }
+        BinaryDataPtr label_binary = BinaryData::create_binary_data(
+                (const char*) &labels[0], labels.size() * sizeof(uint64));
+        BinaryDataPtr label_encoded = BinaryData::encode(label_binary,
+                "blocks");
+        if ((BinaryData::decode(label_encoded, "blocks")->get_data() !=
+                    label_binary->get_data()) ||
+                (BinaryData::decode(label_encoded, "blocks",
+                    label_binary->length())->get_data() !=
+                 label_binary->get_data())) {
+            throw ErrMsg("Label blocks do not round trip");
+        }
+
+        LabelBlockCodec label_codec;
+        string solid_block, few_block;
+        label_codec.encode_block(&labels[0], solid_block);
+        label_codec.encode_block(&labels[block_voxels], few_block);
+        if ((solid_block.size() != 24) ||
+                (few_block.size() * 10 > block_voxels * sizeof(uint64))) {
+            throw ErrMsg("Label blocks are not compressed");
+        }
+
+        rejected = false;
+        try {
+            BinaryData::decode(BinaryData::create_binary_data(
+                        label_encoded->get_data().data(),
+                        label_encoded->length() - 1), "blocks",
+                    label_binary->length());
+        } catch (ErrMsg&) {
+            rejected = true;
+        }
+        if (!rejected) {
+            throw ErrMsg("Truncated label blocks were not rejected");
+        }
+
+        test_mapped(argv[3]);
     } catch (std::exception& e) {
         cerr << e.what() << endl;
         return -1;
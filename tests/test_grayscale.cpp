@@ -108,6 +108,17 @@ int main(int argc, char** argv)
                 return -1;
             }
         }
+
+        // round trip through the gzip codec
+        dvid_node.set_codec(gray_datatype_name, "gzip");
+        dvid_node.put_gray3D(gray_datatype_name, graybin, start, true, true);
+        Grayscale3D graygzip = dvid_node.get_gray3D(gray_datatype_name,
+                sizes, start, true, true);
+        if (graygzip.get_binary()->get_data() !=
+                graybin.get_binary()->get_data()) {
+            cerr << "Read/write mismatch with gzip" << endl;
+            return -1;
+        }
         delete []img_gray;
     } catch (std::exception& e) {
         cerr << e.what() << endl;
@@ -53,6 +53,41 @@ int main(int argc, char** argv)
             cerr << "Key value not stored properly" << endl;
             return -1;
         }
+
+        // values that look encoded are returned as stored without a codec
+        string plain = string("LDVC") + char(3) + "zip" + string(12, 'x');
+        dvid_node.put(keyvalue_datatype_name, "spot2",
+                BinaryData::create_binary_data(plain.c_str(), plain.size()));
+        if (dvid_node.get(keyvalue_datatype_name, "spot2")->get_data() !=
+                plain) {
+            cerr << "Plain key value not returned as stored" << endl;
+            return -1;
+        }
+
+        // values put with a codec are decoded by get
+        dvid_node.set_codec(keyvalue_datatype_name, "gzip");
+        string value(10000, 'a');
+        dvid_node.put(keyvalue_datatype_name, "spot1",
+                BinaryData::create_binary_data(value.c_str(), value.size()));
+        BinaryDataPtr stored = dvid_node.get(keyvalue_datatype_name, "spot1");
+        if (stored->get_data() != value) {
+            cerr << "Encoded key value not stored properly" << endl;
+            return -1;
+        }
+        if (dvid_node.get(keyvalue_datatype_name, "spot2")->get_data() !=
+                plain) {
+            cerr << "Value naming an unregistered codec was altered" << endl;
+            return -1;
+        }
+
+        // empty values round trip with a codec that needs a size
+        dvid_node.set_codec(keyvalue_datatype_name, "lz4");
+        dvid_node.put(keyvalue_datatype_name, "spot3",
+                BinaryData::create_binary_data());
+        if (dvid_node.get(keyvalue_datatype_name, "spot3")->length() != 0) {
+            cerr << "Empty encoded key value not stored properly" << endl;
+            return -1;
+        }
     } catch (std::exception& e) {
         cerr << e.what() << endl;
         return -1;
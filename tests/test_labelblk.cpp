@@ -2,7 +2,10 @@
  * This file gives a simple example of creating
  * a labels64 instance (used for image segmentation).
  * It stores some data, retrieves the data, and
- * checks that the data is equal.
+ * checks that the data is equal.  Volumes compressed in
+ * parallel slabs and volumes larger than the request limit are
+ * also written and read, and label blocks are transferred
+ * compressed through a labelarray instance.
  *
  * \author Stephen Plaza (plazas@janelia.hhmi.org)
 */
@@ -10,6 +13,7 @@
 #include <libdvid/DVIDServerService.h>
 #include <libdvid/DVIDNodeService.h>
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
@@ -94,6 +98,127 @@ int main(int argc, char** argv)
             }
         }
         delete []img_labels;
+
+        // ** Write and read a volume posted as compressed slabs **
+
+        // slabs are about 16 MB so the volume must be larger
+        dvid_node.set_compression_threads(2);
+        Dims_t slabsizes; slabsizes.push_back(BLK_SIZE*2);
+        slabsizes.push_back(BLK_SIZE*2); slabsizes.push_back(BLK_SIZE*17);
+        vector<uint64> slab_labels(slabsizes[0]*slabsizes[1]*slabsizes[2]);
+        for (unsigned int i = 0; i < slab_labels.size(); ++i) {
+            slab_labels[i] = i / 100 + 7;
+        }
+        Labels3D slabbin(&slab_labels[0], slab_labels.size(), slabsizes);
+        dvid_node.put_labels3D(label_datatype_name, slabbin, start, false,
+                true);
+        dvid_node.set_compression_threads(1);
+        Labels3D slabcomp = dvid_node.get_labels3D(label_datatype_name,
+                slabsizes, start, false, true);
+        if (!std::equal(slab_labels.begin(), slab_labels.end(),
+                    slabcomp.get_raw())) {
+            cerr << "Slab read/write mismatch" << endl;
+            return -1;
+        }
+
+        // ** Write and read a volume split into several requests **
+
+        // limit requests to one block so the volume is split
+        dvid_node.set_max_request_bytes(BLK_SIZE*BLK_SIZE*BLK_SIZE*sizeof(uint64));
+        int VOL_SIZE = BLK_SIZE*2;
+        Dims_t vsizes(3, VOL_SIZE);
+        vector<uint64> vol_labels(VOL_SIZE*VOL_SIZE*VOL_SIZE);
+        for (unsigned int i = 0; i < vol_labels.size(); ++i) {
+            vol_labels[i] = i * 3 + 1;
+        }
+        vector<int> vstart(3, BLK_SIZE);
+        Labels3D volbin(&vol_labels[0], vol_labels.size(), vsizes);
+        dvid_node.put_labels3D(label_datatype_name, volbin, vstart);
+
+        // read back a subvolume that is not block aligned
+        int SUB_OFFSET = BLK_SIZE/2;
+        Dims_t subsizes(3, VOL_SIZE - SUB_OFFSET);
+        vector<int> substart(3, BLK_SIZE + SUB_OFFSET);
+        Labels3D subcomp = dvid_node.get_labels3D(label_datatype_name,
+                subsizes, substart, false, true);
+        const uint64* subdatacomp = subcomp.get_raw();
+        int SUB_SIZE = VOL_SIZE - SUB_OFFSET;
+        for (int z = 0; z < SUB_SIZE; ++z) {
+            for (int y = 0; y < SUB_SIZE; ++y) {
+                for (int x = 0; x < SUB_SIZE; ++x) {
+                    uint64 label = vol_labels[((z + SUB_OFFSET)*VOL_SIZE +
+                        y + SUB_OFFSET)*VOL_SIZE + x + SUB_OFFSET];
+                    if (subdatacomp[(z*SUB_SIZE + y)*SUB_SIZE + x] != label) {
+                        cerr << "Split read/write mismatch" << endl;
+                        return -1;
+                    }
+                }
+            }
+        }
+
+        // ** Write and read compressed label blocks **
+
+        // a label block codec is only accepted for labelarray
+        bool rejected = false;
+        try {
+            dvid_node.set_codec(label_datatype_name, "blocks");
+        } catch (ErrMsg&) {
+            rejected = true;
+        }
+        if (!rejected) {
+            cerr << "Label block codec accepted for labelblk" << endl;
+            return -1;
+        }
+
+        string array_datatype_name = "labelarray1";
+        dvid_node.create_labelarray(array_datatype_name);
+        dvid_node.set_codec(array_datatype_name, "blocks");
+        int BLOCK_VOXELS = BLK_SIZE*BLK_SIZE*BLK_SIZE;
+        vector<uint64> block_labels(BLOCK_VOXELS*3);
+        for (int i = 0; i < BLOCK_VOXELS*3; ++i) {
+            block_labels[i] = (i < BLOCK_VOXELS) ? 9 : (i / 1000 + 1);
+        }
+        LabelBlocks blocks(&block_labels[0], 3);
+        vector<int> block_start(3, 1);
+        dvid_node.put_labelblocks(array_datatype_name, blocks, block_start);
+
+        // the last block of the span was never written
+        LabelBlocks blockscomp = dvid_node.get_labelblocks(
+                array_datatype_name, block_start, 4);
+        BinaryDataPtr asynccomp = dvid_node.get_blocks_async(
+                array_datatype_name, block_start, 4).get();
+        vector<uint64> expected(block_labels);
+        expected.resize(BLOCK_VOXELS*4, 0);
+        if ((blockscomp.get_num_blocks() != 4) ||
+                !std::equal(expected.begin(), expected.end(),
+                    blockscomp.get_raw()) ||
+                (asynccomp->length() != expected.size()*sizeof(uint64)) ||
+                !std::equal(expected.begin(), expected.end(),
+                    (const uint64*) asynccomp->get_raw())) {
+            cerr << "Compressed label block mismatch" << endl;
+            return -1;
+        }
+
+        // the blocks are also readable as a volume
+        Dims_t arraysizes; arraysizes.push_back(BLK_SIZE*3);
+        arraysizes.push_back(BLK_SIZE); arraysizes.push_back(BLK_SIZE);
+        vector<int> arraystart(3, BLK_SIZE);
+        Labels3D arraycomp = dvid_node.get_labels3D(array_datatype_name,
+                arraysizes, arraystart, false, false);
+        const uint64* arraydatacomp = arraycomp.get_raw();
+        for (int z = 0; z < BLK_SIZE; ++z) {
+            for (int y = 0; y < BLK_SIZE; ++y) {
+                for (int x = 0; x < BLK_SIZE*3; ++x) {
+                    uint64 label = block_labels[(x / BLK_SIZE)*BLOCK_VOXELS +
+                        (z*BLK_SIZE + y)*BLK_SIZE + x % BLK_SIZE];
+                    if (arraydatacomp[(z*BLK_SIZE + y)*BLK_SIZE*3 + x] !=
+                            label) {
+                        cerr << "Label block volume mismatch" << endl;
+                        return -1;
+                    }
+                }
+            }
+        }
     } catch (std::exception& e) {
         cerr << e.what() << endl;
         return -1;
@@ -0,0 +1,258 @@
+/*!
+ * This file verifies the priority lanes of the request scheduler and
+ * that waiting requests (blocked callers and asynchronous requests on
+ * the request engine) are woken when a slot becomes free.  The
+ * asynchronous requests are sent to a mock server in this process.
+*/
+
+#include <libdvid/RequestScheduler.h>
+#include <libdvid/DVIDConnection.h>
+#include <libdvid/DVIDMockServer.h>
+#include <libdvid/DVIDException.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+#include <vector>
+
+using std::cerr; using std::cout; using std::endl;
+using std::vector;
+using namespace libdvid;
+
+//! Number of asynchronous requests (well above the capacity)
+static const int NumAsync = 400;
+
+/*!
+ * Wait up to a second for a lane to have the number of requests in flight.
+*/
+bool wait_for_in_flight(RequestScheduler& scheduler,
+        RequestPriority priority, int count)
+{
+    for (int i = 0; i < 100; ++i) {
+        if (scheduler.get_in_flight(priority) == count) {
+            return true;
+        }
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    return false;
+}
+
+/*!
+ * Counts the calls to the slot listener.
+*/
+struct CountCalls {
+    CountCalls(int& count_) : count(count_) {}
+    void operator()()
+    {
+        ++count;
+    }
+    int& count;
+};
+
+/*!
+ * Counts the completed asynchronous requests.
+*/
+struct CountResponses {
+    CountResponses(boost::mutex& mutex_, int& num_ok_, int& num_done_) :
+        mutex(mutex_), num_ok(num_ok_), num_done(num_done_) {}
+    void operator()(DVIDResponse& response)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (response.status == 200) {
+            ++num_ok;
+        }
+        ++num_done;
+    }
+    boost::mutex& mutex;
+    int& num_ok;
+    int& num_done;
+};
+
+/*!
+ * Check that each lane is limited to its share of the capacity and
+ * that newcomers queue behind waiting requests.
+*/
+void test_lane_shares()
+{
+    RequestScheduler scheduler(10);
+
+    // bulk requests get half of the connections by default
+    bool waiting = false;
+    for (int i = 0; i < 5; ++i) {
+        if (!scheduler.try_acquire(BULK_PRIORITY, waiting)) {
+            throw ErrMsg("Bulk lane refused a request within its share");
+        }
+    }
+    if (scheduler.try_acquire(BULK_PRIORITY, waiting) || !waiting ||
+            (scheduler.get_waiting(BULK_PRIORITY) != 1)) {
+        throw ErrMsg("Bulk lane exceeded its share");
+    }
+
+    // normal requests fill the rest, since 9 is the lane limit
+    bool normal_waiting = false;
+    for (int i = 0; i < 5; ++i) {
+        if (!scheduler.try_acquire(NORMAL_PRIORITY, normal_waiting)) {
+            throw ErrMsg("Normal lane refused a request below capacity");
+        }
+    }
+    if (scheduler.try_acquire(INTERACTIVE_PRIORITY, normal_waiting)) {
+        throw ErrMsg("Request started beyond the capacity");
+    }
+    scheduler.abandon(INTERACTIVE_PRIORITY, normal_waiting);
+
+    // a free slot goes to the waiting bulk request, not a newcomer
+    scheduler.release(NORMAL_PRIORITY);
+    bool newcomer = false;
+    if (scheduler.try_acquire(BULK_PRIORITY, newcomer)) {
+        throw ErrMsg("Newcomer started ahead of a waiting request");
+    }
+    scheduler.abandon(BULK_PRIORITY, newcomer);
+    // still at the bulk share
+    if (scheduler.try_acquire(BULK_PRIORITY, waiting)) {
+        throw ErrMsg("Bulk lane exceeded its share after a release");
+    }
+    scheduler.set_lane_share(BULK_PRIORITY, 0.6);
+    if (!scheduler.try_acquire(BULK_PRIORITY, waiting) || waiting) {
+        throw ErrMsg("Waiting request did not start after the share grew");
+    }
+    if ((scheduler.get_in_flight(BULK_PRIORITY) != 6) ||
+            (scheduler.get_num_dispatched(BULK_PRIORITY) != 6)) {
+        throw ErrMsg("Bulk lane counts are wrong");
+    }
+
+    // a lane always gets one request
+    RequestScheduler small(1);
+    small.set_lane_share(BULK_PRIORITY, 0.1);
+    if (!small.try_acquire(BULK_PRIORITY, waiting)) {
+        throw ErrMsg("Lane with a small share was starved");
+    }
+
+    bool rejected = false;
+    try {
+        scheduler.set_lane_share(NORMAL_PRIORITY, 0);
+    } catch (ErrMsg&) {
+        rejected = true;
+    }
+    if (!rejected || (scheduler.get_lane_share(NORMAL_PRIORITY) != 0.9)) {
+        throw ErrMsg("Empty lane share was accepted");
+    }
+}
+
+/*!
+ * Check that a blocked caller in a lower lane starts once a waiter in
+ * a higher lane is admitted through try_acquire, and that the slot
+ * listener is called when a slot is freed.
+*/
+void test_wakeup()
+{
+    RequestScheduler scheduler(3);
+    for (int i = 0; i < NUM_PRIORITIES; ++i) {
+        scheduler.set_lane_share(RequestPriority(i), 1.0);
+    }
+    int num_calls = 0;
+    scheduler.set_slot_listener(CountCalls(num_calls));
+
+    for (int i = 0; i < 3; ++i) {
+        scheduler.acquire(INTERACTIVE_PRIORITY);
+    }
+    bool waiting = false;
+    if (scheduler.try_acquire(NORMAL_PRIORITY, waiting)) {
+        throw ErrMsg("Request started beyond the capacity");
+    }
+
+    // the bulk caller waits behind the normal waiter
+    boost::thread bulk(boost::bind(&RequestScheduler::acquire, &scheduler,
+                BULK_PRIORITY));
+    for (int i = 0; (i < 100) && (scheduler.get_waiting(BULK_PRIORITY) == 0);
+            ++i) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    scheduler.release(INTERACTIVE_PRIORITY);
+    scheduler.release(INTERACTIVE_PRIORITY);
+    if (num_calls != 2) {
+        throw ErrMsg("Slot listener was not called on release");
+    }
+    if (wait_for_in_flight(scheduler, BULK_PRIORITY, 1)) {
+        throw ErrMsg("Bulk request started ahead of a normal waiter");
+    }
+
+    // admitting the normal waiter frees the bulk caller
+    if (!scheduler.try_acquire(NORMAL_PRIORITY, waiting)) {
+        throw ErrMsg("Waiting request did not start");
+    }
+    if (!wait_for_in_flight(scheduler, BULK_PRIORITY, 1)) {
+        throw ErrMsg("Blocked request was not woken");
+    }
+    bulk.join();
+    scheduler.set_slot_listener(SlotListener());
+}
+
+/*!
+ * Send many more asynchronous requests than the scheduler admits at
+ * once and check that they all finish quickly.
+*/
+void test_engine_wakeup()
+{
+    DVIDMockServer server;
+    server.start();
+
+    DVIDConnection connection(server.get_url());
+    DVIDConnectionPoolPtr pool = connection.get_pool();
+    pool->set_max_handles(2);
+    RequestSchedulerPtr scheduler = pool->get_scheduler();
+
+    boost::mutex mutex;
+    int num_ok = 0;
+    int num_done = 0;
+    boost::posix_time::ptime start =
+        boost::posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < NumAsync; ++i) {
+        connection.set_priority((i % 2) ? BULK_PRIORITY : NORMAL_PRIORITY);
+        connection.make_request_async("/server/info", GET, BinaryDataPtr(),
+                CountResponses(mutex, num_ok, num_done));
+    }
+
+    // each request takes far less than the old 2 ms poll
+    for (int i = 0; i < 1000; ++i) {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (num_done == NumAsync) {
+                break;
+            }
+        }
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    double seconds = (boost::posix_time::microsec_clock::universal_time() -
+            start).total_milliseconds() / 1000.0;
+    cout << NumAsync << " requests with 2 slots: " << seconds << " s" << endl;
+    if (num_ok != NumAsync) {
+        throw ErrMsg("Asynchronous requests did not all finish");
+    }
+    if ((scheduler->get_waiting(NORMAL_PRIORITY) != 0) ||
+            (scheduler->get_waiting(BULK_PRIORITY) != 0) ||
+            (scheduler->get_in_flight(NORMAL_PRIORITY) != 0) ||
+            (scheduler->get_in_flight(BULK_PRIORITY) != 0)) {
+        throw ErrMsg("Scheduler counts were not restored");
+    }
+    if (scheduler->get_num_dispatched(NORMAL_PRIORITY) +
+            scheduler->get_num_dispatched(BULK_PRIORITY) != uint64(NumAsync)) {
+        throw ErrMsg("Wrong number of requests dispatched");
+    }
+    server.stop();
+}
+
+/*!
+ * Test the scheduler lanes and wakeups.
+*/
+int main(int argc, char** argv)
+{
+    try {
+        test_lane_shares();
+        test_wakeup();
+        test_engine_wakeup();
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
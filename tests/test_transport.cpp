@@ -0,0 +1,385 @@
+/*!
+ * This file verifies the request layer of DVIDConnection (hedged
+ * reads, merged GETs, and flow control) against a mock server in this
+ * process that simulates slow and busy responses.
+*/
+
+#include <libdvid/DVIDConnection.h>
+#include <libdvid/DVIDRequestEngine.h>
+#include <libdvid/DVIDServerService.h>
+#include <libdvid/DVIDNodeService.h>
+#include <libdvid/DVIDMockServer.h>
+#include <libdvid/DVIDException.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+
+using std::cerr; using std::cout; using std::endl;
+using std::string;
+using namespace libdvid;
+
+//! Extra delay of a straggling response (seconds)
+static const double StragglerDelay = 1.0;
+
+//! Number of hedged reads
+static const int NumHedged = 40;
+
+//! Number of threads reading the same key at once
+static const int NumReaders = 8;
+
+//! Monotonic time in seconds
+double now_seconds()
+{
+    return (boost::posix_time::microsec_clock::universal_time() -
+            boost::posix_time::ptime(boost::gregorian::date(2000, 1, 1))).
+        total_microseconds() / 1000000.0;
+}
+
+/*!
+ * Read the server info.
+ * \return http status
+*/
+int read_info(DVIDConnection& connection)
+{
+    BinaryDataPtr results = BinaryData::create_binary_data();
+    string error_msg;
+    return connection.make_request("/server/info", GET, BinaryDataPtr(),
+            results, error_msg);
+}
+
+/*!
+ * Wait up to the given time for the engine to finish its requests.
+*/
+bool wait_for_engine(double seconds)
+{
+    for (int i = 0; i < int(seconds * 100); ++i) {
+        if (DVIDRequestEngine::get_engine().num_outstanding() == 0) {
+            return true;
+        }
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    return false;
+}
+
+/*!
+ * Issues a (hedged) synchronous read from an engine callback.
+*/
+struct ReadInCallback {
+    ReadInCallback(DVIDConnection& connection_, boost::mutex& mutex_,
+            int& status_) :
+        connection(connection_), mutex(mutex_), status(status_) {}
+    void operator()(DVIDResponse&)
+    {
+        int code = 0;
+        try {
+            code = read_info(connection);
+        } catch (std::exception&) {
+            code = -1;
+        }
+        boost::mutex::scoped_lock lock(mutex);
+        status = code;
+    }
+    DVIDConnection& connection;
+    boost::mutex& mutex;
+    int& status;
+};
+
+/*!
+ * Reads a key through a service that merges identical GETs.
+*/
+struct ReadKey {
+    ReadKey(DVIDNodeService& service_, BinaryDataPtr& value_) :
+        service(service_), value(value_) {}
+    void operator()()
+    {
+        try {
+            value = service.custom_request("/kv/key/shared",
+                    BinaryDataPtr(), GET);
+        } catch (std::exception&) {
+        }
+    }
+    DVIDNodeService& service;
+    BinaryDataPtr& value;
+};
+
+/*!
+ * Fetch for a coalescer that waits for another caller to join and then
+ * throws an exception that is not a std::exception.
+*/
+BinaryDataPtr throw_after_join(RequestCoalescer& coalescer)
+{
+    for (int i = 0; (i < 500) && (coalescer.get_num_shared() == 0); ++i) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    throw 42;
+}
+
+/*!
+ * Runs the failing fetch and records the exception received.
+*/
+struct RunFailingFetch {
+    RunFailingFetch(RequestCoalescer& coalescer_, bool& caught_int_,
+            bool& caught_errmsg_) : coalescer(coalescer_),
+        caught_int(caught_int_), caught_errmsg(caught_errmsg_) {}
+    void operator()()
+    {
+        try {
+            coalescer.run("key", boost::bind(&throw_after_join,
+                        boost::ref(coalescer)));
+        } catch (int) {
+            caught_int = true;
+        } catch (ErrMsg&) {
+            caught_errmsg = true;
+        }
+    }
+    RequestCoalescer& coalescer;
+    bool& caught_int;
+    bool& caught_errmsg;
+};
+
+/*!
+ * Fetch that returns an empty result.
+*/
+BinaryDataPtr fetch_empty()
+{
+    return BinaryData::create_binary_data();
+}
+
+/*!
+ * Check that concurrent identical GETs are sent once and that a fetch
+ * failing with an unknown exception fails its waiters and clears its key.
+*/
+void test_coalescing(DVIDMockServer& server)
+{
+    DVIDServerService dvid_server(server.get_url());
+    string uuid = dvid_server.create_new_repo("coalesce", "merged reads");
+    DVIDNodeService service(server.get_url(), uuid);
+    service.create_keyvalue("kv");
+    string data = "value shared by the readers";
+    service.put("kv", "shared", BinaryData::create_binary_data(data.c_str(),
+                data.size()));
+
+    // the latency keeps the first read in flight while the rest join it
+    service.set_coalescing(true);
+    RequestCoalescerPtr coalescer = service.get_request_coalescer();
+    uint64 num_fetches = coalescer->get_num_fetches();
+    uint64 num_shared = coalescer->get_num_shared();
+    int num_requests = server.get_num_requests();
+    server.set_latency(0.3);
+    BinaryDataPtr values[NumReaders];
+    boost::thread_group readers;
+    for (int i = 0; i < NumReaders; ++i) {
+        readers.create_thread(ReadKey(service, values[i]));
+    }
+    readers.join_all();
+    server.set_latency(0);
+
+    for (int i = 0; i < NumReaders; ++i) {
+        if (!values[i] || (values[i]->get_data() != data)) {
+            throw ErrMsg("Merged read returned the wrong value");
+        }
+    }
+    if ((coalescer->get_num_fetches() - num_fetches != 1) ||
+            (coalescer->get_num_shared() - num_shared !=
+             uint64(NumReaders - 1)) ||
+            (server.get_num_requests() - num_requests != 1)) {
+        throw ErrMsg("Identical reads were not merged");
+    }
+    if (values[0] != values[NumReaders - 1]) {
+        throw ErrMsg("Merged reads did not share the result");
+    }
+
+    // the caller that ran the fetch sees the original exception and
+    // the caller that joined it an ErrMsg
+    RequestCoalescer failing;
+    bool leader_int = false, leader_errmsg = false;
+    boost::thread leader(RunFailingFetch(failing, leader_int,
+                leader_errmsg));
+    for (int i = 0; (i < 500) && (failing.get_num_fetches() == 0); ++i) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    bool waiter_int = false, waiter_errmsg = false;
+    RunFailingFetch(failing, waiter_int, waiter_errmsg)();
+    leader.join();
+    if (!leader_int || !waiter_errmsg) {
+        throw ErrMsg("Unknown exception was not passed to every caller");
+    }
+    failing.run("key", fetch_empty);
+    if (failing.get_num_fetches() != 2) {
+        throw ErrMsg("Failed key was not cleared");
+    }
+}
+
+/*!
+ * Check that reads delayed by stragglers are answered by the hedge,
+ * that the losing request is cancelled, and that a hedged read from
+ * an engine callback completes.
+*/
+void test_hedging(DVIDMockServer& server)
+{
+    DVIDConnection connection(server.get_url());
+    RequestHedgerPtr hedger = connection.get_pool()->get_hedger();
+    hedger->set_min_samples(5);
+    hedger->set_percentile(0.5);
+    hedger->set_delay_bounds(0.01, 0.05);
+    hedger->set_budget(1.0);
+
+    // learn the latency of normal responses
+    for (int i = 0; i < 10; ++i) {
+        read_info(connection);
+    }
+
+    connection.set_hedging(true);
+    server.set_straggler_rate(0.2, StragglerDelay, 7);
+    int num_slow = 0;
+    for (int i = 0; i < NumHedged; ++i) {
+        double start = now_seconds();
+        if (read_info(connection) != 200) {
+            throw ErrMsg("Hedged read failed");
+        }
+        if ((now_seconds() - start) >= StragglerDelay) {
+            ++num_slow;
+        }
+
+        // a straggling loser is cancelled rather than awaited
+        if (!wait_for_engine(StragglerDelay / 4)) {
+            throw ErrMsg("Losing request was not cancelled");
+        }
+    }
+    cout << "hedges: " << hedger->get_num_hedges() << " wins: " <<
+        hedger->get_num_hedge_wins() << " slow reads: " << num_slow << endl;
+    if ((hedger->get_num_hedge_wins() == 0) ||
+            (num_slow >= int(hedger->get_num_hedge_wins()))) {
+        throw ErrMsg("Hedges did not hide the stragglers");
+    }
+
+    // a hedged read from a callback must not wait on the engine
+    server.set_straggler_rate(0, 0);
+    boost::mutex mutex;
+    int status = 0;
+    connection.make_request_async("/server/info", GET, BinaryDataPtr(),
+            ReadInCallback(connection, mutex, status));
+    for (int i = 0; i < 500; ++i) {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (status != 0) {
+                break;
+            }
+        }
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    boost::mutex::scoped_lock lock(mutex);
+    if (status != 200) {
+        throw ErrMsg("Read from an engine callback did not complete");
+    }
+}
+
+/*!
+ * Counts the completed asynchronous requests.
+*/
+struct CountDone {
+    CountDone(boost::mutex& mutex_, int& num_done_) :
+        mutex(mutex_), num_done(num_done_) {}
+    void operator()(DVIDResponse&)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        ++num_done;
+    }
+    boost::mutex& mutex;
+    int& num_done;
+};
+
+/*!
+ * Check that the request rate limit spaces out synchronous and
+ * asynchronous requests and that the adaptive concurrency limit grows
+ * with successful requests and halves (once) when the server is busy.
+*/
+void test_flow_control(DVIDMockServer& server)
+{
+    DVIDConnection connection(server.get_url());
+    FlowControllerPtr flow = connection.get_pool()->get_flow_controller();
+
+    // 20 requests per second without a burst: 10 requests take 0.45 s
+    flow->set_request_rate(20, 1);
+    double start = now_seconds();
+    for (int i = 0; i < 10; ++i) {
+        read_info(connection);
+    }
+    double sync_seconds = now_seconds() - start;
+
+    boost::mutex mutex;
+    int num_done = 0;
+    start = now_seconds();
+    for (int i = 0; i < 10; ++i) {
+        connection.make_request_async("/server/info", GET, BinaryDataPtr(),
+                CountDone(mutex, num_done));
+    }
+    for (int i = 0; i < 500; ++i) {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (num_done == 10) {
+                break;
+            }
+        }
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+    double async_seconds = now_seconds() - start;
+    flow->set_request_rate(0);
+    cout << "rate limited: " << sync_seconds << " s sync, " <<
+        async_seconds << " s async" << endl;
+    if ((sync_seconds < 0.4) || (async_seconds < 0.4) ||
+            (async_seconds > 2.5)) {
+        throw ErrMsg("Request rate was not enforced");
+    }
+
+    // slow start adds one per completed request (the high latency
+    // tolerance keeps the mock latency from counting as congestion)
+    flow->enable_adaptive(1, 16, 100.0);
+    for (int i = 0; i < 20; ++i) {
+        read_info(connection);
+    }
+    if (flow->get_concurrency_limit() != 16) {
+        throw ErrMsg("Concurrency limit did not grow to the maximum");
+    }
+
+    // busy responses halve the limit at most once per round trip
+    uint64 num_decreases = flow->get_num_decreases();
+    server.inject_busy(2);
+    if ((read_info(connection) != 503) || (read_info(connection) != 503)) {
+        throw ErrMsg("Mock server did not respond busy");
+    }
+    if ((flow->get_concurrency_limit() != 8) ||
+            (flow->get_num_decreases() - num_decreases != 1)) {
+        throw ErrMsg("Concurrency limit did not back off once on 503");
+    }
+
+    // afterwards the limit grows by about one per limit of requests
+    for (int i = 0; i < 20; ++i) {
+        read_info(connection);
+    }
+    int limit = flow->get_concurrency_limit();
+    flow->disable_adaptive();
+    if ((limit < 9) || (limit > 11)) {
+        throw ErrMsg("Concurrency limit did not grow additively");
+    }
+}
+
+/*!
+ * Test the request layer against an in-process mock server.
+*/
+int main(int argc, char** argv)
+{
+    try {
+        DVIDMockServer server;
+        server.start();
+        test_coalescing(server);
+        test_hedging(server);
+        test_flow_control(server);
+        server.stop();
+    } catch (std::exception& e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}